@@ -482,6 +482,7 @@ enum nrquality {QUALITY_STANDARD, QUALITY_HIGH};
 
 void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagefloat * dst, Imagefloat * calclum, float * ch_M, float *max_r, float *max_b, bool isRAW, const procparams::DirPyrDenoiseParams & dnparams, const double expcomp, const NoiseCurve & noiseLCurve, const NoiseCurve & noiseCCurve, float &nresi, float &highresi)
 {
+    TRACEFUN
 BENCHFUN
     MyTime t1e, t2e;
     t1e.set();
@@ -23,6 +23,7 @@
 #include <iostream>
 #include <string>
 #include "mytime.h"
+#include "proctrace.h"
 
 #ifdef BENCHMARK
     #define BENCHFUN StopWatch StopFun(__func__);
@@ -32,6 +33,9 @@
     #define BENCHFUNMICRO
 #endif
 
+// always compiled, records only while rtengine::ProcTrace is enabled
+#define TRACEFUN rtengine::ProcTrace::Scope TraceFun(__func__);
+
 class StopWatch
 {
 public:
@@ -18,264 +18,358 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <memory>
+#include <algorithm>
 #include <cmath>
 
 #include "boxblur.h"
 
+#include "alignedbuffer.h"
 #include "rt_math.h"
 #include "opthelper.h"
 
 namespace rtengine
 {
 
-void boxblur(float** src, float** dst, int radius, int W, int H, bool multiThread)
+namespace
 {
-    //box blur using rowbuffers and linebuffers instead of a full size buffer
 
-    radius = rtengine::min(radius, W - 1, H - 1);
-    if (radius == 0) {
-        if (src != dst) {
-#ifdef _OPENMP
-            #pragma omp parallel for if (multiThread)
-#endif
+// columns per strip of the vertical pass, the inner loops run over them. Each thread
+// keeps radius + 1 rows of a strip per plane in its ring buffer.
+constexpr int boxLanes = 256;
 
-            for (int row = 0; row < H; ++row) {
-                for (int col = 0; col < W; ++col) {
-                    dst[row][col] = src[row][col];
-                }
-            }
+// Means along a row over windows of 2 * radius + 1 pixels clipped at the borders.
+// 'line' holds the row padded with radius + 1 zeros on both sides, norm[x] is the
+// reciprocal of the number of pixels in the window of x. The differences of the
+// running sum are vectorized, the sum itself runs on four segments of the row,
+// which are independent and hide the latency of the additions.
+void boxRowMeans(const float* line, float* dst, const float* norm, float* diff, int W, int radius)
+{
+    const int span = 2 * radius + 1;
+
+    for (int x = 0; x < W; ++x) {
+        diff[x] = line[x + span + 1] - line[x + 1];
+    }
+
+    const int length = W >= 8 * span ? (W + 3) / 4 : W;
+    float sum[4] = {};
+
+    for (int k = 0; k < 4 && k * length < W; ++k) {
+        // pixels k * length - radius .. k * length + radius
+        for (int j = 1; j <= span; ++j) {
+            sum[k] += line[k * length + j];
         }
+    }
+
+    if (length == W) {
+        for (int x = 0; x < W; ++x) {
+            dst[x] = sum[0] * norm[x];
+            sum[0] += diff[x];
+        }
+
         return;
     }
 
-    constexpr int numCols = 8; // process numCols columns at once for better usage of L1 cpu cache
-#ifdef _OPENMP
-    #pragma omp parallel if (multiThread)
-#endif
-    {
-        std::unique_ptr<float[]> buffer(new float[numCols * (radius + 1)]);
+    float s0 = sum[0], s1 = sum[1], s2 = sum[2], s3 = sum[3];
+    const int l1 = length;
+    const int l2 = 2 * length;
+    const int l3 = 3 * length;
+    const int lastLength = W - l3;
+    int i = 0;
+
+    for (; i < lastLength; ++i) {
+        dst[i] = s0 * norm[i];
+        s0 += diff[i];
+        dst[l1 + i] = s1 * norm[l1 + i];
+        s1 += diff[l1 + i];
+        dst[l2 + i] = s2 * norm[l2 + i];
+        s2 += diff[l2 + i];
+        dst[l3 + i] = s3 * norm[l3 + i];
+        s3 += diff[l3 + i];
+    }
+
+    for (; i < length; ++i) {
+        dst[i] = s0 * norm[i];
+        s0 += diff[i];
+        dst[l1 + i] = s1 * norm[l1 + i];
+        s1 += diff[l1 + i];
+        dst[l2 + i] = s2 * norm[l2 + i];
+        s2 += diff[l2 + i];
+    }
+}
+
+// Horizontal pass of 'channels' planes, to be called from inside a parallel region.
+// load(row, lines) writes pixel x of channel c of row 'row' to lines[c][x],
+// the means are written to dst[c][row], which may be a source plane.
+template<typename Load>
+void boxHorizontal(float** const* dst, int channels, int radius, int W, int H, const Load& load)
+{
+    const int stride = W + 2 * radius + 2;
+    AlignedBuffer<float> buffer(static_cast<std::size_t>(channels) * stride + 2 * W, 64);
+    float* const norm = buffer.data + static_cast<std::size_t>(channels) * stride;
+    float* const diff = norm + W;
+    std::vector<float*> lines(channels);
+
+    for (int c = 0; c < channels; ++c) {
+        float* const line = buffer.data + static_cast<std::size_t>(c) * stride;
+        std::fill(line, line + radius + 1, 0.f);
+        std::fill(line + radius + 1 + W, line + stride, 0.f);
+        lines[c] = line + radius + 1;
+    }
+
+    for (int x = 0; x < W; ++x) {
+        norm[x] = 1.f / (min(x + radius, W - 1) - max(x - radius, 0) + 1);
+    }
 
-        //horizontal blur
-        float* const lineBuffer = buffer.get();
 #ifdef _OPENMP
-        #pragma omp for
+    #pragma omp for
 #endif
-        for (int row = 0; row < H; ++row) {
-            float len = radius + 1;
-            float tempval = src[row][0];
-            lineBuffer[0] = tempval;
-            for (int j = 1; j <= radius; j++) {
-                tempval += src[row][j];
-            }
 
-            tempval /= len;
-            dst[row][0] = tempval;
+    for (int row = 0; row < H; ++row) {
+        load(row, lines.data());
 
-            for (int col = 1; col <= radius; ++col) {
-                lineBuffer[col] = src[row][col];
-                tempval = (tempval * len + src[row][col + radius]) / (len + 1);
-                dst[row][col] = tempval;
-                ++len;
-            }
-            int pos = 0;
-            for (int col = radius + 1; col < W - radius; ++col) {
-                const float oldVal = lineBuffer[pos];
-                lineBuffer[pos] = src[row][col];
-                tempval = tempval + (src[row][col + radius] - oldVal) / len;
-                dst[row][col] = tempval;
-                ++pos;
-                pos = pos <= radius ? pos : 0;
-            }
+        for (int c = 0; c < channels; ++c) {
+            boxRowMeans(lines[c] - radius - 1, dst[c][row], norm, diff, W, radius);
+        }
+    }
+}
 
-            for (int col = W - radius; col < W; ++col) {
-                tempval = (tempval * len - lineBuffer[pos]) / (len - 1);
-                dst[row][col] = tempval;
-                --len;
-                ++pos;
-                pos = pos <= radius ? pos : 0;
-            }
+SIMD_CLONES void boxColumnMeans(const float* src, const float* sum, float* ring, float* means, float norm, int cols)
+{
+    for (int k = 0; k < cols; ++k) {
+        ring[k] = src[k];
+        means[k] = sum[k] * norm;
+    }
+}
+
+// sum += add - sub, either of add and sub may be null
+SIMD_CLONES void boxColumnUpdate(float* sum, const float* add, const float* sub, int cols)
+{
+    if (add && sub) {
+        for (int k = 0; k < cols; ++k) {
+            sum[k] += add[k] - sub[k];
         }
+    } else if (add) {
+        for (int k = 0; k < cols; ++k) {
+            sum[k] += add[k];
+        }
+    } else if (sub) {
+        for (int k = 0; k < cols; ++k) {
+            sum[k] -= sub[k];
+        }
+    }
+}
 
-        //vertical blur
-#ifdef __SSE2__
-        vfloat (* const rowBuffer)[2] = (vfloat(*)[2]) buffer.get();
-        const vfloat leninitv = F2V(radius + 1);
-        const vfloat onev = F2V(1.f);
-        vfloat tempv, temp1v, lenv, lenp1v, lenm1v, rlenv;
+// Vertical pass of 'channels' planes on strips of boxLanes columns, to be called from
+// inside a parallel region. store(row, col, cols, means) gets the means of the
+// columns [col, col + cols) of row 'row' and may overwrite them in the source planes,
+// the source rows are kept in a ring buffer until they leave the window.
+template<typename Store>
+void boxVertical(float** const* src, int channels, int radius, int W, int H, const Store& store)
+{
+    const std::size_t ringSize = static_cast<std::size_t>(radius + 1) * boxLanes;
+    AlignedBuffer<float> buffer(channels * (ringSize + 2 * boxLanes), 64);
+    std::vector<float*> sums(channels);
+    std::vector<float*> means(channels);
+
+    for (int c = 0; c < channels; ++c) {
+        sums[c] = buffer.data + c * (ringSize + 2 * boxLanes) + ringSize;
+        means[c] = sums[c] + boxLanes;
+    }
 
 #ifdef _OPENMP
-        #pragma omp for nowait
+    #pragma omp for
 #endif
 
-        for (int col = 0; col < W - 7; col += 8) {
-            lenv = leninitv;
-            tempv = LVFU(dst[0][col]);
-            temp1v = LVFU(dst[0][col + 4]);
-            rowBuffer[0][0] = tempv;
-            rowBuffer[0][1] = temp1v;
+    for (int col = 0; col < W; col += boxLanes) {
+        const int cols = min(boxLanes, W - col);
 
-            for (int i = 1; i <= radius; ++i) {
-                tempv = tempv + LVFU(dst[i][col]);
-                temp1v = temp1v + LVFU(dst[i][col + 4]);
-            }
+        for (int c = 0; c < channels; ++c) {
+            std::fill(sums[c], sums[c] + cols, 0.f);
 
-            tempv = tempv / lenv;
-            temp1v = temp1v / lenv;
-            STVFU(dst[0][col], tempv);
-            STVFU(dst[0][col + 4], temp1v);
-
-            for (int row = 1; row <= radius; ++row) {
-                rowBuffer[row][0] = LVFU(dst[row][col]);
-                rowBuffer[row][1] = LVFU(dst[row][col + 4]);
-                lenp1v = lenv + onev;
-                tempv = (tempv * lenv + LVFU(dst[row + radius][col])) / lenp1v;
-                temp1v = (temp1v * lenv + LVFU(dst[row + radius][col + 4])) / lenp1v;
-                STVFU(dst[row][col], tempv);
-                STVFU(dst[row][col + 4], temp1v);
-                lenv = lenp1v;
+            for (int row = 0; row <= min(radius, H - 1); ++row) {
+                boxColumnUpdate(sums[c], src[c][row] + col, nullptr, cols);
             }
+        }
+
+        for (int row = 0; row < H; ++row) {
+            const float norm = 1.f / (min(row + radius, H - 1) - max(row - radius, 0) + 1);
 
-            rlenv = onev / lenv;
-            int pos = 0;
-            for (int row = radius + 1; row < H - radius; ++row) {
-                vfloat oldVal0 = rowBuffer[pos][0];
-                vfloat oldVal1 = rowBuffer[pos][1];
-                rowBuffer[pos][0] = LVFU(dst[row][col]);
-                rowBuffer[pos][1] = LVFU(dst[row][col + 4]);
-                tempv = tempv + (LVFU(dst[row + radius][col]) - oldVal0) * rlenv ;
-                temp1v = temp1v + (LVFU(dst[row + radius][col + 4]) - oldVal1) * rlenv ;
-                STVFU(dst[row][col], tempv);
-                STVFU(dst[row][col + 4], temp1v);
-                ++pos;
-                pos = pos <= radius ? pos : 0;
+            for (int c = 0; c < channels; ++c) {
+                float* const ring = buffer.data + c * (ringSize + 2 * boxLanes);
+                boxColumnMeans(src[c][row] + col, sums[c], ring + (row % (radius + 1)) * boxLanes, means[c], norm, cols);
             }
 
-            for (int row = H - radius; row < H; ++row) {
-                lenm1v = lenv - onev;
-                tempv = (tempv * lenv - rowBuffer[pos][0]) / lenm1v;
-                temp1v = (temp1v * lenv - rowBuffer[pos][1]) / lenm1v;
-                STVFU(dst[row][col], tempv);
-                STVFU(dst[row][col + 4], temp1v);
-                lenv = lenm1v;
-                ++pos;
-                pos = pos <= radius ? pos : 0;
+            store(row, col, cols, means.data());
+
+            for (int c = 0; c < channels; ++c) {
+                const float* const ring = buffer.data + c * (ringSize + 2 * boxLanes);
+                const float* const add = row + radius + 1 < H ? src[c][row + radius + 1] + col : nullptr;
+                const float* const sub = row >= radius ? ring + ((row - radius) % (radius + 1)) * boxLanes : nullptr;
+                boxColumnUpdate(sums[c], add, sub, cols);
             }
         }
+    }
+}
+
+// Box means of 'channels' planes from sums of the columns, which slide down along strips
+// of rows, to be called from inside a parallel region. load(row, scratch, lines) points
+// lines[c] to channel c of row 'row', either in the source or in scratch[c] (W floats).
+// store(row, means) gets the means of row 'row'. The source rows are loaded again when
+// they leave the window, the results can't be written to the sources.
+template<typename Load, typename Store>
+void boxSliding(int channels, int radiusH, int radiusV, int W, int H, const Load& load, const Store& store)
+{
+    const std::size_t stride = W + 2 * radiusH + 2;
+    AlignedBuffer<float> buffer(channels * (stride + 3 * static_cast<std::size_t>(W)) + 3 * W, 64);
+    std::vector<float*> sums(channels);
+    std::vector<float*> scratchAdd(channels);
+    std::vector<float*> scratchSub(channels);
+    std::vector<float*> means(channels);
+    std::vector<const float*> add(channels);
+    std::vector<const float*> sub(channels);
+
+    for (int c = 0; c < channels; ++c) {
+        float* const channelBuffer = buffer.data + c * (stride + 3 * W);
+        std::fill(channelBuffer, channelBuffer + stride, 0.f);
+        sums[c] = channelBuffer + radiusH + 1;
+        scratchAdd[c] = channelBuffer + stride;
+        scratchSub[c] = scratchAdd[c] + W;
+        means[c] = scratchSub[c] + W;
+    }
+
+    float* const normH = buffer.data + channels * (stride + 3 * W);
+    float* const norm = normH + W;
+    float* const diff = norm + W;
+
+    for (int x = 0; x < W; ++x) {
+        normH[x] = 1.f / (min(x + radiusH, W - 1) - max(x - radiusH, 0) + 1);
+    }
+
+    int next = -1;
 
-#else
-        float (* const rowBuffer)[8] = (float(*)[8]) buffer.get();
 #ifdef _OPENMP
-        #pragma omp for nowait
+    #pragma omp for schedule(static)
 #endif
 
-        for (int col = 0; col < W - numCols + 1; col += 8) {
-            float len = radius + 1;
-
-            for (int k = 0; k < numCols; ++k) {
-                rowBuffer[0][k] = dst[0][col + k];
+    for (int row = 0; row < H; ++row) {
+        if (row != next) {
+            // first row of the strip of this thread
+            for (int c = 0; c < channels; ++c) {
+                std::fill(sums[c], sums[c] + W, 0.f);
             }
 
-            for (int i = 1; i <= radius; ++i) {
-                for (int k = 0; k < numCols; ++k) {
-                    dst[0][col + k] += dst[i][col + k];
+            for (int i = max(row - radiusV, 0); i <= min(row + radiusV, H - 1); ++i) {
+                load(i, scratchAdd.data(), add.data());
+
+                for (int c = 0; c < channels; ++c) {
+                    boxColumnUpdate(sums[c], add[c], nullptr, W);
                 }
             }
+        }
 
-            for(int k = 0; k < numCols; ++k) {
-                dst[0][col + k] /= len;
-            }
+        const float normV = 1.f / (min(row + radiusV, H - 1) - max(row - radiusV, 0) + 1);
 
-            for (int row = 1; row <= radius; ++row) {
-                for(int k = 0; k < numCols; ++k) {
-                    rowBuffer[row][k] = dst[row][col + k];
-                    dst[row][col + k] = (dst[row - 1][col + k] * len + dst[row + radius][col + k]) / (len + 1);
-                }
+        for (int x = 0; x < W; ++x) {
+            norm[x] = normH[x] * normV;
+        }
 
-                len ++;
-            }
+        for (int c = 0; c < channels; ++c) {
+            boxRowMeans(sums[c] - radiusH - 1, means[c], norm, diff, W, radiusH);
+        }
 
-            int pos = 0;
-            for (int row = radius + 1; row < H - radius; ++row) {
-                for(int k = 0; k < numCols; ++k) {
-                    float oldVal = rowBuffer[pos][k];
-                    rowBuffer[pos][k] = dst[row][col + k];
-                    dst[row][col + k] = dst[row - 1][col + k] + (dst[row + radius][col + k] - oldVal) / len;
-                }
-                ++pos;
-                pos = pos <= radius ? pos : 0;
-            }
+        store(row, means.data());
 
-            for (int row = H - radius; row < H; ++row) {
-                for(int k = 0; k < numCols; ++k) {
-                    dst[row][col + k] = (dst[row - 1][col + k] * len - rowBuffer[pos][k]) / (len - 1);
-                }
-                len --;
-                ++pos;
-                pos = pos <= radius ? pos : 0;
-            }
+        const bool adding = row + radiusV + 1 < H;
+        const bool subtracting = row >= radiusV;
+
+        if (adding) {
+            load(row + radiusV + 1, scratchAdd.data(), add.data());
         }
 
-#endif
-        //vertical blur, remaining columns
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            const int remaining = W % numCols;
+        if (subtracting) {
+            load(row - radiusV, scratchSub.data(), sub.data());
+        }
 
-            if (remaining > 0) {
-                float (* const rowBuffer)[8] = (float(*)[8]) buffer.get();
-                const int col = W - remaining;
+        for (int c = 0; c < channels; ++c) {
+            boxColumnUpdate(sums[c], adding ? add[c] : nullptr, subtracting ? sub[c] : nullptr, W);
+        }
 
-                float len = radius + 1;
-                for(int k = 0; k < remaining; ++k) {
-                    rowBuffer[0][k] = dst[0][col + k];
-                }
-                for (int row = 1; row <= radius; ++row) {
-                    for(int k = 0; k < remaining; ++k) {
-                        dst[0][col + k] += dst[row][col + k];
-                    }
-                }
-                for(int k = 0; k < remaining; ++k) {
-                    dst[0][col + k] /= len;
-                }
-                for (int row = 1; row <= radius; ++row) {
-                    for(int k = 0; k < remaining; ++k) {
-                        rowBuffer[row][k] = dst[row][col + k];
-                        dst[row][col + k] = (dst[row - 1][col + k] * len + dst[row + radius][col + k]) / (len + 1);
-                    }
-                    len ++;
-                }
-                const float rlen = 1.f / len;
-                int pos = 0;
-                for (int row = radius + 1; row < H - radius; ++row) {
-                    for(int k = 0; k < remaining; ++k) {
-                        float oldVal = rowBuffer[pos][k];
-                        rowBuffer[pos][k] = dst[row][col + k];
-                        dst[row][col + k] = dst[row - 1][col + k] + (dst[row + radius][col + k] - oldVal) * rlen;
-                    }
-                    ++pos;
-                    pos = pos <= radius ? pos : 0;
+        next = row + 1;
+    }
+}
+
+SIMD_CLONES void guidedStatistics(const float* I, const float* p, float* corrI, float* corrIp, bool guideStatistics, int W)
+{
+    if (guideStatistics) {
+        for (int x = 0; x < W; ++x) {
+            corrI[x] = I[x] * I[x];
+        }
+    }
+
+    for (int x = 0; x < W; ++x) {
+        corrIp[x] = I[x] * p[x];
+    }
+}
+
+SIMD_CLONES void guidedCoefficients(const float* meanI, const float* corrI, const float* meanp, const float* corrIp, float* a, float* b, float epsilon, int W)
+{
+    for (int x = 0; x < W; ++x) {
+        const float varI = corrI[x] - meanI[x] * meanI[x];
+        const float covIp = corrIp[x] - meanI[x] * meanp[x];
+        const float ax = covIp / (varI + epsilon);
+        a[x] = ax;
+        b[x] = meanp[x] - ax * meanI[x];
+    }
+}
+
+SIMD_CLONES void guidedOutput(const float* meana, const float* meanb, const float* I, float* q, int W)
+{
+    for (int x = 0; x < W; ++x) {
+        q[x] = meana[x] * I[x] + meanb[x];
+    }
+}
+
+}
+
+void boxblur(const std::vector<float**>& planes, int radius, int W, int H, bool multiThread)
+{
+    const int channels = planes.size();
+
+    if (radius <= 0 || channels == 0) {
+        return;
+    }
+
+    // windows larger than the image are clipped to it anyway
+    const int radiusH = min(radius, W - 1);
+    const int radiusV = min(radius, H - 1);
+
+#ifdef _OPENMP
+    #pragma omp parallel if (multiThread)
+#endif
+    {
+        boxHorizontal(planes.data(), channels, radiusH, W, H,
+            [&](int row, float* const* lines) {
+                for (int c = 0; c < channels; ++c) {
+                    std::copy(planes[c][row], planes[c][row] + W, lines[c]);
                 }
-                for (int row = H - radius; row < H; ++row) {
-                    for(int k = 0; k < remaining; ++k) {
-                        dst[row][col + k] = (dst[(row - 1)][col + k] * len - rowBuffer[pos][k]) / (len - 1);
-                    }
-                    len --;
-                    ++pos;
-                    pos = pos <= radius ? pos : 0;
+            });
+
+        boxVertical(planes.data(), channels, radiusV, W, H,
+            [&](int row, int col, int cols, const float* const* means) {
+                for (int c = 0; c < channels; ++c) {
+                    std::copy(means[c], means[c] + cols, planes[c][row] + col);
                 }
-            }
-        }
+            });
     }
 }
 
-void boxabsblur(float** src, float** dst, int radius, int W, int H, bool multiThread)
+void boxblur(float** src, float** dst, int radius, int W, int H, bool multiThread)
 {
-    //abs box blur using rowbuffers and linebuffers instead of a full size buffer, W should be a multiple of 16
+    //box blur using rowbuffers and linebuffers instead of a full size buffer, in place if src == dst
+
+    radius = rtengine::min(radius, W - 1, H - 1);
 
-    if (radius == 0) {
+    if (radius <= 0) {
         if (src != dst) {
 #ifdef _OPENMP
             #pragma omp parallel for if (multiThread)
@@ -283,117 +377,170 @@ void boxabsblur(float** src, float** dst, int radius, int W, int H, bool multiTh
 
             for (int row = 0; row < H; ++row) {
                 for (int col = 0; col < W; ++col) {
-                    dst[row][col] = std::fabs(src[row][col]);
+                    dst[row][col] = src[row][col];
                 }
             }
         }
+
+        return;
+    }
+
+    if (src != dst) {
+        // one pass, without intermediate results in dst
+#ifdef _OPENMP
+        #pragma omp parallel if (multiThread)
+#endif
+        boxSliding(1, radius, radius, W, H,
+            [&](int row, float* const*, const float** lines) {
+                lines[0] = src[row];
+            },
+            [&](int row, const float* const* means) {
+                std::copy(means[0], means[0] + W, dst[row]);
+            });
+
         return;
     }
 
-    constexpr int numCols = 16; // process numCols columns at once for better usage of L1 cpu cache
 #ifdef _OPENMP
     #pragma omp parallel if (multiThread)
 #endif
     {
-        float buffer[numCols * (radius + 1)] ALIGNED64;
+        boxHorizontal(&dst, 1, radius, W, H,
+            [&](int row, float* const* lines) {
+                std::copy(src[row], src[row] + W, lines[0]);
+            });
+
+        boxVertical(&dst, 1, radius, W, H,
+            [&](int row, int col, int cols, const float* const* means) {
+                std::copy(means[0], means[0] + cols, dst[row] + col);
+            });
+    }
+}
+
+void boxabsblur(float** src, float** dst, int radius, int W, int H, bool multiThread)
+{
+    //abs box blur using rowbuffers and linebuffers instead of a full size buffer, in place if src == dst
 
-        //horizontal blur
-        float* const lineBuffer = buffer;
+    radius = rtengine::min(radius, W - 1, H - 1);
+
+    if (radius <= 0) {
 #ifdef _OPENMP
-        #pragma omp for
+        #pragma omp parallel for if (multiThread)
 #endif
+
         for (int row = 0; row < H; ++row) {
-            float len = radius + 1;
-            float tempval = std::fabs(src[row][0]);
-            lineBuffer[0] = tempval;
-            for (int j = 1; j <= radius; j++) {
-                tempval += std::fabs(src[row][j]);
+            for (int col = 0; col < W; ++col) {
+                dst[row][col] = std::fabs(src[row][col]);
             }
+        }
 
-            tempval /= len;
-            dst[row][0] = tempval;
+        return;
+    }
 
-            for (int col = 1; col <= radius; ++col) {
-                lineBuffer[col] = std::fabs(src[row][col]);
-                tempval = (tempval * len + std::fabs(src[row][col + radius])) / (len + 1);
-                dst[row][col] = tempval;
-                ++len;
-            }
+    if (src != dst) {
+        // one pass, without intermediate results in dst
+#ifdef _OPENMP
+        #pragma omp parallel if (multiThread)
+#endif
+        boxSliding(1, radius, radius, W, H,
+            [&](int row, float* const* scratch, const float** lines) {
+                for (int col = 0; col < W; ++col) {
+                    scratch[0][col] = std::fabs(src[row][col]);
+                }
 
-            const float rlen = 1.f / len;
-            int pos = 0;
-            for (int col = radius + 1; col < W - radius; ++col) {
-                const float oldVal = lineBuffer[pos];
-                lineBuffer[pos] = std::fabs(src[row][col]);
-                tempval = tempval + (std::fabs(src[row][col + radius]) - oldVal) * rlen;
-                dst[row][col] = tempval;
-                ++pos;
-                pos = pos <= radius ? pos : 0;
-            }
+                lines[0] = scratch[0];
+            },
+            [&](int row, const float* const* means) {
+                std::copy(means[0], means[0] + W, dst[row]);
+            });
 
-            for (int col = W - radius; col < W; ++col) {
-                tempval = (tempval * len - lineBuffer[pos]) / (len - 1);
-                dst[row][col] = tempval;
-                --len;
-                ++pos;
-                pos = pos <= radius ? pos : 0;
-            }
-        }
+        return;
+    }
 
-        //vertical blur
-        float (* const rowBuffer)[numCols] = (float(*)[numCols]) buffer;
 #ifdef _OPENMP
-        #pragma omp for
+    #pragma omp parallel if (multiThread)
 #endif
+    {
+        boxHorizontal(&dst, 1, radius, W, H,
+            [&](int row, float* const* lines) {
+                for (int col = 0; col < W; ++col) {
+                    lines[0][col] = std::fabs(src[row][col]);
+                }
+            });
 
-        for (int col = 0; col < W; col += numCols) {
-            float len = radius + 1;
+        boxVertical(&dst, 1, radius, W, H,
+            [&](int row, int col, int cols, const float* const* means) {
+                std::copy(means[0], means[0] + cols, dst[row] + col);
+            });
+    }
+}
 
-            for (int k = 0; k < numCols; ++k) {
-                rowBuffer[0][k] = dst[0][col + k];
-            }
+void boxGuidedCoefficients(const float* const* guide, const std::vector<const float* const*>& src, const std::vector<float**>& a, const std::vector<float**>& b, int radius, float epsilon, int W, int H, bool multiThread)
+{
+    const int channels = src.size();
 
-            for (int i = 1; i <= radius; ++i) {
-                for (int k = 0; k < numCols; ++k) {
-                    dst[0][col + k] += dst[i][col + k];
-                }
-            }
+    // windows larger than the image are clipped to it anyway
+    const int radiusH = LIM(radius, 0, W - 1);
+    const int radiusV = LIM(radius, 0, H - 1);
 
-            for(int k = 0; k < numCols; ++k) {
-                dst[0][col + k] /= len;
+    // sums of I, I * I, then of p and I * p for each channel
+#ifdef _OPENMP
+    #pragma omp parallel if (multiThread)
+#endif
+    boxSliding(2 * channels + 2, radiusH, radiusV, W, H,
+        [&](int row, float* const* scratch, const float** lines) {
+            lines[0] = guide[row];
+            lines[1] = scratch[1];
+
+            for (int c = 0; c < channels; ++c) {
+                lines[2 * c + 2] = src[c][row];
+                lines[2 * c + 3] = scratch[2 * c + 3];
+                guidedStatistics(guide[row], src[c][row], scratch[1], scratch[2 * c + 3], c == 0, W);
             }
+        },
+        [&](int row, const float* const* means) {
+            for (int c = 0; c < channels; ++c) {
+                guidedCoefficients(means[0], means[1], means[2 * c + 2], means[2 * c + 3], a[c][row], b[c][row], epsilon, W);
+            }
+        });
+}
 
-            for (int row = 1; row <= radius; ++row) {
-                for(int k = 0; k < numCols; ++k) {
-                    rowBuffer[row][k] = dst[row][col + k];
-                    dst[row][col + k] = (dst[row - 1][col + k] * len + dst[row + radius][col + k]) / (len + 1);
-                }
+void boxGuidedOutput(const float* const* guide, const std::vector<const float* const*>& a, const std::vector<const float* const*>& b, const std::vector<float**>& dst, int radius, int W, int H, bool multiThread)
+{
+    const int channels = dst.size();
+    const int radiusH = LIM(radius, 0, W - 1);
+    const int radiusV = LIM(radius, 0, H - 1);
 
-                ++len;
-            }
+    // the guide may be one of the outputs, which has to be written last
+    std::vector<int> order;
 
-            const float rlen = 1.f / len;
-            int pos = 0;
-            for (int row = radius + 1; row < H - radius; ++row) {
-                for(int k = 0; k < numCols; ++k) {
-                    float oldVal = rowBuffer[pos][k];
-                    rowBuffer[pos][k] = dst[row][col + k];
-                    dst[row][col + k] = dst[row - 1][col + k] + (dst[row + radius][col + k] - oldVal) * rlen;
-                }
-                ++pos;
-                pos = pos <= radius ? pos : 0;
-            }
+    for (int c = 0; c < channels; ++c) {
+        if (dst[c][0] != guide[0]) {
+            order.push_back(c);
+        }
+    }
 
-            for (int row = H - radius; row < H; ++row) {
-                for(int k = 0; k < numCols; ++k) {
-                    dst[row][col + k] = (dst[row - 1][col + k] * len - rowBuffer[pos][k]) / (len - 1);
-                }
-                --len;
-                ++pos;
-                pos = pos <= radius ? pos : 0;
-            }
+    for (int c = 0; c < channels; ++c) {
+        if (dst[c][0] == guide[0]) {
+            order.push_back(c);
         }
     }
+
+#ifdef _OPENMP
+    #pragma omp parallel if (multiThread)
+#endif
+    boxSliding(2 * channels, radiusH, radiusV, W, H,
+        [&](int row, float* const*, const float** lines) {
+            for (int c = 0; c < channels; ++c) {
+                lines[2 * c] = a[c][row];
+                lines[2 * c + 1] = b[c][row];
+            }
+        },
+        [&](int row, const float* const* means) {
+            for (int c : order) {
+                guidedOutput(means[2 * c], means[2 * c + 1], guide[row], dst[c][row], W);
+            }
+        });
 }
 
 void boxblur(float* src, float* dst, int radius, int W, int H, bool multiThread)
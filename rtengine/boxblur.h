@@ -18,12 +18,29 @@
 */
 #pragma once
 
+#include <vector>
+
 namespace rtengine
 {
 
+// Box blurs are O(1) per pixel: running sums along the rows, then along strips of
+// columns. Windows are clipped at the image borders.
+
 void boxblur(float** src, float** dst, int radius, int W, int H, bool multiThread);
 void boxblur(float* src, float* dst, int radius, int W, int H, bool multiThread);
 void boxabsblur(float** src, float** dst, int radius, int W, int H, bool multiThread);
 void boxabsblur(float* src, float* dst, int radius, int W, int H, bool multiThread);
 
+// In place box blur of several planes of W x H pixels in the same passes
+void boxblur(const std::vector<float**>& planes, int radius, int W, int H, bool multiThread);
+
+// Coefficients of the guided filter of each plane p = src[c] with the guide I, from the
+// box means over the same pass: a = cov(I, p) / (var(I) + epsilon), b = mean(p) - a * mean(I).
+// a and b must not overlap the sources.
+void boxGuidedCoefficients(const float* const* guide, const std::vector<const float* const*>& src, const std::vector<float**>& a, const std::vector<float**>& b, int radius, float epsilon, int W, int H, bool multiThread);
+
+// Output of the guided filter from its coefficients, dst[c] = mean(a[c]) * I + mean(b[c]).
+// dst may be the guide, but not a or b.
+void boxGuidedOutput(const float* const* guide, const std::vector<const float* const*>& a, const std::vector<const float* const*>& b, const std::vector<float**>& dst, int radius, int W, int H, bool multiThread);
+
 }
@@ -23,8 +23,10 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <string>
 #include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #include "../rtgui/threadutils.h"
 
@@ -47,6 +49,20 @@ namespace cache_helper
     {
     };
 
+    // Shard selection: std::hash if available, else the hash of the raw
+    // string (keys like Glib::ustring)
+    template<typename T>
+    typename std::enable_if<has_hash<T>::value, std::size_t>::type shard_hash(const T& key)
+    {
+        return std::hash<T>()(key);
+    }
+
+    template<typename T>
+    typename std::enable_if<!has_hash<T>::value, std::size_t>::type shard_hash(const T& key)
+    {
+        return std::hash<std::string>()(key.raw());
+    }
+
 }
 
 template<class K, class V>
@@ -236,4 +252,221 @@ private:
     mutable LruList lru_list;
 };
 
+/*
+ * Drop-in variant of Cache for lookups from many threads at once.
+ *
+ * The keys are spread over shards, each with its own mutex, and the LRU list
+ * is replaced by the CLOCK approximation: get() only sets a reference bit
+ * instead of splicing a list, so the critical section is a single lookup.
+ * The capacity is split evenly between the shards, hence an entry may be
+ * discarded a bit earlier than with Cache when the keys are unevenly spread.
+ * To keep that rare every shard has room for at least min_shard_size entries:
+ * caches smaller than twice that use a single shard, like Cache.
+ */
+template<class K, class V>
+class ShardedCache
+{
+public:
+    using Hook = typename Cache<K, V>::Hook;
+
+    static constexpr unsigned long min_shard_size = 8;
+
+    explicit ShardedCache(unsigned long _size, Hook* _hook = nullptr, unsigned int _shards = 16) :
+        shards(std::max<unsigned long>(1, std::min<unsigned long>(_shards, _size / min_shard_size))),
+        hook(_hook)
+    {
+        resize(_size);
+    }
+
+    ~ShardedCache()
+    {
+        if (hook) {
+            resize(0);
+            hook->onDestroy();
+        }
+    }
+
+    bool get(const K& key, V& value) const
+    {
+        Shard& shard = getShard(key);
+        MyMutex::MyLock lock(shard.mutex);
+        const auto store_it = shard.store.find(key);
+        const bool present = store_it != shard.store.end();
+        if (present) {
+            store_it->second.referenced = true;
+            value = store_it->second.value;
+        }
+
+        return present;
+    }
+
+    bool set(const K& key, const V& value)
+    {
+        return set(key, value, Mode::UNCOND);
+    }
+
+    bool replace(const K& key, const V& value)
+    {
+        return set(key, value, Mode::KNOWN);
+    }
+
+    bool insert(const K& key, const V& value)
+    {
+        return set(key, value, Mode::UNKNOWN);
+    }
+
+    bool remove(const K& key)
+    {
+        Shard& shard = getShard(key);
+        MyMutex::MyLock lock(shard.mutex);
+        const auto store_it = shard.store.find(key);
+        const bool present = store_it != shard.store.end();
+        if (present) {
+            remove(shard, store_it);
+        }
+
+        return present;
+    }
+
+    void resize(unsigned long size)
+    {
+        // ceil, so that the total capacity is at least size
+        const unsigned long shard_size = (size + shards.size() - 1) / shards.size();
+
+        for (auto& shard : shards) {
+            MyMutex::MyLock lock(shard.mutex);
+            while (shard.clock.size() > shard_size) {
+                discard(shard);
+            }
+            shard.store_size = shard_size;
+        }
+    }
+
+    void clear()
+    {
+        for (auto& shard : shards) {
+            MyMutex::MyLock lock(shard.mutex);
+            if (hook) {
+                for (const auto& entry : shard.store) {
+                    hook->onRemove(entry.first, entry.second.value);
+                }
+            }
+            shard.clock.clear();
+            shard.hand = 0;
+            shard.store.clear();
+        }
+    }
+
+private:
+    struct Value {
+        V value;
+        std::size_t clock_pos;
+        bool referenced;
+    };
+
+    // Node based containers: pointers to the entries survive insertions
+    using Store = typename std::conditional<
+        cache_helper::has_hash<K>::value,
+        std::unordered_map<K, Value>,
+        std::map<K, Value>
+    >::type;
+    using StoreIterator = typename Store::iterator;
+    using Entry = typename Store::value_type;
+
+    struct Shard {
+        Shard() :
+            store_size(0),
+            hand(0)
+        {
+        }
+
+        mutable MyMutex mutex;
+        unsigned long store_size;
+        Store store;
+        std::vector<Entry*> clock;
+        std::size_t hand;
+    };
+
+    enum class Mode {
+        UNCOND,
+        KNOWN,
+        UNKNOWN
+    };
+
+    Shard& getShard(const K& key) const
+    {
+        return shards[cache_helper::shard_hash(key) % shards.size()];
+    }
+
+    void discard(Shard& shard)
+    {
+        // give every referenced entry a second chance
+        while (true) {
+            if (shard.hand >= shard.clock.size()) {
+                shard.hand = 0;
+            }
+            Entry* const entry = shard.clock[shard.hand];
+            if (!entry->second.referenced) {
+                break;
+            }
+            entry->second.referenced = false;
+            ++shard.hand;
+        }
+
+        const StoreIterator store_it = shard.store.find(shard.clock[shard.hand]->first);
+        if (hook) {
+            hook->onDiscard(store_it->first, store_it->second.value);
+        }
+        unlink(shard, store_it);
+    }
+
+    bool set(const K& key, const V& value, Mode mode)
+    {
+        Shard& shard = getShard(key);
+        MyMutex::MyLock lock(shard.mutex);
+        const StoreIterator store_it = shard.store.find(key);
+        const bool is_new_key = store_it == shard.store.end();
+        if (is_new_key) {
+            if ((mode == Mode::UNCOND || mode == Mode::UNKNOWN) && shard.store_size > 0) {
+                if (shard.clock.size() >= shard.store_size) {
+                    discard(shard);
+                }
+                Entry& entry = *shard.store.emplace(key, Value{value, shard.clock.size(), false}).first;
+                shard.clock.push_back(&entry);
+            }
+        } else {
+            if (mode == Mode::UNCOND || mode == Mode::KNOWN) {
+                if (hook) {
+                    hook->onDisplace(key, store_it->second.value);
+                }
+                store_it->second.value = value;
+                store_it->second.referenced = true;
+            }
+        }
+
+        return is_new_key;
+    }
+
+    void remove(Shard& shard, const StoreIterator& store_it)
+    {
+        if (hook) {
+            hook->onRemove(store_it->first, store_it->second.value);
+        }
+        unlink(shard, store_it);
+    }
+
+    void unlink(Shard& shard, const StoreIterator& store_it)
+    {
+        // move the last clock slot into the freed one
+        const std::size_t pos = store_it->second.clock_pos;
+        shard.clock[pos] = shard.clock.back();
+        shard.clock[pos]->second.clock_pos = pos;
+        shard.clock.pop_back();
+        shard.store.erase(store_it);
+    }
+
+    mutable std::vector<Shard> shards;
+    Hook* const hook;
+};
+
 }
@@ -66,6 +66,7 @@ it under the terms of the one of two licenses as you choose:
 
 #include "dcraw.h"
 
+#include "opthelper.h"
 #include "rt_math.h"
 
 void DCraw::parse_canon_cr3()
@@ -649,8 +650,8 @@ unsigned int sgetn(int n, unsigned char* s)
     return result;
 }
 
-// this should be divisible by 4
-constexpr std::uint64_t CRX_BUF_SIZE = 0x10000;
+// largest part of a bitstream viewed at once, this should be divisible by 4
+constexpr std::uint64_t CRX_BUF_SIZE = 0x40000000;
 
 #if !defined (_WIN32) || (defined (__GNUC__) && !defined (__INTRINSIC_SPECIAL__BitScanReverse))
 /* __INTRINSIC_SPECIAL__BitScanReverse found in MinGW32-W64 v7.30 headers, may be there is a better solution? */
@@ -668,27 +669,27 @@ std::uint32_t _byteswap_ulong(std::uint32_t x)
 }
 #endif
 
+// The whole file is in memory, so the bitstreams of all planes and tiles are
+// read from it directly, without copying or locking.
 struct LibRaw_abstract_datastream {
     rtengine::IMFILE* ifp;
 
-    void lock()
+    // Sets 'data' to the part of the file at 'offset' and returns its size,
+    // at most 'size' and 0 past the end of the file
+    std::uint64_t view(std::uint64_t offset, std::uint64_t size, const std::uint8_t*& data) const
     {
-    }
-    void unlock()
-    {
-    }
-    void seek(long p, int how)
-    {
-        fseek(ifp, p, how);
-    }
-    int read(void* dst, int es, int count)
-    {
-        return fread(dst, es, count, ifp);
+        if (offset >= static_cast<std::uint64_t>(ifp->size)) {
+            return 0;
+        }
+
+        ssize_t spanSize = std::min<std::uint64_t>(size, ifp->size);
+        data = rtengine::fspan(ifp, offset, spanSize);
+        return spanSize;
     }
 };
 
 struct CrxBitstream {
-    std::uint8_t mdatBuf[CRX_BUF_SIZE];
+    const std::uint8_t* mdatBuf;
     std::uint64_t mdatSize;
     std::uint64_t curBufOffset;
     std::uint32_t curPos;
@@ -835,25 +836,13 @@ inline void crxFillBuffer(CrxBitstream* bitStrm)
     if (bitStrm->curPos >= bitStrm->curBufSize && bitStrm->mdatSize) {
         bitStrm->curPos = 0;
         bitStrm->curBufOffset += bitStrm->curBufSize;
-#ifdef _OPENMP
-        #pragma omp critical
-#endif
-        {
-#ifndef _OPENMP
-            bitStrm->input->lock();
-#endif
-            bitStrm->input->seek(bitStrm->curBufOffset, SEEK_SET);
-            bitStrm->curBufSize = bitStrm->input->read(bitStrm->mdatBuf, 1, std::min(bitStrm->mdatSize, CRX_BUF_SIZE));
-#ifndef _OPENMP
-            bitStrm->input->unlock();
-#endif
+        bitStrm->curBufSize = bitStrm->input->view(bitStrm->curBufOffset, std::min(bitStrm->mdatSize, CRX_BUF_SIZE), bitStrm->mdatBuf);
 
-            if (bitStrm->curBufSize < 1) {  // nothing read
-                throw std::runtime_error("Unexpected end of file in CRX bitstream");
-            }
-
-            bitStrm->mdatSize -= bitStrm->curBufSize;
+        if (bitStrm->curBufSize < 1) {  // nothing read
+            throw std::runtime_error("Unexpected end of file in CRX bitstream");
         }
+
+        bitStrm->mdatSize -= bitStrm->curBufSize;
     }
 }
 
@@ -873,7 +862,7 @@ inline int crxBitstreamGetZeros(CrxBitstream* bitStrm)
 
         while (true) {
             while (bitStrm->curPos + 4 <= bitStrm->curBufSize) {
-                nextData = _byteswap_ulong(*reinterpret_cast<std::uint32_t*>(bitStrm->mdatBuf + bitStrm->curPos));
+                nextData = _byteswap_ulong(*reinterpret_cast<const std::uint32_t*>(bitStrm->mdatBuf + bitStrm->curPos));
                 bitStrm->curPos += 4;
                 crxFillBuffer(bitStrm);
 
@@ -922,7 +911,7 @@ inline std::uint32_t crxBitstreamGetBits(CrxBitstream* bitStrm, int bits)
     if (bitsLeft < bits) {
         // get them from stream
         if (bitStrm->curPos + 4 <= bitStrm->curBufSize) {
-            nextWord = _byteswap_ulong(*reinterpret_cast<std::uint32_t*>(bitStrm->mdatBuf + bitStrm->curPos));
+            nextWord = _byteswap_ulong(*reinterpret_cast<const std::uint32_t*>(bitStrm->mdatBuf + bitStrm->curPos));
             bitStrm->curPos += 4;
             crxFillBuffer(bitStrm);
             bitStrm->bitsLeft = 32 - (bits - bitsLeft);
@@ -1842,6 +1831,46 @@ bool crxDecodeLineWithIQuantization(CrxSubband* subband, CrxQStep *qStep)
     return true;
 }
 
+// Inner part of the horizontal inverse 5/3 lifting of a line of 'width'
+// samples. Each pair of output samples gets the even sample predicted from the
+// low band and its two high band neighbours, and the odd one updated from the
+// even samples around it. lineBuf[0] holds the first even sample on entry, the
+// pointers are advanced past the pairs for the right border handling.
+inline void crxHorizontal53Pairs(std::int32_t*& lineBuf, const std::int32_t*& band0Buf, const std::int32_t*& band1Buf, int width)
+{
+    const int pairs = std::max((width - 2) / 2, 0);
+    int i = 0;
+
+#ifdef __SSE2__
+    // the even samples only depend on the bands, so 4 pairs are done at once
+    const vint twov = _mm_set1_epi32(2);
+    vint prevDeltav = _mm_cvtsi32_si128(lineBuf[0]);
+
+    for (; i < pairs - 3; i += 4) {
+        const vint band0v = _mm_loadu_si128(reinterpret_cast<const vint*>(band0Buf + i));
+        const vint band1v = _mm_loadu_si128(reinterpret_cast<const vint*>(band1Buf + i));
+        const vint band1Nextv = _mm_loadu_si128(reinterpret_cast<const vint*>(band1Buf + i + 1));
+        const vint deltav = vsubi(band0v, vsrai(vaddi(vaddi(band1v, band1Nextv), twov), 2));
+        const vint leftDeltav = vori(_mm_slli_si128(deltav, 4), prevDeltav);
+        const vint oddv = vaddi(band1v, vsrai(vaddi(leftDeltav, deltav), 1));
+        _mm_storeu_si128(reinterpret_cast<vint*>(lineBuf + 2 * i + 1), _mm_unpacklo_epi32(oddv, deltav));
+        _mm_storeu_si128(reinterpret_cast<vint*>(lineBuf + 2 * i + 5), _mm_unpackhi_epi32(oddv, deltav));
+        prevDeltav = _mm_srli_si128(deltav, 12);
+    }
+
+#endif
+
+    for (; i < pairs; ++i) {
+        const std::int32_t delta = band0Buf[i] - ((band1Buf[i] + band1Buf[i + 1] + 2) >> 2);
+        lineBuf[2 * i + 1] = band1Buf[i] + ((lineBuf[2 * i] + delta) >> 1);
+        lineBuf[2 * i + 2] = delta;
+    }
+
+    lineBuf += 2 * pairs;
+    band0Buf += pairs;
+    band1Buf += pairs;
+}
+
 void crxHorizontal53(
     std::int32_t* lineBufLA,
     std::int32_t* lineBufLB,
@@ -1849,10 +1878,10 @@ void crxHorizontal53(
     std::uint32_t tileFlag
 )
 {
-    std::int32_t* band0Buf = wavelet->subband0Buf;
-    std::int32_t* band1Buf = wavelet->subband1Buf;
-    std::int32_t* band2Buf = wavelet->subband2Buf;
-    std::int32_t* band3Buf = wavelet->subband3Buf;
+    const std::int32_t* band0Buf = wavelet->subband0Buf;
+    const std::int32_t* band1Buf = wavelet->subband1Buf;
+    const std::int32_t* band2Buf = wavelet->subband2Buf;
+    const std::int32_t* band3Buf = wavelet->subband3Buf;
 
     if (wavelet->width <= 1) {
         lineBufLA[0] = band0Buf[0];
@@ -1871,22 +1900,8 @@ void crxHorizontal53(
         ++band0Buf;
         ++band2Buf;
 
-        for (int i = 0; i < wavelet->width - 3; i += 2) {
-            std::int32_t delta = band0Buf[0] - ((band1Buf[0] + band1Buf[1] + 2) >> 2);
-            lineBufLA[1] = band1Buf[0] + ((delta + lineBufLA[0]) >> 1);
-            lineBufLA[2] = delta;
-
-            delta = band2Buf[0] - ((band3Buf[0] + band3Buf[1] + 2) >> 2);
-            lineBufLB[1] = band3Buf[0] + ((delta + lineBufLB[0]) >> 1);
-            lineBufLB[2] = delta;
-
-            ++band0Buf;
-            ++band1Buf;
-            ++band2Buf;
-            ++band3Buf;
-            lineBufLA += 2;
-            lineBufLB += 2;
-        }
+        crxHorizontal53Pairs(lineBufLA, band0Buf, band1Buf, wavelet->width);
+        crxHorizontal53Pairs(lineBufLB, band2Buf, band3Buf, wavelet->width);
 
         if (tileFlag & E_HAS_TILES_ON_THE_RIGHT) {
             const std::int32_t deltaA = band0Buf[0] - ((band1Buf[0] + band1Buf[1] + 2) >> 2);
@@ -2010,14 +2025,7 @@ bool crxIdwt53FilterTransform(CrxPlaneComp* comp, std::uint32_t level)
 
                     ++band0Buf;
 
-                    for (int i = 0; i < wavelet->width - 3; i += 2) {
-                        const std::int32_t delta = band0Buf[0] - ((band1Buf[0] + band1Buf[1] + 2) >> 2);
-                        lineBufL0[1] = band1Buf[0] + ((lineBufL0[0] + delta) >> 1);
-                        lineBufL0[2] = delta;
-                        ++band0Buf;
-                        ++band1Buf;
-                        lineBufL0 += 2;
-                    }
+                    crxHorizontal53Pairs(lineBufL0, band0Buf, band1Buf, wavelet->width);
 
                     if (comp->tileFlag & E_HAS_TILES_ON_THE_RIGHT) {
                         const std::int32_t delta = band0Buf[0] - ((band1Buf[0] + band1Buf[1] + 2) >> 2);
@@ -2105,22 +2113,8 @@ bool crxIdwt53FilterTransform(CrxPlaneComp* comp, std::uint32_t level)
             ++band0Buf;
             ++band2Buf;
 
-            for (int i = 0; i < wavelet->width - 3; i += 2) {
-                std::int32_t delta = band0Buf[0] - ((band1Buf[0] + band1Buf[1] + 2) >> 2);
-                lineBufL0[1] = band1Buf[0] + ((delta + lineBufL0[0]) >> 1);
-                lineBufL0[2] = delta;
-
-                delta = band2Buf[0] - ((band3Buf[0] + band3Buf[1] + 2) >> 2);
-                lineBufL1[1] = band3Buf[0] + ((delta + lineBufL1[0]) >> 1);
-                lineBufL1[2] = delta;
-
-                ++band0Buf;
-                ++band1Buf;
-                ++band2Buf;
-                ++band3Buf;
-                lineBufL0 += 2;
-                lineBufL1 += 2;
-            }
+            crxHorizontal53Pairs(lineBufL0, band0Buf, band1Buf, wavelet->width);
+            crxHorizontal53Pairs(lineBufL1, band2Buf, band3Buf, wavelet->width);
 
             if (comp->tileFlag & E_HAS_TILES_ON_THE_RIGHT) {
                 const std::int32_t deltaA = band0Buf[0] - ((band1Buf[0] + band1Buf[1] + 2) >> 2);
@@ -2226,15 +2220,7 @@ bool crxIdwt53FilterInitialize(CrxPlaneComp* comp, std::int32_t prevLevel, CrxQS
 
                     ++band2Buf;
 
-                    for (int i = 0; i < wavelet->width - 3; i += 2) {
-                        const std::int32_t delta = band2Buf[0] - ((band3Buf[0] + band3Buf[1] + 2) >> 2);
-                        lineBufL2[1] = band3Buf[0] + ((lineBufL2[0] + delta) >> 1);
-                        lineBufL2[2] = delta;
-
-                        ++band2Buf;
-                        ++band3Buf;
-                        lineBufL2 += 2;
-                    }
+                    crxHorizontal53Pairs(lineBufL2, band2Buf, band3Buf, wavelet->width);
 
                     if (comp->tileFlag & E_HAS_TILES_ON_THE_RIGHT) {
                         const std::int32_t delta = band2Buf[0] - ((band3Buf[0] + band3Buf[1] + 2) >> 2);
@@ -2289,15 +2275,7 @@ bool crxIdwt53FilterInitialize(CrxPlaneComp* comp, std::int32_t prevLevel, CrxQS
 
                 ++band0Buf;
 
-                for (int i = 0; i < wavelet->width - 3; i += 2) {
-                    std::int32_t delta = band0Buf[0] - ((band1Buf[0] + band1Buf[1] + 2) >> 2);
-                    lineBufH0[1] = band1Buf[0] + ((lineBufH0[0] + delta) >> 1);
-                    lineBufH0[2] = delta;
-
-                    ++band0Buf;
-                    ++band1Buf;
-                    lineBufH0 += 2;
-                }
+                crxHorizontal53Pairs(lineBufH0, band0Buf, band1Buf, wavelet->width);
 
                 if (comp->tileFlag & E_HAS_TILES_ON_THE_RIGHT) {
                     const std::int32_t delta = band0Buf[0] - ((band1Buf[0] + band1Buf[1] + 2) >> 2);
@@ -2604,59 +2582,62 @@ bool crxSetupSubbandData(
 
 } // namespace
 
-bool DCraw::crxDecodePlane(void* p, std::uint32_t planeNumber)
+bool DCraw::crxDecodeTile(void* p, int tileNumber, std::uint32_t planeNumber)
 {
     CrxImage* const img = static_cast<CrxImage*>(p);
+    const int tRow = tileNumber / img->tileCols;
+    const int tCol = tileNumber % img->tileCols;
+    const CrxTile* const tile = img->tiles + tileNumber;
+    CrxPlaneComp* const planeComp = tile->comps + planeNumber;
+    const std::uint64_t tileMdatOffset = tile->dataOffset + tile->mdatQPDataSize + tile->mdatExtraSize + planeComp->dataOffset;
+
     int imageRow = 0;
 
-    for (int tRow = 0; tRow < img->tileRows; ++tRow) {
-        int imageCol = 0;
+    for (int i = 0; i < tRow; ++i) {
+        imageRow += img->tiles[i * img->tileCols].height;
+    }
 
-        for (int tCol = 0; tCol < img->tileCols; ++tCol) {
-            const CrxTile* const tile = img->tiles + tRow * img->tileRows + tCol;
-            CrxPlaneComp* const planeComp = tile->comps + planeNumber;
-            const std::uint64_t tileMdatOffset = tile->dataOffset + tile->mdatQPDataSize + tile->mdatExtraSize + planeComp->dataOffset;
+    int imageCol = 0;
 
-            // decode single tile
-            if (!crxSetupSubbandData(img, planeComp, tile, tileMdatOffset)) {
-                return false;
-            }
+    for (int i = 0; i < tCol; ++i) {
+        imageCol += img->tiles[tRow * img->tileCols + i].width;
+    }
 
-            if (img->levels) {
-                if (!crxIdwt53FilterInitialize(planeComp, img->levels, tile->qStep)) {
-                    return false;
-                }
+    // decode single tile
+    if (!crxSetupSubbandData(img, planeComp, tile, tileMdatOffset)) {
+        return false;
+    }
 
-                for (int i = 0; i < tile->height; ++i) {
-                    if (!crxIdwt53FilterDecode(planeComp, img->levels - 1, tile->qStep) || !crxIdwt53FilterTransform(planeComp, img->levels - 1)) {
-                        return false;
-                    }
+    if (img->levels) {
+        if (!crxIdwt53FilterInitialize(planeComp, img->levels, tile->qStep)) {
+            return false;
+        }
 
-                    const std::int32_t* const lineData = crxIdwt53FilterGetLine(planeComp, img->levels - 1);
-                    crxConvertPlaneLine(img, imageRow + i, imageCol, planeNumber, lineData, tile->width);
-                }
-            } else {
-                // we have the only subband in this case
-                if (!planeComp->subBands->dataSize) {
-                    memset(planeComp->subBands->bandBuf, 0, planeComp->subBands->bandSize);
-                    return true;
-                }
+        for (int i = 0; i < tile->height; ++i) {
+            if (!crxIdwt53FilterDecode(planeComp, img->levels - 1, tile->qStep) || !crxIdwt53FilterTransform(planeComp, img->levels - 1)) {
+                return false;
+            }
 
-                for (int i = 0; i < tile->height; ++i) {
-                    if (!crxDecodeLine(planeComp->subBands->bandParam, planeComp->subBands->bandBuf)) {
-                        return false;
-                    }
+            const std::int32_t* const lineData = crxIdwt53FilterGetLine(planeComp, img->levels - 1);
+            crxConvertPlaneLine(img, imageRow + i, imageCol, planeNumber, lineData, tile->width);
+        }
+    } else {
+        // we have the only subband in this case
+        if (!planeComp->subBands->dataSize) {
+            memset(planeComp->subBands->bandBuf, 0, planeComp->subBands->bandSize);
+            return true;
+        }
 
-                    const std::int32_t* const lineData = reinterpret_cast<std::int32_t*>(planeComp->subBands->bandBuf);
-                    crxConvertPlaneLine(img, imageRow + i, imageCol, planeNumber, lineData, tile->width);
-                }
+        for (int i = 0; i < tile->height; ++i) {
+            if (!crxDecodeLine(planeComp->subBands->bandParam, planeComp->subBands->bandBuf)) {
+                return false;
             }
 
-            imageCol += tile->width;
+            const std::int32_t* const lineData = reinterpret_cast<std::int32_t*>(planeComp->subBands->bandBuf);
+            crxConvertPlaneLine(img, imageRow + i, imageCol, planeNumber, lineData, tile->width);
         }
-
-        imageRow += img->tiles[tRow * img->tileCols].height;
     }
+
     return true;
 }
 
@@ -3381,29 +3362,36 @@ void crxFreeImageData(CrxImage* img)
 
 void DCraw::crxLoadDecodeLoop(void* img, int nPlanes)
 {
+    // every tile of every plane has its own bitstreams and buffers and writes
+    // its own part of the output, so they are all decoded in parallel
+    const int nTiles = static_cast<CrxImage*>(img)->tileRows * static_cast<CrxImage*>(img)->tileCols;
+    bool failed = false;
+
 #ifdef _OPENMP
-    bool results[4]; // nPlanes is always <= 4
-    #pragma omp parallel for
+    #pragma omp parallel for schedule(dynamic)
+#endif
 
-    for (std::int32_t plane = 0; plane < nPlanes; ++plane) {
-        results[plane] = crxDecodePlane(img, plane);
-    }
+    for (int job = 0; job < nTiles * nPlanes; ++job) {
+        bool result;
 
-    for (std::int32_t plane = 0; plane < nPlanes; ++plane) {
-        if (!results[plane]) {
-            derror();
+        try {
+            result = crxDecodeTile(img, job / nPlanes, job % nPlanes);
+        } catch (const std::exception&) {
+            // must not leave the parallel region
+            result = false;
         }
-    }
 
-#else
-
-    for (std::int32_t plane = 0; plane < nPlanes; ++plane) {
-        if (!crxDecodePlane(img, plane)) {
-            derror();
+        if (!result) {
+#ifdef _OPENMP
+            #pragma omp atomic write
+#endif
+            failed = true;
         }
     }
 
-#endif
+    if (failed) {
+        derror();
+    }
 }
 
 void DCraw::crxConvertPlaneLineDf(void* p, int imageRow)
@@ -3450,19 +3438,8 @@ void DCraw::crxLoadRaw()
     std::uint8_t* const hdrBuf = static_cast<std::uint8_t*>(malloc(hdr.mdatHdrSize * 2));
 
     // read image header
-#ifdef _OPENMP
-    #pragma omp critical
-#endif
-    {
-#ifndef _OPENMP
-        /*libraw_internal_data.internal_data.input->*/ input.lock();
-#endif
-        /*libraw_internal_data.internal_data.input->*/ input.seek(data_offset, SEEK_SET);
-        /*libraw_internal_data.internal_data.input->*/ input.read(hdrBuf, 1, hdr.mdatHdrSize);
-#ifndef _OPENMP
-        /*libraw_internal_data.internal_data.input->*/ input.unlock();
-#endif
-    }
+    fseek(ifp, data_offset, SEEK_SET);
+    fread(hdrBuf, 1, hdr.mdatHdrSize, ifp);
 
     // parse and setup the image data
     if (!crxSetupImageData(&hdr, &img, reinterpret_cast<std::int16_t*>(raw_image), hdr.MediaOffset /*data_offset*/, hdr.MediaSize /*RT_canon_CR3_data.data_size*/, hdrBuf, hdr.mdatHdrSize*2)) {
@@ -63,7 +63,7 @@ public:
 private:
     CLUTStore();
 
-    mutable Cache<Glib::ustring, std::shared_ptr<HaldCLUT>> cache;
+    mutable ShardedCache<Glib::ustring, std::shared_ptr<HaldCLUT>> cache;
 };
 
 }
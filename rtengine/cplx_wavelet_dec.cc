@@ -18,7 +18,10 @@
  *  2012 Emil Martinec <ejmartin@uchicago.edu>
  */
 
+#include <cstdio>
+
 #include "cplx_wavelet_dec.h"
+#include "settings.h"
 
 namespace rtengine
 {
@@ -34,10 +37,19 @@ wavelet_decomposition::~wavelet_decomposition()
     delete[] wavfilt_anal;
     delete[] wavfilt_synth;
 
-    if(coeff0) {
-        delete [] coeff0;
-    }
+    WaveletBufferPool::release(coeff0, coeff0Size);
 }
 
+bool wavelet_decomposition::timingEnabled()
+{
+    return settings && settings->verbose;
 }
 
+void wavelet_decomposition::printLevelTime(int level, const char* phase, const MyTime& t1, const MyTime& t2) const
+{
+    // only the subsampled levels use the Daubechies filter, the others a Haar filter
+    const int taps = (subsamp >> level) & 1 ? wavfilt_len : 2;
+    printf("Wavelet level %d (%dx%d, %d taps): %s %d usec\n", level, wavelet_decomp[level]->m_w, wavelet_decomp[level]->m_h, taps, phase, t2.etime(t1));
+}
+
+}
@@ -24,6 +24,8 @@
 
 #include "cplx_wavelet_level.h"
 #include "cplx_wavelet_filter_coeffs.h"
+#include "cplx_wavelet_pool.h"
+#include "mytime.h"
 #include "noncopyable.h"
 
 namespace rtengine
@@ -96,6 +98,10 @@ public:
 private:
     static const int maxlevels = 10; // should be greater than any conceivable order of decimation
 
+    // with settings->verbose, the time taken by each level is printed
+    static bool timingEnabled();
+    void printLevelTime(int level, const char* phase, const MyTime& t1, const MyTime& t2) const;
+
     int lvltot;
     int subsamp;
     // Dimensions
@@ -108,6 +114,7 @@ private:
     internal_type* wavfilt_synth;
 
     internal_type* coeff0;
+    std::size_t coeff0Size; // of coeff0 and the buffers of the decomposition
     bool memoryAllocationFailed;
 
     wavelet_level<internal_type>* wavelet_decomp[maxlevels];
@@ -129,6 +136,7 @@ wavelet_decomposition::wavelet_decomposition(
     m_w(width),
     m_h(height),
     coeff0(nullptr),
+    coeff0Size(static_cast<std::size_t>(width / 2 + 1) * (height / 2 + 1)),
     memoryAllocationFailed(false)
 {
 
@@ -193,27 +201,38 @@ wavelet_decomposition::wavelet_decomposition(
 
     lvltot = 0;
     E *buffer[2];
-    buffer[0] = new (std::nothrow) E[(m_w / 2 + 1) * (m_h / 2 + 1)];
+    buffer[0] = WaveletBufferPool::allocate(coeff0Size);
 
     if(buffer[0] == nullptr) {
         memoryAllocationFailed = true;
         return;
     }
 
-    buffer[1] = new (std::nothrow) E[(m_w / 2 + 1) * (m_h / 2 + 1)];
+    buffer[1] = WaveletBufferPool::allocate(coeff0Size);
 
     if(buffer[1] == nullptr) {
         memoryAllocationFailed = true;
-        delete[] buffer[0];
+        WaveletBufferPool::release(buffer[0], coeff0Size);
         buffer[0] = nullptr;
         return;
     }
 
     int bufferindex = 0;
+    const bool timed = timingEnabled();
+    MyTime t1, t2;
+
+    if(timed) {
+        t1.set();
+    }
 
     wavelet_decomp[lvltot] = new wavelet_level<internal_type>(src, buffer[bufferindex ^ 1], lvltot/*level*/, subsamp, m_w, m_h, \
             wavfilt_anal, wavfilt_anal, wavfilt_len, wavfilt_offset, skipcrop, numThreads);
 
+    if(timed) {
+        t2.set();
+        printLevelTime(lvltot, "decomposition", t1, t2);
+    }
+
     if(wavelet_decomp[lvltot]->memoryAllocationFailed) {
         memoryAllocationFailed = true;
     }
@@ -221,17 +240,27 @@ wavelet_decomposition::wavelet_decomposition(
     while(lvltot < maxlvl - 1) {
         lvltot++;
         bufferindex ^= 1;
+
+        if(timed) {
+            t1.set();
+        }
+
         wavelet_decomp[lvltot] = new wavelet_level<internal_type>(buffer[bufferindex], buffer[bufferindex ^ 1]/*lopass*/, lvltot/*level*/, subsamp, \
                 wavelet_decomp[lvltot - 1]->width(), wavelet_decomp[lvltot - 1]->height(), \
                 wavfilt_anal, wavfilt_anal, wavfilt_len, wavfilt_offset, skipcrop, numThreads);
 
+        if(timed) {
+            t2.set();
+            printLevelTime(lvltot, "decomposition", t1, t2);
+        }
+
         if(wavelet_decomp[lvltot]->memoryAllocationFailed) {
             memoryAllocationFailed = true;
         }
     }
 
     coeff0 = buffer[bufferindex ^ 1];
-    delete[] buffer[bufferindex];
+    WaveletBufferPool::release(buffer[bufferindex], coeff0Size);
 }
 
 template<typename E>
@@ -244,11 +273,14 @@ void wavelet_decomposition::reconstruct(E * dst, const float blend)
 
     // data structure is wavcoeffs[scale][channel={lo,hi1,hi2,hi3}][pixel_array]
 
+    const bool timed = timingEnabled();
+    MyTime t1, t2;
+
     if(lvltot >= 1) {
         int width = wavelet_decomp[1]->m_w;
         int height = wavelet_decomp[1]->m_h;
 
-        E *tmpHi = new (std::nothrow) E[width * height];
+        E *tmpHi = WaveletBufferPool::allocate(width * height);
 
         if(tmpHi == nullptr) {
             memoryAllocationFailed = true;
@@ -257,12 +289,23 @@ void wavelet_decomposition::reconstruct(E * dst, const float blend)
 
         for (int lvl = lvltot; lvl > 0; lvl--) {
             E *tmpLo = wavelet_decomp[lvl]->wavcoeffs[2]; // we can use this as buffer
+
+            if(timed) {
+                t1.set();
+            }
+
             wavelet_decomp[lvl]->reconstruct_level(tmpLo, tmpHi, coeff0, coeff0, wavfilt_synth, wavfilt_synth, wavfilt_len, wavfilt_offset);
+
+            if(timed) {
+                t2.set();
+                printLevelTime(lvl, "reconstruction", t1, t2);
+            }
+
             delete wavelet_decomp[lvl];
             wavelet_decomp[lvl] = nullptr;
         }
 
-        delete[] tmpHi;
+        WaveletBufferPool::release(tmpHi, width * height);
     }
 
     int width = wavelet_decomp[0]->m_w;
@@ -272,7 +315,7 @@ void wavelet_decomposition::reconstruct(E * dst, const float blend)
     if(wavelet_decomp[0]->bigBlockOfMemoryUsed()) { // bigBlockOfMemoryUsed means that wavcoeffs[2] points to a block of memory big enough to hold the data
         tmpLo = wavelet_decomp[0]->wavcoeffs[2];
     } else {                                      // allocate new block of memory
-        tmpLo = new (std::nothrow) E[width * height];
+        tmpLo = WaveletBufferPool::allocate(width * height);
 
         if(tmpLo == nullptr) {
             memoryAllocationFailed = true;
@@ -280,29 +323,37 @@ void wavelet_decomposition::reconstruct(E * dst, const float blend)
         }
     }
 
-    E *tmpHi = new (std::nothrow) E[width * height];
+    E *tmpHi = WaveletBufferPool::allocate(width * height);
 
     if(tmpHi == nullptr) {
         memoryAllocationFailed = true;
 
         if(!wavelet_decomp[0]->bigBlockOfMemoryUsed()) {
-            delete[] tmpLo;
+            WaveletBufferPool::release(tmpLo, width * height);
         }
 
         return;
     }
 
+    if(timed) {
+        t1.set();
+    }
 
     wavelet_decomp[0]->reconstruct_level(tmpLo, tmpHi, coeff0, dst, wavfilt_synth, wavfilt_synth, wavfilt_len, wavfilt_offset, blend);
 
+    if(timed) {
+        t2.set();
+        printLevelTime(0, "reconstruction", t1, t2);
+    }
+
     if(!wavelet_decomp[0]->bigBlockOfMemoryUsed()) {
-        delete[] tmpLo;
+        WaveletBufferPool::release(tmpLo, width * height);
     }
 
-    delete[] tmpHi;
+    WaveletBufferPool::release(tmpHi, width * height);
     delete wavelet_decomp[0];
     wavelet_decomp[0] = nullptr;
-    delete[] coeff0;
+    WaveletBufferPool::release(coeff0, coeff0Size);
     coeff0 = nullptr;
 }
 
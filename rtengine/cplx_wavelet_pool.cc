@@ -0,0 +1,134 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "cplx_wavelet_pool.h"
+
+namespace rtengine
+{
+
+namespace
+{
+
+std::mutex mutex;
+int keepers = 0;
+int exports = 0;
+std::size_t cachedSize = 0; // in bytes
+std::map<std::size_t, std::vector<float*>> cached; // by size class
+
+// 8 size classes per power of two
+std::size_t getSizeClass(std::size_t size)
+{
+    std::size_t step = 1;
+
+    while (size >= 16 * step) {
+        step *= 2;
+    }
+
+    return (size + step - 1) & ~(step - 1);
+}
+
+void clear()
+{
+    for (const auto& sizeClass : cached) {
+        for (const auto buffer : sizeClass.second) {
+            delete[] buffer;
+        }
+    }
+
+    cached.clear();
+    cachedSize = 0;
+}
+
+}
+
+WaveletBufferPool::Keeper::Keeper()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ++keepers;
+}
+
+WaveletBufferPool::Keeper::~Keeper()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (--keepers == 0) {
+        clear();
+    }
+}
+
+WaveletBufferPool::Exporting::Exporting()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ++exports;
+}
+
+WaveletBufferPool::Exporting::~Exporting()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    --exports;
+}
+
+float* WaveletBufferPool::allocate(std::size_t size)
+{
+    const std::size_t sizeClass = getSizeClass(size);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = cached.find(sizeClass);
+
+        if (it != cached.end()) {
+            float* const buffer = it->second.back();
+            it->second.pop_back();
+
+            if (it->second.empty()) {
+                cached.erase(it);
+            }
+
+            cachedSize -= sizeClass * sizeof(float);
+            return buffer;
+        }
+    }
+
+    return new (std::nothrow) float[sizeClass];
+}
+
+void WaveletBufferPool::release(float* buffer, std::size_t size)
+{
+    if (!buffer) {
+        return;
+    }
+
+    const std::size_t sizeClass = getSizeClass(size);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (keepers > 0 && exports == 0 && cachedSize + sizeClass * sizeof(float) <= maxCachedSize) {
+            cached[sizeClass].push_back(buffer);
+            cachedSize += sizeClass * sizeof(float);
+            return;
+        }
+    }
+
+    delete[] buffer;
+}
+
+}
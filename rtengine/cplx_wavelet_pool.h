@@ -0,0 +1,68 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+/*
+ * Coefficient buffers of wavelet_decomposition and wavelet_level.
+ *
+ * While a Keeper exists (ImProcCoordinator holds one for the editor), released
+ * buffers are kept in size classes at most 1/8 larger than the requested size
+ * and handed out again, so the decompositions of consecutive preview updates
+ * neither fault in fresh pages nor fragment the heap. At most maxCachedSize
+ * bytes are kept. Without a Keeper, e.g. in rawtherapee-cli, buffers are
+ * freed at once.
+ *
+ * Exports hold an Exporting while they run. The pool cannot tell which
+ * pipeline releases a buffer, so nothing is cached while an export runs: the
+ * cache only holds buffers of the editors, and the memory of exports stays
+ * within their budget.
+ */
+class WaveletBufferPool final
+{
+public:
+    static constexpr std::size_t maxCachedSize = 512 << 20;
+
+    class Keeper final :
+        public NonCopyable
+    {
+    public:
+        Keeper();
+        ~Keeper();
+    };
+
+    class Exporting final :
+        public NonCopyable
+    {
+    public:
+        Exporting();
+        ~Exporting();
+    };
+
+    // nullptr if the allocation fails
+    static float* allocate(std::size_t size);
+    // size must be the one passed to allocate
+    static void release(float* buffer, std::size_t size);
+};
+
+}
@@ -0,0 +1,185 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "cplx_wavelet_transform.h"
+
+#include "opthelper.h"
+#include "rt_math.h"
+
+namespace rtengine
+{
+
+namespace
+{
+
+// pixels per block of the inner loops, so that the sums stay in L1 cache
+constexpr int blockSize = 256;
+
+}
+
+SIMD_CLONES void waveletAnalysisHorizontal(const float* src, float* dstLo, float* dstHi, const float* filterLo, const float* filterHi, int taps, int offset, int skip, int width, float* buffer)
+{
+    // even and odd pixels of the row with clamped borders of 'pad' pixels, pad is even
+    const int pad = (skip * taps + 1) & ~1;
+    const int n = (width + 1) / 2 + pad + 1;
+    float* const even = buffer;
+    float* const odd = buffer + n;
+
+    for (int i = 0; i < n; ++i) {
+        even[i] = src[LIM(2 * i - pad, 0, width - 1)];
+        odd[i] = src[LIM(2 * i + 1 - pad, 0, width - 1)];
+    }
+
+    const int dstwidth = (width + 1) / 2;
+
+    for (int begin = 0; begin < dstwidth; begin += blockSize) {
+        const int end = min(begin + blockSize, dstwidth);
+        float* RESTRICT lo = dstLo;
+        float* RESTRICT hi = dstHi;
+
+        for (int i = begin; i < end; ++i) {
+            lo[i] = 0.f;
+            hi[i] = 0.f;
+        }
+
+        for (int j = 0; j < taps; ++j) {
+            // pixel 2 * i + skip * (offset - j) of the row
+            const int shift = pad + skip * (offset - j);
+            const float* RESTRICT in = (shift & 1 ? odd : even) + shift / 2;
+            const float fLo = filterLo[j];
+            const float fHi = filterHi[j];
+
+            for (int i = begin; i < end; ++i) {
+                lo[i] += fLo * in[i];
+                hi[i] += fHi * in[i];
+            }
+        }
+    }
+}
+
+SIMD_CLONES void waveletAnalysisVertical(const float* src, float* dstLo, float* dstHi, const float* filterLo, const float* filterHi, int taps, int offset, int skip, int width, int height, int row)
+{
+    for (int begin = 0; begin < width; begin += blockSize) {
+        const int end = min(begin + blockSize, width);
+        float* RESTRICT lo = dstLo;
+        float* RESTRICT hi = dstHi;
+
+        for (int k = begin; k < end; ++k) {
+            lo[k] = 0.f;
+            hi[k] = 0.f;
+        }
+
+        for (int j = 0; j < taps; ++j) {
+            const float* RESTRICT in = src + static_cast<std::size_t>(LIM(row + skip * (offset - j), 0, height - 1)) * width; //clamped BC's
+            const float fLo = filterLo[j];
+            const float fHi = filterHi[j];
+
+            for (int k = begin; k < end; ++k) {
+                lo[k] += fLo * in[k];
+                hi[k] += fHi * in[k];
+            }
+        }
+    }
+}
+
+SIMD_CLONES void waveletSynthesisHorizontal(const float* srcLo, const float* srcHi, float* dst, const float* filterLo, const float* filterHi, int taps, int offset, int skip, int srcwidth, int dstwidth, float* buffer)
+{
+    // the input with clamped borders of 'pad' pixels
+    const int pad = skip * taps + 2;
+    const int n = srcwidth + 2 * pad;
+    float* const lo = buffer;
+    float* const hi = buffer + n;
+
+    for (int i = 0; i < n; ++i) {
+        const int arg = LIM(i - pad, 0, srcwidth - 1);
+        lo[i] = srcLo[arg];
+        hi[i] = srcHi[arg];
+    }
+
+    //TODO: this is correct only if skip=1; otherwise, want to work with cosets of length 'skip'
+    const int shift = skip * (taps - offset - 1); //align filter with data
+
+    // pixel i of the result uses the taps of parity (i + shift) % 2 around pixel (i + shift) / 2 of the input
+    for (int parity = 0; parity < 2; ++parity) {
+        const int first = (shift - parity + 1) / 2;
+        const int last = (dstwidth - 1 + shift - parity) / 2;
+
+        for (int begin = first; begin <= last; begin += blockSize) {
+            const int count = min(blockSize, last - begin + 1);
+            float tot[blockSize] ALIGNED64;
+
+            for (int i = 0; i < count; ++i) {
+                tot[i] = 0.f;
+            }
+
+            for (int j = parity, l = 0; j < taps; j += 2, l += skip) {
+                const float* RESTRICT inLo = lo + pad + begin - l;
+                const float* RESTRICT inHi = hi + pad + begin - l;
+                const float fLo = filterLo[j];
+                const float fHi = filterHi[j];
+
+                for (int i = 0; i < count; ++i) {
+                    tot[i] += (fLo * inLo[i] + fHi * inHi[i]);
+                }
+            }
+
+            float* const out = dst + 2 * begin + parity - shift;
+
+            for (int i = 0; i < count; ++i) {
+                out[2 * i] = tot[i];
+            }
+        }
+    }
+}
+
+SIMD_CLONES void waveletSynthesisVertical(const float* srcLo, const float* srcHi, float* dst, const float* filterLo, const float* filterHi, int taps, int offset, int skip, int width, int srcheight, int row, float blend)
+{
+    const float srcFactor = 1.f - blend;
+    const float dstFactor = blend * 4.f;
+    //TODO: this is correct only if skip=1; otherwise, want to work with cosets of length 'skip'
+    const int shift = skip * (taps - offset - 1); //align filter with data
+    const int i_src = (row + shift) / 2;
+    const int parity = (row + shift) % 2;
+
+    for (int begin = 0; begin < width; begin += blockSize) {
+        const int count = min(blockSize, width - begin);
+        float tot[blockSize] ALIGNED64;
+
+        for (int k = 0; k < count; ++k) {
+            tot[k] = 0.f;
+        }
+
+        for (int j = parity, l = 0; j < taps; j += 2, l += skip) {
+            const std::size_t arg = static_cast<std::size_t>(LIM(i_src - l, 0, srcheight - 1)) * width + begin; //clamped BC's
+            const float* RESTRICT inLo = srcLo + arg;
+            const float* RESTRICT inHi = srcHi + arg;
+            const float fLo = filterLo[j];
+            const float fHi = filterHi[j];
+
+            for (int k = 0; k < count; ++k) {
+                tot[k] += (fLo * inLo[k] + fHi * inHi[k]);
+            }
+        }
+
+        float* RESTRICT out = dst + begin;
+
+        for (int k = 0; k < count; ++k) {
+            out[k] = out[k] * srcFactor + dstFactor * tot[k];
+        }
+    }
+}
+
+}
@@ -0,0 +1,55 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+
+namespace rtengine
+{
+
+/*
+ * Subsampling Daubechies filters of wavelet_level, one row at a time.
+ *
+ * The filters are FIR convolutions with 'taps' coefficients spaced by 'skip'
+ * pixels, element 'offset' aligned with the input pixel and clamped borders.
+ * The rows are split into their even and odd pixels first, so that every tap
+ * is a multiply-add over contiguous data, vectorized at the width of the
+ * running cpu (AVX2/AVX-512 when built with WITH_TARGET_CLONES). The sums are
+ * formed in the same order as the direct convolution, the results are
+ * identical.
+ */
+
+// Size in floats of the scratch buffer of the horizontal filters for rows of
+// at most 'width' pixels
+inline std::size_t waveletRowBufferSize(int width, int taps, int skip)
+{
+    return 2 * (static_cast<std::size_t>(width) + 2 * skip * taps + 4);
+}
+
+// Low and high pass of 'src' (width pixels) into (width + 1) / 2 pixels each
+void waveletAnalysisHorizontal(const float* src, float* dstLo, float* dstHi, const float* filterLo, const float* filterHi, int taps, int offset, int skip, int width, float* buffer);
+
+// Low and high pass of row 'row' of 'src' (width x height) into rows of width pixels
+void waveletAnalysisVertical(const float* src, float* dstLo, float* dstHi, const float* filterLo, const float* filterHi, int taps, int offset, int skip, int width, int height, int row);
+
+// Inverse of waveletAnalysisHorizontal, from srcwidth to dstwidth pixels
+void waveletSynthesisHorizontal(const float* srcLo, const float* srcHi, float* dst, const float* filterLo, const float* filterHi, int taps, int offset, int skip, int srcwidth, int dstwidth, float* buffer);
+
+// Inverse of waveletAnalysisVertical for row 'row' of the result, blended with the content of 'dst'
+void waveletSynthesisVertical(const float* srcLo, const float* srcHi, float* dst, const float* filterLo, const float* filterHi, int taps, int offset, int skip, int width, int srcheight, int row, float blend);
+
+}
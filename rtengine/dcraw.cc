@@ -266,6 +266,11 @@ void CLASS merror (void *ptr, const char *where)
 }
 
 void CLASS derror()
+{
+/*RT the tiles of DNG files are decoded in parallel */
+#ifdef _OPENMP
+  #pragma omp critical(dcraw_derror)
+#endif
 {
   if (!data_error) {
     fprintf (stderr, "%s: ", ifname);
@@ -275,10 +280,11 @@ void CLASS derror()
       fprintf (stderr,_("Corrupt data near 0x%llx\n"), (INT64) ftello(ifp));
   }
   data_error++;
+}
 /*RT Issue 2467  longjmp (failure, 1);*/
 }
 
-ushort CLASS sget2 (uchar *s)
+ushort CLASS sget2 (const uchar *s)
 {
   if (order == 0x4949)		/* "II" means little-endian */
     return s[0] | s[1] << 8;
@@ -293,7 +299,7 @@ ushort CLASS get2()
   return sget2(str);
 }
 
-unsigned CLASS sget4 (uchar *s)
+unsigned CLASS sget4 (const uchar *s)
 {
   if (order == 0x4949)
     return s[0] | s[1] << 8 | s[2] << 16 | s[3] << 24;
@@ -601,6 +607,27 @@ inline unsigned CLASS getbithuff_t::operator() (int nbits, ushort *huff)
   return c;
 }
 
+/*RT the next nbits without consuming them, zeros past the end of the data */
+inline unsigned CLASS getbithuff_t::peek (int nbits)
+{
+  unsigned c;
+
+  while (!reset && vbits < nbits && (c = fgetc(ifp)) != EOF &&
+    !(reset = zero_after_ff && c == 0xff && fgetc(ifp))) {
+    bitbuf = (bitbuf << 8) + (uchar) c;
+    vbits += 8;
+  }
+  return vbits <= 0 ? 0 : bitbuf << (32-vbits) >> (32-nbits);
+}
+
+/*RT false, and nothing consumed, if fewer than nbits are left */
+inline bool CLASS getbithuff_t::skip (int nbits)
+{
+  if (nbits > vbits) return false;
+  vbits -= nbits;
+  return true;
+}
+
 #define getbits(n) getbithuff(n,0)
 #define gethuff(h) getbithuff(*h,h+1)
 
@@ -630,6 +657,30 @@ inline unsigned CLASS nikbithuff_t::operator() (int nbits, ushort *huff)
     return c;
 }
 
+inline unsigned CLASS nikbithuff_t::peek (int nbits)
+{
+    unsigned c;
+
+    if (vbits < nbits && LIKELY((c = fgetc(ifp)) != EOF)) {
+        bitbuf = (bitbuf << 8) | c;
+        vbits += 8;
+        if (vbits < nbits && LIKELY((c = fgetc(ifp)) != EOF)) {
+            bitbuf = (bitbuf << 8) | c;
+            vbits += 8;
+        }
+    }
+    return vbits <= 0 ? 0 : bitbuf << (32-vbits) >> (32-nbits);
+}
+
+inline bool CLASS nikbithuff_t::skip (int nbits)
+{
+    if (nbits > vbits) {
+        return false;
+    }
+    vbits -= nbits;
+    return true;
+}
+
 #define nikinit(n) nikbithuff()
 #define nikbits(n) nikbithuff(n,0)
 #define nikhuff(h) nikbithuff(*h,h+1)
@@ -684,6 +735,33 @@ ushort * CLASS make_decoder (const uchar *source)
   return make_decoder_ref (&source);
 }
 
+/*
+   RT: Fills the 1 << LJPEG_FAST_BITS entries of fast with the lossless JPEG
+   differences whose Huffman code and extra bits both fit in the next
+   LJPEG_FAST_BITS bits of the stream, so that they are decoded with one
+   lookup instead of two reads. An entry is diff << 8 | bits used, 0 for the
+   longer ones, which take the usual path.
+ */
+void CLASS ljpeg_make_fast (const ushort *huff, int *fast)
+{
+  int max, code, len, size, diff;
+  ushort leaf;
+
+  max = huff[0];
+  for (code=0; code < 1 << LJPEG_FAST_BITS; code++) {
+    leaf = max > LJPEG_FAST_BITS ? huff[1 + (code << (max - LJPEG_FAST_BITS))]
+				 : huff[1 + (code >> (LJPEG_FAST_BITS - max))];
+    len = leaf >> 8;
+    size = (uchar) leaf;
+    fast[code] = 0;
+    if (!len || size >= 16 || len + size > LJPEG_FAST_BITS) continue;
+    diff = code >> (LJPEG_FAST_BITS - len - size) & ((1 << size) - 1);
+    if (size && (diff & (1 << (size-1))) == 0)
+      diff -= (1 << size) - 1;
+    fast[code] = diff * 256 + len + size;
+  }
+}
+
 void CLASS crw_init_tables (unsigned table, ushort *huff[2])
 {
   static const uchar first_tree[3][29] = {
@@ -832,10 +910,18 @@ struct jhead {
 };
 
 int CLASS ljpeg_start (struct jhead *jh, int info_only)
+{
+  return ljpeg_start (jh, info_only, ifp, zero_after_ff);
+}
+
+// RT: the decoder state is passed in, so that several tiles can be decoded at once.
+// The parameters shadow the members on purpose, the body is the one of dcraw.
+int CLASS ljpeg_start (struct jhead *jh, int info_only, rtengine::IMFILE *ifp, unsigned &zero_after_ff)
 {
   ushort c, tag, len;
   uchar data[0x10000];
   const uchar *dp;
+  int i, *fast;
 
   memset (jh, 0, sizeof *jh);
   jh->restart = INT_MAX;
@@ -885,6 +971,16 @@ int CLASS ljpeg_start (struct jhead *jh, int info_only)
   }
   jh->row = (ushort *) calloc (2 * jh->wide*jh->clrs, 4);
   merror (jh->row, "ljpeg_start()");
+  for (i=c=0; c < 20; c++)
+    if (jh->free[c]) i++;
+  fast = jh->fastbuf = (int *) malloc ((i << LJPEG_FAST_BITS) * sizeof *fast);
+  merror (jh->fastbuf, "ljpeg_start()");
+  FORC(20) if (jh->free[c]) {
+    ljpeg_make_fast (jh->free[c], fast);
+    for (i=0; i < 20; i++)
+      if (jh->huff[i] == jh->free[c]) jh->fast[i] = fast;
+    fast += 1 << LJPEG_FAST_BITS;
+  }
   return zero_after_ff = 1;
 }
 
@@ -893,12 +989,23 @@ void CLASS ljpeg_end (struct jhead *jh)
   int c;
   FORC4 if (jh->free[c]) free (jh->free[c]);
   free (jh->row);
+  free (jh->fastbuf);
 }
 
 inline int CLASS ljpeg_diff (ushort *huff)
+{
+  return ljpeg_diff (huff, 0, getbithuff);
+}
+
+inline int CLASS ljpeg_diff (ushort *huff, const int *fast, getbithuff_t &getbithuff)
 {
   int len, diff;
 
+  if (fast) {
+    diff = fast[getbithuff.peek (LJPEG_FAST_BITS)];
+    if ((diff & 0xff) && getbithuff.skip (diff & 0xff))
+      return diff >> 8;
+  }
   len = gethuff(huff);
   if (len == 16 && (!dng_version || dng_version >= 0x1010000))
     return -32768;
@@ -909,6 +1016,11 @@ inline int CLASS ljpeg_diff (ushort *huff)
 }
 
 ushort * CLASS ljpeg_row (int jrow, struct jhead *jh)
+{
+  return ljpeg_row (jrow, jh, ifp, getbithuff);
+}
+
+ushort * CLASS ljpeg_row (int jrow, struct jhead *jh, rtengine::IMFILE *ifp, getbithuff_t &getbithuff)
 {
   int col, c, diff, pred, spred=0;
   ushort mark=0, *row[3];
@@ -925,7 +1037,7 @@ ushort * CLASS ljpeg_row (int jrow, struct jhead *jh)
   FORC3 row[c] = jh->row + jh->wide*jh->clrs*((jrow+c) & 1);
   for (col=0; col < jh->wide; col++)
     FORC(jh->clrs) {
-      diff = ljpeg_diff (jh->huff[c]);
+      diff = ljpeg_diff (jh->huff[c], jh->fast[c], getbithuff);
       if (jh->sraw && c <= jh->sraw && (col | c))
 		    pred = spred;
       else if (col) pred = row[0][-jh->clrs];
@@ -946,6 +1058,74 @@ ushort * CLASS ljpeg_row (int jrow, struct jhead *jh)
   return row[2];
 }
 
+/*
+   RT: When restart markers split the scan into intervals of whole rows,
+   which do not predict from each other, the intervals are decoded in
+   parallel, each from its own copy of the file, into one buffer of all the
+   rows. Returns 0 if the scan can't be split, ljpeg_row() then decodes the
+   rows in sequence.
+ */
+ushort * CLASS ljpeg_decode_intervals (struct jhead *jh)
+{
+  if (jh->restart <= 0 || jh->restart == INT_MAX || jh->restart % jh->wide || jh->psv != 1)
+    return 0;
+
+  const int rows = jh->restart / jh->wide;
+  const int intervals = (jh->high + rows - 1) / rows;
+  const int jwide = jh->wide * jh->clrs;
+  const uchar *data = (const uchar *) ifp->data;
+  std::vector<long> start (intervals);
+  long pos = ftell (ifp);
+
+  if (intervals < 2) return 0;
+
+  // the entropy coded data has no 0xff byte not followed by 0 or by a marker
+  start[0] = pos;
+  for (int i=1; i < intervals; ) {
+    const uchar *ff = pos < ifp->size ? (const uchar *) memchr (data + pos, 0xff, ifp->size - pos) : 0;
+    if (!ff || ff + 1 >= data + ifp->size) return 0;
+    pos = ff - data + 1;
+    if (*++ff == 0xff) continue;	/* fill byte */
+    pos++;
+    if (*ff == 0) continue;		/* stuffed byte */
+    if (*ff >> 3 != 0xd0 >> 3) return 0;	/* not RST0-7, the scan ended early */
+    start[i++] = pos;
+  }
+
+  ushort *out = (ushort *) malloc ((size_t) jh->high * jwide * sizeof *out);
+  merror (out, "ljpeg_decode_intervals()");
+  int failed = 0;
+
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic) reduction(+:failed)
+#endif
+  for (int i=0; i < intervals; i++) {
+    // the copies must not update the progress of the shared IMFILE
+    rtengine::IMFILE file = *ifp;
+    rtengine::IMFILE *fp = &file;
+    unsigned zero = 1;
+    getbithuff_t bits (this, fp, zero);
+    struct jhead ijh = *jh;
+
+    file.plistener = nullptr;
+    ijh.row = (ushort *) calloc (2 * jwide, 4);
+    if (!ijh.row) {
+      ++failed;
+      continue;
+    }
+    fseek (fp, start[i], SEEK_SET);
+    for (int jrow = i * rows; jrow < MIN(jh->high, (i+1) * rows); jrow++)
+      memcpy (out + (size_t) jrow * jwide, ljpeg_row (jrow, &ijh, fp, bits), jwide * sizeof *out);
+    free (ijh.row);
+  }
+
+  if (failed) {
+    free (out);
+    return 0;
+  }
+  return out;
+}
+
 void CLASS lossless_jpeg_load_raw()
 {
   struct jhead jh;
@@ -953,19 +1133,22 @@ void CLASS lossless_jpeg_load_raw()
 
   if (!ljpeg_start (&jh, 0)) return;
   int jwide = jh.wide * jh.clrs;
+  ushort *intervals = ljpeg_decode_intervals (&jh);
   ushort *rp[2];
-  rp[0] = ljpeg_row (0, &jh);
+  rp[0] = intervals ? intervals : ljpeg_row (0, &jh);
 
   for (int jrow=0; jrow < jh.high; jrow++) {
+    if (intervals)
+      rp[jrow&1] = intervals + (size_t) jrow * jwide;
 #ifdef _OPENMP
-#pragma omp parallel sections
+#pragma omp parallel sections if (!intervals)
 #endif
 {
 #ifdef _OPENMP
     #pragma omp section
 #endif
     {
-        if(jrow < jh.high - 1)
+        if(!intervals && jrow < jh.high - 1)
             rp[(jrow + 1)&1] = ljpeg_row (jrow + 1, &jh);
     }
 #ifdef _OPENMP
@@ -995,6 +1178,7 @@ void CLASS lossless_jpeg_load_raw()
     }
 }
   }
+  free (intervals);
   ljpeg_end (&jh);
 }
 
@@ -1125,12 +1309,100 @@ void CLASS ljpeg_idct (struct jhead *jh)
   FORC(64) jh->idct[c] = CLIP(((float *)work[2])[c]+0.5);
 }
 
+// RT: decodes the tiles of a lossless JPEG DNG in parallel. Every tile gets its own
+// cursor over the buffer of the file and its own bit reader. Returns false for the
+// lossy (0xc1) DNGs, whose shared tables keep them on the serial path.
+bool CLASS lossless_dng_load_tiles()
+{
+  const unsigned tilesWide = (raw_width + tile_width - 1) / tile_width;
+  const unsigned tilesHigh = (raw_height + tile_length - 1) / tile_length;
+  const unsigned tileCount = tilesWide * tilesHigh;
+  std::vector<unsigned> tileOffsets(tileCount);
+  const long start = ftell(ifp);
+
+  for (unsigned t = 0; t < tileCount; ++t) {
+    tileOffsets[t] = get4();
+  }
+
+  fseek (ifp, start, SEEK_SET);
+
+  if (!tileCount) {
+    return false;
+  }
+
+  {
+    rtengine::IMFILE probe = *ifp;
+    unsigned probeZeroAfterFF = 0;
+    struct jhead jh;
+
+    probe.plistener = nullptr;
+    fseek (&probe, tileOffsets[0], SEEK_SET);
+
+    if (!ljpeg_start (&jh, 1, &probe, probeZeroAfterFF) || jh.algo != 0xc3) {
+      return false;
+    }
+  }
+
+  int failed = 0;
+
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic) reduction(+:failed)
+#endif
+  for (unsigned t = 0; t < tileCount; ++t) {
+    // the copies must not update the progress of the shared IMFILE
+    rtengine::IMFILE tileFile = *ifp;
+    rtengine::IMFILE *tileIfp = &tileFile;
+    unsigned tileZeroAfterFF = 0;
+    getbithuff_t tileBits (this, tileIfp, tileZeroAfterFF);
+    struct jhead jh;
+
+    tileFile.plistener = nullptr;
+    fseek (tileIfp, tileOffsets[t], SEEK_SET);
+
+    if (!ljpeg_start (&jh, 0, tileIfp, tileZeroAfterFF)) {
+      ++failed;
+      continue;
+    }
+
+    if (jh.algo == 0xc3) {
+      const unsigned trow = (t / tilesWide) * tile_length;
+      const unsigned tcol = (t % tilesWide) * tile_width;
+      unsigned jwide = jh.wide;
+      if (filters || (colors == 1 && jh.clrs > 1)) jwide *= jh.clrs;
+      jwide /= MIN (is_raw, tiff_samples);
+
+      for (unsigned row = 0, col = 0, jrow = 0; jrow < jh.high; jrow++) {
+        ushort *rp = ljpeg_row (jrow, &jh, tileIfp, tileBits);
+        for (unsigned jcol = 0; jcol < jwide; jcol++) {
+          adobe_copy_pixel (trow+row, tcol+col, &rp);
+          if (++col >= tile_width || col >= raw_width)
+            row += 1 + (col = 0);
+        }
+      }
+    } else {
+      ++failed;
+    }
+
+    ljpeg_end (&jh);
+  }
+
+  if (failed) {
+    derror();
+  }
+
+  return true;
+}
+
 void CLASS lossless_dng_load_raw()
 {
   unsigned save, trow=0, tcol=0, jwide, jrow, jcol, row, col, i, j;
   struct jhead jh;
   ushort *rp;
 
+  if (tile_length < INT_MAX && lossless_dng_load_tiles()) {
+    return;
+  }
+
   while (trow < raw_height) {
     save = ftell(ifp);
     if (tile_length < INT_MAX)
@@ -1242,6 +1514,20 @@ void CLASS pentax_load_raw()
     }
 }
 
+/*RT with the lookup table of ljpeg_make_fast() */
+inline int CLASS nikon_diff (ushort *huff, const int *fast)
+{
+    int diff = fast[nikbithuff.peek(LJPEG_FAST_BITS)];
+    if ((diff & 0xff) && nikbithuff.skip(diff & 0xff)) {
+        return diff >> 8;
+    }
+    const int len = nikhuff(huff);
+    diff = nikbits(len);
+    if ((diff & (1 << (len-1))) == 0)
+        diff -= (1 << len) - 1;
+    return diff;
+}
+
 void CLASS nikon_load_raw()
 {
     static const uchar nikon_tree[][32] = {
@@ -1313,26 +1599,24 @@ void CLASS nikon_load_raw()
             }
         }
     } else {
+        int *fast = (int *) malloc ((1 << LJPEG_FAST_BITS) * sizeof *fast);
+        merror (fast, "nikon_load_raw()");
+        ljpeg_make_fast (huff, fast);
         for (int row=0; row < height; row++) {
             for (int col=0; col < 2; col++) {
-                int len = nikhuff(huff);
-                int diff = nikbits(len);
-                if ((diff & (1 << (len-1))) == 0)
-                    diff -= (1 << len) - 1;
+                int diff = nikon_diff(huff, fast);
                 hpred[col] = vpred[row & 1][col] += diff;
                 derror(hpred[col] >= max);
                 RAW(row,col) = curve[hpred[col]];
             }
             for (int col=2; col < raw_width; col++) {
-                int len = nikhuff(huff);
-                int diff = nikbits(len);
-                if ((diff & (1 << (len-1))) == 0)
-                    diff -= (1 << len) - 1;
+                int diff = nikon_diff(huff, fast);
                 hpred[col & 1] += diff;
                 derror(hpred[col & 1] >= max);
                 RAW(row,col) = curve[hpred[col & 1]];
             }
         }
+        free (fast);
     }
     free (huff);
     data_error += nikbithuff.errorCount();
@@ -1876,62 +2160,6 @@ inline unsigned CLASS ph1_bithuff_t::operator() ()
 #define hb_bits(n) ph1_bithuff(n,0)
 #define ph1_huff(h) ph1_bithuff(*h,h+1)
 
-#ifndef MYFILE_MMAP
-void CLASS phase_one_load_raw_c()
-{
-  static const int length[] = { 8,7,6,9,11,10,5,12,14,13 };
-  int *offset, len[2], pred[2], row, col, i, j;
-  ushort *pixel;
-  short (*cblack)[2], (*rblack)[2];
-
-  pixel = (ushort *) calloc (raw_width*3 + raw_height*4, 2);
-  merror (pixel, "phase_one_load_raw_c()");
-  offset = (int *) (pixel + raw_width);
-  fseek (ifp, strip_offset, SEEK_SET);
-  for (row=0; row < raw_height; row++)
-    offset[row] = get4();
-  cblack = (short (*)[2]) (offset + raw_height);
-  fseek (ifp, ph1.black_col, SEEK_SET);
-  if (ph1.black_col)
-    read_shorts ((ushort *) cblack[0], raw_height*2);
-  rblack = cblack + raw_height;
-  fseek (ifp, ph1.black_row, SEEK_SET);
-  if (ph1.black_row)
-    read_shorts ((ushort *) rblack[0], raw_width*2);
-  for (i=0; i < 256; i++)
-    curve[i] = i*i / 3.969 + 0.5;
-  ph1_bithuff_t ph1_bithuff(this, ifp, order);
-  for (row=0; row < raw_height; row++) {
-    fseek (ifp, data_offset + offset[row], SEEK_SET);
-    ph1_init();
-    pred[0] = pred[1] = 0;
-    for (col=0; col < raw_width; col++) {
-      if (col >= (raw_width & -8))
-	len[0] = len[1] = 14;
-      else if ((col & 7) == 0)
-	for (i=0; i < 2; i++) {
-	  for (j=0; j < 5 && !ph1_bits(1); j++);
-	  if (j--) len[i] = length[j*2 + ph1_bits(1)];
-	}
-      if ((i = len[col & 1]) == 14)
-	pixel[col] = pred[col & 1] = ph1_bits(16);
-      else
-	pixel[col] = pred[col & 1] += ph1_bits(i) + 1 - (1 << (i - 1));
-      if (pred[col & 1] >> 16) derror();
-      if (ph1.format == 5 && pixel[col] < 256)
-	pixel[col] = curve[pixel[col]];
-    }
-    for (col=0; col < raw_width; col++) {
-      i = (pixel[col] << 2*(ph1.format != 8)) - ph1.black
-	+ cblack[row][col >= ph1.split_col]
-	+ rblack[col][row >= ph1.split_row];
-      if (i > 0) RAW(row,col) = i;
-    }
-  }
-  free (pixel);
-  maximum = 0xfffc - ph1.black;
-}
-#else
 void CLASS phase_one_load_raw_c()
 {
     static const int length[] = { 8,7,6,9,11,10,5,12,14,13 };
@@ -2015,7 +2243,7 @@ void CLASS phase_one_load_raw_c()
   free(offset);
   maximum = 0xfffc - ph1.black;
 }
-#endif
+
 void CLASS parse_hasselblad_gain()
 {
     /*
@@ -3335,30 +3563,29 @@ void CLASS sony_arw_load_raw()
 void CLASS sony_arw2_load_raw()
 {
 
-#if defined( _OPENMP ) && defined( MYFILE_MMAP )
+    const int pos = ifp->pos;
+
+#ifdef _OPENMP
 #pragma omp parallel
 #endif
 {
     uchar *data = new (std::nothrow) uchar[raw_width + 1];
     merror(data, "sony_arw2_load_raw()");
-    rtengine::IMFILE ifpthr = *ifp;
-    int pos = ifpthr.pos;
     ushort pix[16];
 
-#if defined( _OPENMP ) && defined( MYFILE_MMAP )
-    // only master thread will update the progress bar
-    ifpthr.plistener = nullptr;
-    #pragma omp master
-    {
-    ifpthr.plistener = ifp->plistener;
-    }
+#ifdef _OPENMP
     #pragma omp for schedule(dynamic,16) nowait
 #endif
 
     for (int row = 0; row < height; row++) {
-        fseek(&ifpthr, pos + row * raw_width, SEEK_SET);
-        fread(data, 1, raw_width, &ifpthr);
-        uchar *dp = data;
+        // the rows are read in place, only the last one may need the padded copy
+        ssize_t size = raw_width + 1;
+        const uchar *dp = rtengine::fspan(ifp, pos + static_cast<ssize_t>(row) * raw_width, size);
+        if (size < raw_width + 1) {
+            memset(data, 0, raw_width + 1);
+            memcpy(data, dp, size);
+            dp = data;
+        }
         for (int col = 0; col < raw_width - 30; dp += 16) {
             int val = sget4(dp);
             int max = 0x7ff & val;
@@ -6966,7 +7193,7 @@ it under the terms of the one of two licenses as you choose:
             if (ntags < ifp->size / 12) { // rough check for wrong value (happens for example with DNG files from DJI FC6310)
                 while (ntags-- && !ifp->eof) {
                     unsigned opcode = get4();
-                    if (opcode == 9 && gainMaps.size() < 4) {
+                    if (opcode == 9 && gainMaps.size() < 4 && !RT_header_only) {
                         fseek(ifp, 4, SEEK_CUR); // skip 4 bytes as we know that the opcode 4 takes 4 byte
                         fseek(ifp, 8, SEEK_CUR); // skip 8 bytes as they don't interest us currently
                         GainMap gainMap;
@@ -9128,6 +9355,7 @@ void CLASS adobe_coeff (const char *make, const char *model)
   char name[130];
   int i, j;
 
+  if (RT_header_only) return; // RT: levels and matrices are not needed for the thumbnail
   snprintf(name, sizeof(name), "%s %s", make, model);
 
 
@@ -10995,16 +11223,13 @@ void CLASS deflate_dng_load_raw() {
       tileOffsets[t] = get4();
     }
     size_t tileBytes[tileCount];
-    uLongf maxCompressed = 0;
     if (tileCount == 1) {
-      tileBytes[0] = maxCompressed = ifd->bytes;
+      tileBytes[0] = ifd->bytes;
     } else {
       fseek(ifp, ifd->bytes, SEEK_SET);
       for (size_t t = 0; t < tileCount; ++t) {
         tileBytes[t] = get4();
         //fprintf(stderr, "Tile %d at %d, size %d\n", t, tileOffsets[t], tileBytes[t]);
-        if (maxCompressed < tileBytes[t])
-          maxCompressed = tileBytes[t];
       }
     }
     uLongf dstLen = tile_width * tile_length * 4;
@@ -11013,7 +11238,6 @@ void CLASS deflate_dng_load_raw() {
 #pragma omp parallel
 #endif
 {
-    Bytef * cBuffer = new Bytef[maxCompressed];
     Bytef * uBuffer = new Bytef[dstLen];
 
 #ifdef _OPENMP
@@ -11022,14 +11246,12 @@ void CLASS deflate_dng_load_raw() {
     for (size_t y = 0; y < raw_height; y += tile_length) {
         for (size_t x = 0; x < raw_width; x += tile_width) {
             size_t t = (y / tile_length) * tilesWide + (x / tile_width);
-#ifdef _OPENMP
-            #pragma omp critical
-#endif
-            {
-                fseek(ifp, tileOffsets[t], SEEK_SET);
-                fread(cBuffer, 1, tileBytes[t], ifp);
+            // inflate straight from the buffer of the file, no need to serialize reads
+            if (tileOffsets[t] > static_cast<size_t>(ifp->size) || tileBytes[t] > static_cast<size_t>(ifp->size) - tileOffsets[t]) {
+                fprintf(stderr, "DNG Deflate: Tile %d is out of the file\n", (int)t);
+                continue;
             }
-            int err = decompress(tileBytes[t], dstLen, cBuffer, uBuffer);
+            int err = decompress(tileBytes[t], dstLen, reinterpret_cast<unsigned char *>(ifp->data) + tileOffsets[t], uBuffer);
             if (err != Z_OK) {
                 fprintf(stderr, "DNG Deflate: Failed uncompressing tile %d, with error %d\n", (int)t, err);
             } else if (ifd->sample_format == 3) {  // Floating point data
@@ -11050,7 +11272,6 @@ void CLASS deflate_dng_load_raw() {
         }
     }
 
-    delete [] cBuffer;
     delete [] uBuffer;
 }
   }
@@ -64,6 +64,7 @@ public:
     ,RT_blacklevel_from_constant(ThreeValBool::X)
     ,RT_matrix_from_constant(ThreeValBool::X)
     ,RT_baseline_exposure(0)
+    ,RT_header_only(false)
 	,getbithuff(this,ifp,zero_after_ff)
 	,nikbithuff(ifp)
     {
@@ -123,13 +124,9 @@ protected:
 
     struct fuji_compressed_block {
         int         cur_bit;         // current bit being read (from left to right)
-        int         cur_pos;         // current position in a buffer
-        INT64       cur_buf_offset;  // offset of this buffer in a file
-        unsigned	max_read_size;	 // Amount of data to be read
-        int         cur_buf_size;    // buffer size
-        uchar       *cur_buf;        // currently read block
-        int         fillbytes;          // Counter to add extra byte for block size N*16
-        rtengine::IMFILE      *input;
+        int         cur_pos;         // current position in the strip
+        int         cur_buf_size;    // size of the strip
+        const uchar *cur_buf;        // data of the strip, in the file
         struct int_pair grad_even[3][41];    // tables of gradients
         struct int_pair grad_odd[3][41];
         ushort		*linealloc;
@@ -162,6 +159,7 @@ protected:
     ThreeValBool RT_matrix_from_constant;
     std::string RT_software;
     double RT_baseline_exposure;
+    bool RT_header_only; // identify() only fills what is needed for the thumbnail and the metadata
 
     struct PanasonicRW2Info {
         ushort bpp;
@@ -252,9 +250,13 @@ protected:
         off_t levels, unknown1, flatfield;
     } hbd;
 
+    // bits looked up at once to decode a lossless JPEG difference, see ljpeg_make_fast()
+    static constexpr int LJPEG_FAST_BITS = 12;
+
     struct jhead {
       int algo, bits, high, wide, clrs, sraw, psv, restart, vpred[6];
       ushort quant[64], idct[64], *huff[20], *free[20], *row;
+      int *fast[20], *fastbuf;
     };
 
     struct tiff_tag {
@@ -284,9 +286,9 @@ int fcol (int row, int col);
 void merror (void *ptr, const char *where);
 void derror();
 inline void derror(bool condition) {if(UNLIKELY(condition)) ++data_error;}
-ushort sget2 (uchar *s);
+ushort sget2 (const uchar *s);
 ushort get2();
-unsigned sget4 (uchar *s);
+unsigned sget4 (const uchar *s);
 unsigned get4();
 unsigned getint (int type);
 float int_to_float (int i);
@@ -309,6 +311,8 @@ class getbithuff_t
 public:
    getbithuff_t(DCraw *p,rtengine::IMFILE *&i, unsigned &z):parent(p),bitbuf(0),vbits(0),reset(0),ifp(i),zero_after_ff(z){}
    unsigned operator()(int nbits, ushort *huff);
+   unsigned peek(int nbits);
+   bool skip(int nbits);
 
 private:
    void derror(){
@@ -328,6 +332,8 @@ public:
    explicit nikbithuff_t(rtengine::IMFILE *&i):bitbuf(0),errors(0),vbits(0),ifp(i){}
    void operator()() {bitbuf = vbits = 0;};
    unsigned operator()(int nbits, ushort *huff);
+   unsigned peek(int nbits);
+   bool skip(int nbits);
    unsigned errorCount() { return errors; }
 private:
    inline bool derror(bool condition){
@@ -348,23 +354,29 @@ void crw_init_tables (unsigned table, ushort *huff[2]);
 int canon_has_lowbits();
 void canon_load_raw();
 int ljpeg_start (struct jhead *jh, int info_only);
+int ljpeg_start (struct jhead *jh, int info_only, rtengine::IMFILE *ifp, unsigned &zero_after_ff);
 void ljpeg_end (struct jhead *jh);
+void ljpeg_make_fast (const ushort *huff, int *fast);
 int ljpeg_diff (ushort *huff);
+int ljpeg_diff (ushort *huff, const int *fast, getbithuff_t &getbithuff);
 ushort * ljpeg_row (int jrow, struct jhead *jh);
+ushort * ljpeg_row (int jrow, struct jhead *jh, rtengine::IMFILE *ifp, getbithuff_t &getbithuff);
+ushort * ljpeg_decode_intervals (struct jhead *jh);
 void lossless_jpeg_load_raw();
 void ljpeg_idct (struct jhead *jh);
 
 
 void canon_sraw_load_raw();
 void adobe_copy_pixel (unsigned row, unsigned col, ushort **rp);
+bool lossless_dng_load_tiles();
 void lossless_dng_load_raw();
 void packed_dng_load_raw();
 void deflate_dng_load_raw();
 void init_fuji_compr(struct fuji_compressed_params* info);
-void fuji_fill_buffer(struct fuji_compressed_block *info);
 void init_fuji_block(struct fuji_compressed_block* info, const struct fuji_compressed_params *params, INT64 raw_offset, unsigned dsize);
 void copy_line_to_xtrans(struct fuji_compressed_block* info, int cur_line, int cur_block, int cur_block_width);
 void copy_line_to_bayer(struct fuji_compressed_block* info, int cur_line, int cur_block, int cur_block_width);
+unsigned fuji_peek_word(const struct fuji_compressed_block* info);
 void fuji_zerobits(struct fuji_compressed_block* info, int *count);
 void fuji_read_code(struct fuji_compressed_block* info, int *data, int bits_to_read);
 int fuji_decode_sample_even(struct fuji_compressed_block* info, const struct fuji_compressed_params * params, ushort* line_buf, int pos, struct int_pair* grads);
@@ -382,6 +394,7 @@ void fuji_decode_loop(const struct fuji_compressed_params* common_info, int coun
 void parse_fuji_compressed_header();
 void fuji_14bit_load_raw();    
 void pentax_load_raw();
+int nikon_diff (ushort *huff, const int *fast);
 void nikon_load_raw();
 int nikon_is_compressed();
 int nikon_e995();
@@ -596,7 +609,7 @@ void selectCRXTrack(unsigned short maxTrack);
 int parseCR3(unsigned long long oAtomList,
              unsigned long long szAtomList, short &nesting,
              char *AtomNameStack, short &nTrack, short &TrackType);
-bool crxDecodePlane(void *p, uint32_t planeNumber);
+bool crxDecodeTile(void *p, int tileNumber, uint32_t planeNumber);
 void crxLoadDecodeLoop(void *img, int nPlanes);
 void crxConvertPlaneLineDf(void *p, int imageRow);
 void crxLoadFinalizeLoopE3(void *p, int planeHeight);
@@ -18,6 +18,7 @@
  */
 #include <cmath>
 #include <cassert>
+#include <cstring>
 
 #include "rawimagesource.h"
 #include "rawimage.h"
@@ -220,25 +221,31 @@ void RawImageSource::igv_interpolate(int winw, int winh)
     static const float eps = 1e-5f, epssq = 1e-5f; //mod epssq -10f =>-5f Jacques 3/2013 to prevent artifact (divide by zero)
 
     static const int h1 = 1, h2 = 2, h3 = 3, h5 = 5;
-    const int width = winw, height = winh;
-    const int v1 = 1 * width, v2 = 2 * width, v3 = 3 * width, v5 = 5 * width;
-    float* rgb[2];
-    float* chr[4];
-    float *rgbarray, *vdif, *hdif, *chrarray;
-    rgbarray    = (float (*)) malloc((width * height) * sizeof( float ) );
-    rgb[0] = rgbarray;
-    rgb[1] = rgbarray + (width * height) / 2;
-
-    vdif  = (float (*)) calloc( width * height / 2, sizeof * vdif );
-    hdif  = (float (*)) calloc( width * height / 2, sizeof * hdif );
-
-    chrarray    = (float (*)) calloc(static_cast<size_t>(width) * height, sizeof( float ) );
-    chr[0] = chrarray;
-    chr[1] = chrarray + (width * height) / 2;
-
-    // mapped chr[2] and chr[3] to hdif and hdif, because these are out of use, when chr[2] and chr[3] are used
-    chr[2] = hdif;
-    chr[3] = vdif;
+    // The passes run on tiles which fit into the L2 cache. The tiles overlap by more than the
+    // reach of the passes (at most 20 pixels), so the result does not depend on the tiling.
+    // Tiles start on multiples of 16 pixels, where the cfa pattern repeats, so FC() can take
+    // coordinates inside a tile.
+    constexpr int tileBorder = 32;
+    constexpr int tileSize = 256;
+    constexpr int tileSizeN = tileSize - 2 * tileBorder;
+    const int numTh = winh / tileSizeN + ((winh % tileSizeN) ? 1 : 0);
+    const int numTw = winw / tileSizeN + ((winw % tileSizeN) ? 1 : 0);
+    // rgb and chr with tileSize * tileSize floats, vdif and hdif with half of it
+    constexpr size_t bufferSize = 3 * tileSize * tileSize;
+#ifdef _OPENMP
+    const int numThreads = omp_get_max_threads();
+#else
+    const int numThreads = 1;
+#endif
+    float *buffers = (float *)malloc(numThreads * bufferSize * sizeof(float));
+
+    if (buffers == nullptr) {
+        printf("igv_interpolate: allocation of the tile buffers failed, falling back to nodemosaic\n");
+        nodemosaic(false);
+        return;
+    }
+
+    double progress = 0.0;
 
     if (plistener) {
         plistener->setProgressStr (Glib::ustring::compose(M("TP_RAW_DMETHOD_PROGRESSBAR"), M("TP_RAW_IGV")));
@@ -246,7 +253,7 @@ void RawImageSource::igv_interpolate(int winw, int winh)
     }
 
 #ifdef _OPENMP
-    #pragma omp parallel shared(rgb,vdif,hdif,chr)
+    #pragma omp parallel num_threads(numThreads)
 #endif
     {
         __m128 ngv, egv, wgv, sgv, nvv, evv, wvv, svv, nwgv, negv, swgv, segv, nwvv, nevv, swvv, sevv, tempv, temp1v, temp2v, temp3v, temp4v, temp5v, temp6v, temp7v, temp8v;
@@ -273,360 +280,357 @@ void RawImageSource::igv_interpolate(int winw, int winh)
         float *dest1, *dest2;
         float ng, eg, wg, sg, nv, ev, wv, sv, nwg, neg, swg, seg, nwv, nev, swv, sev;
 #ifdef _OPENMP
-        #pragma omp for
+        float *buffer = buffers + omp_get_thread_num() * bufferSize;
+#else
+        float *buffer = buffers;
 #endif
-
-        for (int row = 0; row < height - 0; row++) {
-            dest1 = rgb[FC(row, 0) & 1];
-            dest2 = rgb[FC(row, 1) & 1];
-            int col, indx;
-
-            for (col = 0, indx = row * width + col; col < width - 7; col += 8, indx += 8) {
-                temp1v = LVFU( rawData[row][col] );
-                temp1v = vmaxf(temp1v, ZEROV);
-                temp2v = LVFU( rawData[row][col + 4] );
-                temp2v = vmaxf(temp2v, ZEROV);
-                tempv = _mm_shuffle_ps( temp1v, temp2v, _MM_SHUFFLE( 2, 0, 2, 0 ) );
-                _mm_storeu_ps( &dest1[indx >> 1], tempv );
-                tempv = _mm_shuffle_ps( temp1v, temp2v, _MM_SHUFFLE( 3, 1, 3, 1 ) );
-                _mm_storeu_ps( &dest2[indx >> 1], tempv );
-            }
-
-            for (; col < width; col++, indx += 2) {
-                dest1[indx >> 1] = std::max(0.f, rawData[row][col]); //rawData = RT data
-                col++;
-                if(col < width)
-                    dest2[indx >> 1] = std::max(0.f, rawData[row][col]); //rawData = RT data
-            }
-        }
+        int progresscounter = 0;
 
 #ifdef _OPENMP
-        #pragma omp single
+        #pragma omp for schedule(dynamic) collapse(2) nowait
 #endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.13);
-            }
-        }
 
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+        for (int tr = 0; tr < numTh; ++tr) {
+            for (int tc = 0; tc < numTw; ++tc) {
+                // image rows and columns of the tile without its border
+                const int rowStart = tr * tileSizeN;
+                const int rowEnd = std::min(rowStart + tileSizeN, winh);
+                const int colStart = tc * tileSizeN;
+                const int colEnd = std::min(colStart + tileSizeN, winw);
+                // image position and size of the tile including its border, which is cut at the image
+                const int top = std::max(rowStart - tileBorder, 0);
+                const int left = std::max(colStart - tileBorder, 0);
+                const int height = std::min(rowEnd + tileBorder, winh) - top;
+                // the packed planes need an even width, an odd last column is left to border_interpolate
+                const int width = (std::min(colEnd + tileBorder, winw) - left) & ~1;
+                // part of the tile written to the image, border_interpolate does the frame of 7 pixels
+                const int rowFrom = std::max(rowStart - top, 7);
+                const int rowTo = std::min(rowEnd - top, height - 7);
+                const int colFrom = std::max(colStart - left, 7);
+                const int colTo = std::min(colEnd - left, width - 7);
+                const int v1 = 1 * width, v2 = 2 * width, v3 = 3 * width, v5 = 5 * width;
+                float* rgb[2];
+                float* chr[4];
+                float *rgbarray = buffer;
+                float *chrarray = buffer + tileSize * tileSize;
+                float *vdif = chrarray + tileSize * tileSize;
+                float *hdif = vdif + tileSize * tileSize / 2;
+                rgb[0] = rgbarray;
+                rgb[1] = rgbarray + (width * height) / 2;
+                chr[0] = chrarray;
+                chr[1] = chrarray + (width * height) / 2;
+                // mapped chr[2] and chr[3] to hdif and hdif, because these are out of use, when chr[2] and chr[3] are used
+                chr[2] = hdif;
+                chr[3] = vdif;
+                memset(chrarray, 0, static_cast<size_t>(width) * height * sizeof(float));
+                memset(vdif, 0, width * height / 2 * sizeof(float));
+                memset(hdif, 0, width * height / 2 * sizeof(float));
+
+                for (int row = 0; row < height - 0; row++) {
+                    dest1 = rgb[FC(row, 0) & 1];
+                    dest2 = rgb[FC(row, 1) & 1];
+                    int col, indx;
+
+                    for (col = 0, indx = row * width + col; col < width - 7; col += 8, indx += 8) {
+                        temp1v = LVFU( rawData[top + row][left + col] );
+                        temp1v = vmaxf(temp1v, ZEROV);
+                        temp2v = LVFU( rawData[top + row][left + col + 4] );
+                        temp2v = vmaxf(temp2v, ZEROV);
+                        tempv = _mm_shuffle_ps( temp1v, temp2v, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+                        _mm_storeu_ps( &dest1[indx >> 1], tempv );
+                        tempv = _mm_shuffle_ps( temp1v, temp2v, _MM_SHUFFLE( 3, 1, 3, 1 ) );
+                        _mm_storeu_ps( &dest2[indx >> 1], tempv );
+                    }
 
-        for (int row = 5; row < height - 5; row++) {
-            int col, indx, indx1;
-
-            for (col = 5 + (FC(row, 1) & 1), indx = row * width + col, indx1 = indx >> 1; col < width - 12; col += 8, indx += 8, indx1 += 4) {
-                //N,E,W,S Gradients
-                ngv = (epsv + (vabsf(LVFU(rgb[1][(indx - v1) >> 1]) - LVFU(rgb[1][(indx - v3) >> 1])) + vabsf(LVFU(rgb[0][indx1]) - LVFU(rgb[0][(indx1 - v1)]))) / c65535v);
-                egv = (epsv + (vabsf(LVFU(rgb[1][(indx + h1) >> 1]) - LVFU(rgb[1][(indx + h3) >> 1])) + vabsf(LVFU(rgb[0][indx1]) - LVFU(rgb[0][(indx1 + h1)]))) / c65535v);
-                wgv = (epsv + (vabsf(LVFU(rgb[1][(indx - h1) >> 1]) - LVFU(rgb[1][(indx - h3) >> 1])) + vabsf(LVFU(rgb[0][indx1]) - LVFU(rgb[0][(indx1 - h1)]))) / c65535v);
-                sgv = (epsv + (vabsf(LVFU(rgb[1][(indx + v1) >> 1]) - LVFU(rgb[1][(indx + v3) >> 1])) + vabsf(LVFU(rgb[0][indx1]) - LVFU(rgb[0][(indx1 + v1)]))) / c65535v);
-                //N,E,W,S High Order Interpolation (Li & Randhawa)
-                //N,E,W,S Hamilton Adams Interpolation
-                // (48.f * 65535.f) = 3145680.f
-                tempv = c40v * LVFU(rgb[0][indx1]);
-                nvv = vclampf(((c23v * LVFU(rgb[1][(indx - v1) >> 1]) + c23v * LVFU(rgb[1][(indx - v3) >> 1]) + LVFU(rgb[1][(indx - v5) >> 1]) + LVFU(rgb[1][(indx + v1) >> 1]) + tempv - c32v * LVFU(rgb[0][(indx1 - v1)]) - c8v * LVFU(rgb[0][(indx1 - v2)]))) / c3145680v, zerov, onev);
-                evv = vclampf(((c23v * LVFU(rgb[1][(indx + h1) >> 1]) + c23v * LVFU(rgb[1][(indx + h3) >> 1]) + LVFU(rgb[1][(indx + h5) >> 1]) + LVFU(rgb[1][(indx - h1) >> 1]) + tempv - c32v * LVFU(rgb[0][(indx1 + h1)]) - c8v * LVFU(rgb[0][(indx1 + h2)]))) / c3145680v, zerov, onev);
-                wvv = vclampf(((c23v * LVFU(rgb[1][(indx - h1) >> 1]) + c23v * LVFU(rgb[1][(indx - h3) >> 1]) + LVFU(rgb[1][(indx - h5) >> 1]) + LVFU(rgb[1][(indx + h1) >> 1]) + tempv - c32v * LVFU(rgb[0][(indx1 - h1)]) - c8v * LVFU(rgb[0][(indx1 - h2)]))) / c3145680v, zerov, onev);
-                svv = vclampf(((c23v * LVFU(rgb[1][(indx + v1) >> 1]) + c23v * LVFU(rgb[1][(indx + v3) >> 1]) + LVFU(rgb[1][(indx + v5) >> 1]) + LVFU(rgb[1][(indx - v1) >> 1]) + tempv - c32v * LVFU(rgb[0][(indx1 + v1)]) - c8v * LVFU(rgb[0][(indx1 + v2)]))) / c3145680v, zerov, onev);
-                //Horizontal and vertical color differences
-                tempv = LVFU( rgb[0][indx1] ) / c65535v;
-                _mm_storeu_ps( &vdif[indx1], (sgv * nvv + ngv * svv) / (ngv + sgv) - tempv );
-                _mm_storeu_ps( &hdif[indx1], (wgv * evv + egv * wvv) / (egv + wgv) - tempv );
-            }
+                    for (; col < width; col++, indx += 2) {
+                        dest1[indx >> 1] = std::max(0.f, rawData[top + row][left + col]); //rawData = RT data
+                        col++;
+                        if(col < width)
+                            dest2[indx >> 1] = std::max(0.f, rawData[top + row][left + col]); //rawData = RT data
+                    }
+                }
 
-            // borders without SSE
-            for (; col < width - 5; col += 2, indx += 2, indx1++) {
-                //N,E,W,S Gradients
-                ng = (eps + (fabsf(rgb[1][(indx - v1) >> 1] - rgb[1][(indx - v3) >> 1]) + fabsf(rgb[0][indx1] - rgb[0][(indx1 - v1)])) / 65535.f);;
-                eg = (eps + (fabsf(rgb[1][(indx + h1) >> 1] - rgb[1][(indx + h3) >> 1]) + fabsf(rgb[0][indx1] - rgb[0][(indx1 + h1)])) / 65535.f);
-                wg = (eps + (fabsf(rgb[1][(indx - h1) >> 1] - rgb[1][(indx - h3) >> 1]) + fabsf(rgb[0][indx1] - rgb[0][(indx1 - h1)])) / 65535.f);
-                sg = (eps + (fabsf(rgb[1][(indx + v1) >> 1] - rgb[1][(indx + v3) >> 1]) + fabsf(rgb[0][indx1] - rgb[0][(indx1 + v1)])) / 65535.f);
-                //N,E,W,S High Order Interpolation (Li & Randhawa)
-                //N,E,W,S Hamilton Adams Interpolation
-                // (48.f * 65535.f) = 3145680.f
-                nv = LIM(((23.0f * rgb[1][(indx - v1) >> 1] + 23.0f * rgb[1][(indx - v3) >> 1] + rgb[1][(indx - v5) >> 1] + rgb[1][(indx + v1) >> 1] + 40.0f * rgb[0][indx1] - 32.0f * rgb[0][(indx1 - v1)] - 8.0f * rgb[0][(indx1 - v2)])) / 3145680.f, 0.0f, 1.0f);
-                ev = LIM(((23.0f * rgb[1][(indx + h1) >> 1] + 23.0f * rgb[1][(indx + h3) >> 1] + rgb[1][(indx + h5) >> 1] + rgb[1][(indx - h1) >> 1] + 40.0f * rgb[0][indx1] - 32.0f * rgb[0][(indx1 + h1)] - 8.0f * rgb[0][(indx1 + h2)])) / 3145680.f, 0.0f, 1.0f);
-                wv = LIM(((23.0f * rgb[1][(indx - h1) >> 1] + 23.0f * rgb[1][(indx - h3) >> 1] + rgb[1][(indx - h5) >> 1] + rgb[1][(indx + h1) >> 1] + 40.0f * rgb[0][indx1] - 32.0f * rgb[0][(indx1 - h1)] - 8.0f * rgb[0][(indx1 - h2)])) / 3145680.f, 0.0f, 1.0f);
-                sv = LIM(((23.0f * rgb[1][(indx + v1) >> 1] + 23.0f * rgb[1][(indx + v3) >> 1] + rgb[1][(indx + v5) >> 1] + rgb[1][(indx - v1) >> 1] + 40.0f * rgb[0][indx1] - 32.0f * rgb[0][(indx1 + v1)] - 8.0f * rgb[0][(indx1 + v2)])) / 3145680.f, 0.0f, 1.0f);
-                //Horizontal and vertical color differences
-                vdif[indx1] = (sg * nv + ng * sv) / (ng + sg) - (rgb[0][indx1]) / 65535.f;
-                hdif[indx1] = (wg * ev + eg * wv) / (eg + wg) - (rgb[0][indx1]) / 65535.f;
-            }
-        }
+                for (int row = 5; row < height - 5; row++) {
+                    int col, indx, indx1;
+
+                    for (col = 5 + (FC(row, 1) & 1), indx = row * width + col, indx1 = indx >> 1; col < width - 12; col += 8, indx += 8, indx1 += 4) {
+                        //N,E,W,S Gradients
+                        ngv = (epsv + (vabsf(LVFU(rgb[1][(indx - v1) >> 1]) - LVFU(rgb[1][(indx - v3) >> 1])) + vabsf(LVFU(rgb[0][indx1]) - LVFU(rgb[0][(indx1 - v1)]))) / c65535v);
+                        egv = (epsv + (vabsf(LVFU(rgb[1][(indx + h1) >> 1]) - LVFU(rgb[1][(indx + h3) >> 1])) + vabsf(LVFU(rgb[0][indx1]) - LVFU(rgb[0][(indx1 + h1)]))) / c65535v);
+                        wgv = (epsv + (vabsf(LVFU(rgb[1][(indx - h1) >> 1]) - LVFU(rgb[1][(indx - h3) >> 1])) + vabsf(LVFU(rgb[0][indx1]) - LVFU(rgb[0][(indx1 - h1)]))) / c65535v);
+                        sgv = (epsv + (vabsf(LVFU(rgb[1][(indx + v1) >> 1]) - LVFU(rgb[1][(indx + v3) >> 1])) + vabsf(LVFU(rgb[0][indx1]) - LVFU(rgb[0][(indx1 + v1)]))) / c65535v);
+                        //N,E,W,S High Order Interpolation (Li & Randhawa)
+                        //N,E,W,S Hamilton Adams Interpolation
+                        // (48.f * 65535.f) = 3145680.f
+                        tempv = c40v * LVFU(rgb[0][indx1]);
+                        nvv = vclampf(((c23v * LVFU(rgb[1][(indx - v1) >> 1]) + c23v * LVFU(rgb[1][(indx - v3) >> 1]) + LVFU(rgb[1][(indx - v5) >> 1]) + LVFU(rgb[1][(indx + v1) >> 1]) + tempv - c32v * LVFU(rgb[0][(indx1 - v1)]) - c8v * LVFU(rgb[0][(indx1 - v2)]))) / c3145680v, zerov, onev);
+                        evv = vclampf(((c23v * LVFU(rgb[1][(indx + h1) >> 1]) + c23v * LVFU(rgb[1][(indx + h3) >> 1]) + LVFU(rgb[1][(indx + h5) >> 1]) + LVFU(rgb[1][(indx - h1) >> 1]) + tempv - c32v * LVFU(rgb[0][(indx1 + h1)]) - c8v * LVFU(rgb[0][(indx1 + h2)]))) / c3145680v, zerov, onev);
+                        wvv = vclampf(((c23v * LVFU(rgb[1][(indx - h1) >> 1]) + c23v * LVFU(rgb[1][(indx - h3) >> 1]) + LVFU(rgb[1][(indx - h5) >> 1]) + LVFU(rgb[1][(indx + h1) >> 1]) + tempv - c32v * LVFU(rgb[0][(indx1 - h1)]) - c8v * LVFU(rgb[0][(indx1 - h2)]))) / c3145680v, zerov, onev);
+                        svv = vclampf(((c23v * LVFU(rgb[1][(indx + v1) >> 1]) + c23v * LVFU(rgb[1][(indx + v3) >> 1]) + LVFU(rgb[1][(indx + v5) >> 1]) + LVFU(rgb[1][(indx - v1) >> 1]) + tempv - c32v * LVFU(rgb[0][(indx1 + v1)]) - c8v * LVFU(rgb[0][(indx1 + v2)]))) / c3145680v, zerov, onev);
+                        //Horizontal and vertical color differences
+                        tempv = LVFU( rgb[0][indx1] ) / c65535v;
+                        _mm_storeu_ps( &vdif[indx1], (sgv * nvv + ngv * svv) / (ngv + sgv) - tempv );
+                        _mm_storeu_ps( &hdif[indx1], (wgv * evv + egv * wvv) / (egv + wgv) - tempv );
+                    }
 
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.26);
-            }
-        }
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+                    // borders without SSE
+                    for (; col < width - 5; col += 2, indx += 2, indx1++) {
+                        //N,E,W,S Gradients
+                        ng = (eps + (fabsf(rgb[1][(indx - v1) >> 1] - rgb[1][(indx - v3) >> 1]) + fabsf(rgb[0][indx1] - rgb[0][(indx1 - v1)])) / 65535.f);;
+                        eg = (eps + (fabsf(rgb[1][(indx + h1) >> 1] - rgb[1][(indx + h3) >> 1]) + fabsf(rgb[0][indx1] - rgb[0][(indx1 + h1)])) / 65535.f);
+                        wg = (eps + (fabsf(rgb[1][(indx - h1) >> 1] - rgb[1][(indx - h3) >> 1]) + fabsf(rgb[0][indx1] - rgb[0][(indx1 - h1)])) / 65535.f);
+                        sg = (eps + (fabsf(rgb[1][(indx + v1) >> 1] - rgb[1][(indx + v3) >> 1]) + fabsf(rgb[0][indx1] - rgb[0][(indx1 + v1)])) / 65535.f);
+                        //N,E,W,S High Order Interpolation (Li & Randhawa)
+                        //N,E,W,S Hamilton Adams Interpolation
+                        // (48.f * 65535.f) = 3145680.f
+                        nv = LIM(((23.0f * rgb[1][(indx - v1) >> 1] + 23.0f * rgb[1][(indx - v3) >> 1] + rgb[1][(indx - v5) >> 1] + rgb[1][(indx + v1) >> 1] + 40.0f * rgb[0][indx1] - 32.0f * rgb[0][(indx1 - v1)] - 8.0f * rgb[0][(indx1 - v2)])) / 3145680.f, 0.0f, 1.0f);
+                        ev = LIM(((23.0f * rgb[1][(indx + h1) >> 1] + 23.0f * rgb[1][(indx + h3) >> 1] + rgb[1][(indx + h5) >> 1] + rgb[1][(indx - h1) >> 1] + 40.0f * rgb[0][indx1] - 32.0f * rgb[0][(indx1 + h1)] - 8.0f * rgb[0][(indx1 + h2)])) / 3145680.f, 0.0f, 1.0f);
+                        wv = LIM(((23.0f * rgb[1][(indx - h1) >> 1] + 23.0f * rgb[1][(indx - h3) >> 1] + rgb[1][(indx - h5) >> 1] + rgb[1][(indx + h1) >> 1] + 40.0f * rgb[0][indx1] - 32.0f * rgb[0][(indx1 - h1)] - 8.0f * rgb[0][(indx1 - h2)])) / 3145680.f, 0.0f, 1.0f);
+                        sv = LIM(((23.0f * rgb[1][(indx + v1) >> 1] + 23.0f * rgb[1][(indx + v3) >> 1] + rgb[1][(indx + v5) >> 1] + rgb[1][(indx - v1) >> 1] + 40.0f * rgb[0][indx1] - 32.0f * rgb[0][(indx1 + v1)] - 8.0f * rgb[0][(indx1 + v2)])) / 3145680.f, 0.0f, 1.0f);
+                        //Horizontal and vertical color differences
+                        vdif[indx1] = (sg * nv + ng * sv) / (ng + sg) - (rgb[0][indx1]) / 65535.f;
+                        hdif[indx1] = (wg * ev + eg * wv) / (eg + wg) - (rgb[0][indx1]) / 65535.f;
+                    }
+                }
 
-        for (int row = 7; row < height - 7; row++) {
-            int col, d, indx1;
-
-            for (col = 7 + (FC(row, 1) & 1), indx1 = (row * width + col) >> 1, d = FC(row, col) / 2; col < width - 14; col += 8, indx1 += 4) {
-                //H&V integrated gaussian vector over variance on color differences
-                //Mod Jacques 3/2013
-                ngv = vclampf(epssqv + c78v * SQRV(LVFU(vdif[indx1])) + c69v * (SQRV(LVFU(vdif[indx1 - v1])) + SQRV(LVFU(vdif[indx1 + v1]))) + c51v * (SQRV(LVFU(vdif[indx1 - v2])) + SQRV(LVFU(vdif[indx1 + v2]))) + c21v * (SQRV(LVFU(vdif[indx1 - v3])) + SQRV(LVFU(vdif[indx1 + v3]))) - c6v * SQRV(LVFU(vdif[indx1 - v1]) + LVFU(vdif[indx1]) + LVFU(vdif[indx1 + v1]))
-                           - c10v * (SQRV(LVFU(vdif[indx1 - v2]) + LVFU(vdif[indx1 - v1]) + LVFU(vdif[indx1])) + SQRV(LVFU(vdif[indx1]) + LVFU(vdif[indx1 + v1]) + LVFU(vdif[indx1 + v2]))) - c7v * (SQRV(LVFU(vdif[indx1 - v3]) + LVFU(vdif[indx1 - v2]) + LVFU(vdif[indx1 - v1])) + SQRV(LVFU(vdif[indx1 + v1]) + LVFU(vdif[indx1 + v2]) + LVFU(vdif[indx1 + v3]))), zerov, onev);
-                egv = vclampf(epssqv + c78v * SQRV(LVFU(hdif[indx1])) + c69v * (SQRV(LVFU(hdif[indx1 - h1])) + SQRV(LVFU(hdif[indx1 + h1]))) + c51v * (SQRV(LVFU(hdif[indx1 - h2])) + SQRV(LVFU(hdif[indx1 + h2]))) + c21v * (SQRV(LVFU(hdif[indx1 - h3])) + SQRV(LVFU(hdif[indx1 + h3]))) - c6v * SQRV(LVFU(hdif[indx1 - h1]) + LVFU(hdif[indx1]) + LVFU(hdif[indx1 + h1]))
-                           - c10v * (SQRV(LVFU(hdif[indx1 - h2]) + LVFU(hdif[indx1 - h1]) + LVFU(hdif[indx1])) + SQRV(LVFU(hdif[indx1]) + LVFU(hdif[indx1 + h1]) + LVFU(hdif[indx1 + h2]))) - c7v * (SQRV(LVFU(hdif[indx1 - h3]) + LVFU(hdif[indx1 - h2]) + LVFU(hdif[indx1 - h1])) + SQRV(LVFU(hdif[indx1 + h1]) + LVFU(hdif[indx1 + h2]) + LVFU(hdif[indx1 + h3]))), zerov, onev);
-                //Limit chrominance using H/V neighbourhood
-                nvv = median(d725v * LVFU(vdif[indx1]) + d1375v * LVFU(vdif[indx1 - v1]) + d1375v * LVFU(vdif[indx1 + v1]), LVFU(vdif[indx1 - v1]), LVFU(vdif[indx1 + v1]));
-                evv = median(d725v * LVFU(hdif[indx1]) + d1375v * LVFU(hdif[indx1 - h1]) + d1375v * LVFU(hdif[indx1 + h1]), LVFU(hdif[indx1 - h1]), LVFU(hdif[indx1 + h1]));
-                //Chrominance estimation
-                tempv = (egv * nvv + ngv * evv) / (ngv + egv);
-                _mm_storeu_ps(&(chr[d][indx1]), tempv);
-                //Green channel population
-                temp1v = c65535v * tempv + LVFU(rgb[0][indx1]);
-                _mm_storeu_ps( &(rgb[0][indx1]), temp1v );
-            }
+                for (int row = 7; row < height - 7; row++) {
+                    int col, d, indx1;
+
+                    for (col = 7 + (FC(row, 1) & 1), indx1 = (row * width + col) >> 1, d = FC(row, col) / 2; col < width - 14; col += 8, indx1 += 4) {
+                        //H&V integrated gaussian vector over variance on color differences
+                        //Mod Jacques 3/2013
+                        ngv = vclampf(epssqv + c78v * SQRV(LVFU(vdif[indx1])) + c69v * (SQRV(LVFU(vdif[indx1 - v1])) + SQRV(LVFU(vdif[indx1 + v1]))) + c51v * (SQRV(LVFU(vdif[indx1 - v2])) + SQRV(LVFU(vdif[indx1 + v2]))) + c21v * (SQRV(LVFU(vdif[indx1 - v3])) + SQRV(LVFU(vdif[indx1 + v3]))) - c6v * SQRV(LVFU(vdif[indx1 - v1]) + LVFU(vdif[indx1]) + LVFU(vdif[indx1 + v1]))
+                                   - c10v * (SQRV(LVFU(vdif[indx1 - v2]) + LVFU(vdif[indx1 - v1]) + LVFU(vdif[indx1])) + SQRV(LVFU(vdif[indx1]) + LVFU(vdif[indx1 + v1]) + LVFU(vdif[indx1 + v2]))) - c7v * (SQRV(LVFU(vdif[indx1 - v3]) + LVFU(vdif[indx1 - v2]) + LVFU(vdif[indx1 - v1])) + SQRV(LVFU(vdif[indx1 + v1]) + LVFU(vdif[indx1 + v2]) + LVFU(vdif[indx1 + v3]))), zerov, onev);
+                        egv = vclampf(epssqv + c78v * SQRV(LVFU(hdif[indx1])) + c69v * (SQRV(LVFU(hdif[indx1 - h1])) + SQRV(LVFU(hdif[indx1 + h1]))) + c51v * (SQRV(LVFU(hdif[indx1 - h2])) + SQRV(LVFU(hdif[indx1 + h2]))) + c21v * (SQRV(LVFU(hdif[indx1 - h3])) + SQRV(LVFU(hdif[indx1 + h3]))) - c6v * SQRV(LVFU(hdif[indx1 - h1]) + LVFU(hdif[indx1]) + LVFU(hdif[indx1 + h1]))
+                                   - c10v * (SQRV(LVFU(hdif[indx1 - h2]) + LVFU(hdif[indx1 - h1]) + LVFU(hdif[indx1])) + SQRV(LVFU(hdif[indx1]) + LVFU(hdif[indx1 + h1]) + LVFU(hdif[indx1 + h2]))) - c7v * (SQRV(LVFU(hdif[indx1 - h3]) + LVFU(hdif[indx1 - h2]) + LVFU(hdif[indx1 - h1])) + SQRV(LVFU(hdif[indx1 + h1]) + LVFU(hdif[indx1 + h2]) + LVFU(hdif[indx1 + h3]))), zerov, onev);
+                        //Limit chrominance using H/V neighbourhood
+                        nvv = median(d725v * LVFU(vdif[indx1]) + d1375v * LVFU(vdif[indx1 - v1]) + d1375v * LVFU(vdif[indx1 + v1]), LVFU(vdif[indx1 - v1]), LVFU(vdif[indx1 + v1]));
+                        evv = median(d725v * LVFU(hdif[indx1]) + d1375v * LVFU(hdif[indx1 - h1]) + d1375v * LVFU(hdif[indx1 + h1]), LVFU(hdif[indx1 - h1]), LVFU(hdif[indx1 + h1]));
+                        //Chrominance estimation
+                        tempv = (egv * nvv + ngv * evv) / (ngv + egv);
+                        _mm_storeu_ps(&(chr[d][indx1]), tempv);
+                        //Green channel population
+                        temp1v = c65535v * tempv + LVFU(rgb[0][indx1]);
+                        _mm_storeu_ps( &(rgb[0][indx1]), temp1v );
+                    }
 
-            for (; col < width - 7; col += 2, indx1++) {
-                //H&V integrated gaussian vector over variance on color differences
-                //Mod Jacques 3/2013
-                ng = LIM(epssq + 78.0f * SQR(vdif[indx1]) + 69.0f * (SQR(vdif[indx1 - v1]) + SQR(vdif[indx1 + v1])) + 51.0f * (SQR(vdif[indx1 - v2]) + SQR(vdif[indx1 + v2])) + 21.0f * (SQR(vdif[indx1 - v3]) + SQR(vdif[indx1 + v3])) - 6.0f * SQR(vdif[indx1 - v1] + vdif[indx1] + vdif[indx1 + v1])
-                         - 10.0f * (SQR(vdif[indx1 - v2] + vdif[indx1 - v1] + vdif[indx1]) + SQR(vdif[indx1] + vdif[indx1 + v1] + vdif[indx1 + v2])) - 7.0f * (SQR(vdif[indx1 - v3] + vdif[indx1 - v2] + vdif[indx1 - v1]) + SQR(vdif[indx1 + v1] + vdif[indx1 + v2] + vdif[indx1 + v3])), 0.f, 1.f);
-                eg = LIM(epssq + 78.0f * SQR(hdif[indx1]) + 69.0f * (SQR(hdif[indx1 - h1]) + SQR(hdif[indx1 + h1])) + 51.0f * (SQR(hdif[indx1 - h2]) + SQR(hdif[indx1 + h2])) + 21.0f * (SQR(hdif[indx1 - h3]) + SQR(hdif[indx1 + h3])) - 6.0f * SQR(hdif[indx1 - h1] + hdif[indx1] + hdif[indx1 + h1])
-                         - 10.0f * (SQR(hdif[indx1 - h2] + hdif[indx1 - h1] + hdif[indx1]) + SQR(hdif[indx1] + hdif[indx1 + h1] + hdif[indx1 + h2])) - 7.0f * (SQR(hdif[indx1 - h3] + hdif[indx1 - h2] + hdif[indx1 - h1]) + SQR(hdif[indx1 + h1] + hdif[indx1 + h2] + hdif[indx1 + h3])), 0.f, 1.f);
-                //Limit chrominance using H/V neighbourhood
-                nv = median(0.725f * vdif[indx1] + 0.1375f * vdif[indx1 - v1] + 0.1375f * vdif[indx1 + v1], vdif[indx1 - v1], vdif[indx1 + v1]);
-                ev = median(0.725f * hdif[indx1] + 0.1375f * hdif[indx1 - h1] + 0.1375f * hdif[indx1 + h1], hdif[indx1 - h1], hdif[indx1 + h1]);
-                //Chrominance estimation
-                chr[d][indx1] = (eg * nv + ng * ev) / (ng + eg);
-                //Green channel population
-                rgb[0][indx1] = rgb[0][indx1] + 65535.f * chr[d][indx1];
-            }
-        }
+                    for (; col < width - 7; col += 2, indx1++) {
+                        //H&V integrated gaussian vector over variance on color differences
+                        //Mod Jacques 3/2013
+                        ng = LIM(epssq + 78.0f * SQR(vdif[indx1]) + 69.0f * (SQR(vdif[indx1 - v1]) + SQR(vdif[indx1 + v1])) + 51.0f * (SQR(vdif[indx1 - v2]) + SQR(vdif[indx1 + v2])) + 21.0f * (SQR(vdif[indx1 - v3]) + SQR(vdif[indx1 + v3])) - 6.0f * SQR(vdif[indx1 - v1] + vdif[indx1] + vdif[indx1 + v1])
+                                 - 10.0f * (SQR(vdif[indx1 - v2] + vdif[indx1 - v1] + vdif[indx1]) + SQR(vdif[indx1] + vdif[indx1 + v1] + vdif[indx1 + v2])) - 7.0f * (SQR(vdif[indx1 - v3] + vdif[indx1 - v2] + vdif[indx1 - v1]) + SQR(vdif[indx1 + v1] + vdif[indx1 + v2] + vdif[indx1 + v3])), 0.f, 1.f);
+                        eg = LIM(epssq + 78.0f * SQR(hdif[indx1]) + 69.0f * (SQR(hdif[indx1 - h1]) + SQR(hdif[indx1 + h1])) + 51.0f * (SQR(hdif[indx1 - h2]) + SQR(hdif[indx1 + h2])) + 21.0f * (SQR(hdif[indx1 - h3]) + SQR(hdif[indx1 + h3])) - 6.0f * SQR(hdif[indx1 - h1] + hdif[indx1] + hdif[indx1 + h1])
+                                 - 10.0f * (SQR(hdif[indx1 - h2] + hdif[indx1 - h1] + hdif[indx1]) + SQR(hdif[indx1] + hdif[indx1 + h1] + hdif[indx1 + h2])) - 7.0f * (SQR(hdif[indx1 - h3] + hdif[indx1 - h2] + hdif[indx1 - h1]) + SQR(hdif[indx1 + h1] + hdif[indx1 + h2] + hdif[indx1 + h3])), 0.f, 1.f);
+                        //Limit chrominance using H/V neighbourhood
+                        nv = median(0.725f * vdif[indx1] + 0.1375f * vdif[indx1 - v1] + 0.1375f * vdif[indx1 + v1], vdif[indx1 - v1], vdif[indx1 + v1]);
+                        ev = median(0.725f * hdif[indx1] + 0.1375f * hdif[indx1 - h1] + 0.1375f * hdif[indx1 + h1], hdif[indx1 - h1], hdif[indx1 + h1]);
+                        //Chrominance estimation
+                        chr[d][indx1] = (eg * nv + ng * ev) / (ng + eg);
+                        //Green channel population
+                        rgb[0][indx1] = rgb[0][indx1] + 65535.f * chr[d][indx1];
+                    }
+                }
 
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.39);
-            }
-        }
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+                for (int row = 7; row < height - 7; row++) {
+                    int col, indx, c;
+
+                    for (col = 7 + (FC(row, 1) & 1), indx = row * width + col, c = 1 - FC(row, col) / 2; col < width - 14; col += 8, indx += 8) {
+                        //NW,NE,SW,SE Gradients
+                        nwgv = onev / (epsv + vabsf(LVFU(chr[c][(indx - v1 - h1) >> 1]) - LVFU(chr[c][(indx - v3 - h3) >> 1])) + vabsf(LVFU(chr[c][(indx + v1 + h1) >> 1]) - LVFU(chr[c][(indx - v3 - h3) >> 1])));
+                        negv = onev / (epsv + vabsf(LVFU(chr[c][(indx - v1 + h1) >> 1]) - LVFU(chr[c][(indx - v3 + h3) >> 1])) + vabsf(LVFU(chr[c][(indx + v1 - h1) >> 1]) - LVFU(chr[c][(indx - v3 + h3) >> 1])));
+                        swgv = onev / (epsv + vabsf(LVFU(chr[c][(indx + v1 - h1) >> 1]) - LVFU(chr[c][(indx + v3 + h3) >> 1])) + vabsf(LVFU(chr[c][(indx - v1 + h1) >> 1]) - LVFU(chr[c][(indx + v3 - h3) >> 1])));
+                        segv = onev / (epsv + vabsf(LVFU(chr[c][(indx + v1 + h1) >> 1]) - LVFU(chr[c][(indx + v3 - h3) >> 1])) + vabsf(LVFU(chr[c][(indx - v1 - h1) >> 1]) - LVFU(chr[c][(indx + v3 + h3) >> 1])));
+                        //Limit NW,NE,SW,SE Color differences
+                        nwvv = median(LVFU(chr[c][(indx - v1 - h1) >> 1]), LVFU(chr[c][(indx - v3 - h1) >> 1]), LVFU(chr[c][(indx - v1 - h3) >> 1]));
+                        nevv = median(LVFU(chr[c][(indx - v1 + h1) >> 1]), LVFU(chr[c][(indx - v3 + h1) >> 1]), LVFU(chr[c][(indx - v1 + h3) >> 1]));
+                        swvv = median(LVFU(chr[c][(indx + v1 - h1) >> 1]), LVFU(chr[c][(indx + v3 - h1) >> 1]), LVFU(chr[c][(indx + v1 - h3) >> 1]));
+                        sevv = median(LVFU(chr[c][(indx + v1 + h1) >> 1]), LVFU(chr[c][(indx + v3 + h1) >> 1]), LVFU(chr[c][(indx + v1 + h3) >> 1]));
+                        //Interpolate chrominance: R@B and B@R
+                        tempv = (nwgv * nwvv + negv * nevv + swgv * swvv + segv * sevv) / (nwgv + negv + swgv + segv);
+                        _mm_storeu_ps( &(chr[c][indx >> 1]), tempv);
+                    }
 
-        for (int row = 7; row < height - 7; row++) {
-            int col, indx, c;
-
-            for (col = 7 + (FC(row, 1) & 1), indx = row * width + col, c = 1 - FC(row, col) / 2; col < width - 14; col += 8, indx += 8) {
-                //NW,NE,SW,SE Gradients
-                nwgv = onev / (epsv + vabsf(LVFU(chr[c][(indx - v1 - h1) >> 1]) - LVFU(chr[c][(indx - v3 - h3) >> 1])) + vabsf(LVFU(chr[c][(indx + v1 + h1) >> 1]) - LVFU(chr[c][(indx - v3 - h3) >> 1])));
-                negv = onev / (epsv + vabsf(LVFU(chr[c][(indx - v1 + h1) >> 1]) - LVFU(chr[c][(indx - v3 + h3) >> 1])) + vabsf(LVFU(chr[c][(indx + v1 - h1) >> 1]) - LVFU(chr[c][(indx - v3 + h3) >> 1])));
-                swgv = onev / (epsv + vabsf(LVFU(chr[c][(indx + v1 - h1) >> 1]) - LVFU(chr[c][(indx + v3 + h3) >> 1])) + vabsf(LVFU(chr[c][(indx - v1 + h1) >> 1]) - LVFU(chr[c][(indx + v3 - h3) >> 1])));
-                segv = onev / (epsv + vabsf(LVFU(chr[c][(indx + v1 + h1) >> 1]) - LVFU(chr[c][(indx + v3 - h3) >> 1])) + vabsf(LVFU(chr[c][(indx - v1 - h1) >> 1]) - LVFU(chr[c][(indx + v3 + h3) >> 1])));
-                //Limit NW,NE,SW,SE Color differences
-                nwvv = median(LVFU(chr[c][(indx - v1 - h1) >> 1]), LVFU(chr[c][(indx - v3 - h1) >> 1]), LVFU(chr[c][(indx - v1 - h3) >> 1]));
-                nevv = median(LVFU(chr[c][(indx - v1 + h1) >> 1]), LVFU(chr[c][(indx - v3 + h1) >> 1]), LVFU(chr[c][(indx - v1 + h3) >> 1]));
-                swvv = median(LVFU(chr[c][(indx + v1 - h1) >> 1]), LVFU(chr[c][(indx + v3 - h1) >> 1]), LVFU(chr[c][(indx + v1 - h3) >> 1]));
-                sevv = median(LVFU(chr[c][(indx + v1 + h1) >> 1]), LVFU(chr[c][(indx + v3 + h1) >> 1]), LVFU(chr[c][(indx + v1 + h3) >> 1]));
-                //Interpolate chrominance: R@B and B@R
-                tempv = (nwgv * nwvv + negv * nevv + swgv * swvv + segv * sevv) / (nwgv + negv + swgv + segv);
-                _mm_storeu_ps( &(chr[c][indx >> 1]), tempv);
-            }
+                    for (; col < width - 7; col += 2, indx += 2) {
+                        //NW,NE,SW,SE Gradients
+                        nwg = 1.0f / (eps + fabsf(chr[c][(indx - v1 - h1) >> 1] - chr[c][(indx - v3 - h3) >> 1]) + fabsf(chr[c][(indx + v1 + h1) >> 1] - chr[c][(indx - v3 - h3) >> 1]));
+                        neg = 1.0f / (eps + fabsf(chr[c][(indx - v1 + h1) >> 1] - chr[c][(indx - v3 + h3) >> 1]) + fabsf(chr[c][(indx + v1 - h1) >> 1] - chr[c][(indx - v3 + h3) >> 1]));
+                        swg = 1.0f / (eps + fabsf(chr[c][(indx + v1 - h1) >> 1] - chr[c][(indx + v3 + h3) >> 1]) + fabsf(chr[c][(indx - v1 + h1) >> 1] - chr[c][(indx + v3 - h3) >> 1]));
+                        seg = 1.0f / (eps + fabsf(chr[c][(indx + v1 + h1) >> 1] - chr[c][(indx + v3 - h3) >> 1]) + fabsf(chr[c][(indx - v1 - h1) >> 1] - chr[c][(indx + v3 + h3) >> 1]));
+                        //Limit NW,NE,SW,SE Color differences
+                        nwv = median(chr[c][(indx - v1 - h1) >> 1], chr[c][(indx - v3 - h1) >> 1], chr[c][(indx - v1 - h3) >> 1]);
+                        nev = median(chr[c][(indx - v1 + h1) >> 1], chr[c][(indx - v3 + h1) >> 1], chr[c][(indx - v1 + h3) >> 1]);
+                        swv = median(chr[c][(indx + v1 - h1) >> 1], chr[c][(indx + v3 - h1) >> 1], chr[c][(indx + v1 - h3) >> 1]);
+                        sev = median(chr[c][(indx + v1 + h1) >> 1], chr[c][(indx + v3 + h1) >> 1], chr[c][(indx + v1 + h3) >> 1]);
+                        //Interpolate chrominance: R@B and B@R
+                        chr[c][indx >> 1] = (nwg * nwv + neg * nev + swg * swv + seg * sev) / (nwg + neg + swg + seg);
+                    }
+                }
 
-            for (; col < width - 7; col += 2, indx += 2) {
-                //NW,NE,SW,SE Gradients
-                nwg = 1.0f / (eps + fabsf(chr[c][(indx - v1 - h1) >> 1] - chr[c][(indx - v3 - h3) >> 1]) + fabsf(chr[c][(indx + v1 + h1) >> 1] - chr[c][(indx - v3 - h3) >> 1]));
-                neg = 1.0f / (eps + fabsf(chr[c][(indx - v1 + h1) >> 1] - chr[c][(indx - v3 + h3) >> 1]) + fabsf(chr[c][(indx + v1 - h1) >> 1] - chr[c][(indx - v3 + h3) >> 1]));
-                swg = 1.0f / (eps + fabsf(chr[c][(indx + v1 - h1) >> 1] - chr[c][(indx + v3 + h3) >> 1]) + fabsf(chr[c][(indx - v1 + h1) >> 1] - chr[c][(indx + v3 - h3) >> 1]));
-                seg = 1.0f / (eps + fabsf(chr[c][(indx + v1 + h1) >> 1] - chr[c][(indx + v3 - h3) >> 1]) + fabsf(chr[c][(indx - v1 - h1) >> 1] - chr[c][(indx + v3 + h3) >> 1]));
-                //Limit NW,NE,SW,SE Color differences
-                nwv = median(chr[c][(indx - v1 - h1) >> 1], chr[c][(indx - v3 - h1) >> 1], chr[c][(indx - v1 - h3) >> 1]);
-                nev = median(chr[c][(indx - v1 + h1) >> 1], chr[c][(indx - v3 + h1) >> 1], chr[c][(indx - v1 + h3) >> 1]);
-                swv = median(chr[c][(indx + v1 - h1) >> 1], chr[c][(indx + v3 - h1) >> 1], chr[c][(indx + v1 - h3) >> 1]);
-                sev = median(chr[c][(indx + v1 + h1) >> 1], chr[c][(indx + v3 + h1) >> 1], chr[c][(indx + v1 + h3) >> 1]);
-                //Interpolate chrominance: R@B and B@R
-                chr[c][indx >> 1] = (nwg * nwv + neg * nev + swg * swv + seg * sev) / (nwg + neg + swg + seg);
-            }
-        }
+                for (int row = 7; row < height - 7; row++) {
+                    int col, indx;
+
+                    for (col = 7 + (FC(row, 0) & 1), indx = row * width + col; col < width - 14; col += 8, indx += 8) {
+                        //N,E,W,S Gradients
+                        ngv = onev / (epsv + vabsf(LVFU(chr[0][(indx - v1) >> 1]) - LVFU(chr[0][(indx - v3) >> 1])) + vabsf(LVFU(chr[0][(indx + v1) >> 1]) - LVFU(chr[0][(indx - v3) >> 1])));
+                        egv = onev / (epsv + vabsf(LVFU(chr[0][(indx + h1) >> 1]) - LVFU(chr[0][(indx + h3) >> 1])) + vabsf(LVFU(chr[0][(indx - h1) >> 1]) - LVFU(chr[0][(indx + h3) >> 1])));
+                        wgv = onev / (epsv + vabsf(LVFU(chr[0][(indx - h1) >> 1]) - LVFU(chr[0][(indx - h3) >> 1])) + vabsf(LVFU(chr[0][(indx + h1) >> 1]) - LVFU(chr[0][(indx - h3) >> 1])));
+                        sgv = onev / (epsv + vabsf(LVFU(chr[0][(indx + v1) >> 1]) - LVFU(chr[0][(indx + v3) >> 1])) + vabsf(LVFU(chr[0][(indx - v1) >> 1]) - LVFU(chr[0][(indx + v3) >> 1])));
+                        //Interpolate chrominance: R@G and B@G
+                        tempv = ((ngv * LVFU(chr[0][(indx - v1) >> 1]) + egv * LVFU(chr[0][(indx + h1) >> 1]) + wgv * LVFU(chr[0][(indx - h1) >> 1]) + sgv * LVFU(chr[0][(indx + v1) >> 1])) / (ngv + egv + wgv + sgv));
+                        _mm_storeu_ps( &chr[0 + 2][indx >> 1], tempv);
+                    }
 
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.65);
-            }
-        }
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+                    for (; col < width - 7; col += 2, indx += 2) {
+                        //N,E,W,S Gradients
+                        ng = 1.0f / (eps + fabsf(chr[0][(indx - v1) >> 1] - chr[0][(indx - v3) >> 1]) + fabsf(chr[0][(indx + v1) >> 1] - chr[0][(indx - v3) >> 1]));
+                        eg = 1.0f / (eps + fabsf(chr[0][(indx + h1) >> 1] - chr[0][(indx + h3) >> 1]) + fabsf(chr[0][(indx - h1) >> 1] - chr[0][(indx + h3) >> 1]));
+                        wg = 1.0f / (eps + fabsf(chr[0][(indx - h1) >> 1] - chr[0][(indx - h3) >> 1]) + fabsf(chr[0][(indx + h1) >> 1] - chr[0][(indx - h3) >> 1]));
+                        sg = 1.0f / (eps + fabsf(chr[0][(indx + v1) >> 1] - chr[0][(indx + v3) >> 1]) + fabsf(chr[0][(indx - v1) >> 1] - chr[0][(indx + v3) >> 1]));
+                        //Interpolate chrominance: R@G and B@G
+                        chr[0 + 2][indx >> 1] = ((ng * chr[0][(indx - v1) >> 1] + eg * chr[0][(indx + h1) >> 1] + wg * chr[0][(indx - h1) >> 1] + sg * chr[0][(indx + v1) >> 1]) / (ng + eg + wg + sg));
+                    }
+                }
 
-        for (int row = 7; row < height - 7; row++) {
-            int col, indx;
-
-            for (col = 7 + (FC(row, 0) & 1), indx = row * width + col; col < width - 14; col += 8, indx += 8) {
-                //N,E,W,S Gradients
-                ngv = onev / (epsv + vabsf(LVFU(chr[0][(indx - v1) >> 1]) - LVFU(chr[0][(indx - v3) >> 1])) + vabsf(LVFU(chr[0][(indx + v1) >> 1]) - LVFU(chr[0][(indx - v3) >> 1])));
-                egv = onev / (epsv + vabsf(LVFU(chr[0][(indx + h1) >> 1]) - LVFU(chr[0][(indx + h3) >> 1])) + vabsf(LVFU(chr[0][(indx - h1) >> 1]) - LVFU(chr[0][(indx + h3) >> 1])));
-                wgv = onev / (epsv + vabsf(LVFU(chr[0][(indx - h1) >> 1]) - LVFU(chr[0][(indx - h3) >> 1])) + vabsf(LVFU(chr[0][(indx + h1) >> 1]) - LVFU(chr[0][(indx - h3) >> 1])));
-                sgv = onev / (epsv + vabsf(LVFU(chr[0][(indx + v1) >> 1]) - LVFU(chr[0][(indx + v3) >> 1])) + vabsf(LVFU(chr[0][(indx - v1) >> 1]) - LVFU(chr[0][(indx + v3) >> 1])));
-                //Interpolate chrominance: R@G and B@G
-                tempv = ((ngv * LVFU(chr[0][(indx - v1) >> 1]) + egv * LVFU(chr[0][(indx + h1) >> 1]) + wgv * LVFU(chr[0][(indx - h1) >> 1]) + sgv * LVFU(chr[0][(indx + v1) >> 1])) / (ngv + egv + wgv + sgv));
-                _mm_storeu_ps( &chr[0 + 2][indx >> 1], tempv);
-            }
+                for (int row = 7; row < height - 7; row++) {
+                    int col, indx;
+
+                    for (col = 7 + (FC(row, 0) & 1), indx = row * width + col; col < width - 14; col += 8, indx += 8) {
+                        //N,E,W,S Gradients
+                        ngv = onev / (epsv + vabsf(LVFU(chr[1][(indx - v1) >> 1]) - LVFU(chr[1][(indx - v3) >> 1])) + vabsf(LVFU(chr[1][(indx + v1) >> 1]) - LVFU(chr[1][(indx - v3) >> 1])));
+                        egv = onev / (epsv + vabsf(LVFU(chr[1][(indx + h1) >> 1]) - LVFU(chr[1][(indx + h3) >> 1])) + vabsf(LVFU(chr[1][(indx - h1) >> 1]) - LVFU(chr[1][(indx + h3) >> 1])));
+                        wgv = onev / (epsv + vabsf(LVFU(chr[1][(indx - h1) >> 1]) - LVFU(chr[1][(indx - h3) >> 1])) + vabsf(LVFU(chr[1][(indx + h1) >> 1]) - LVFU(chr[1][(indx - h3) >> 1])));
+                        sgv = onev / (epsv + vabsf(LVFU(chr[1][(indx + v1) >> 1]) - LVFU(chr[1][(indx + v3) >> 1])) + vabsf(LVFU(chr[1][(indx - v1) >> 1]) - LVFU(chr[1][(indx + v3) >> 1])));
+                        //Interpolate chrominance: R@G and B@G
+                        tempv = ((ngv * LVFU(chr[1][(indx - v1) >> 1]) + egv * LVFU(chr[1][(indx + h1) >> 1]) + wgv * LVFU(chr[1][(indx - h1) >> 1]) + sgv * LVFU(chr[1][(indx + v1) >> 1])) / (ngv + egv + wgv + sgv));
+                        _mm_storeu_ps( &chr[1 + 2][indx >> 1], tempv);
+                    }
 
-            for (; col < width - 7; col += 2, indx += 2) {
-                //N,E,W,S Gradients
-                ng = 1.0f / (eps + fabsf(chr[0][(indx - v1) >> 1] - chr[0][(indx - v3) >> 1]) + fabsf(chr[0][(indx + v1) >> 1] - chr[0][(indx - v3) >> 1]));
-                eg = 1.0f / (eps + fabsf(chr[0][(indx + h1) >> 1] - chr[0][(indx + h3) >> 1]) + fabsf(chr[0][(indx - h1) >> 1] - chr[0][(indx + h3) >> 1]));
-                wg = 1.0f / (eps + fabsf(chr[0][(indx - h1) >> 1] - chr[0][(indx - h3) >> 1]) + fabsf(chr[0][(indx + h1) >> 1] - chr[0][(indx - h3) >> 1]));
-                sg = 1.0f / (eps + fabsf(chr[0][(indx + v1) >> 1] - chr[0][(indx + v3) >> 1]) + fabsf(chr[0][(indx - v1) >> 1] - chr[0][(indx + v3) >> 1]));
-                //Interpolate chrominance: R@G and B@G
-                chr[0 + 2][indx >> 1] = ((ng * chr[0][(indx - v1) >> 1] + eg * chr[0][(indx + h1) >> 1] + wg * chr[0][(indx - h1) >> 1] + sg * chr[0][(indx + v1) >> 1]) / (ng + eg + wg + sg));
-            }
-        }
+                    for (; col < width - 7; col += 2, indx += 2) {
+                        //N,E,W,S Gradients
+                        ng = 1.0f / (eps + fabsf(chr[1][(indx - v1) >> 1] - chr[1][(indx - v3) >> 1]) + fabsf(chr[1][(indx + v1) >> 1] - chr[1][(indx - v3) >> 1]));
+                        eg = 1.0f / (eps + fabsf(chr[1][(indx + h1) >> 1] - chr[1][(indx + h3) >> 1]) + fabsf(chr[1][(indx - h1) >> 1] - chr[1][(indx + h3) >> 1]));
+                        wg = 1.0f / (eps + fabsf(chr[1][(indx - h1) >> 1] - chr[1][(indx - h3) >> 1]) + fabsf(chr[1][(indx + h1) >> 1] - chr[1][(indx - h3) >> 1]));
+                        sg = 1.0f / (eps + fabsf(chr[1][(indx + v1) >> 1] - chr[1][(indx + v3) >> 1]) + fabsf(chr[1][(indx - v1) >> 1] - chr[1][(indx + v3) >> 1]));
+                        //Interpolate chrominance: R@G and B@G
+                        chr[1 + 2][indx >> 1] = ((ng * chr[1][(indx - v1) >> 1] + eg * chr[1][(indx + h1) >> 1] + wg * chr[1][(indx - h1) >> 1] + sg * chr[1][(indx + v1) >> 1]) / (ng + eg + wg + sg));
+                    }
+                }
 
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.78);
-            }
-        }
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+                float *src1, *src2, *redsrc0, *redsrc1, *bluesrc0, *bluesrc1;
+
+                for(int row = rowFrom; row < rowTo; row++) {
+                    int col, indx, fc;
+                    fc = FC(row, colFrom) & 1;
+                    src1 = rgb[fc];
+                    src2 = rgb[fc ^ 1];
+                    redsrc0 = chr[fc << 1];
+                    redsrc1 = chr[(fc ^ 1) << 1];
+                    bluesrc0 = chr[(fc << 1) + 1];
+                    bluesrc1 = chr[((fc ^ 1) << 1) + 1];
+
+                    for(col = colFrom, indx = row * width + col; col < colTo - 7; col += 8, indx += 8) {
+                        temp1v = LVFU( src1[indx >> 1] );
+                        temp2v = LVFU( src2[(indx + 1) >> 1] );
+                        tempv = _mm_shuffle_ps( temp1v, temp2v, _MM_SHUFFLE( 1, 0, 1, 0 ) );
+                        tempv = _mm_shuffle_ps( tempv, tempv, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+                        _mm_storeu_ps( &green[top + row][left + col], vmaxf(tempv, ZEROV));
+                        temp5v = LVFU(redsrc0[indx >> 1]);
+                        temp6v = LVFU(redsrc1[(indx + 1) >> 1]);
+                        temp3v = _mm_shuffle_ps( temp5v, temp6v, _MM_SHUFFLE( 1, 0, 1, 0 ) );
+                        temp3v = _mm_shuffle_ps( temp3v, temp3v, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+                        temp3v = vmaxf(tempv - c65535v * temp3v, ZEROV);
+                        _mm_storeu_ps( &red[top + row][left + col], temp3v);
+                        temp7v = LVFU(bluesrc0[indx >> 1]);
+                        temp8v = LVFU(bluesrc1[(indx + 1) >> 1]);
+                        temp4v = _mm_shuffle_ps( temp7v, temp8v, _MM_SHUFFLE( 1, 0, 1, 0 ) );
+                        temp4v = _mm_shuffle_ps( temp4v, temp4v, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+                        temp4v = vmaxf(tempv - c65535v * temp4v, ZEROV);
+                        _mm_storeu_ps( &blue[top + row][left + col], temp4v);
+
+                        tempv = _mm_shuffle_ps( temp1v, temp2v, _MM_SHUFFLE( 3, 2, 3, 2 ) );
+                        tempv = _mm_shuffle_ps( tempv, tempv, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+                        _mm_storeu_ps( &green[top + row][left + col + 4], vmaxf(tempv, ZEROV));
+
+                        temp3v = _mm_shuffle_ps( temp5v, temp6v, _MM_SHUFFLE( 3, 2, 3, 2 ) );
+                        temp3v = _mm_shuffle_ps( temp3v, temp3v, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+                        temp3v = vmaxf(tempv - c65535v * temp3v, ZEROV);
+                        _mm_storeu_ps( &red[top + row][left + col + 4], temp3v);
+                        temp4v = _mm_shuffle_ps( temp7v, temp8v, _MM_SHUFFLE( 3, 2, 3, 2 ) );
+                        temp4v = _mm_shuffle_ps( temp4v, temp4v, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+                        temp4v = vmaxf(tempv - c65535v * temp4v, ZEROV);
+                        _mm_storeu_ps( &blue[top + row][left + col + 4], temp4v);
+                    }
 
-        for (int row = 7; row < height - 7; row++) {
-            int col, indx;
-
-            for (col = 7 + (FC(row, 0) & 1), indx = row * width + col; col < width - 14; col += 8, indx += 8) {
-                //N,E,W,S Gradients
-                ngv = onev / (epsv + vabsf(LVFU(chr[1][(indx - v1) >> 1]) - LVFU(chr[1][(indx - v3) >> 1])) + vabsf(LVFU(chr[1][(indx + v1) >> 1]) - LVFU(chr[1][(indx - v3) >> 1])));
-                egv = onev / (epsv + vabsf(LVFU(chr[1][(indx + h1) >> 1]) - LVFU(chr[1][(indx + h3) >> 1])) + vabsf(LVFU(chr[1][(indx - h1) >> 1]) - LVFU(chr[1][(indx + h3) >> 1])));
-                wgv = onev / (epsv + vabsf(LVFU(chr[1][(indx - h1) >> 1]) - LVFU(chr[1][(indx - h3) >> 1])) + vabsf(LVFU(chr[1][(indx + h1) >> 1]) - LVFU(chr[1][(indx - h3) >> 1])));
-                sgv = onev / (epsv + vabsf(LVFU(chr[1][(indx + v1) >> 1]) - LVFU(chr[1][(indx + v3) >> 1])) + vabsf(LVFU(chr[1][(indx - v1) >> 1]) - LVFU(chr[1][(indx + v3) >> 1])));
-                //Interpolate chrominance: R@G and B@G
-                tempv = ((ngv * LVFU(chr[1][(indx - v1) >> 1]) + egv * LVFU(chr[1][(indx + h1) >> 1]) + wgv * LVFU(chr[1][(indx - h1) >> 1]) + sgv * LVFU(chr[1][(indx + v1) >> 1])) / (ngv + egv + wgv + sgv));
-                _mm_storeu_ps( &chr[1 + 2][indx >> 1], tempv);
-            }
+                    for(; col < colTo; col++, indx += 2) {
+                        red  [top + row][left + col] = std::max(0.f, src1[indx >> 1] - 65535.f * redsrc0[indx >> 1]);
+                        green[top + row][left + col] = std::max(0.f, src1[indx >> 1]);
+                        blue [top + row][left + col] = std::max(0.f, src1[indx >> 1] - 65535.f * bluesrc0[indx >> 1]);
+                        col++;
+
+                        if (col < colTo) {
+                            red  [top + row][left + col] = std::max(0.f, src2[(indx + 1) >> 1] - 65535.f * redsrc1[(indx + 1) >> 1]);
+                            green[top + row][left + col] = std::max(0.f, src2[(indx + 1) >> 1]);
+                            blue [top + row][left + col] = std::max(0.f, src2[(indx + 1) >> 1] - 65535.f * bluesrc1[(indx + 1) >> 1]);
+                        }
+                    }
+                }
 
-            for (; col < width - 7; col += 2, indx += 2) {
-                //N,E,W,S Gradients
-                ng = 1.0f / (eps + fabsf(chr[1][(indx - v1) >> 1] - chr[1][(indx - v3) >> 1]) + fabsf(chr[1][(indx + v1) >> 1] - chr[1][(indx - v3) >> 1]));
-                eg = 1.0f / (eps + fabsf(chr[1][(indx + h1) >> 1] - chr[1][(indx + h3) >> 1]) + fabsf(chr[1][(indx - h1) >> 1] - chr[1][(indx + h3) >> 1]));
-                wg = 1.0f / (eps + fabsf(chr[1][(indx - h1) >> 1] - chr[1][(indx - h3) >> 1]) + fabsf(chr[1][(indx + h1) >> 1] - chr[1][(indx - h3) >> 1]));
-                sg = 1.0f / (eps + fabsf(chr[1][(indx + v1) >> 1] - chr[1][(indx + v3) >> 1]) + fabsf(chr[1][(indx - v1) >> 1] - chr[1][(indx + v3) >> 1]));
-                //Interpolate chrominance: R@G and B@G
-                chr[1 + 2][indx >> 1] = ((ng * chr[1][(indx - v1) >> 1] + eg * chr[1][(indx + h1) >> 1] + wg * chr[1][(indx - h1) >> 1] + sg * chr[1][(indx + v1) >> 1]) / (ng + eg + wg + sg));
-            }
-        }
+                if (plistener) {
+                    progresscounter++;
 
+                    if (progresscounter % 16 == 0) {
 #ifdef _OPENMP
-        #pragma omp single
+                        #pragma omp critical (igvprogress)
 #endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.91);
-            }
-        }
-        float *src1, *src2, *redsrc0, *redsrc1, *bluesrc0, *bluesrc1;
-#ifdef _OPENMP
-        #pragma omp for
-#endif
-
-        for(int row = 7; row < height - 7; row++) {
-            int col, indx, fc;
-            fc = FC(row, 7) & 1;
-            src1 = rgb[fc];
-            src2 = rgb[fc ^ 1];
-            redsrc0 = chr[fc << 1];
-            redsrc1 = chr[(fc ^ 1) << 1];
-            bluesrc0 = chr[(fc << 1) + 1];
-            bluesrc1 = chr[((fc ^ 1) << 1) + 1];
-
-            for(col = 7, indx = row * width + col; col < width - 14; col += 8, indx += 8) {
-                temp1v = LVFU( src1[indx >> 1] );
-                temp2v = LVFU( src2[(indx + 1) >> 1] );
-                tempv = _mm_shuffle_ps( temp1v, temp2v, _MM_SHUFFLE( 1, 0, 1, 0 ) );
-                tempv = _mm_shuffle_ps( tempv, tempv, _MM_SHUFFLE( 3, 1, 2, 0 ) );
-                _mm_storeu_ps( &green[row][col], vmaxf(tempv, ZEROV));
-                temp5v = LVFU(redsrc0[indx >> 1]);
-                temp6v = LVFU(redsrc1[(indx + 1) >> 1]);
-                temp3v = _mm_shuffle_ps( temp5v, temp6v, _MM_SHUFFLE( 1, 0, 1, 0 ) );
-                temp3v = _mm_shuffle_ps( temp3v, temp3v, _MM_SHUFFLE( 3, 1, 2, 0 ) );
-                temp3v = vmaxf(tempv - c65535v * temp3v, ZEROV);
-                _mm_storeu_ps( &red[row][col], temp3v);
-                temp7v = LVFU(bluesrc0[indx >> 1]);
-                temp8v = LVFU(bluesrc1[(indx + 1) >> 1]);
-                temp4v = _mm_shuffle_ps( temp7v, temp8v, _MM_SHUFFLE( 1, 0, 1, 0 ) );
-                temp4v = _mm_shuffle_ps( temp4v, temp4v, _MM_SHUFFLE( 3, 1, 2, 0 ) );
-                temp4v = vmaxf(tempv - c65535v * temp4v, ZEROV);
-                _mm_storeu_ps( &blue[row][col], temp4v);
-
-                tempv = _mm_shuffle_ps( temp1v, temp2v, _MM_SHUFFLE( 3, 2, 3, 2 ) );
-                tempv = _mm_shuffle_ps( tempv, tempv, _MM_SHUFFLE( 3, 1, 2, 0 ) );
-                _mm_storeu_ps( &green[row][col + 4], vmaxf(tempv, ZEROV));
-
-                temp3v = _mm_shuffle_ps( temp5v, temp6v, _MM_SHUFFLE( 3, 2, 3, 2 ) );
-                temp3v = _mm_shuffle_ps( temp3v, temp3v, _MM_SHUFFLE( 3, 1, 2, 0 ) );
-                temp3v = vmaxf(tempv - c65535v * temp3v, ZEROV);
-                _mm_storeu_ps( &red[row][col + 4], temp3v);
-                temp4v = _mm_shuffle_ps( temp7v, temp8v, _MM_SHUFFLE( 3, 2, 3, 2 ) );
-                temp4v = _mm_shuffle_ps( temp4v, temp4v, _MM_SHUFFLE( 3, 1, 2, 0 ) );
-                temp4v = vmaxf(tempv - c65535v * temp4v, ZEROV);
-                _mm_storeu_ps( &blue[row][col + 4], temp4v);
-            }
-
-            for(; col < width - 7; col++, indx += 2) {
-                red  [row][col] = std::max(0.f, src1[indx >> 1] - 65535.f * redsrc0[indx >> 1]);
-                green[row][col] = std::max(0.f, src1[indx >> 1]);
-                blue [row][col] = std::max(0.f, src1[indx >> 1] - 65535.f * bluesrc0[indx >> 1]);
-                col++;
-                red  [row][col] = std::max(0.f, src2[(indx + 1) >> 1] - 65535.f * redsrc1[(indx + 1) >> 1]);
-                green[row][col] = std::max(0.f, src2[(indx + 1) >> 1]);
-                blue [row][col] = std::max(0.f, src2[(indx + 1) >> 1] - 65535.f * bluesrc1[(indx + 1) >> 1]);
+                        {
+                            progress += 16.0 * tileSizeN * tileSizeN / (winh * winw);
+                            progress = progress > 1.0 ? 1.0 : progress;
+                            plistener->setProgress(progress);
+                        }
+                    }
+                }
             }
         }
     }// End of parallelization
+
+    free(buffers);
     border_interpolate(winw, winh, 8, rawData, red, green, blue);
 
     if (plistener) {
         plistener->setProgress (1.0);
     }
-
-    free(chrarray);
-    free(rgbarray);
-    free(vdif);
-    free(hdif);
 }
 #else
 void RawImageSource::igv_interpolate(int winw, int winh)
 {
     static const float eps = 1e-5f, epssq = 1e-5f; //mod epssq -10f =>-5f Jacques 3/2013 to prevent artifact (divide by zero)
-    static const int h1 = 1, h2 = 2, h3 = 3, h4 = 4, h5 = 5, h6 = 6;
-    const int width = winw, height = winh;
-    const int v1 = 1 * width, v2 = 2 * width, v3 = 3 * width, v4 = 4 * width, v5 = 5 * width, v6 = 6 * width;
-    float* rgb[3];
-    float* chr[2];
-    float *rgbarray, *vdif, *hdif, *chrarray;
 
-    rgbarray    = (float (*)) calloc(width * height * 3, sizeof( float));
-    rgb[0] = rgbarray;
-    rgb[1] = rgbarray + (width * height);
-    rgb[2] = rgbarray + 2 * (width * height);
+    static const int h1 = 1, h2 = 2, h3 = 3, h4 = 4, h5 = 5, h6 = 6;
+    // The passes run on tiles which fit into the L2 cache. The tiles overlap by more than the
+    // reach of the passes (at most 20 pixels), so the result does not depend on the tiling.
+    // Tiles start on multiples of 16 pixels, where the cfa pattern repeats, so FC() can take
+    // coordinates inside a tile.
+    constexpr int tileBorder = 32;
+    constexpr int tileSize = 256;
+    constexpr int tileSizeN = tileSize - 2 * tileBorder;
+    const int numTh = winh / tileSizeN + ((winh % tileSizeN) ? 1 : 0);
+    const int numTw = winw / tileSizeN + ((winw % tileSizeN) ? 1 : 0);
+    // rgb with 3 * tileSize * tileSize floats, chr with 2 * tileSize * tileSize, vdif and hdif with half of tileSize * tileSize
+    constexpr size_t bufferSize = 6 * tileSize * tileSize;
+#ifdef _OPENMP
+    const int numThreads = omp_get_max_threads();
+#else
+    const int numThreads = 1;
+#endif
+    float *buffers = (float *)malloc(numThreads * bufferSize * sizeof(float));
 
-    chrarray    = (float (*)) calloc(width * height * 2, sizeof( float));
-    chr[0] = chrarray;
-    chr[1] = chrarray + (width * height);
+    if (buffers == nullptr) {
+        printf("igv_interpolate: allocation of the tile buffers failed, falling back to nodemosaic\n");
+        nodemosaic(false);
+        return;
+    }
 
-    vdif  = (float (*))    calloc(width * height / 2, sizeof * vdif);
-    hdif  = (float (*))    calloc(width * height / 2, sizeof * hdif);
+    double progress = 0.0;
 
     if (plistener) {
         plistener->setProgressStr (Glib::ustring::compose(M("TP_RAW_DMETHOD_PROGRESSBAR"), M("TP_RAW_IGV")));
@@ -634,234 +638,198 @@ void RawImageSource::igv_interpolate(int winw, int winh)
     }
 
 #ifdef _OPENMP
-    #pragma omp parallel shared(rgb,vdif,hdif,chr)
+    #pragma omp parallel num_threads(numThreads)
 #endif
     {
 
         float ng, eg, wg, sg, nv, ev, wv, sv, nwg, neg, swg, seg, nwv, nev, swv, sev;
-
 #ifdef _OPENMP
-        #pragma omp for
-#endif
-
-        for (int row = 0; row < height - 0; row++)
-            for (int col = 0, indx = row * width + col; col < width - 0; col++, indx++) {
-                int c = FC(row, col);
-                rgb[c][indx] = std::max(0.f, rawData[row][col]); //rawData = RT data
-            }
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.13);
-            }
-        }
-
-#ifdef _OPENMP
-        #pragma omp for
-#endif
-
-        for (int row = 5; row < height - 5; row++)
-            for (int col = 5 + (FC(row, 1) & 1), indx = row * width + col, c = FC(row, col); col < width - 5; col += 2, indx += 2) {
-                //N,E,W,S Gradients
-                ng = (eps + (fabsf(rgb[1][indx - v1] - rgb[1][indx - v3]) + fabsf(rgb[c][indx] - rgb[c][indx - v2])) / 65535.f);;
-                eg = (eps + (fabsf(rgb[1][indx + h1] - rgb[1][indx + h3]) + fabsf(rgb[c][indx] - rgb[c][indx + h2])) / 65535.f);
-                wg = (eps + (fabsf(rgb[1][indx - h1] - rgb[1][indx - h3]) + fabsf(rgb[c][indx] - rgb[c][indx - h2])) / 65535.f);
-                sg = (eps + (fabsf(rgb[1][indx + v1] - rgb[1][indx + v3]) + fabsf(rgb[c][indx] - rgb[c][indx + v2])) / 65535.f);
-                //N,E,W,S High Order Interpolation (Li & Randhawa)
-                //N,E,W,S Hamilton Adams Interpolation
-                // (48.f * 65535.f) = 3145680.f
-                nv = LIM(((23.0f * rgb[1][indx - v1] + 23.0f * rgb[1][indx - v3] + rgb[1][indx - v5] + rgb[1][indx + v1] + 40.0f * rgb[c][indx] - 32.0f * rgb[c][indx - v2] - 8.0f * rgb[c][indx - v4])) / 3145680.f, 0.0f, 1.0f);
-                ev = LIM(((23.0f * rgb[1][indx + h1] + 23.0f * rgb[1][indx + h3] + rgb[1][indx + h5] + rgb[1][indx - h1] + 40.0f * rgb[c][indx] - 32.0f * rgb[c][indx + h2] - 8.0f * rgb[c][indx + h4])) / 3145680.f, 0.0f, 1.0f);
-                wv = LIM(((23.0f * rgb[1][indx - h1] + 23.0f * rgb[1][indx - h3] + rgb[1][indx - h5] + rgb[1][indx + h1] + 40.0f * rgb[c][indx] - 32.0f * rgb[c][indx - h2] - 8.0f * rgb[c][indx - h4])) / 3145680.f, 0.0f, 1.0f);
-                sv = LIM(((23.0f * rgb[1][indx + v1] + 23.0f * rgb[1][indx + v3] + rgb[1][indx + v5] + rgb[1][indx - v1] + 40.0f * rgb[c][indx] - 32.0f * rgb[c][indx + v2] - 8.0f * rgb[c][indx + v4])) / 3145680.f, 0.0f, 1.0f);
-                //Horizontal and vertical color differences
-                vdif[indx >> 1] = (sg * nv + ng * sv) / (ng + sg) - (rgb[c][indx]) / 65535.f;
-                hdif[indx >> 1] = (wg * ev + eg * wv) / (eg + wg) - (rgb[c][indx]) / 65535.f;
-            }
-
-#ifdef _OPENMP
-        #pragma omp single
+        float *buffer = buffers + omp_get_thread_num() * bufferSize;
+#else
+        float *buffer = buffers;
 #endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.26);
-            }
-        }
+        int progresscounter = 0;
 
 #ifdef _OPENMP
-        #pragma omp for
+        #pragma omp for schedule(dynamic) collapse(2) nowait
 #endif
 
-        for (int row = 7; row < height - 7; row++)
-            for (int col = 7 + (FC(row, 1) & 1), indx = row * width + col, c = FC(row, col), d = c / 2; col < width - 7; col += 2, indx += 2) {
-                //H&V integrated gaussian vector over variance on color differences
-                //Mod Jacques 3/2013
-                ng = LIM(epssq + 78.0f * SQR(vdif[indx >> 1]) + 69.0f * (SQR(vdif[(indx - v2) >> 1]) + SQR(vdif[(indx + v2) >> 1])) + 51.0f * (SQR(vdif[(indx - v4) >> 1]) + SQR(vdif[(indx + v4) >> 1])) + 21.0f * (SQR(vdif[(indx - v6) >> 1]) + SQR(vdif[(indx + v6) >> 1])) - 6.0f * SQR(vdif[(indx - v2) >> 1] + vdif[indx >> 1] + vdif[(indx + v2) >> 1])
-                         - 10.0f * (SQR(vdif[(indx - v4) >> 1] + vdif[(indx - v2) >> 1] + vdif[indx >> 1]) + SQR(vdif[indx >> 1] + vdif[(indx + v2) >> 1] + vdif[(indx + v4) >> 1])) - 7.0f * (SQR(vdif[(indx - v6) >> 1] + vdif[(indx - v4) >> 1] + vdif[(indx - v2) >> 1]) + SQR(vdif[(indx + v2) >> 1] + vdif[(indx + v4) >> 1] + vdif[(indx + v6) >> 1])), 0.f, 1.f);
-                eg = LIM(epssq + 78.0f * SQR(hdif[indx >> 1]) + 69.0f * (SQR(hdif[(indx - h2) >> 1]) + SQR(hdif[(indx + h2) >> 1])) + 51.0f * (SQR(hdif[(indx - h4) >> 1]) + SQR(hdif[(indx + h4) >> 1])) + 21.0f * (SQR(hdif[(indx - h6) >> 1]) + SQR(hdif[(indx + h6) >> 1])) - 6.0f * SQR(hdif[(indx - h2) >> 1] + hdif[indx >> 1] + hdif[(indx + h2) >> 1])
-                         - 10.0f * (SQR(hdif[(indx - h4) >> 1] + hdif[(indx - h2) >> 1] + hdif[indx >> 1]) + SQR(hdif[indx >> 1] + hdif[(indx + h2) >> 1] + hdif[(indx + h4) >> 1])) - 7.0f * (SQR(hdif[(indx - h6) >> 1] + hdif[(indx - h4) >> 1] + hdif[(indx - h2) >> 1]) + SQR(hdif[(indx + h2) >> 1] + hdif[(indx + h4) >> 1] + hdif[(indx + h6) >> 1])), 0.f, 1.f);
-                //Limit chrominance using H/V neighbourhood
-                nv = median(0.725f * vdif[indx >> 1] + 0.1375f * vdif[(indx - v2) >> 1] + 0.1375f * vdif[(indx + v2) >> 1], vdif[(indx - v2) >> 1], vdif[(indx + v2) >> 1]);
-                ev = median(0.725f * hdif[indx >> 1] + 0.1375f * hdif[(indx - h2) >> 1] + 0.1375f * hdif[(indx + h2) >> 1], hdif[(indx - h2) >> 1], hdif[(indx + h2) >> 1]);
-                //Chrominance estimation
-                chr[d][indx] = (eg * nv + ng * ev) / (ng + eg);
-                //Green channel population
-                rgb[1][indx] = rgb[c][indx] + 65535.f * chr[d][indx];
-            }
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.39);
-            }
-        }
+        for (int tr = 0; tr < numTh; ++tr) {
+            for (int tc = 0; tc < numTw; ++tc) {
+                // image rows and columns of the tile without its border
+                const int rowStart = tr * tileSizeN;
+                const int rowEnd = std::min(rowStart + tileSizeN, winh);
+                const int colStart = tc * tileSizeN;
+                const int colEnd = std::min(colStart + tileSizeN, winw);
+                // image position and size of the tile including its border, which is cut at the image
+                const int top = std::max(rowStart - tileBorder, 0);
+                const int left = std::max(colStart - tileBorder, 0);
+                const int height = std::min(rowEnd + tileBorder, winh) - top;
+                const int width = std::min(colEnd + tileBorder, winw) - left;
+                // part of the tile written to the image, border_interpolate does the frame of 7 pixels
+                const int rowFrom = std::max(rowStart - top, 7);
+                const int rowTo = std::min(rowEnd - top, height - 7);
+                const int colFrom = std::max(colStart - left, 7);
+                const int colTo = std::min(colEnd - left, width - 7);
+                const int v1 = 1 * width, v2 = 2 * width, v3 = 3 * width, v4 = 4 * width, v5 = 5 * width, v6 = 6 * width;
+                float* rgb[3];
+                float* chr[2];
+                float *rgbarray = buffer;
+                float *chrarray = buffer + 3 * tileSize * tileSize;
+                float *vdif = chrarray + 2 * tileSize * tileSize;
+                float *hdif = vdif + tileSize * tileSize / 2;
+                rgb[0] = rgbarray;
+                rgb[1] = rgbarray + (width * height);
+                rgb[2] = rgbarray + 2 * (width * height);
+                chr[0] = chrarray;
+                chr[1] = chrarray + (width * height);
+                memset(rgbarray, 0, 3 * width * height * sizeof(float));
+                memset(chrarray, 0, 2 * width * height * sizeof(float));
+                memset(vdif, 0, width * height / 2 * sizeof(float));
+                memset(hdif, 0, width * height / 2 * sizeof(float));
+
+                for (int row = 0; row < height - 0; row++)
+                    for (int col = 0, indx = row * width + col; col < width - 0; col++, indx++) {
+                        int c = FC(row, col);
+                        rgb[c][indx] = std::max(0.f, rawData[top + row][left + col]); //rawData = RT data
+                    }
 
-//  free(vdif); free(hdif);
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+                for (int row = 5; row < height - 5; row++)
+                    for (int col = 5 + (FC(row, 1) & 1), indx = row * width + col, c = FC(row, col); col < width - 5; col += 2, indx += 2) {
+                        //N,E,W,S Gradients
+                        ng = (eps + (fabsf(rgb[1][indx - v1] - rgb[1][indx - v3]) + fabsf(rgb[c][indx] - rgb[c][indx - v2])) / 65535.f);;
+                        eg = (eps + (fabsf(rgb[1][indx + h1] - rgb[1][indx + h3]) + fabsf(rgb[c][indx] - rgb[c][indx + h2])) / 65535.f);
+                        wg = (eps + (fabsf(rgb[1][indx - h1] - rgb[1][indx - h3]) + fabsf(rgb[c][indx] - rgb[c][indx - h2])) / 65535.f);
+                        sg = (eps + (fabsf(rgb[1][indx + v1] - rgb[1][indx + v3]) + fabsf(rgb[c][indx] - rgb[c][indx + v2])) / 65535.f);
+                        //N,E,W,S High Order Interpolation (Li & Randhawa)
+                        //N,E,W,S Hamilton Adams Interpolation
+                        // (48.f * 65535.f) = 3145680.f
+                        nv = LIM(((23.0f * rgb[1][indx - v1] + 23.0f * rgb[1][indx - v3] + rgb[1][indx - v5] + rgb[1][indx + v1] + 40.0f * rgb[c][indx] - 32.0f * rgb[c][indx - v2] - 8.0f * rgb[c][indx - v4])) / 3145680.f, 0.0f, 1.0f);
+                        ev = LIM(((23.0f * rgb[1][indx + h1] + 23.0f * rgb[1][indx + h3] + rgb[1][indx + h5] + rgb[1][indx - h1] + 40.0f * rgb[c][indx] - 32.0f * rgb[c][indx + h2] - 8.0f * rgb[c][indx + h4])) / 3145680.f, 0.0f, 1.0f);
+                        wv = LIM(((23.0f * rgb[1][indx - h1] + 23.0f * rgb[1][indx - h3] + rgb[1][indx - h5] + rgb[1][indx + h1] + 40.0f * rgb[c][indx] - 32.0f * rgb[c][indx - h2] - 8.0f * rgb[c][indx - h4])) / 3145680.f, 0.0f, 1.0f);
+                        sv = LIM(((23.0f * rgb[1][indx + v1] + 23.0f * rgb[1][indx + v3] + rgb[1][indx + v5] + rgb[1][indx - v1] + 40.0f * rgb[c][indx] - 32.0f * rgb[c][indx + v2] - 8.0f * rgb[c][indx + v4])) / 3145680.f, 0.0f, 1.0f);
+                        //Horizontal and vertical color differences
+                        vdif[indx >> 1] = (sg * nv + ng * sv) / (ng + sg) - (rgb[c][indx]) / 65535.f;
+                        hdif[indx >> 1] = (wg * ev + eg * wv) / (eg + wg) - (rgb[c][indx]) / 65535.f;
+                    }
 
-        for (int row = 7; row < height - 7; row += 2)
-            for (int col = 7 + (FC(row, 1) & 1), indx = row * width + col, c = 1 - FC(row, col) / 2; col < width - 7; col += 2, indx += 2) {
-                //NW,NE,SW,SE Gradients
-                nwg = 1.0f / (eps + fabsf(chr[c][indx - v1 - h1] - chr[c][indx - v3 - h3]) + fabsf(chr[c][indx + v1 + h1] - chr[c][indx - v3 - h3]));
-                neg = 1.0f / (eps + fabsf(chr[c][indx - v1 + h1] - chr[c][indx - v3 + h3]) + fabsf(chr[c][indx + v1 - h1] - chr[c][indx - v3 + h3]));
-                swg = 1.0f / (eps + fabsf(chr[c][indx + v1 - h1] - chr[c][indx + v3 + h3]) + fabsf(chr[c][indx - v1 + h1] - chr[c][indx + v3 - h3]));
-                seg = 1.0f / (eps + fabsf(chr[c][indx + v1 + h1] - chr[c][indx + v3 - h3]) + fabsf(chr[c][indx - v1 - h1] - chr[c][indx + v3 + h3]));
-                //Limit NW,NE,SW,SE Color differences
-                nwv = median(chr[c][indx - v1 - h1], chr[c][indx - v3 - h1], chr[c][indx - v1 - h3]);
-                nev = median(chr[c][indx - v1 + h1], chr[c][indx - v3 + h1], chr[c][indx - v1 + h3]);
-                swv = median(chr[c][indx + v1 - h1], chr[c][indx + v3 - h1], chr[c][indx + v1 - h3]);
-                sev = median(chr[c][indx + v1 + h1], chr[c][indx + v3 + h1], chr[c][indx + v1 + h3]);
-                //Interpolate chrominance: R@B and B@R
-                chr[c][indx] = (nwg * nwv + neg * nev + swg * swv + seg * sev) / (nwg + neg + swg + seg);
-            }
+                for (int row = 7; row < height - 7; row++)
+                    for (int col = 7 + (FC(row, 1) & 1), indx = row * width + col, c = FC(row, col), d = c / 2; col < width - 7; col += 2, indx += 2) {
+                        //H&V integrated gaussian vector over variance on color differences
+                        //Mod Jacques 3/2013
+                        ng = LIM(epssq + 78.0f * SQR(vdif[indx >> 1]) + 69.0f * (SQR(vdif[(indx - v2) >> 1]) + SQR(vdif[(indx + v2) >> 1])) + 51.0f * (SQR(vdif[(indx - v4) >> 1]) + SQR(vdif[(indx + v4) >> 1])) + 21.0f * (SQR(vdif[(indx - v6) >> 1]) + SQR(vdif[(indx + v6) >> 1])) - 6.0f * SQR(vdif[(indx - v2) >> 1] + vdif[indx >> 1] + vdif[(indx + v2) >> 1])
+                                 - 10.0f * (SQR(vdif[(indx - v4) >> 1] + vdif[(indx - v2) >> 1] + vdif[indx >> 1]) + SQR(vdif[indx >> 1] + vdif[(indx + v2) >> 1] + vdif[(indx + v4) >> 1])) - 7.0f * (SQR(vdif[(indx - v6) >> 1] + vdif[(indx - v4) >> 1] + vdif[(indx - v2) >> 1]) + SQR(vdif[(indx + v2) >> 1] + vdif[(indx + v4) >> 1] + vdif[(indx + v6) >> 1])), 0.f, 1.f);
+                        eg = LIM(epssq + 78.0f * SQR(hdif[indx >> 1]) + 69.0f * (SQR(hdif[(indx - h2) >> 1]) + SQR(hdif[(indx + h2) >> 1])) + 51.0f * (SQR(hdif[(indx - h4) >> 1]) + SQR(hdif[(indx + h4) >> 1])) + 21.0f * (SQR(hdif[(indx - h6) >> 1]) + SQR(hdif[(indx + h6) >> 1])) - 6.0f * SQR(hdif[(indx - h2) >> 1] + hdif[indx >> 1] + hdif[(indx + h2) >> 1])
+                                 - 10.0f * (SQR(hdif[(indx - h4) >> 1] + hdif[(indx - h2) >> 1] + hdif[indx >> 1]) + SQR(hdif[indx >> 1] + hdif[(indx + h2) >> 1] + hdif[(indx + h4) >> 1])) - 7.0f * (SQR(hdif[(indx - h6) >> 1] + hdif[(indx - h4) >> 1] + hdif[(indx - h2) >> 1]) + SQR(hdif[(indx + h2) >> 1] + hdif[(indx + h4) >> 1] + hdif[(indx + h6) >> 1])), 0.f, 1.f);
+                        //Limit chrominance using H/V neighbourhood
+                        nv = median(0.725f * vdif[indx >> 1] + 0.1375f * vdif[(indx - v2) >> 1] + 0.1375f * vdif[(indx + v2) >> 1], vdif[(indx - v2) >> 1], vdif[(indx + v2) >> 1]);
+                        ev = median(0.725f * hdif[indx >> 1] + 0.1375f * hdif[(indx - h2) >> 1] + 0.1375f * hdif[(indx + h2) >> 1], hdif[(indx - h2) >> 1], hdif[(indx + h2) >> 1]);
+                        //Chrominance estimation
+                        chr[d][indx] = (eg * nv + ng * ev) / (ng + eg);
+                        //Green channel population
+                        rgb[1][indx] = rgb[c][indx] + 65535.f * chr[d][indx];
+                    }
 
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.52);
-            }
-        }
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+        //  free(vdif); free(hdif);
+
+                for (int row = 7; row < height - 7; row += 2)
+                    for (int col = 7 + (FC(row, 1) & 1), indx = row * width + col, c = 1 - FC(row, col) / 2; col < width - 7; col += 2, indx += 2) {
+                        //NW,NE,SW,SE Gradients
+                        nwg = 1.0f / (eps + fabsf(chr[c][indx - v1 - h1] - chr[c][indx - v3 - h3]) + fabsf(chr[c][indx + v1 + h1] - chr[c][indx - v3 - h3]));
+                        neg = 1.0f / (eps + fabsf(chr[c][indx - v1 + h1] - chr[c][indx - v3 + h3]) + fabsf(chr[c][indx + v1 - h1] - chr[c][indx - v3 + h3]));
+                        swg = 1.0f / (eps + fabsf(chr[c][indx + v1 - h1] - chr[c][indx + v3 + h3]) + fabsf(chr[c][indx - v1 + h1] - chr[c][indx + v3 - h3]));
+                        seg = 1.0f / (eps + fabsf(chr[c][indx + v1 + h1] - chr[c][indx + v3 - h3]) + fabsf(chr[c][indx - v1 - h1] - chr[c][indx + v3 + h3]));
+                        //Limit NW,NE,SW,SE Color differences
+                        nwv = median(chr[c][indx - v1 - h1], chr[c][indx - v3 - h1], chr[c][indx - v1 - h3]);
+                        nev = median(chr[c][indx - v1 + h1], chr[c][indx - v3 + h1], chr[c][indx - v1 + h3]);
+                        swv = median(chr[c][indx + v1 - h1], chr[c][indx + v3 - h1], chr[c][indx + v1 - h3]);
+                        sev = median(chr[c][indx + v1 + h1], chr[c][indx + v3 + h1], chr[c][indx + v1 + h3]);
+                        //Interpolate chrominance: R@B and B@R
+                        chr[c][indx] = (nwg * nwv + neg * nev + swg * swv + seg * sev) / (nwg + neg + swg + seg);
+                    }
 
-        for (int row = 8; row < height - 7; row += 2)
-            for (int col = 7 + (FC(row, 1) & 1), indx = row * width + col, c = 1 - FC(row, col) / 2; col < width - 7; col += 2, indx += 2) {
-                //NW,NE,SW,SE Gradients
-                nwg = 1.0f / (eps + fabsf(chr[c][indx - v1 - h1] - chr[c][indx - v3 - h3]) + fabsf(chr[c][indx + v1 + h1] - chr[c][indx - v3 - h3]));
-                neg = 1.0f / (eps + fabsf(chr[c][indx - v1 + h1] - chr[c][indx - v3 + h3]) + fabsf(chr[c][indx + v1 - h1] - chr[c][indx - v3 + h3]));
-                swg = 1.0f / (eps + fabsf(chr[c][indx + v1 - h1] - chr[c][indx + v3 + h3]) + fabsf(chr[c][indx - v1 + h1] - chr[c][indx + v3 - h3]));
-                seg = 1.0f / (eps + fabsf(chr[c][indx + v1 + h1] - chr[c][indx + v3 - h3]) + fabsf(chr[c][indx - v1 - h1] - chr[c][indx + v3 + h3]));
-                //Limit NW,NE,SW,SE Color differences
-                nwv = median(chr[c][indx - v1 - h1], chr[c][indx - v3 - h1], chr[c][indx - v1 - h3]);
-                nev = median(chr[c][indx - v1 + h1], chr[c][indx - v3 + h1], chr[c][indx - v1 + h3]);
-                swv = median(chr[c][indx + v1 - h1], chr[c][indx + v3 - h1], chr[c][indx + v1 - h3]);
-                sev = median(chr[c][indx + v1 + h1], chr[c][indx + v3 + h1], chr[c][indx + v1 + h3]);
-                //Interpolate chrominance: R@B and B@R
-                chr[c][indx] = (nwg * nwv + neg * nev + swg * swv + seg * sev) / (nwg + neg + swg + seg);
-            }
+                for (int row = 8; row < height - 7; row += 2)
+                    for (int col = 7 + (FC(row, 1) & 1), indx = row * width + col, c = 1 - FC(row, col) / 2; col < width - 7; col += 2, indx += 2) {
+                        //NW,NE,SW,SE Gradients
+                        nwg = 1.0f / (eps + fabsf(chr[c][indx - v1 - h1] - chr[c][indx - v3 - h3]) + fabsf(chr[c][indx + v1 + h1] - chr[c][indx - v3 - h3]));
+                        neg = 1.0f / (eps + fabsf(chr[c][indx - v1 + h1] - chr[c][indx - v3 + h3]) + fabsf(chr[c][indx + v1 - h1] - chr[c][indx - v3 + h3]));
+                        swg = 1.0f / (eps + fabsf(chr[c][indx + v1 - h1] - chr[c][indx + v3 + h3]) + fabsf(chr[c][indx - v1 + h1] - chr[c][indx + v3 - h3]));
+                        seg = 1.0f / (eps + fabsf(chr[c][indx + v1 + h1] - chr[c][indx + v3 - h3]) + fabsf(chr[c][indx - v1 - h1] - chr[c][indx + v3 + h3]));
+                        //Limit NW,NE,SW,SE Color differences
+                        nwv = median(chr[c][indx - v1 - h1], chr[c][indx - v3 - h1], chr[c][indx - v1 - h3]);
+                        nev = median(chr[c][indx - v1 + h1], chr[c][indx - v3 + h1], chr[c][indx - v1 + h3]);
+                        swv = median(chr[c][indx + v1 - h1], chr[c][indx + v3 - h1], chr[c][indx + v1 - h3]);
+                        sev = median(chr[c][indx + v1 + h1], chr[c][indx + v3 + h1], chr[c][indx + v1 + h3]);
+                        //Interpolate chrominance: R@B and B@R
+                        chr[c][indx] = (nwg * nwv + neg * nev + swg * swv + seg * sev) / (nwg + neg + swg + seg);
+                    }
 
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.65);
-            }
-        }
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+                for (int row = 7; row < height - 7; row++)
+                    for (int col = 7 + (FC(row, 0) & 1), indx = row * width + col; col < width - 7; col += 2, indx += 2) {
+                        //N,E,W,S Gradients
+                        ng = 1.0f / (eps + fabsf(chr[0][indx - v1] - chr[0][indx - v3]) + fabsf(chr[0][indx + v1] - chr[0][indx - v3]));
+                        eg = 1.0f / (eps + fabsf(chr[0][indx + h1] - chr[0][indx + h3]) + fabsf(chr[0][indx - h1] - chr[0][indx + h3]));
+                        wg = 1.0f / (eps + fabsf(chr[0][indx - h1] - chr[0][indx - h3]) + fabsf(chr[0][indx + h1] - chr[0][indx - h3]));
+                        sg = 1.0f / (eps + fabsf(chr[0][indx + v1] - chr[0][indx + v3]) + fabsf(chr[0][indx - v1] - chr[0][indx + v3]));
+                        //Interpolate chrominance: R@G and B@G
+                        chr[0][indx] = ((ng * chr[0][indx - v1] + eg * chr[0][indx + h1] + wg * chr[0][indx - h1] + sg * chr[0][indx + v1]) / (ng + eg + wg + sg));
+                    }
 
-        for (int row = 7; row < height - 7; row++)
-            for (int col = 7 + (FC(row, 0) & 1), indx = row * width + col; col < width - 7; col += 2, indx += 2) {
-                //N,E,W,S Gradients
-                ng = 1.0f / (eps + fabsf(chr[0][indx - v1] - chr[0][indx - v3]) + fabsf(chr[0][indx + v1] - chr[0][indx - v3]));
-                eg = 1.0f / (eps + fabsf(chr[0][indx + h1] - chr[0][indx + h3]) + fabsf(chr[0][indx - h1] - chr[0][indx + h3]));
-                wg = 1.0f / (eps + fabsf(chr[0][indx - h1] - chr[0][indx - h3]) + fabsf(chr[0][indx + h1] - chr[0][indx - h3]));
-                sg = 1.0f / (eps + fabsf(chr[0][indx + v1] - chr[0][indx + v3]) + fabsf(chr[0][indx - v1] - chr[0][indx + v3]));
-                //Interpolate chrominance: R@G and B@G
-                chr[0][indx] = ((ng * chr[0][indx - v1] + eg * chr[0][indx + h1] + wg * chr[0][indx - h1] + sg * chr[0][indx + v1]) / (ng + eg + wg + sg));
-            }
+                for (int row = 7; row < height - 7; row++)
+                    for (int col = 7 + (FC(row, 0) & 1), indx = row * width + col; col < width - 7; col += 2, indx += 2) {
 
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.78);
-            }
-        }
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+                        //N,E,W,S Gradients
+                        ng = 1.0f / (eps + fabsf(chr[1][indx - v1] - chr[1][indx - v3]) + fabsf(chr[1][indx + v1] - chr[1][indx - v3]));
+                        eg = 1.0f / (eps + fabsf(chr[1][indx + h1] - chr[1][indx + h3]) + fabsf(chr[1][indx - h1] - chr[1][indx + h3]));
+                        wg = 1.0f / (eps + fabsf(chr[1][indx - h1] - chr[1][indx - h3]) + fabsf(chr[1][indx + h1] - chr[1][indx - h3]));
+                        sg = 1.0f / (eps + fabsf(chr[1][indx + v1] - chr[1][indx + v3]) + fabsf(chr[1][indx - v1] - chr[1][indx + v3]));
+                        //Interpolate chrominance: R@G and B@G
+                        chr[1][indx] = ((ng * chr[1][indx - v1] + eg * chr[1][indx + h1] + wg * chr[1][indx - h1] + sg * chr[1][indx + v1]) / (ng + eg + wg + sg));
+                    }
 
-        for (int row = 7; row < height - 7; row++)
-            for (int col = 7 + (FC(row, 0) & 1), indx = row * width + col; col < width - 7; col += 2, indx += 2) {
+                /*
+                    for (int row=0; row < height; row++)  //borders
+                        for (int col=0; col < width; col++) {
+                            if (col==7 && row >= 7 && row < height-7)
+                                col = width-7;
+                            int indxc=row*width+col;
+                            red  [row][col] = rgb[indxc][0];
+                            green[row][col] = rgb[indxc][1];
+                            blue [row][col] = rgb[indxc][2];
+                        }
+                */
+
+                for(int row = rowFrom; row < rowTo; row++)
+                    for(int col = colFrom, indx = row * width + col; col < colTo; col++, indx++) {
+                        red  [top + row][left + col] = std::max(0.f, rgb[1][indx] - 65535.f * chr[0][indx]);
+                        green[top + row][left + col] = std::max(0.f, rgb[1][indx]);
+                        blue [top + row][left + col] = std::max(0.f, rgb[1][indx] - 65535.f * chr[1][indx]);
+                    }
 
-                //N,E,W,S Gradients
-                ng = 1.0f / (eps + fabsf(chr[1][indx - v1] - chr[1][indx - v3]) + fabsf(chr[1][indx + v1] - chr[1][indx - v3]));
-                eg = 1.0f / (eps + fabsf(chr[1][indx + h1] - chr[1][indx + h3]) + fabsf(chr[1][indx - h1] - chr[1][indx + h3]));
-                wg = 1.0f / (eps + fabsf(chr[1][indx - h1] - chr[1][indx - h3]) + fabsf(chr[1][indx + h1] - chr[1][indx - h3]));
-                sg = 1.0f / (eps + fabsf(chr[1][indx + v1] - chr[1][indx + v3]) + fabsf(chr[1][indx - v1] - chr[1][indx + v3]));
-                //Interpolate chrominance: R@G and B@G
-                chr[1][indx] = ((ng * chr[1][indx - v1] + eg * chr[1][indx + h1] + wg * chr[1][indx - h1] + sg * chr[1][indx + v1]) / (ng + eg + wg + sg));
-            }
+                if (plistener) {
+                    progresscounter++;
 
+                    if (progresscounter % 16 == 0) {
 #ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.91);
-            }
-        }
-        /*
-#ifdef _OPENMP
-        #pragma omp for
+                        #pragma omp critical (igvprogress)
 #endif
-            for (int row=0; row < height; row++)  //borders
-                for (int col=0; col < width; col++) {
-                    if (col==7 && row >= 7 && row < height-7)
-                        col = width-7;
-                    int indxc=row*width+col;
-                    red  [row][col] = rgb[indxc][0];
-                    green[row][col] = rgb[indxc][1];
-                    blue [row][col] = rgb[indxc][2];
+                        {
+                            progress += 16.0 * tileSizeN * tileSizeN / (winh * winw);
+                            progress = progress > 1.0 ? 1.0 : progress;
+                            plistener->setProgress(progress);
+                        }
+                    }
                 }
-        */
-
-#ifdef _OPENMP
-        #pragma omp for
-#endif
-
-        for(int row = 7; row < height - 7; row++)
-            for(int col = 7, indx = row * width + col; col < width - 7; col++, indx++) {
-                red  [row][col] = std::max(0.f, rgb[1][indx] - 65535.f * chr[0][indx]);
-                green[row][col] = std::max(0.f, rgb[1][indx]);
-                blue [row][col] = std::max(0.f, rgb[1][indx] - 65535.f * chr[1][indx]);
             }
+        }
     }// End of parallelization
-    border_interpolate(winw, winh, 8, rawData, red, green, blue);
 
+    free(buffers);
+    border_interpolate(winw, winh, 8, rawData, red, green, blue);
 
     if (plistener) {
         plistener->setProgress (1.0);
     }
-
-    free(chrarray);
-    free(rgbarray);
-    free(vdif);
-    free(hdif);
 }
 #endif
 
@@ -921,6 +889,58 @@ void RawImageSource::nodemosaic(bool bw)
     }
 }
 
+/*
+ * Averages each colour inside blocks of block x block pixels and fills the
+ * whole block with the result. Used as a stand-in for the first preview of an
+ * image until the real demosaic is done. Any 2x2 Bayer or 3x3 X-Trans window
+ * holds the three colours, the last row and column of blocks are moved
+ * inside the image to keep them complete.
+ */
+void RawImageSource::draft_demosaic(int block)
+{
+    red(W, H);
+    green(W, H);
+    blue(W, H);
+
+    const bool xtrans = ri->getSensorType() == ST_FUJI_XTRANS;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 16)
+#endif
+
+    for (int i = 0; i < H; i += block) {
+        const int top = std::min(i, H - block);
+        const int bottom = std::min(i + block, H);
+
+        for (int j = 0; j < W; j += block) {
+            const int left = std::min(j, W - block);
+            const int right = std::min(j + block, W);
+            float sum[3] = {};
+            int count[3] = {};
+
+            for (int ii = top; ii < top + block; ++ii) {
+                for (int jj = left; jj < left + block; ++jj) {
+                    const unsigned c = xtrans ? ri->XTRANSFC(ii, jj) : FC(ii, jj);
+                    sum[c] += rawData[ii][jj];
+                    ++count[c];
+                }
+            }
+
+            const float r = sum[0] / count[0];
+            const float g = sum[1] / count[1];
+            const float b = sum[2] / count[2];
+
+            for (int ii = i; ii < bottom; ++ii) {
+                for (int jj = j; jj < right; ++jj) {
+                    red[ii][jj] = r;
+                    green[ii][jj] = g;
+                    blue[ii][jj] = b;
+                }
+            }
+        }
+    }
+}
+
 /*
  *      Redistribution and use in source and binary forms, with or without
  *      modification, are permitted provided that the following conditions are
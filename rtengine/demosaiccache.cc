@@ -0,0 +1,440 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <glib/gstdio.h>
+#include <glibmm/checksum.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/miscutils.h>
+#include <zlib.h>
+
+#include "demosaiccache.h"
+
+#include "array2D.h"
+#include "settings.h"
+
+namespace rtengine
+{
+
+namespace
+{
+
+// Bump the version when the file layout or the contents of the planes change
+constexpr char cacheMagic[] = {'R', 'T', 'D', 'M'};
+constexpr std::uint32_t cacheVersion = 1;
+constexpr std::uint32_t byteOrderMark = 0x01020304;
+constexpr int blockRows = 64;
+
+// the planes are scaled to [0;1] before conversion, a half float can't hold values above 65504
+constexpr float planeScale = 65535.f;
+
+// From DNG SDK dng_utils.h, as Imagefloat::DNG_FloatToHalf
+std::uint16_t floatToHalf(float value)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const std::uint32_t sign = (bits >> 16) & 0x8000;
+    std::int32_t exponent = ((bits >> 23) & 0xff) - (127 - 15);
+    std::int32_t mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign;
+        }
+
+        mantissa = (mantissa | 0x800000) >> (1 - exponent);
+
+        if (mantissa & 0x1000) {
+            mantissa += 0x2000;
+        }
+
+        return sign | (mantissa >> 13);
+    } else if (exponent == 0xff - (127 - 15)) {
+        // infinity or nan, neither is expected from demosaic
+        return sign | 0x7bff;
+    }
+
+    if (mantissa & 0x1000) {
+        mantissa += 0x2000;
+
+        if (mantissa & 0x800000) {
+            mantissa = 0;
+            exponent += 1;
+        }
+    }
+
+    if (exponent > 30) {
+        return sign | 0x7bff;
+    }
+
+    return sign | (exponent << 10) | (mantissa >> 13);
+}
+
+// From DNG SDK dng_utils.h, as Imagefloat::DNG_HalfToFloat
+float halfToFloat(std::uint16_t half)
+{
+    const std::uint32_t sign = (half >> 15) & 1;
+    std::int32_t exponent = (half >> 10) & 0x1f;
+    std::int32_t mantissa = half & 0x3ff;
+    std::uint32_t bits;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign << 31;
+        } else {
+            // denormalized number, renormalize it
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent -= 1;
+            }
+
+            exponent += 1;
+            mantissa &= ~0x400;
+            bits = (sign << 31) | ((exponent + (127 - 15)) << 23) | (mantissa << 13);
+        }
+    } else if (exponent == 31) {
+        // not written by floatToHalf
+        return 0.f;
+    } else {
+        bits = (sign << 31) | ((exponent + (127 - 15)) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+Glib::ustring getFileName(const std::string& key)
+{
+    return Glib::build_filename(settings->demosaicCacheDir, key + ".rtd");
+}
+
+// Removes the least recently used files until the cache fits its size
+void trim()
+{
+    struct Entry {
+        Glib::ustring path;
+        std::int64_t size;
+        std::int64_t mtime;
+    };
+
+    std::vector<Entry> entries;
+    std::int64_t total = 0;
+
+    try {
+        Glib::Dir dir(settings->demosaicCacheDir);
+
+        for (Glib::DirIterator entry = dir.begin(); entry != dir.end(); ++entry) {
+            const std::string name = *entry;
+
+            if (name.size() < 4 || name.compare(name.size() - 4, 4, ".rtd")) {
+                continue;
+            }
+
+            const Glib::ustring path = Glib::build_filename(settings->demosaicCacheDir, name);
+            GStatBuf fileStat;
+
+            if (g_stat(path.c_str(), &fileStat) == 0) {
+                entries.push_back({path, static_cast<std::int64_t>(fileStat.st_size), static_cast<std::int64_t>(fileStat.st_mtime)});
+                total += fileStat.st_size;
+            }
+        }
+    } catch (const Glib::Exception&) {
+        return;
+    }
+
+    const std::int64_t limit = static_cast<std::int64_t>(settings->demosaicCacheSize) << 20;
+
+    if (total <= limit) {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.mtime < b.mtime; });
+
+    for (const auto& entry : entries) {
+        if (total <= limit) {
+            break;
+        }
+
+        if (g_remove(entry.path.c_str()) == 0) {
+            total -= entry.size;
+        }
+    }
+}
+
+}
+
+bool DemosaicCache::isEnabled()
+{
+    return settings->demosaicCacheSize > 0 && !settings->demosaicCacheDir.empty();
+}
+
+std::string DemosaicCache::getKey(const Glib::ustring& fileName, const std::string& description, const array2D<float>& rawData)
+{
+    GStatBuf fileStat;
+
+    if (!isEnabled() || g_stat(fileName.c_str(), &fileStat) != 0) {
+        return {};
+    }
+
+    const int width = rawData.getWidth();
+    const int height = rawData.getHeight();
+
+    // digest the rows in parallel, md5 of the whole data would be too slow
+    std::vector<std::uint64_t> rowDigests(height);
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 16)
+#endif
+
+    for (int i = 0; i < height; ++i) {
+        std::uint64_t digest = 0xcbf29ce484222325ULL;
+
+        for (int j = 0; j < width; ++j) {
+            std::uint32_t bits;
+            std::memcpy(&bits, &rawData[i][j], sizeof(bits));
+            digest = (digest ^ bits) * 0x100000001b3ULL;
+        }
+
+        rowDigests[i] = digest;
+    }
+
+    std::ostringstream identity;
+    identity << fileName.raw() << '\n' << fileStat.st_size << '\n' << fileStat.st_mtime << '\n' << width << 'x' << height << '\n' << description;
+
+    Glib::Checksum checksum(Glib::Checksum::CHECKSUM_MD5);
+    checksum.update(identity.str());
+    checksum.update(reinterpret_cast<const guchar*>(rowDigests.data()), rowDigests.size() * sizeof(std::uint64_t));
+    return checksum.get_string();
+}
+
+bool DemosaicCache::load(const std::string& key, array2D<float>& red, array2D<float>& green, array2D<float>& blue, double& contrastThreshold)
+{
+    if (key.empty()) {
+        return false;
+    }
+
+    const Glib::ustring fname = getFileName(key);
+    FILE* const file = g_fopen(fname.c_str(), "rb");
+
+    if (!file) {
+        return false;
+    }
+
+    char magic[sizeof(cacheMagic)];
+    std::uint32_t version;
+    std::uint32_t bom;
+    std::int32_t width;
+    std::int32_t height;
+    std::int32_t rows;
+    double threshold;
+
+    const bool validHeader =
+        std::fread(magic, sizeof(magic), 1, file) == 1
+        && std::fread(&version, sizeof(version), 1, file) == 1
+        && std::fread(&bom, sizeof(bom), 1, file) == 1
+        && std::fread(&width, sizeof(width), 1, file) == 1
+        && std::fread(&height, sizeof(height), 1, file) == 1
+        && std::fread(&rows, sizeof(rows), 1, file) == 1
+        && std::fread(&threshold, sizeof(threshold), 1, file) == 1
+        && !std::memcmp(magic, cacheMagic, sizeof(magic))
+        && version == cacheVersion
+        && bom == byteOrderMark
+        && width == red.getWidth() && height == red.getHeight()
+        && width == green.getWidth() && height == green.getHeight()
+        && width == blue.getWidth() && height == blue.getHeight()
+        && rows > 0;
+
+    if (!validHeader) {
+        std::fclose(file);
+        return false;
+    }
+
+    const int blocks = (height + rows - 1) / rows;
+    std::vector<std::uint32_t> sizes(3 * blocks);
+    std::vector<std::size_t> offsets(3 * blocks + 1, 0);
+    bool valid = std::fread(sizes.data(), sizeof(std::uint32_t), sizes.size(), file) == sizes.size();
+
+    for (std::size_t i = 0; valid && i < sizes.size(); ++i) {
+        offsets[i + 1] = offsets[i] + sizes[i];
+    }
+
+    std::vector<Bytef> data(valid ? offsets.back() : 0);
+    valid = valid && std::fread(data.data(), 1, data.size(), file) == data.size();
+    std::fclose(file);
+
+    if (!valid) {
+        return false;
+    }
+
+    array2D<float>* const planes[3] = {&red, &green, &blue};
+    int failed = 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) reduction(+:failed)
+#endif
+
+    for (int job = 0; job < 3 * blocks; ++job) {
+        array2D<float>& plane = *planes[job / blocks];
+        const int rowBegin = (job % blocks) * rows;
+        const int rowEnd = std::min(rowBegin + rows, static_cast<int>(height));
+        const std::size_t count = static_cast<std::size_t>(rowEnd - rowBegin) * width;
+
+        std::vector<Bytef> buffer(2 * count);
+        uLongf length = buffer.size();
+
+        if (uncompress(buffer.data(), &length, data.data() + offsets[job], sizes[job]) != Z_OK || length != buffer.size()) {
+            ++failed;
+            continue;
+        }
+
+        // low bytes of the block first, then the high bytes
+        std::size_t k = 0;
+
+        for (int i = rowBegin; i < rowEnd; ++i) {
+            for (int j = 0; j < width; ++j, ++k) {
+                plane[i][j] = planeScale * halfToFloat(buffer[k] | (buffer[count + k] << 8));
+            }
+        }
+    }
+
+    if (failed) {
+        if (settings->verbose) {
+            std::cerr << "Damaged demosaic cache file '" << fname << "'" << std::endl;
+        }
+
+        g_remove(fname.c_str());
+        return false;
+    }
+
+    // the modification time orders the files for trim()
+    g_utime(fname.c_str(), nullptr);
+
+    contrastThreshold = threshold;
+    return true;
+}
+
+void DemosaicCache::store(const std::string& key, const array2D<float>& red, const array2D<float>& green, const array2D<float>& blue, double contrastThreshold)
+{
+    if (key.empty()) {
+        return;
+    }
+
+    if (g_mkdir_with_parents(settings->demosaicCacheDir.c_str(), 0755) != 0) {
+        if (settings->verbose) {
+            std::cerr << "Failed to create the demosaic cache directory '" << settings->demosaicCacheDir << "'" << std::endl;
+        }
+
+        return;
+    }
+
+    const std::int32_t width = red.getWidth();
+    const std::int32_t height = red.getHeight();
+    const int blocks = (height + blockRows - 1) / blockRows;
+    const array2D<float>* const planes[3] = {&red, &green, &blue};
+
+    std::vector<std::vector<Bytef>> compressed(3 * blocks);
+    int failed = 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) reduction(+:failed)
+#endif
+
+    for (int job = 0; job < 3 * blocks; ++job) {
+        const array2D<float>& plane = *planes[job / blocks];
+        const int rowBegin = (job % blocks) * blockRows;
+        const int rowEnd = std::min(rowBegin + blockRows, static_cast<int>(height));
+        const std::size_t count = static_cast<std::size_t>(rowEnd - rowBegin) * width;
+
+        // splitting the bytes of the half floats helps zlib a lot
+        std::vector<Bytef> buffer(2 * count);
+        std::size_t k = 0;
+
+        for (int i = rowBegin; i < rowEnd; ++i) {
+            for (int j = 0; j < width; ++j, ++k) {
+                const std::uint16_t half = floatToHalf(plane[i][j] / planeScale);
+                buffer[k] = half & 0xff;
+                buffer[count + k] = half >> 8;
+            }
+        }
+
+        std::vector<Bytef>& block = compressed[job];
+        block.resize(compressBound(buffer.size()));
+        uLongf length = block.size();
+
+        if (compress2(block.data(), &length, buffer.data(), buffer.size(), Z_BEST_SPEED) != Z_OK) {
+            ++failed;
+            continue;
+        }
+
+        block.resize(length);
+    }
+
+    if (failed) {
+        return;
+    }
+
+    // written under a temporary name, a concurrent load must not see a partial file
+    const Glib::ustring fname = getFileName(key);
+    const Glib::ustring tempName = fname + ".tmp";
+    FILE* const file = g_fopen(tempName.c_str(), "wb");
+
+    if (!file) {
+        return;
+    }
+
+    const std::int32_t rows = blockRows;
+    bool written =
+        std::fwrite(cacheMagic, sizeof(cacheMagic), 1, file) == 1
+        && std::fwrite(&cacheVersion, sizeof(cacheVersion), 1, file) == 1
+        && std::fwrite(&byteOrderMark, sizeof(byteOrderMark), 1, file) == 1
+        && std::fwrite(&width, sizeof(width), 1, file) == 1
+        && std::fwrite(&height, sizeof(height), 1, file) == 1
+        && std::fwrite(&rows, sizeof(rows), 1, file) == 1
+        && std::fwrite(&contrastThreshold, sizeof(contrastThreshold), 1, file) == 1;
+
+    for (const auto& block : compressed) {
+        const std::uint32_t size = block.size();
+        written = written && std::fwrite(&size, sizeof(size), 1, file) == 1;
+    }
+
+    for (const auto& block : compressed) {
+        written = written && std::fwrite(block.data(), 1, block.size(), file) == block.size();
+    }
+
+    written = !std::fclose(file) && written;
+
+    if (!written || g_rename(tempName.c_str(), fname.c_str()) != 0) {
+        if (settings->verbose) {
+            std::cerr << "Failed to write demosaic cache file '" << fname << "'" << std::endl;
+        }
+
+        g_remove(tempName.c_str());
+        return;
+    }
+
+    trim();
+}
+
+}
@@ -0,0 +1,57 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <string>
+
+#include <glibmm/ustring.h>
+
+template<typename T> class array2D;
+
+namespace rtengine
+{
+
+/*
+ * On-disk cache of the red, green and blue planes produced by
+ * RawImageSource::demosaic, so that reopening an image does not run the
+ * demosaic algorithm again. Enabled by settings->demosaicCacheSize (MiB, 0
+ * disables it), the files live in settings->demosaicCacheDir.
+ *
+ * An entry is keyed by the identity of the raw file, a description of the
+ * demosaic parameters and a digest of the preprocessed raw data, so every
+ * preprocessing step (dark frame, flat field, raw CA correction, line
+ * denoise, green equilibration...) invalidates it. The planes are stored as
+ * half floats, compressed in independent blocks of rows to allow parallel
+ * (de)compression. The least recently used files are removed once the cache
+ * exceeds its size.
+ *
+ * The half floats are lossy, so only the editor previews use the cache, the
+ * exports always demosaic the raw data.
+ */
+class DemosaicCache final
+{
+public:
+    static bool isEnabled();
+
+    static std::string getKey(const Glib::ustring& fileName, const std::string& description, const array2D<float>& rawData);
+
+    // Fills the planes, which must have the size of the cached ones, and the contrast threshold of dual demosaic
+    static bool load(const std::string& key, array2D<float>& red, array2D<float>& green, array2D<float>& blue, double& contrastThreshold);
+    static void store(const std::string& key, const array2D<float>& red, const array2D<float>& green, const array2D<float>& blue, double contrastThreshold);
+};
+
+}
@@ -102,46 +102,16 @@ void CLASS init_fuji_compr (struct fuji_compressed_params* info)
     info->maxDiff = info->total_values >> 6;
 }
 
-#define FUJI_BUF_SIZE 0x10000u
-
-void CLASS fuji_fill_buffer (struct fuji_compressed_block *info)
-{
-    if (info->cur_pos >= info->cur_buf_size) {
-        info->cur_pos = 0;
-        info->cur_buf_offset += info->cur_buf_size;
-#ifdef MYFILE_MMAP
-        info->cur_buf_size = info->max_read_size;
-        info->cur_buf = fdata(info->cur_buf_offset, info->input);
-#else
-#ifdef _OPENMP
-        #pragma omp critical
-#endif
-        {
-            fseek (info->input, info->cur_buf_offset, SEEK_SET);
-            info->cur_buf_size = fread (info->cur_buf, 1, std::min (info->max_read_size, FUJI_BUF_SIZE), info->input);
-        }
-#endif
-        if (info->cur_buf_size < 1) { // nothing read
-            if (info->fillbytes > 0) {
-                int ls = std::max (1, std::min (info->fillbytes, (int)FUJI_BUF_SIZE));
-                memset (info->cur_buf, 0, ls);
-                info->fillbytes -= ls;
-            }
-        }
-
-        info->max_read_size -= info->cur_buf_size;
-    }
-}
-
 void CLASS init_fuji_block (struct fuji_compressed_block* info, const struct fuji_compressed_params *params, INT64 raw_offset, unsigned dsize)
 {
     info->linealloc = (ushort*)calloc (sizeof (ushort), _ltotal * (params->line_width + 2));
     merror (info->linealloc, "init_fuji_block()");
 
-    info->input = ifp;
-    INT64 fsize = info->input->size;
-    info->max_read_size = std::min (unsigned (fsize - raw_offset), dsize + 16); // Data size may be incorrect?
-    info->fillbytes = 1;
+    // The whole file is in memory, so each strip reads its data there without
+    // copying it or sharing a file position. Reads past it return zeros.
+    ssize_t size = INT64 (dsize) + 16; // Data size may be incorrect?
+    info->cur_buf = fspan (ifp, raw_offset, size);
+    info->cur_buf_size = size;
 
     info->linebuf[_R0] = info->linealloc;
 
@@ -149,14 +119,8 @@ void CLASS init_fuji_block (struct fuji_compressed_block* info, const struct fuj
         info->linebuf[i] = info->linebuf[i - 1] + params->line_width + 2;
     }
 
-    // init buffer
-#ifndef MYFILE_MMAP
-    info->cur_buf = (uchar*)malloc (FUJI_BUF_SIZE);
-    merror (info->cur_buf, "init_fuji_block()");
-#endif
     info->cur_bit = 0;
     info->cur_pos = 0;
-    info->cur_buf_offset = raw_offset;
 
     for (int j = 0; j < 3; j++)
         for (int i = 0; i < 41; i++) {
@@ -165,9 +129,6 @@ void CLASS init_fuji_block (struct fuji_compressed_block* info, const struct fuj
             info->grad_odd[j][i].value1 = params->maxDiff;
             info->grad_odd[j][i].value2 = 1;
         }
-
-    info->cur_buf_size = 0;
-    fuji_fill_buffer (info);
 }
 
 void CLASS copy_line_to_xtrans (struct fuji_compressed_block* info, int cur_line, int cur_block, int cur_block_width)
@@ -280,64 +241,61 @@ void CLASS copy_line_to_bayer (struct fuji_compressed_block *info, int cur_line,
 
 #define fuji_quant_gradient(i,v1,v2) (9*i->q_table[i->q_point[4]+(v1)] + i->q_table[i->q_point[4]+(v2)])
 
+// 4 bytes at the current position, MSB first
+inline unsigned CLASS fuji_peek_word (const struct fuji_compressed_block* info)
+{
+    const uchar *p = info->cur_buf + info->cur_pos;
+
+    if (LIKELY(info->cur_pos + 4 <= info->cur_buf_size)) {
+        return (unsigned)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+    }
+
+    unsigned word = 0;
+
+    for (int i = 0; i < 4; i++) {
+        word = word << 8 | (info->cur_pos + i < info->cur_buf_size ? p[i] : 0);
+    }
+
+    return word;
+}
+
 inline void CLASS fuji_zerobits (struct fuji_compressed_block* info, int *count)
 {
-    uchar zero = 0;
     *count = 0;
+    unsigned word = fuji_peek_word (info) << info->cur_bit;
 
-    while (zero == 0) {
-        zero = (info->cur_buf[info->cur_pos] >> (7 - info->cur_bit)) & 1;
-        info->cur_bit++;
-        info->cur_bit &= 7;
+    while (UNLIKELY(!word)) {
+        *count += 32 - info->cur_bit;
+        info->cur_pos += 4;
+        info->cur_bit = 0;
 
-        if (!info->cur_bit) {
-            ++info->cur_pos;
-#ifndef MYFILE_MMAP
-            fuji_fill_buffer (info);
-#endif
-        }
-
-        if (zero) {
-            break;
+        if (UNLIKELY(info->cur_pos >= info->cur_buf_size)) { // no 1 before the end
+            derror();
+            return;
         }
 
-        ++*count;
+        word = fuji_peek_word (info);
     }
+
+    const int zeros = __builtin_clz (word);
+    *count += zeros;
+    info->cur_bit += zeros + 1;
+    info->cur_pos += info->cur_bit >> 3;
+    info->cur_bit &= 7;
 }
 
 inline void CLASS fuji_read_code (struct fuji_compressed_block* info, int *data, int bits_to_read)
 {
-    *data = 0;
-
     if (!bits_to_read) {
+        *data = 0;
         return;
     }
 
-    uchar bits_left = bits_to_read;
-    uchar bits_left_in_byte = 8 - (info->cur_bit & 7);
-
-    if (bits_to_read >= bits_left_in_byte) {
-        do {
-            *data <<= bits_left_in_byte;
-            bits_left -= bits_left_in_byte;
-            *data |= info->cur_buf[info->cur_pos] & ((1 << bits_left_in_byte) - 1);
-            ++info->cur_pos;
-#ifndef MYFILE_MMAP
-            fuji_fill_buffer (info);
-#endif
-            bits_left_in_byte = 8;
-        } while (bits_left >= 8);
-    }
-
-    if (!bits_left) {
-        info->cur_bit = (8 - (bits_left_in_byte & 7)) & 7;
-        return;
-    }
-
-    *data <<= bits_left;
-    bits_left_in_byte -= bits_left;
-    *data |= ((1 << bits_left) - 1) & ((unsigned)info->cur_buf[info->cur_pos] >> bits_left_in_byte);
-    info->cur_bit = (8 - (bits_left_in_byte & 7)) & 7;
+    // cur_bit is at most 7 and bits_to_read at most 16, so a word has them all
+    *data = fuji_peek_word (info) << info->cur_bit >> (32 - bits_to_read);
+    info->cur_bit += bits_to_read;
+    info->cur_pos += info->cur_bit >> 3;
+    info->cur_bit &= 7;
 }
 
 int CLASS fuji_decode_sample_even (struct fuji_compressed_block* info, const struct fuji_compressed_params * params, ushort* line_buf, int pos, struct int_pair* grads)
@@ -895,9 +853,6 @@ void CLASS fuji_decode_strip (const struct fuji_compressed_params* info_common,
 
     // release data
     free (info.linealloc);
-#ifndef MYFILE_MMAP
-    free (info.cur_buf);
-#endif
 }
 
 static unsigned sgetn (int n, uchar *s)
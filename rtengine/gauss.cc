@@ -16,6 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -23,6 +24,7 @@
 
 #include "gauss.h"
 
+#include "alignedbuffer.h"
 #include "boxblur.h"
 #include "opthelper.h"
 #include "rt_math.h"
@@ -527,596 +529,315 @@ template<class T> void gaussVertical3 (T** src, T** dst, int W, int H, const flo
 }
 #endif
 
-#ifdef __SSE2__
-// fast gaussian approximation if the support window is large
-template<class T> void gaussHorizontalSse (T** src, T** dst, const int W, const int H, const float sigma)
+// Young - van Vliet recursive filter on blocks of gaussLanes rows or columns,
+// in single precision. The inner loops run over the lanes of a block, they are
+// vectorized at the width of the running cpu (AVX2/AVX-512 when built with
+// WITH_TARGET_CLONES).
+constexpr int gaussLanes = 32;
+
+struct YvVCoefficients {
+    float B, b1, b2, b3;
+    float M[3][3];
+};
+
+YvVCoefficients calculateYvVCoefficients(float sigma)
 {
     double b1, b2, b3, B, M[3][3];
     calculateYvVFactors<double>(sigma, b1, b2, b3, B, M);
 
+    YvVCoefficients coeffs;
+    coeffs.B = B;
+    coeffs.b1 = b1;
+    coeffs.b2 = b2;
+    coeffs.b3 = b3;
+
     for (int i = 0; i < 3; i++)
         for (int j = 0; j < 3; j++) {
             M[i][j] *= (1.0 + b2 + (b1 - b3) * b3);
             M[i][j] /= (1.0 + b1 - b2 + b3) * (1.0 - b1 - b2 - b3);
+            coeffs.M[i][j] = M[i][j];
         }
 
-    vfloat Rv;
-    vfloat Tv, Tm2v, Tm3v;
-    vfloat Bv, b1v, b2v, b3v;
-    vfloat temp2W, temp2Wp1;
-    float tmp[W][4] ALIGNED16;
-    Bv = F2V(B);
-    b1v = F2V(b1);
-    b2v = F2V(b2);
-    b3v = F2V(b3);
-
-#ifdef _OPENMP
-    #pragma omp for nowait
-#endif
-
-    for (int i = 0; i < H - 3; i += 4) {
-        Tv = _mm_set_ps(src[i][0], src[i + 1][0], src[i + 2][0], src[i + 3][0]);
-        Tm3v = Tv * (Bv + b1v + b2v + b3v);
-        STVF( tmp[0][0], Tm3v );
+    return coeffs;
+}
 
-        Tm2v = _mm_set_ps(src[i][1], src[i + 1][1], src[i + 2][1], src[i + 3][1]) * Bv + Tm3v * b1v + Tv * (b2v + b3v);
-        STVF( tmp[1][0], Tm2v );
+// first 3 lines of the causal pass, with the first input line repeated before the data
+inline void gaussCausalStart(float (* RESTRICT data)[gaussLanes], const YvVCoefficients& c)
+{
+    const float sum = c.B + c.b1 + c.b2 + c.b3;
+    const float b23 = c.b2 + c.b3;
+
+    for (int k = 0; k < gaussLanes; k++) {
+        const float in0 = data[0][k];
+        const float in1 = data[1][k];
+        const float in2 = data[2][k];
+        const float out0 = in0 * sum;
+        const float out1 = in1 * c.B + out0 * c.b1 + in0 * b23;
+        data[0][k] = out0;
+        data[1][k] = out1;
+        data[2][k] = in2 * c.B + out1 * c.b1 + out0 * c.b2 + in0 * c.b3;
+    }
+}
 
-        Rv = _mm_set_ps(src[i][2], src[i + 1][2], src[i + 2][2], src[i + 3][2]) * Bv + Tm2v * b1v + Tm3v * b2v + Tv * b3v;
-        STVF( tmp[2][0], Rv );
+// one line of the causal or anticausal pass, in place
+inline void gaussRecursiveLine(float* RESTRICT line, const float* RESTRICT prev1, const float* RESTRICT prev2, const float* RESTRICT prev3, const YvVCoefficients& c)
+{
+    for (int k = 0; k < gaussLanes; k++) {
+        line[k] = line[k] * c.B + prev3[k] * c.b3 + prev2[k] * c.b2 + prev1[k] * c.b1;
+    }
+}
 
-        for (int j = 3; j < W; j++) {
-            Tv = Rv;
-            Rv = _mm_set_ps(src[i][j], src[i + 1][j], src[i + 2][j], src[i + 3][j]) * Bv + Tv * b1v + Tm2v * b2v + Tm3v * b3v;
-            STVF( tmp[j][0], Rv );
-            Tm3v = Tm2v;
-            Tm2v = Tv;
-        }
+// last 3 lines of the anticausal pass, 'last' is the last input line, repeated after the data
+inline void gaussAnticausalStart(float (* RESTRICT data)[gaussLanes], const int n, const float* RESTRICT last, const YvVCoefficients& c)
+{
+    for (int k = 0; k < gaussLanes; k++) {
+        const float T = last[k];
+        const float R = data[n - 1][k];
+        const float Tm2 = data[n - 2][k];
+        const float Tm3 = data[n - 3][k];
+        const float temp2Wp1 = T + c.M[2][0] * (R - T) + c.M[2][1] * (Tm2 - T) + c.M[2][2] * (Tm3 - T);
+        const float temp2W = T + c.M[1][0] * (R - T) + c.M[1][1] * (Tm2 - T) + c.M[1][2] * (Tm3 - T);
+        const float out1 = T + c.M[0][0] * (R - T) + c.M[0][1] * (Tm2 - T) + c.M[0][2] * (Tm3 - T);
+        const float out2 = c.B * Tm2 + c.b1 * out1 + c.b2 * temp2W + c.b3 * temp2Wp1;
+        data[n - 1][k] = out1;
+        data[n - 2][k] = out2;
+        data[n - 3][k] = c.B * Tm3 + c.b1 * out2 + c.b2 * out1 + c.b3 * temp2W;
+    }
+}
 
-        Tv = _mm_set_ps(src[i][W - 1], src[i + 1][W - 1], src[i + 2][W - 1], src[i + 3][W - 1]);
+// Rows [row, row + rows) of src into dst. Blocks of gaussLanes x gaussLanes pixels are
+// transposed into 'tmp' (W lines) and filtered while they are in L1 cache.
+SIMD_CLONES void gaussHorizontalBlock(float** src, float** dst, const int row, const int rows, const int W, const YvVCoefficients& c, float (* RESTRICT tmp)[gaussLanes])
+{
+    const float* in[gaussLanes];
 
-        temp2Wp1 = Tv + F2V(M[2][0]) * (Rv - Tv) + F2V(M[2][1]) * ( Tm2v - Tv ) +  F2V(M[2][2]) * (Tm3v - Tv);
-        temp2W = Tv + F2V(M[1][0]) * (Rv - Tv) + F2V(M[1][1]) * (Tm2v - Tv) + F2V(M[1][2]) * (Tm3v - Tv);
+    for (int k = 0; k < gaussLanes; k++) {
+        in[k] = src[row + std::min(k, rows - 1)];
+    }
 
-        Rv = Tv + F2V(M[0][0]) * (Rv - Tv) + F2V(M[0][1]) * (Tm2v - Tv) + F2V(M[0][2]) * (Tm3v - Tv);
-        STVF(tmp[W - 1][0], Rv);
+    float last[gaussLanes] ALIGNED64;
 
-        Tm2v = Bv * Tm2v + b1v * Rv + b2v * temp2W + b3v * temp2Wp1;
-        STVF(tmp[W - 2][0], Tm2v);
+    for (int jj = 0; jj < W; jj += gaussLanes) {
+        const int jEnd = std::min(jj + gaussLanes, W);
+        int j = jj;
+#ifdef __SSE2__
 
-        Tm3v = Bv * Tm3v + b1v * Tm2v + b2v * Rv + b3v * temp2W;
-        STVF(tmp[W - 3][0], Tm3v);
+        for (; j < jEnd - 3; j += 4) {
+            for (int k = 0; k < gaussLanes; k += 4) {
+                vfloat v0 = LVFU(in[k][j]);
+                vfloat v1 = LVFU(in[k + 1][j]);
+                vfloat v2 = LVFU(in[k + 2][j]);
+                vfloat v3 = LVFU(in[k + 3][j]);
+                _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+                STVF(tmp[j][k], v0);
+                STVF(tmp[j + 1][k], v1);
+                STVF(tmp[j + 2][k], v2);
+                STVF(tmp[j + 3][k], v3);
+            }
+        }
 
-        Tv = Rv;
-        Rv = Tm3v;
-        Tm3v = Tv;
+#endif
 
-        for (int j = W - 4; j >= 0; j--) {
-            Tv = Rv;
-            Rv = LVF(tmp[j][0]) * Bv + Tv * b1v + Tm2v * b2v + Tm3v * b3v;
-            STVF(tmp[j][0], Rv);
-            Tm3v = Tm2v;
-            Tm2v = Tv;
+        for (; j < jEnd; j++) {
+            for (int k = 0; k < gaussLanes; k++) {
+                tmp[j][k] = in[k][j];
+            }
         }
 
-        for (int j = 0; j < W; j++) {
-            dst[i + 3][j] = tmp[j][0];
-            dst[i + 2][j] = tmp[j][1];
-            dst[i + 1][j] = tmp[j][2];
-            dst[i + 0][j] = tmp[j][3];
+        if (jEnd == W) {
+            std::copy(tmp[W - 1], tmp[W - 1] + gaussLanes, last);
         }
 
+        if (jj == 0) {
+            gaussCausalStart(tmp, c);
+        }
 
+        for (j = std::max(jj, 3); j < jEnd; j++) {
+            gaussRecursiveLine(tmp[j], tmp[j - 1], tmp[j - 2], tmp[j - 3], c);
+        }
     }
 
-// Borders are done without SSE
-#ifdef _OPENMP
-    #pragma omp single
-#endif
+    gaussAnticausalStart(tmp, W, last, c);
 
-    for (int i = H - (H % 4); i < H; i++) {
-        tmp[0][0] = src[i][0] * (B + b1 + b2 + b3);
-        tmp[1][0] = B * src[i][1] + b1 * tmp[0][0]  + src[i][0] * (b2 + b3);
-        tmp[2][0] = B * src[i][2] + b1 * tmp[1][0]  + b2 * tmp[0][0]  + b3 * src[i][0];
+    for (int jj = (W - 1) / gaussLanes * gaussLanes; jj >= 0; jj -= gaussLanes) {
+        const int jEnd = std::min(jj + gaussLanes, W);
 
-        for (int j = 3; j < W; j++) {
-            tmp[j][0] = B * src[i][j] + b1 * tmp[j - 1][0] + b2 * tmp[j - 2][0] + b3 * tmp[j - 3][0];
+        for (int j = std::min(jEnd, W - 3) - 1; j >= jj; j--) {
+            gaussRecursiveLine(tmp[j], tmp[j + 1], tmp[j + 2], tmp[j + 3], c);
         }
 
-        float temp2Wm1 = src[i][W - 1] + M[0][0] * (tmp[W - 1][0] - src[i][W - 1]) + M[0][1] * (tmp[W - 2][0] - src[i][W - 1]) + M[0][2] * (tmp[W - 3][0] - src[i][W - 1]);
-        float temp2W   = src[i][W - 1] + M[1][0] * (tmp[W - 1][0] - src[i][W - 1]) + M[1][1] * (tmp[W - 2][0] - src[i][W - 1]) + M[1][2] * (tmp[W - 3][0] - src[i][W - 1]);
-        float temp2Wp1 = src[i][W - 1] + M[2][0] * (tmp[W - 1][0] - src[i][W - 1]) + M[2][1] * (tmp[W - 2][0] - src[i][W - 1]) + M[2][2] * (tmp[W - 3][0] - src[i][W - 1]);
-
-        tmp[W - 1][0] = temp2Wm1;
-        tmp[W - 2][0] = B * tmp[W - 2][0] + b1 * tmp[W - 1][0] + b2 * temp2W + b3 * temp2Wp1;
-        tmp[W - 3][0] = B * tmp[W - 3][0] + b1 * tmp[W - 2][0] + b2 * tmp[W - 1][0] + b3 * temp2W;
+        int j = jj;
+#ifdef __SSE2__
 
-        for (int j = W - 4; j >= 0; j--) {
-            tmp[j][0] = B * tmp[j][0] + b1 * tmp[j + 1][0] + b2 * tmp[j + 2][0] + b3 * tmp[j + 3][0];
+        if (rows == gaussLanes) {
+            for (; j < jEnd - 3; j += 4) {
+                for (int k = 0; k < gaussLanes; k += 4) {
+                    vfloat v0 = LVF(tmp[j][k]);
+                    vfloat v1 = LVF(tmp[j + 1][k]);
+                    vfloat v2 = LVF(tmp[j + 2][k]);
+                    vfloat v3 = LVF(tmp[j + 3][k]);
+                    _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+                    STVFU(dst[row + k][j], v0);
+                    STVFU(dst[row + k + 1][j], v1);
+                    STVFU(dst[row + k + 2][j], v2);
+                    STVFU(dst[row + k + 3][j], v3);
+                }
+            }
         }
 
-        for (int j = 0; j < W; j++) {
-            dst[i][j] = tmp[j][0];
+#endif
+
+        for (; j < jEnd; j++) {
+            for (int k = 0; k < rows; k++) {
+                dst[row + k][j] = tmp[j][k];
+            }
         }
     }
 }
-#endif
 
-// fast gaussian approximation if the support window is large
-template<class T> void gaussHorizontal (T** src, T** dst, const int W, const int H, const double sigma)
+// Columns [col, col + cols) of src, filtered in 'tmp' (H lines), then stored, multiplied or divided into dst
+SIMD_CLONES void gaussVerticalBlock(float** src, float** dst, float** divBuffer, eGaussType gausstype, const int col, const int cols, const int H, const YvVCoefficients& c, float (* RESTRICT tmp)[gaussLanes])
 {
-    double b1, b2, b3, B, M[3][3];
-    calculateYvVFactors<double>(sigma, b1, b2, b3, B, M);
-
-    for (int i = 0; i < 3; i++)
-        for (int j = 0; j < 3; j++) {
-            M[i][j] /= (1.0 + b1 - b2 + b3) * (1.0 + b2 + (b1 - b3) * b3);
-        }
-
-    double temp2[W] ALIGNED16;
-
-#ifdef _OPENMP
-    #pragma omp for
-#endif
-
-    for (int i = 0; i < H; i++) {
+    float last[gaussLanes] ALIGNED64;
 
-        temp2[0] = B * src[i][0] + b1 * src[i][0] + b2 * src[i][0] + b3 * src[i][0];
-        temp2[1] = B * src[i][1] + b1 * temp2[0]  + b2 * src[i][0] + b3 * src[i][0];
-        temp2[2] = B * src[i][2] + b1 * temp2[1]  + b2 * temp2[0]  + b3 * src[i][0];
+    for (int j = 0; j < H; j++) {
+        const float* const in = src[j] + col;
 
-        for (int j = 3; j < W; j++) {
-            temp2[j] = B * src[i][j] + b1 * temp2[j - 1] + b2 * temp2[j - 2] + b3 * temp2[j - 3];
+        if (cols == gaussLanes) {
+            for (int k = 0; k < gaussLanes; k++) {
+                tmp[j][k] = in[k];
+            }
+        } else {
+            for (int k = 0; k < gaussLanes; k++) {
+                tmp[j][k] = in[std::min(k, cols - 1)];
+            }
         }
 
-        double temp2Wm1 = src[i][W - 1] + M[0][0] * (temp2[W - 1] - src[i][W - 1]) + M[0][1] * (temp2[W - 2] - src[i][W - 1]) + M[0][2] * (temp2[W - 3] - src[i][W - 1]);
-        double temp2W   = src[i][W - 1] + M[1][0] * (temp2[W - 1] - src[i][W - 1]) + M[1][1] * (temp2[W - 2] - src[i][W - 1]) + M[1][2] * (temp2[W - 3] - src[i][W - 1]);
-        double temp2Wp1 = src[i][W - 1] + M[2][0] * (temp2[W - 1] - src[i][W - 1]) + M[2][1] * (temp2[W - 2] - src[i][W - 1]) + M[2][2] * (temp2[W - 3] - src[i][W - 1]);
-
-        temp2[W - 1] = temp2Wm1;
-        temp2[W - 2] = B * temp2[W - 2] + b1 * temp2[W - 1] + b2 * temp2W + b3 * temp2Wp1;
-        temp2[W - 3] = B * temp2[W - 3] + b1 * temp2[W - 2] + b2 * temp2[W - 1] + b3 * temp2W;
-
-        for (int j = W - 4; j >= 0; j--) {
-            temp2[j] = B * temp2[j] + b1 * temp2[j + 1] + b2 * temp2[j + 2] + b3 * temp2[j + 3];
+        if (j == H - 1) {
+            std::copy(tmp[j], tmp[j] + gaussLanes, last);
         }
 
-        for (int j = 0; j < W; j++) {
-            dst[i][j] = (T)temp2[j];
+        if (j == 2) {
+            gaussCausalStart(tmp, c);
+        } else if (j > 2) {
+            gaussRecursiveLine(tmp[j], tmp[j - 1], tmp[j - 2], tmp[j - 3], c);
         }
-
     }
-}
-
-#ifdef __SSE2__
-template<class T> void gaussVerticalSse (T** src, T** dst, const int W, const int H, const float sigma)
-{
-    double b1, b2, b3, B, M[3][3];
-    calculateYvVFactors<double>(sigma, b1, b2, b3, B, M);
-
-    for (int i = 0; i < 3; i++)
-        for (int j = 0; j < 3; j++) {
-            M[i][j] *= (1.0 + b2 + (b1 - b3) * b3);
-            M[i][j] /= (1.0 + b1 - b2 + b3) * (1.0 - b1 - b2 - b3);
-        }
-
-    float tmp[H][8] ALIGNED16;
-    vfloat Rv;
-    vfloat Tv, Tm2v, Tm3v;
-    vfloat Rv1;
-    vfloat Tv1, Tm2v1, Tm3v1;
-    vfloat Bv, b1v, b2v, b3v;
-    vfloat temp2W, temp2Wp1;
-    vfloat temp2W1, temp2Wp11;
-    Bv = F2V(B);
-    b1v = F2V(b1);
-    b2v = F2V(b2);
-    b3v = F2V(b3);
-
-#ifdef _OPENMP
-    #pragma omp for nowait
-#endif
 
-    // process 8 columns per iteration for better usage of cpu cache
-    for (int i = 0; i < W - 7; i += 8) {
-        Tv = LVFU( src[0][i]);
-        Tv1 = LVFU( src[0][i + 4]);
-        Rv = Tv * (Bv + b1v + b2v + b3v);
-        Rv1 = Tv1 * (Bv + b1v + b2v + b3v);
-        Tm3v = Rv;
-        Tm3v1 = Rv1;
-        STVF( tmp[0][0], Rv );
-        STVF( tmp[0][4], Rv1 );
-
-        Rv = LVFU(src[1][i]) * Bv + Rv * b1v + Tv * (b2v + b3v);
-        Rv1 = LVFU(src[1][i + 4]) * Bv + Rv1 * b1v + Tv1 * (b2v + b3v);
-        Tm2v = Rv;
-        Tm2v1 = Rv1;
-        STVF( tmp[1][0], Rv );
-        STVF( tmp[1][4], Rv1 );
-
-        Rv = LVFU(src[2][i]) * Bv + Rv * b1v + Tm3v * b2v + Tv * b3v;
-        Rv1 = LVFU(src[2][i + 4]) * Bv + Rv1 * b1v + Tm3v1 * b2v + Tv1 * b3v;
-        STVF( tmp[2][0], Rv );
-        STVF( tmp[2][4], Rv1 );
+    gaussAnticausalStart(tmp, H, last, c);
 
-        for (int j = 3; j < H; j++) {
-            Tv = Rv;
-            Tv1 = Rv1;
-            Rv = LVFU(src[j][i]) * Bv +  Tv * b1v + Tm2v * b2v + Tm3v * b3v;
-            Rv1 = LVFU(src[j][i + 4]) * Bv +  Tv1 * b1v + Tm2v1 * b2v + Tm3v1 * b3v;
-            STVF( tmp[j][0], Rv );
-            STVF( tmp[j][4], Rv1 );
-            Tm3v = Tm2v;
-            Tm3v1 = Tm2v1;
-            Tm2v = Tv;
-            Tm2v1 = Tv1;
+    for (int j = H - 1; j >= 0; j--) {
+        if (j < H - 3) {
+            gaussRecursiveLine(tmp[j], tmp[j + 1], tmp[j + 2], tmp[j + 3], c);
         }
 
-        Tv = LVFU(src[H - 1][i]);
-        Tv1 = LVFU(src[H - 1][i + 4]);
-
-        temp2Wp1 = Tv + F2V(M[2][0]) * (Rv - Tv) + F2V(M[2][1]) * (Tm2v - Tv) + F2V(M[2][2]) * (Tm3v - Tv);
-        temp2Wp11 = Tv1 + F2V(M[2][0]) * (Rv1 - Tv1) + F2V(M[2][1]) * (Tm2v1 - Tv1) + F2V(M[2][2]) * (Tm3v1 - Tv1);
-        temp2W = Tv + F2V(M[1][0]) * (Rv - Tv) + F2V(M[1][1]) * (Tm2v - Tv) + F2V(M[1][2]) * (Tm3v - Tv);
-        temp2W1 = Tv1 + F2V(M[1][0]) * (Rv1 - Tv1) + F2V(M[1][1]) * (Tm2v1 - Tv1) + F2V(M[1][2]) * (Tm3v1 - Tv1);
-
-        Rv = Tv + F2V(M[0][0]) * (Rv - Tv) + F2V(M[0][1]) * (Tm2v - Tv) + F2V(M[0][2]) * (Tm3v - Tv);
-        Rv1 = Tv1 + F2V(M[0][0]) * (Rv1 - Tv1) + F2V(M[0][1]) * (Tm2v1 - Tv1) + F2V(M[0][2]) * (Tm3v1 - Tv1);
-        STVFU( dst[H - 1][i], Rv );
-        STVFU( dst[H - 1][i + 4], Rv1 );
-
-        Tm2v = Bv * Tm2v + b1v * Rv + b2v * temp2W + b3v * temp2Wp1;
-        Tm2v1 = Bv * Tm2v1 + b1v * Rv1 + b2v * temp2W1 + b3v * temp2Wp11;
-        STVFU( dst[H - 2][i], Tm2v );
-        STVFU( dst[H - 2][i + 4], Tm2v1 );
-
-        Tm3v = Bv * Tm3v + b1v * Tm2v + b2v * Rv + b3v * temp2W;
-        Tm3v1 = Bv * Tm3v1 + b1v * Tm2v1 + b2v * Rv1 + b3v * temp2W1;
-        STVFU( dst[H - 3][i], Tm3v );
-        STVFU( dst[H - 3][i + 4], Tm3v1 );
-
-        Tv = Rv;
-        Tv1 = Rv1;
-        Rv = Tm3v;
-        Rv1 = Tm3v1;
-        Tm3v = Tv;
-        Tm3v1 = Tv1;
-
-        for (int j = H - 4; j >= 0; j--) {
-            Tv = Rv;
-            Tv1 = Rv1;
-            Rv = LVF(tmp[j][0]) * Bv +  Tv * b1v + Tm2v * b2v + Tm3v * b3v;
-            Rv1 = LVF(tmp[j][4]) * Bv +  Tv1 * b1v + Tm2v1 * b2v + Tm3v1 * b3v;
-            STVFU( dst[j][i], Rv );
-            STVFU( dst[j][i + 4], Rv1 );
-            Tm3v = Tm2v;
-            Tm3v1 = Tm2v1;
-            Tm2v = Tv;
-            Tm2v1 = Tv1;
-        }
-    }
+        float* const out = dst[j] + col;
 
-// Borders are done without SSE
-#ifdef _OPENMP
-    #pragma omp single
-#endif
+        switch (gausstype) {
+            case GAUSS_MULT:
+                for (int k = 0; k < cols; k++) {
+                    out[k] *= tmp[j][k];
+                }
 
-    for (int i = W - (W % 8); i < W; i++) {
-        tmp[0][0] = src[0][i] * (B + b1 + b2 + b3);
-        tmp[1][0] = B * src[1][i] + b1 * tmp[0][0] + src[0][i] * (b2 + b3);
-        tmp[2][0] = B * src[2][i] + b1 * tmp[1][0] + b2 * tmp[0][0] + b3 * src[0][i];
+                break;
 
-        for (int j = 3; j < H; j++) {
-            tmp[j][0] = B * src[j][i] + b1 * tmp[j - 1][0] + b2 * tmp[j - 2][0] + b3 * tmp[j - 3][0];
-        }
+            case GAUSS_DIV: {
+                const float* const div = divBuffer[j] + col;
 
-        float temp2Hm1 = src[H - 1][i] + M[0][0] * (tmp[H - 1][0] - src[H - 1][i]) + M[0][1] * (tmp[H - 2][0] - src[H - 1][i]) + M[0][2] * (tmp[H - 3][0] - src[H - 1][i]);
-        float temp2H   = src[H - 1][i] + M[1][0] * (tmp[H - 1][0] - src[H - 1][i]) + M[1][1] * (tmp[H - 2][0] - src[H - 1][i]) + M[1][2] * (tmp[H - 3][0] - src[H - 1][i]);
-        float temp2Hp1 = src[H - 1][i] + M[2][0] * (tmp[H - 1][0] - src[H - 1][i]) + M[2][1] * (tmp[H - 2][0] - src[H - 1][i]) + M[2][2] * (tmp[H - 3][0] - src[H - 1][i]);
+                for (int k = 0; k < cols; k++) {
+                    out[k] = std::max(div[k] / (tmp[j][k] > 0.f ? tmp[j][k] : 1.f), 0.f);
+                }
 
-        tmp[H - 1][0] = temp2Hm1;
-        tmp[H - 2][0] = B * tmp[H - 2][0] + b1 * tmp[H - 1][0] + b2 * temp2H + b3 * temp2Hp1;
-        tmp[H - 3][0] = B * tmp[H - 3][0] + b1 * tmp[H - 2][0] + b2 * tmp[H - 1][0] + b3 * temp2H;
+                break;
+            }
 
-        for (int j = H - 4; j >= 0; j--) {
-            tmp[j][0] = B * tmp[j][0] + b1 * tmp[j + 1][0] + b2 * tmp[j + 2][0] + b3 * tmp[j + 3][0];
-        }
+            case GAUSS_STANDARD:
+                for (int k = 0; k < cols; k++) {
+                    out[k] = tmp[j][k];
+                }
 
-        for (int j = 0; j < H; j++) {
-            dst[j][i] = tmp[j][0];
+                break;
         }
-
     }
 }
-#endif
 
-#ifdef __SSE2__
-template<class T> void gaussVerticalSsemult (T** RESTRICT src, T** RESTRICT dst, const int W, const int H, const float sigma)
+// fast gaussian approximation if the support window is large
+template<class T> void gaussHorizontalBlocks (T** src, T** dst, const int W, const int H, const float sigma)
 {
-    double b1, b2, b3, B, M[3][3];
-    calculateYvVFactors<double>(sigma, b1, b2, b3, B, M);
-
-    for (int i = 0; i < 3; i++)
-        for (int j = 0; j < 3; j++) {
-            M[i][j] *= (1.0 + b2 + (b1 - b3) * b3);
-            M[i][j] /= (1.0 + b1 - b2 + b3) * (1.0 - b1 - b2 - b3);
-        }
-
-    float tmp[H][8] ALIGNED16;
-    vfloat Rv;
-    vfloat Tv, Tm2v, Tm3v;
-    vfloat Rv1;
-    vfloat Tv1, Tm2v1, Tm3v1;
-    vfloat Bv, b1v, b2v, b3v;
-    vfloat temp2W, temp2Wp1;
-    vfloat temp2W1, temp2Wp11;
-    Bv = F2V(B);
-    b1v = F2V(b1);
-    b2v = F2V(b2);
-    b3v = F2V(b3);
+    const YvVCoefficients coeffs = calculateYvVCoefficients(sigma);
+    AlignedBuffer<float> buffer(W * gaussLanes, 64);
+    float (* const tmp)[gaussLanes] = reinterpret_cast<float (*)[gaussLanes]>(buffer.data);
 
 #ifdef _OPENMP
-    #pragma omp for nowait
+    #pragma omp for
 #endif
 
-    // process 8 columns per iteration for better usage of cpu cache
-    for (int i = 0; i < W - 7; i += 8) {
-        Tv = LVFU( src[0][i]);
-        Tv1 = LVFU( src[0][i + 4]);
-        Rv = Tv * (Bv + b1v + b2v + b3v);
-        Rv1 = Tv1 * (Bv + b1v + b2v + b3v);
-        Tm3v = Rv;
-        Tm3v1 = Rv1;
-        STVF( tmp[0][0], Rv );
-        STVF( tmp[0][4], Rv1 );
-
-        Rv = LVFU(src[1][i]) * Bv + Rv * b1v + Tv * (b2v + b3v);
-        Rv1 = LVFU(src[1][i + 4]) * Bv + Rv1 * b1v + Tv1 * (b2v + b3v);
-        Tm2v = Rv;
-        Tm2v1 = Rv1;
-        STVF( tmp[1][0], Rv );
-        STVF( tmp[1][4], Rv1 );
-
-        Rv = LVFU(src[2][i]) * Bv + Rv * b1v + Tm3v * b2v + Tv * b3v;
-        Rv1 = LVFU(src[2][i + 4]) * Bv + Rv1 * b1v + Tm3v1 * b2v + Tv1 * b3v;
-        STVF( tmp[2][0], Rv );
-        STVF( tmp[2][4], Rv1 );
-
-        for (int j = 3; j < H; j++) {
-            Tv = Rv;
-            Tv1 = Rv1;
-            Rv = LVFU(src[j][i]) * Bv +  Tv * b1v + Tm2v * b2v + Tm3v * b3v;
-            Rv1 = LVFU(src[j][i + 4]) * Bv +  Tv1 * b1v + Tm2v1 * b2v + Tm3v1 * b3v;
-            STVF( tmp[j][0], Rv );
-            STVF( tmp[j][4], Rv1 );
-            Tm3v = Tm2v;
-            Tm3v1 = Tm2v1;
-            Tm2v = Tv;
-            Tm2v1 = Tv1;
-        }
-
-        Tv = LVFU(src[H - 1][i]);
-        Tv1 = LVFU(src[H - 1][i + 4]);
-
-        temp2Wp1 = Tv + F2V(M[2][0]) * (Rv - Tv) + F2V(M[2][1]) * (Tm2v - Tv) + F2V(M[2][2]) * (Tm3v - Tv);
-        temp2Wp11 = Tv1 + F2V(M[2][0]) * (Rv1 - Tv1) + F2V(M[2][1]) * (Tm2v1 - Tv1) + F2V(M[2][2]) * (Tm3v1 - Tv1);
-        temp2W = Tv + F2V(M[1][0]) * (Rv - Tv) + F2V(M[1][1]) * (Tm2v - Tv) + F2V(M[1][2]) * (Tm3v - Tv);
-        temp2W1 = Tv1 + F2V(M[1][0]) * (Rv1 - Tv1) + F2V(M[1][1]) * (Tm2v1 - Tv1) + F2V(M[1][2]) * (Tm3v1 - Tv1);
-
-        Rv = Tv + F2V(M[0][0]) * (Rv - Tv) + F2V(M[0][1]) * (Tm2v - Tv) + F2V(M[0][2]) * (Tm3v - Tv);
-        Rv1 = Tv1 + F2V(M[0][0]) * (Rv1 - Tv1) + F2V(M[0][1]) * (Tm2v1 - Tv1) + F2V(M[0][2]) * (Tm3v1 - Tv1);
-        STVFU( dst[H - 1][i], LVFU(dst[H - 1][i]) * Rv );
-        STVFU( dst[H - 1][i + 4], LVFU(dst[H - 1][i + 4]) * Rv1 );
-
-        Tm2v = Bv * Tm2v + b1v * Rv + b2v * temp2W + b3v * temp2Wp1;
-        Tm2v1 = Bv * Tm2v1 + b1v * Rv1 + b2v * temp2W1 + b3v * temp2Wp11;
-        STVFU( dst[H - 2][i], LVFU(dst[H - 2][i]) * Tm2v );
-        STVFU( dst[H - 2][i + 4], LVFU(dst[H - 2][i + 4]) * Tm2v1 );
-
-        Tm3v = Bv * Tm3v + b1v * Tm2v + b2v * Rv + b3v * temp2W;
-        Tm3v1 = Bv * Tm3v1 + b1v * Tm2v1 + b2v * Rv1 + b3v * temp2W1;
-        STVFU( dst[H - 3][i], LVFU(dst[H - 3][i]) * Tm3v );
-        STVFU( dst[H - 3][i + 4], LVFU(dst[H - 3][i + 4]) * Tm3v1 );
-
-        Tv = Rv;
-        Tv1 = Rv1;
-        Rv = Tm3v;
-        Rv1 = Tm3v1;
-        Tm3v = Tv;
-        Tm3v1 = Tv1;
-
-        for (int j = H - 4; j >= 0; j--) {
-            Tv = Rv;
-            Tv1 = Rv1;
-            Rv = LVF(tmp[j][0]) * Bv +  Tv * b1v + Tm2v * b2v + Tm3v * b3v;
-            Rv1 = LVF(tmp[j][4]) * Bv +  Tv1 * b1v + Tm2v1 * b2v + Tm3v1 * b3v;
-            STVFU( dst[j][i], LVFU(dst[j][i]) * Rv );
-            STVFU( dst[j][i + 4], LVFU(dst[j][i + 4]) * Rv1 );
-            Tm3v = Tm2v;
-            Tm3v1 = Tm2v1;
-            Tm2v = Tv;
-            Tm2v1 = Tv1;
-        }
+    for (int i = 0; i < H; i += gaussLanes) {
+        gaussHorizontalBlock(src, dst, i, std::min(gaussLanes, H - i), W, coeffs, tmp);
     }
+}
+
+template<class T> void gaussVerticalBlocks (T** src, T** dst, T** divBuffer, eGaussType gausstype, const int W, const int H, const float sigma)
+{
+    const YvVCoefficients coeffs = calculateYvVCoefficients(sigma);
+    AlignedBuffer<float> buffer(H * gaussLanes, 64);
+    float (* const tmp)[gaussLanes] = reinterpret_cast<float (*)[gaussLanes]>(buffer.data);
 
-// Borders are done without SSE
 #ifdef _OPENMP
-    #pragma omp single
+    #pragma omp for
 #endif
 
-    for (int i = W - (W % 8); i < W; i++) {
-        tmp[0][0] = src[0][i] * (B + b1 + b2 + b3);
-        tmp[1][0] = B * src[1][i] + b1 * tmp[0][0] + src[0][i] * (b2 + b3);
-        tmp[2][0] = B * src[2][i] + b1 * tmp[1][0] + b2 * tmp[0][0] + b3 * src[0][i];
-
-        for (int j = 3; j < H; j++) {
-            tmp[j][0] = B * src[j][i] + b1 * tmp[j - 1][0] + b2 * tmp[j - 2][0] + b3 * tmp[j - 3][0];
-        }
-
-        float temp2Hm1 = src[H - 1][i] + M[0][0] * (tmp[H - 1][0] - src[H - 1][i]) + M[0][1] * (tmp[H - 2][0] - src[H - 1][i]) + M[0][2] * (tmp[H - 3][0] - src[H - 1][i]);
-        float temp2H   = src[H - 1][i] + M[1][0] * (tmp[H - 1][0] - src[H - 1][i]) + M[1][1] * (tmp[H - 2][0] - src[H - 1][i]) + M[1][2] * (tmp[H - 3][0] - src[H - 1][i]);
-        float temp2Hp1 = src[H - 1][i] + M[2][0] * (tmp[H - 1][0] - src[H - 1][i]) + M[2][1] * (tmp[H - 2][0] - src[H - 1][i]) + M[2][2] * (tmp[H - 3][0] - src[H - 1][i]);
-
-        tmp[H - 1][0] = temp2Hm1;
-        tmp[H - 2][0] = B * tmp[H - 2][0] + b1 * tmp[H - 1][0] + b2 * temp2H + b3 * temp2Hp1;
-        tmp[H - 3][0] = B * tmp[H - 3][0] + b1 * tmp[H - 2][0] + b2 * tmp[H - 1][0] + b3 * temp2H;
-
-        for (int j = H - 4; j >= 0; j--) {
-            tmp[j][0] = B * tmp[j][0] + b1 * tmp[j + 1][0] + b2 * tmp[j + 2][0] + b3 * tmp[j + 3][0];
-        }
-
-        for (int j = 0; j < H; j++) {
-            dst[j][i] *= tmp[j][0];
-        }
-
+    for (int i = 0; i < W; i += gaussLanes) {
+        gaussVerticalBlock(src, dst, divBuffer, gausstype, i, std::min(gaussLanes, W - i), H, coeffs, tmp);
     }
 }
 
-template<class T> void gaussVerticalSsediv (T** src, T** dst, T** divBuffer, const int W, const int H, const float sigma)
+// fast gaussian approximation if the support window is large
+template<class T> void gaussHorizontal (T** src, T** dst, const int W, const int H, const double sigma)
 {
     double b1, b2, b3, B, M[3][3];
     calculateYvVFactors<double>(sigma, b1, b2, b3, B, M);
 
     for (int i = 0; i < 3; i++)
         for (int j = 0; j < 3; j++) {
-            M[i][j] *= (1.0 + b2 + (b1 - b3) * b3);
-            M[i][j] /= (1.0 + b1 - b2 + b3) * (1.0 - b1 - b2 - b3);
+            M[i][j] /= (1.0 + b1 - b2 + b3) * (1.0 + b2 + (b1 - b3) * b3);
         }
 
-    float tmp[H][8] ALIGNED16;
-    vfloat Rv;
-    vfloat Tv, Tm2v, Tm3v;
-    vfloat Rv1;
-    vfloat Tv1, Tm2v1, Tm3v1;
-    vfloat Bv, b1v, b2v, b3v;
-    vfloat temp2W, temp2Wp1;
-    vfloat temp2W1, temp2Wp11;
-    vfloat onev = F2V(1.f);
-    Bv = F2V(B);
-    b1v = F2V(b1);
-    b2v = F2V(b2);
-    b3v = F2V(b3);
+    double temp2[W] ALIGNED16;
 
 #ifdef _OPENMP
-    #pragma omp for nowait
+    #pragma omp for
 #endif
 
-    // process 8 columns per iteration for better usage of cpu cache
-    for (int i = 0; i < W - 7; i += 8) {
-        Tv = LVFU( src[0][i]);
-        Tv1 = LVFU( src[0][i + 4]);
-        Rv = Tv * (Bv + b1v + b2v + b3v);
-        Rv1 = Tv1 * (Bv + b1v + b2v + b3v);
-        Tm3v = Rv;
-        Tm3v1 = Rv1;
-        STVF( tmp[0][0], Rv );
-        STVF( tmp[0][4], Rv1 );
-
-        Rv = LVFU(src[1][i]) * Bv + Rv * b1v + Tv * (b2v + b3v);
-        Rv1 = LVFU(src[1][i + 4]) * Bv + Rv1 * b1v + Tv1 * (b2v + b3v);
-        Tm2v = Rv;
-        Tm2v1 = Rv1;
-        STVF( tmp[1][0], Rv );
-        STVF( tmp[1][4], Rv1 );
-
-        Rv = LVFU(src[2][i]) * Bv + Rv * b1v + Tm3v * b2v + Tv * b3v;
-        Rv1 = LVFU(src[2][i + 4]) * Bv + Rv1 * b1v + Tm3v1 * b2v + Tv1 * b3v;
-        STVF( tmp[2][0], Rv );
-        STVF( tmp[2][4], Rv1 );
-
-        for (int j = 3; j < H; j++) {
-            Tv = Rv;
-            Tv1 = Rv1;
-            Rv = LVFU(src[j][i]) * Bv +  Tv * b1v + Tm2v * b2v + Tm3v * b3v;
-            Rv1 = LVFU(src[j][i + 4]) * Bv +  Tv1 * b1v + Tm2v1 * b2v + Tm3v1 * b3v;
-            STVF( tmp[j][0], Rv );
-            STVF( tmp[j][4], Rv1 );
-            Tm3v = Tm2v;
-            Tm3v1 = Tm2v1;
-            Tm2v = Tv;
-            Tm2v1 = Tv1;
-        }
-
-        Tv = LVFU(src[H - 1][i]);
-        Tv1 = LVFU(src[H - 1][i + 4]);
-
-        temp2Wp1 = Tv + F2V(M[2][0]) * (Rv - Tv) + F2V(M[2][1]) * (Tm2v - Tv) + F2V(M[2][2]) * (Tm3v - Tv);
-        temp2Wp11 = Tv1 + F2V(M[2][0]) * (Rv1 - Tv1) + F2V(M[2][1]) * (Tm2v1 - Tv1) + F2V(M[2][2]) * (Tm3v1 - Tv1);
-        temp2W = Tv + F2V(M[1][0]) * (Rv - Tv) + F2V(M[1][1]) * (Tm2v - Tv) + F2V(M[1][2]) * (Tm3v - Tv);
-        temp2W1 = Tv1 + F2V(M[1][0]) * (Rv1 - Tv1) + F2V(M[1][1]) * (Tm2v1 - Tv1) + F2V(M[1][2]) * (Tm3v1 - Tv1);
-
-        Rv = Tv + F2V(M[0][0]) * (Rv - Tv) + F2V(M[0][1]) * (Tm2v - Tv) + F2V(M[0][2]) * (Tm3v - Tv);
-        Rv1 = Tv1 + F2V(M[0][0]) * (Rv1 - Tv1) + F2V(M[0][1]) * (Tm2v1 - Tv1) + F2V(M[0][2]) * (Tm3v1 - Tv1);
-
-        STVFU( dst[H - 1][i], LVFU(divBuffer[H - 1][i]) / vself(vmaskf_gt(Rv, ZEROV), Rv, onev));
-        STVFU( dst[H - 1][i + 4], LVFU(divBuffer[H - 1][i + 4]) / vself(vmaskf_gt(Rv1, ZEROV), Rv1, onev));
-
-        Tm2v = Bv * Tm2v + b1v * Rv + b2v * temp2W + b3v * temp2Wp1;
-        Tm2v1 = Bv * Tm2v1 + b1v * Rv1 + b2v * temp2W1 + b3v * temp2Wp11;
-        STVFU( dst[H - 2][i], LVFU(divBuffer[H - 2][i]) / vself(vmaskf_gt(Tm2v, ZEROV), Tm2v, onev));
-        STVFU( dst[H - 2][i + 4], LVFU(divBuffer[H - 2][i + 4]) / vself(vmaskf_gt(Tm2v1, ZEROV), Tm2v1, onev));
-
-        Tm3v = Bv * Tm3v + b1v * Tm2v + b2v * Rv + b3v * temp2W;
-        Tm3v1 = Bv * Tm3v1 + b1v * Tm2v1 + b2v * Rv1 + b3v * temp2W1;
-        STVFU( dst[H - 3][i], LVFU(divBuffer[H - 3][i]) / vself(vmaskf_gt(Tm3v, ZEROV), Tm3v, onev));
-        STVFU( dst[H - 3][i + 4], LVFU(divBuffer[H - 3][i + 4]) / vself(vmaskf_gt(Tm3v1, ZEROV), Tm3v1, onev));
-
-        Tv = Rv;
-        Tv1 = Rv1;
-        Rv = Tm3v;
-        Rv1 = Tm3v1;
-        Tm3v = Tv;
-        Tm3v1 = Tv1;
-
-        for (int j = H - 4; j >= 0; j--) {
-            Tv = Rv;
-            Tv1 = Rv1;
-            Rv = LVF(tmp[j][0]) * Bv +  Tv * b1v + Tm2v * b2v + Tm3v * b3v;
-            Rv1 = LVF(tmp[j][4]) * Bv +  Tv1 * b1v + Tm2v1 * b2v + Tm3v1 * b3v;
-            STVFU( dst[j][i], vmaxf(LVFU(divBuffer[j][i]) / vself(vmaskf_gt(Rv, ZEROV), Rv, onev), ZEROV));
-            STVFU( dst[j][i + 4], vmaxf(LVFU(divBuffer[j][i + 4]) / vself(vmaskf_gt(Rv1, ZEROV), Rv1, onev), ZEROV));
-            Tm3v = Tm2v;
-            Tm3v1 = Tm2v1;
-            Tm2v = Tv;
-            Tm2v1 = Tv1;
-        }
-    }
-
-// Borders are done without SSE
-#ifdef _OPENMP
-    #pragma omp single
-#endif
+    for (int i = 0; i < H; i++) {
 
-    for (int i = W - (W % 8); i < W; i++) {
-        tmp[0][0] = src[0][i] * (B + b1 + b2 + b3);
-        tmp[1][0] = B * src[1][i] + b1 * tmp[0][0] + src[0][i] * (b2 + b3);
-        tmp[2][0] = B * src[2][i] + b1 * tmp[1][0] + b2 * tmp[0][0] + b3 * src[0][i];
+        temp2[0] = B * src[i][0] + b1 * src[i][0] + b2 * src[i][0] + b3 * src[i][0];
+        temp2[1] = B * src[i][1] + b1 * temp2[0]  + b2 * src[i][0] + b3 * src[i][0];
+        temp2[2] = B * src[i][2] + b1 * temp2[1]  + b2 * temp2[0]  + b3 * src[i][0];
 
-        for (int j = 3; j < H; j++) {
-            tmp[j][0] = B * src[j][i] + b1 * tmp[j - 1][0] + b2 * tmp[j - 2][0] + b3 * tmp[j - 3][0];
+        for (int j = 3; j < W; j++) {
+            temp2[j] = B * src[i][j] + b1 * temp2[j - 1] + b2 * temp2[j - 2] + b3 * temp2[j - 3];
         }
 
-        float temp2Hm1 = src[H - 1][i] + M[0][0] * (tmp[H - 1][0] - src[H - 1][i]) + M[0][1] * (tmp[H - 2][0] - src[H - 1][i]) + M[0][2] * (tmp[H - 3][0] - src[H - 1][i]);
-        float temp2H   = src[H - 1][i] + M[1][0] * (tmp[H - 1][0] - src[H - 1][i]) + M[1][1] * (tmp[H - 2][0] - src[H - 1][i]) + M[1][2] * (tmp[H - 3][0] - src[H - 1][i]);
-        float temp2Hp1 = src[H - 1][i] + M[2][0] * (tmp[H - 1][0] - src[H - 1][i]) + M[2][1] * (tmp[H - 2][0] - src[H - 1][i]) + M[2][2] * (tmp[H - 3][0] - src[H - 1][i]);
+        double temp2Wm1 = src[i][W - 1] + M[0][0] * (temp2[W - 1] - src[i][W - 1]) + M[0][1] * (temp2[W - 2] - src[i][W - 1]) + M[0][2] * (temp2[W - 3] - src[i][W - 1]);
+        double temp2W   = src[i][W - 1] + M[1][0] * (temp2[W - 1] - src[i][W - 1]) + M[1][1] * (temp2[W - 2] - src[i][W - 1]) + M[1][2] * (temp2[W - 3] - src[i][W - 1]);
+        double temp2Wp1 = src[i][W - 1] + M[2][0] * (temp2[W - 1] - src[i][W - 1]) + M[2][1] * (temp2[W - 2] - src[i][W - 1]) + M[2][2] * (temp2[W - 3] - src[i][W - 1]);
 
-        tmp[H - 1][0] = temp2Hm1;
-        tmp[H - 2][0] = B * tmp[H - 2][0] + b1 * tmp[H - 1][0] + b2 * temp2H + b3 * temp2Hp1;
-        tmp[H - 3][0] = B * tmp[H - 3][0] + b1 * tmp[H - 2][0] + b2 * tmp[H - 1][0] + b3 * temp2H;
+        temp2[W - 1] = temp2Wm1;
+        temp2[W - 2] = B * temp2[W - 2] + b1 * temp2[W - 1] + b2 * temp2W + b3 * temp2Wp1;
+        temp2[W - 3] = B * temp2[W - 3] + b1 * temp2[W - 2] + b2 * temp2[W - 1] + b3 * temp2W;
 
-        for (int j = H - 4; j >= 0; j--) {
-            tmp[j][0] = B * tmp[j][0] + b1 * tmp[j + 1][0] + b2 * tmp[j + 2][0] + b3 * tmp[j + 3][0];
+        for (int j = W - 4; j >= 0; j--) {
+            temp2[j] = B * temp2[j] + b1 * temp2[j + 1] + b2 * temp2[j + 2] + b3 * temp2[j + 3];
         }
 
-        for (int j = 0; j < H; j++) {
-            dst[j][i] = rtengine::max(divBuffer[j][i] / (tmp[j][0] > 0.f ? tmp[j][0] : 1.f), 0.f);
+        for (int j = 0; j < W; j++) {
+            dst[i][j] = (T)temp2[j];
         }
 
     }
 }
 
-#endif
 
 template<class T> void gaussVertical (T** src, T** dst, const int W, const int H, const double sigma)
 {
@@ -1201,173 +922,6 @@ template<class T> void gaussVertical (T** src, T** dst, const int W, const int H
     }
 }
 
-#ifndef __SSE2__
-template<class T> void gaussVerticaldiv (T** src, T** dst, T** divBuffer, const int W, const int H, const double sigma)
-{
-    double b1, b2, b3, B, M[3][3];
-    calculateYvVFactors<double>(sigma, b1, b2, b3, B, M);
-
-    for (int i = 0; i < 3; i++)
-        for (int j = 0; j < 3; j++) {
-            M[i][j] /= (1.0 + b1 - b2 + b3) * (1.0 + b2 + (b1 - b3) * b3);
-        }
-
-    // process 'numcols' columns for better usage of L1 cpu cache (especially faster for large values of H)
-    static const int numcols = 8;
-    std::vector<double> temp2(H * numcols);
-    double temp2Hm1[numcols], temp2H[numcols], temp2Hp1[numcols];
-
-    auto coord =
-    [](const int &x, const int &y) -> int {
-        return x * numcols + y;
-    };
-#ifdef _OPENMP
-    #pragma omp for nowait
-#endif
-
-    for (int i = 0; i < W - numcols + 1; i += numcols) {
-        for (int k = 0; k < numcols; k++) {
-            temp2[coord(0, k)] = B * src[0][i + k] + b1 * src[0][i + k] + b2 * src[0][i + k] + b3 * src[0][i + k];
-            temp2[coord(1, k)] = B * src[1][i + k] + b1 * temp2[coord(0, k)] + b2 * src[0][i + k] + b3 * src[0][i + k];
-            temp2[coord(2, k)] = B * src[2][i + k] + b1 * temp2[coord(1, k)] + b2 * temp2[coord(0, k)] + b3 * src[0][i + k];
-        }
-
-        for (int j = 3; j < H; j++) {
-            for (int k = 0; k < numcols; k++) {
-                temp2[coord(j, k)] = B * src[j][i + k] + b1 * temp2[coord(j - 1, k)] + b2 * temp2[coord(j - 2, k)] + b3 * temp2[coord(j - 3, k)];
-            }
-        }
-
-        for (int k = 0; k < numcols; k++) {
-            temp2Hm1[k] = src[H - 1][i + k] + M[0][0] * (temp2[coord(H - 1, k)] - src[H - 1][i + k]) + M[0][1] * (temp2[coord(H - 2, k)] - src[H - 1][i + k]) + M[0][2] * (temp2[coord(H - 3, k)] - src[H - 1][i + k]);
-            temp2H[k]   = src[H - 1][i + k] + M[1][0] * (temp2[coord(H - 1, k)] - src[H - 1][i + k]) + M[1][1] * (temp2[coord(H - 2, k)] - src[H - 1][i + k]) + M[1][2] * (temp2[coord(H - 3, k)] - src[H - 1][i + k]);
-            temp2Hp1[k] = src[H - 1][i + k] + M[2][0] * (temp2[coord(H - 1, k)] - src[H - 1][i + k]) + M[2][1] * (temp2[coord(H - 2, k)] - src[H - 1][i + k]) + M[2][2] * (temp2[coord(H - 3, k)] - src[H - 1][i + k]);
-        }
-
-        for (int k = 0; k < numcols; k++) {
-            dst[H - 1][i + k] = rtengine::max(divBuffer[H - 1][i + k] / (temp2[coord(H - 1, k)] = temp2Hm1[k]), 0.0);
-            dst[H - 2][i + k] = rtengine::max(divBuffer[H - 2][i + k] / (temp2[coord(H - 2, k)] = B * temp2[coord(H - 2, k)] + b1 * temp2[coord(H - 1, k)] + b2 * temp2H[k] + b3 * temp2Hp1[k]), 0.0);
-            dst[H - 3][i + k] = rtengine::max(divBuffer[H - 3][i + k] / (temp2[coord(H - 3, k)] = B * temp2[coord(H - 3, k)] + b1 * temp2[coord(H - 2, k)] + b2 * temp2[coord(H - 1, k)] + b3 * temp2H[k]), 0.0);
-        }
-
-        for (int j = H - 4; j >= 0; j--) {
-            for (int k = 0; k < numcols; k++) {
-                dst[j][i + k] = rtengine::max(divBuffer[j][i + k] / (temp2[coord(j, k)] = B * temp2[coord(j, k)] + b1 * temp2[coord(j + 1, k)] + b2 * temp2[coord(j + 2, k)] + b3 * temp2[coord(j + 3, k)]), 0.0);
-            }
-        }
-    }
-
-#ifdef _OPENMP
-    #pragma omp single
-#endif
-
-    // process remaining columns
-    for (int i = W - (W % numcols); i < W; i++) {
-        temp2[coord(0, 0)] = B * src[0][i] + b1 * src[0][i] + b2 * src[0][i] + b3 * src[0][i];
-        temp2[coord(1, 0)] = B * src[1][i] + b1 * temp2[coord(0, 0)]  + b2 * src[0][i] + b3 * src[0][i];
-        temp2[coord(2, 0)] = B * src[2][i] + b1 * temp2[coord(1, 0)]  + b2 * temp2[coord(0, 0)]  + b3 * src[0][i];
-
-        for (int j = 3; j < H; j++) {
-            temp2[coord(j, 0)] = B * src[j][i] + b1 * temp2[coord(j - 1, 0)] + b2 * temp2[coord(j - 2, 0)] + b3 * temp2[coord(j - 3, 0)];
-        }
-
-        double temp2Hm1 = src[H - 1][i] + M[0][0] * (temp2[coord(H - 1, 0)] - src[H - 1][i]) + M[0][1] * (temp2[coord(H - 2, 0)] - src[H - 1][i]) + M[0][2] * (temp2[coord(H - 3, 0)] - src[H - 1][i]);
-        double temp2H   = src[H - 1][i] + M[1][0] * (temp2[coord(H - 1, 0)] - src[H - 1][i]) + M[1][1] * (temp2[coord(H - 2, 0)] - src[H - 1][i]) + M[1][2] * (temp2[coord(H - 3, 0)] - src[H - 1][i]);
-        double temp2Hp1 = src[H - 1][i] + M[2][0] * (temp2[coord(H - 1, 0)] - src[H - 1][i]) + M[2][1] * (temp2[coord(H - 2, 0)] - src[H - 1][i]) + M[2][2] * (temp2[coord(H - 3, 0)] - src[H - 1][i]);
-
-        dst[H - 1][i] = rtengine::max(divBuffer[H - 1][i] / (temp2[coord(H - 1, 0)] = temp2Hm1), 0.0);
-        dst[H - 2][i] = rtengine::max(divBuffer[H - 2][i] / (temp2[coord(H - 2, 0)] = B * temp2[coord(H - 2, 0)] + b1 * temp2[coord(H - 1, 0)] + b2 * temp2H + b3 * temp2Hp1), 0.0);
-        dst[H - 3][i] = rtengine::max(divBuffer[H - 3][i] / (temp2[coord(H - 3, 0)] = B * temp2[coord(H - 3, 0)] + b1 * temp2[coord(H - 2, 0)] + b2 * temp2[coord(H - 1, 0)] + b3 * temp2H), 0.0);
-
-        for (int j = H - 4; j >= 0; j--) {
-            dst[j][i] = rtengine::max(divBuffer[j][i] / (temp2[coord(j, 0)] = B * temp2[coord(j, 0)] + b1 * temp2[coord(j + 1, 0)] + b2 * temp2[coord(j + 2, 0)] + b3 * temp2[coord(j + 3, 0)]), 0.0);
-        }
-    }
-}
-
-template<class T> void gaussVerticalmult (T** src, T** dst, const int W, const int H, const double sigma)
-{
-    double b1, b2, b3, B, M[3][3];
-    calculateYvVFactors<double>(sigma, b1, b2, b3, B, M);
-
-    for (int i = 0; i < 3; i++)
-        for (int j = 0; j < 3; j++) {
-            M[i][j] /= (1.0 + b1 - b2 + b3) * (1.0 + b2 + (b1 - b3) * b3);
-        }
-
-    // process 'numcols' columns for better usage of L1 cpu cache (especially faster for large values of H)
-    static const int numcols = 8;
-    std::vector<double> temp2(H * numcols);
-    double temp2Hm1[numcols], temp2H[numcols], temp2Hp1[numcols];
-
-    auto coord =
-    [](const int &x, const int &y) -> int {
-        return x * numcols + y;
-    };
-#ifdef _OPENMP
-    #pragma omp for nowait
-#endif
-
-    for (int i = 0; i < W - numcols + 1; i += numcols) {
-        for (int k = 0; k < numcols; k++) {
-            temp2[coord(0, k)] = B * src[0][i + k] + b1 * src[0][i + k] + b2 * src[0][i + k] + b3 * src[0][i + k];
-            temp2[coord(1, k)] = B * src[1][i + k] + b1 * temp2[coord(0, k)] + b2 * src[0][i + k] + b3 * src[0][i + k];
-            temp2[coord(2, k)] = B * src[2][i + k] + b1 * temp2[coord(1, k)] + b2 * temp2[coord(0, k)] + b3 * src[0][i + k];
-        }
-
-        for (int j = 3; j < H; j++) {
-            for (int k = 0; k < numcols; k++) {
-                temp2[coord(j, k)] = B * src[j][i + k] + b1 * temp2[coord(j - 1, k)] + b2 * temp2[coord(j - 2, k)] + b3 * temp2[coord(j - 3, k)];
-            }
-        }
-
-        for (int k = 0; k < numcols; k++) {
-            temp2Hm1[k] = src[H - 1][i + k] + M[0][0] * (temp2[coord(H - 1, k)] - src[H - 1][i + k]) + M[0][1] * (temp2[coord(H - 2, k)] - src[H - 1][i + k]) + M[0][2] * (temp2[coord(H - 3, k)] - src[H - 1][i + k]);
-            temp2H[k]   = src[H - 1][i + k] + M[1][0] * (temp2[coord(H - 1, k)] - src[H - 1][i + k]) + M[1][1] * (temp2[coord(H - 2, k)] - src[H - 1][i + k]) + M[1][2] * (temp2[coord(H - 3, k)] - src[H - 1][i + k]);
-            temp2Hp1[k] = src[H - 1][i + k] + M[2][0] * (temp2[coord(H - 1, k)] - src[H - 1][i + k]) + M[2][1] * (temp2[coord(H - 2, k)] - src[H - 1][i + k]) + M[2][2] * (temp2[coord(H - 3, k)] - src[H - 1][i + k]);
-        }
-
-        for (int k = 0; k < numcols; k++) {
-            dst[H - 1][i + k] *= temp2[coord(H - 1, k)] = temp2Hm1[k];
-            dst[H - 2][i + k] *= temp2[coord(H - 2, k)] = B * temp2[coord(H - 2, k)] + b1 * temp2[coord(H - 1, k)] + b2 * temp2H[k] + b3 * temp2Hp1[k];
-            dst[H - 3][i + k] *= temp2[coord(H - 3, k)] = B * temp2[coord(H - 3, k)] + b1 * temp2[coord(H - 2, k)] + b2 * temp2[coord(H - 1, k)] + b3 * temp2H[k];
-        }
-
-        for (int j = H - 4; j >= 0; j--) {
-            for (int k = 0; k < numcols; k++) {
-                dst[j][i + k] *= (temp2[coord(j, k)] = B * temp2[coord(j, k)] + b1 * temp2[coord(j + 1, k)] + b2 * temp2[coord(j + 2, k)] + b3 * temp2[coord(j + 3, k)]);
-            }
-        }
-    }
-
-#ifdef _OPENMP
-    #pragma omp single
-#endif
-
-    // process remaining columns
-    for (int i = W - (W % numcols); i < W; i++) {
-        temp2[coord(0, 0)] = B * src[0][i] + b1 * src[0][i] + b2 * src[0][i] + b3 * src[0][i];
-        temp2[coord(1, 0)] = B * src[1][i] + b1 * temp2[coord(0, 0)]  + b2 * src[0][i] + b3 * src[0][i];
-        temp2[coord(2, 0)] = B * src[2][i] + b1 * temp2[coord(1, 0)]  + b2 * temp2[coord(0, 0)]  + b3 * src[0][i];
-
-        for (int j = 3; j < H; j++) {
-            temp2[coord(j, 0)] = B * src[j][i] + b1 * temp2[coord(j - 1, 0)] + b2 * temp2[coord(j - 2, 0)] + b3 * temp2[coord(j - 3, 0)];
-        }
-
-        double temp2Hm1 = src[H - 1][i] + M[0][0] * (temp2[coord(H - 1, 0)] - src[H - 1][i]) + M[0][1] * (temp2[coord(H - 2, 0)] - src[H - 1][i]) + M[0][2] * (temp2[coord(H - 3, 0)] - src[H - 1][i]);
-        double temp2H   = src[H - 1][i] + M[1][0] * (temp2[coord(H - 1, 0)] - src[H - 1][i]) + M[1][1] * (temp2[coord(H - 2, 0)] - src[H - 1][i]) + M[1][2] * (temp2[coord(H - 3, 0)] - src[H - 1][i]);
-        double temp2Hp1 = src[H - 1][i] + M[2][0] * (temp2[coord(H - 1, 0)] - src[H - 1][i]) + M[2][1] * (temp2[coord(H - 2, 0)] - src[H - 1][i]) + M[2][2] * (temp2[coord(H - 3, 0)] - src[H - 1][i]);
-
-        dst[H - 1][i] *= temp2[coord(H - 1, 0)] = temp2Hm1;
-        dst[H - 2][i] *= temp2[coord(H - 2, 0)] = B * temp2[coord(H - 2, 0)] + b1 * temp2[coord(H - 1, 0)] + b2 * temp2H + b3 * temp2Hp1;
-        dst[H - 3][i] *= temp2[coord(H - 3, 0)] = B * temp2[coord(H - 3, 0)] + b1 * temp2[coord(H - 2, 0)] + b2 * temp2[coord(H - 1, 0)] + b3 * temp2H;
-
-        for (int j = H - 4; j >= 0; j--) {
-            dst[j][i] *= (temp2[coord(j, 0)] = B * temp2[coord(j, 0)] + b1 * temp2[coord(j + 1, 0)] + b2 * temp2[coord(j + 2, 0)] + b3 * temp2[coord(j + 3, 0)]);
-        }
-    }
-}
-#endif
 
 template<class T> void gaussianBlurImpl(T** src, T** dst, const int W, const int H, const double sigma, bool useBoxBlur, eGaussType gausstype = GAUSS_STANDARD, T** buffer2 = nullptr)
 {
@@ -1470,47 +1024,6 @@ template<class T> void gaussianBlurImpl(T** src, T** dst, const int W, const int
                 gaussVertical3<T>   (dst, dst, W, H, c0, c1);
             }
         } else {
-#ifdef __SSE2__
-
-            if (sigma < GAUSS_DOUBLE) {
-                switch (gausstype) {
-                case GAUSS_MULT : {
-                    if (sigma <= GAUSS_5X5_LIMIT && src != dst) {
-                        gauss5x5mult(src, dst, W, H, sigma);
-                    } else if (sigma <= GAUSS_7X7_LIMIT && src != dst) {
-                        gauss7x7mult(src, dst, W, H, sigma);
-                    } else {
-                        gaussHorizontalSse<T> (src, src, W, H, sigma);
-                        gaussVerticalSsemult<T> (src, dst, W, H, sigma);
-                    }
-                    break;
-                }
-
-                case GAUSS_DIV : {
-                    if (sigma <= GAUSS_5X5_LIMIT && src != dst) {
-                        gauss5x5div (src, dst, buffer2, W, H, sigma);
-                    } else if (sigma <= GAUSS_7X7_LIMIT && src != dst) {
-                        gauss7x7div (src, dst, buffer2, W, H, sigma);
-                    } else {
-                        gaussHorizontalSse<T> (src, dst, W, H, sigma);
-                        gaussVerticalSsediv<T> (dst, dst, buffer2, W, H, sigma);
-                    }
-                    break;
-                }
-
-                case GAUSS_STANDARD : {
-                    gaussHorizontalSse<T> (src, dst, W, H, sigma);
-                    gaussVerticalSse<T> (dst, dst, W, H, sigma);
-                    break;
-                }
-                }
-            } else { // large sigma only with double precision
-                gaussHorizontal<T> (src, dst, W, H, sigma);
-                gaussVertical<T>   (dst, dst, W, H, sigma);
-            }
-
-#else
-
             if (sigma < GAUSS_DOUBLE) {
                 switch (gausstype) {
                 case GAUSS_MULT : {
@@ -1519,8 +1032,8 @@ template<class T> void gaussianBlurImpl(T** src, T** dst, const int W, const int
                     } else if (sigma <= GAUSS_7X7_LIMIT && src != dst) {
                         gauss7x7mult(src, dst, W, H, sigma);
                     } else {
-                        gaussHorizontal<T> (src, src, W, H, sigma);
-                        gaussVerticalmult<T> (src, dst, W, H, sigma);
+                        gaussHorizontalBlocks<T> (src, src, W, H, sigma);
+                        gaussVerticalBlocks<T> (src, dst, nullptr, GAUSS_MULT, W, H, sigma);
                     }
                     break;
                 }
@@ -1531,15 +1044,15 @@ template<class T> void gaussianBlurImpl(T** src, T** dst, const int W, const int
                     } else if (sigma <= GAUSS_7X7_LIMIT && src != dst) {
                         gauss7x7div (src, dst, buffer2, W, H, sigma);
                     } else {
-                        gaussHorizontal<T> (src, dst, W, H, sigma);
-                        gaussVerticaldiv<T> (dst, dst, buffer2, W, H, sigma);
+                        gaussHorizontalBlocks<T> (src, dst, W, H, sigma);
+                        gaussVerticalBlocks<T> (dst, dst, buffer2, GAUSS_DIV, W, H, sigma);
                     }
                     break;
                 }
 
                 case GAUSS_STANDARD : {
-                    gaussHorizontal<T> (src, dst, W, H, sigma);
-                    gaussVertical<T> (dst, dst, W, H, sigma);
+                    gaussHorizontalBlocks<T> (src, dst, W, H, sigma);
+                    gaussVerticalBlocks<T> (dst, dst, nullptr, GAUSS_STANDARD, W, H, sigma);
                     break;
                 }
                 }
@@ -1547,8 +1060,6 @@ template<class T> void gaussianBlurImpl(T** src, T** dst, const int W, const int
                 gaussHorizontal<T> (src, dst, W, H, sigma);
                 gaussVertical<T>   (dst, dst, W, H, sigma);
             }
-
-#endif
         }
     }
 }
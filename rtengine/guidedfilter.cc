@@ -28,33 +28,16 @@
  * available at https://arxiv.org/abs/1505.00996
  */
 
+#include <algorithm>
+
 #include "array2D.h"
 #include "boxblur.h"
 #include "guidedfilter.h"
-#include "boxblur.h"
 #include "sleef.h"
 #include "rescale.h"
-#include "imagefloat.h"
 
 namespace rtengine {
 
-#if 0
-#  define DEBUG_DUMP(arr)                                                 \
-    do {                                                                \
-        Imagefloat im(arr.width(), arr.height());                      \
-        const char *out = "/tmp/" #arr ".tif";                     \
-        for (int y = 0; y < im.getHeight(); ++y) {                      \
-            for (int x = 0; x < im.getWidth(); ++x) {                   \
-                im.r(y, x) = im.g(y, x) = im.b(y, x) = arr[y][x] * 65535.f; \
-            }                                                           \
-        }                                                               \
-        im.saveTIFF(out, 16);                                           \
-    } while (false)
-#else
-#  define DEBUG_DUMP(arr)
-#endif
-
-
 namespace {
 
 int calculate_subsampling(int w, int h, int r)
@@ -76,205 +59,178 @@ int calculate_subsampling(int w, int h, int r)
     return LIM(r / 2, 2, 4);
 }
 
-} // namespace
-
 
-void guidedFilter(const array2D<float> &guide, const array2D<float> &src, array2D<float> &dst, int r, float epsilon, bool multithread, int subsampling)
+// Filters all channels of src with the same guide. The statistics of the guide are
+// shared, the box means of all channels are computed in the same passes.
+void guidedFilterChannels(const array2D<float> &guide, const std::vector<const array2D<float> *> &src, const std::vector<array2D<float> *> &dst, int r, float epsilon, bool multithread, int subsampling)
 {
-
-    const int W = src.getWidth();
-    const int H = src.getHeight();
+    const int W = guide.getWidth();
+    const int H = guide.getHeight();
+    const int channels = src.size();
 
     if (subsampling <= 0) {
         subsampling = calculate_subsampling(W, H, r);
     }
 
-    enum Op { MUL, DIVEPSILON, ADD, SUB, ADDMUL, SUBMUL };
-
-    const auto apply =
-        [=](Op op, array2D<float> &res, const array2D<float> &a, const array2D<float> &b, const array2D<float> &c=array2D<float>()) -> void
-        {
-            const int w = res.getWidth();
-            const int h = res.getHeight();
-            
-#ifdef _OPENMP
-            #pragma omp parallel for if (multithread)
-#endif
-            for (int y = 0; y < h; ++y) {
-                for (int x = 0; x < w; ++x) {
-                    float r;
-                    float aa = a[y][x];
-                    float bb = b[y][x];
-                    switch (op) {
-                    case MUL:
-                        r = aa * bb;
-                        break;
-                    case DIVEPSILON:
-                        r = aa / (bb + epsilon);
-                        break;
-                    case ADD:
-                        r = aa + bb;
-                        break;
-                    case SUB:
-                        r = aa - bb;
-                        break;
-                    case ADDMUL:
-                        r = aa * bb + c[y][x];
-                        break;
-                    case SUBMUL:
-                        r = c[y][x] - (aa * bb);
-                        break;
-                    default:
-                        assert(false);
-                        r = 0;
-                        break;
-                    }
-                    res[y][x] = r;
-                }
-            }
-        };
+    const int w = W / subsampling;
+    const int h = H / subsampling;
+    const bool subsampled = w != W || h != H;
 
     // use the terminology of the paper (Algorithm 2)
-    const array2D<float> &I = guide;
-    const array2D<float> &p = src;
-    array2D<float> &q = dst;
-
-    const auto f_subsample =
-        [=](array2D<float> &d, const array2D<float> &s) -> void
-        {
-            if (d.getWidth() == s.getWidth() && d.getHeight() == s.getHeight()) {
-#ifdef _OPENMP
-#               pragma omp parallel for if (multithread)
-#endif
-                for (int y = 0; y < s.getHeight(); ++y) {
-                    for (int x = 0; x < s.getWidth(); ++x) {
-                        d[y][x] = s[y][x];
-                    }
-                }
-            } else {
-                rescaleBilinear(s, d, multithread);
-            }
-        };
+    array2D<float> I1;
+    std::vector<array2D<float>> p1(subsampled ? channels : 0);
+    std::vector<const float* const*> p(channels);
 
-    // const auto f_upsample = f_subsample;
-    
-    const size_t w = W / subsampling;
-    const size_t h = H / subsampling;
+    if (subsampled) {
+        I1(w, h);
+        rescaleBilinear(guide, I1, multithread);
+    }
 
-    const auto f_mean =
-        [multithread](array2D<float> &d, array2D<float> &s, int rad) -> void
-        {
-            rad = LIM(rad, 0, (min(s.getWidth(), s.getHeight()) - 1) / 2 - 1);
-           // boxblur(s, d, rad, s.getWidth(), s.getHeight(), multithread);
-            boxblur(static_cast<float**>(s), static_cast<float**>(d), rad, s.getWidth(), s.getHeight(), multithread);
-        };
+    std::vector<array2D<float>> a(channels);
+    std::vector<array2D<float>> b(channels);
+    std::vector<float**> planesa(channels);
+    std::vector<float**> planesb(channels);
+
+    for (int c = 0; c < channels; ++c) {
+        if (subsampled) {
+            p1[c](w, h);
+            rescaleBilinear(*src[c], p1[c], multithread);
+            p[c] = static_cast<float**>(p1[c]);
+        } else {
+            p[c] = *src[c];
+        }
 
-    array2D<float> I1(w, h);
-    array2D<float> p1(w, h);
+        a[c](w, h);
+        b[c](w, h);
+        planesa[c] = a[c];
+        planesb[c] = b[c];
+    }
 
-    f_subsample(I1, I);
-    f_subsample(p1, p);
+    const float* const* I = subsampled ? static_cast<float**>(I1) : static_cast<const float* const*>(guide);
+    const int r1 = LIM(static_cast<int>(float(r) / subsampling), 0, (min(w, h) - 1) / 2 - 1);
 
-    DEBUG_DUMP(I);
-    DEBUG_DUMP(p);
-    DEBUG_DUMP(I1);
-    DEBUG_DUMP(p1);
+    boxGuidedCoefficients(I, p, planesa, planesb, r1, epsilon, w, h, multithread);
 
-    float r1 = float(r) / subsampling;
+    if (!subsampled) {
+        std::vector<float**> q(channels);
 
-    array2D<float> meanI(w, h);
-    f_mean(meanI, I1, r1);
-    DEBUG_DUMP(meanI);
+        for (int c = 0; c < channels; ++c) {
+            q[c] = *dst[c];
+        }
 
-    array2D<float> meanp(w, h);
-    f_mean(meanp, p1, r1);
-    DEBUG_DUMP(meanp);
+        boxGuidedOutput(guide, std::vector<const float* const*>(planesa.begin(), planesa.end()), std::vector<const float* const*>(planesb.begin(), planesb.end()), q, r1, W, H, multithread);
+        return;
+    }
 
-    array2D<float> &corrIp = p1;
-    apply(MUL, corrIp, I1, p1);
-    f_mean(corrIp, corrIp, r1);
-    DEBUG_DUMP(corrIp);
+    p1.clear();
+    I1.free();
 
-    array2D<float> &corrI = I1;
-    apply(MUL, corrI, I1, I1);
-    f_mean(corrI, corrI, r1);
-    DEBUG_DUMP(corrI);
+    std::vector<float**> coefficients = planesa;
+    coefficients.insert(coefficients.end(), planesb.begin(), planesb.end());
+    boxblur(coefficients, r1, w, h, multithread);
 
-    array2D<float> &varI = corrI;
-    apply(SUBMUL, varI, meanI, meanI, corrI);
-    DEBUG_DUMP(varI);
+    // speedup by heckflosse67
+    const float col_scale = float(w) / float(W);
+    const float row_scale = float(h) / float(H);
+
+    // columns and weights of the bilinear interpolation, the same for all rows and channels
+    std::vector<int> xi(W);
+    std::vector<int> xi1(W);
+    std::vector<float> xf(W);
+
+    for (int x = 0; x < W; ++x) {
+        const float xs = x * col_scale;
+        xi[x] = xs;
+        xi1[x] = min(xi[x] + 1, w - 1);
+        xf[x] = xs - xi[x];
+    }
 
-    array2D<float> &covIp = corrIp;
-    apply(SUBMUL, covIp, meanI, meanp, corrIp);
-    DEBUG_DUMP(covIp);
+#ifdef _OPENMP
+#   pragma omp parallel if (multithread)
+#endif
+    {
+        // the guide may be one of the outputs
+        std::vector<float> guideRow(W);
 
-    array2D<float> &a = varI;
-    apply(DIVEPSILON, a, covIp, varI);
-    DEBUG_DUMP(a);
+#ifdef _OPENMP
+#       pragma omp for
+#endif
+        for (int y = 0; y < H; ++y) {
+            const float ymrs = y * row_scale;
+            const int yi = ymrs;
+            const int yi1 = min(yi + 1, h - 1);
+            const float yf = ymrs - yi;
+            std::copy(guide[y], guide[y] + W, guideRow.begin());
+
+            for (int c = 0; c < channels; ++c) {
+                const float* const a0 = a[c][yi];
+                const float* const a1 = a[c][yi1];
+                const float* const b0 = b[c][yi];
+                const float* const b1 = b[c][yi1];
+                float* const q = (*dst[c])[y];
+
+                for (int x = 0; x < W; ++x) {
+                    const float meana = intp(yf, intp(xf[x], a1[xi1[x]], a1[xi[x]]), intp(xf[x], a0[xi1[x]], a0[xi[x]]));
+                    const float meanb = intp(yf, intp(xf[x], b1[xi1[x]], b1[xi[x]]), intp(xf[x], b0[xi1[x]], b0[xi[x]]));
+                    q[x] = meana * guideRow[x] + meanb;
+                }
+            }
+        }
+    }
+}
 
-    array2D<float> &b = covIp;
-    apply(SUBMUL, b, a, meanI, meanp);
-    DEBUG_DUMP(b);
+} // namespace
 
-    array2D<float> &meana = a;
-    f_mean(meana, a, r1);
-    DEBUG_DUMP(meana);
 
-    array2D<float> &meanb = b;
-    f_mean(meanb, b, r1);
-    DEBUG_DUMP(meanb);
+void guidedFilter(const array2D<float> &guide, const array2D<float> &src, array2D<float> &dst, int r, float epsilon, bool multithread, int subsampling)
+{
+    guidedFilterChannels(guide, {&src}, {&dst}, r, epsilon, multithread, subsampling);
+}
 
-    // speedup by heckflosse67
-    const int Ws = meana.getWidth();
-    const int Hs = meana.getHeight();
-    const int Wd = q.getWidth();
-    const int Hd = q.getHeight();
-    const float col_scale = float(Ws) / float(Wd);
-    const float row_scale = float(Hs) / float(Hd);
 
-#ifdef _OPENMP
-#   pragma omp parallel for if (multithread)
-#endif
-    for (int y = 0; y < Hd; ++y) {
-        float ymrs = y * row_scale; 
-        for (int x = 0; x < Wd; ++x) {
-            q[y][x] = getBilinearValue(meana, x * col_scale, ymrs) * I[y][x] + getBilinearValue(meanb, x * col_scale, ymrs);
-        }
-    }
+void guidedFilter(const array2D<float> &guide, const std::vector<array2D<float> *> &chans, int r, float epsilon, bool multithread, int subsampling)
+{
+    guidedFilterChannels(guide, std::vector<const array2D<float> *>(chans.begin(), chans.end()), chans, r, epsilon, multithread, subsampling);
 }
 
 
-void guidedFilterLog(const array2D<float> &guide, float base, array2D<float> &chan, int r, float eps, bool multithread, int subsampling)
+void guidedFilterLog(const array2D<float> &guide, float base, const std::vector<array2D<float> *> &chans, int r, float eps, bool multithread, int subsampling)
 {
+    for (auto chan : chans) {
 #ifdef _OPENMP
 #    pragma omp parallel for if (multithread)
 #endif
-    for (int y = 0; y < chan.getHeight(); ++y) {
-        for (int x = 0; x < chan.getWidth(); ++x) {
-            chan[y][x] = xlin2log(max(chan[y][x], 0.f), base);
+        for (int y = 0; y < chan->getHeight(); ++y) {
+            for (int x = 0; x < chan->getWidth(); ++x) {
+                (*chan)[y][x] = xlin2log(max((*chan)[y][x], 0.f), base);
+            }
         }
     }
 
-    guidedFilter(guide, chan, chan, r, eps, multithread, subsampling);
+    guidedFilter(guide, chans, r, eps, multithread, subsampling);
 
+    for (auto chan : chans) {
 #ifdef _OPENMP
 #    pragma omp parallel for if (multithread)
 #endif
-    for (int y = 0; y < chan.getHeight(); ++y) {
-        for (int x = 0; x < chan.getWidth(); ++x) {
-            chan[y][x] = xlog2lin(max(chan[y][x], 0.f), base);
+        for (int y = 0; y < chan->getHeight(); ++y) {
+            for (int x = 0; x < chan->getWidth(); ++x) {
+                (*chan)[y][x] = xlog2lin(max((*chan)[y][x], 0.f), base);
+            }
         }
     }
 }
 
 
+void guidedFilterLog(const array2D<float> &guide, float base, array2D<float> &chan, int r, float eps, bool multithread, int subsampling)
+{
+    guidedFilterLog(guide, base, std::vector<array2D<float> *>{&chan}, r, eps, multithread, subsampling);
+}
+
+
 void guidedFilterLog(float base, array2D<float> &chan, int r, float eps, bool multithread, int subsampling)
 {
     guidedFilterLog(chan, base, chan, r, eps, multithread, subsampling);
 }
 
 } // namespace rtengine
-
-
-
-
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <vector>
+
 template<typename T> class array2D;
 
 namespace rtengine
@@ -28,8 +30,13 @@ namespace rtengine
 
 void guidedFilter(const array2D<float> &guide, const array2D<float> &src, array2D<float> &dst, int r, float epsilon, bool multithread, int subsampling=0);
 
+// In place filter of several channels with the same guide, faster than one call per channel
+void guidedFilter(const array2D<float> &guide, const std::vector<array2D<float> *> &chans, int r, float epsilon, bool multithread, int subsampling=0);
+
 void guidedFilterLog(float base, array2D<float> &chan, int r, float eps, bool multithread, int subsampling=0);
 
 void guidedFilterLog(const array2D<float> &guide, float base, array2D<float> &chan, int r, float eps, bool multithread, int subsampling=0);
 
+void guidedFilterLog(const array2D<float> &guide, float base, const std::vector<array2D<float> *> &chans, int r, float eps, bool multithread, int subsampling=0);
+
 } // namespace rtengine
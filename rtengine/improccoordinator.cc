@@ -17,6 +17,8 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <fstream>
+#include <map>
+#include <mutex>
 
 #include <glibmm/thread.h>
 
@@ -36,6 +38,8 @@
 #include "metadata.h"
 #include "labimage.h"
 #include "lcp.h"
+#include "mytime.h"
+#include "pipelinestages.h"
 #include "procparams.h"
 #include "tweakoperator.h"
 #include "refreshmap.h"
@@ -52,6 +56,12 @@ namespace
 
 constexpr int VECTORSCOPE_SIZE = 128;
 
+// Measured costs shared by all the editors, to decide whether a draft preview pays off:
+// it delays the real preview by one more pass of the pipeline.
+std::mutex draftCostsMutex;
+std::map<std::pair<int, Glib::ustring>, double> demosaicCosts; // usec per raw pixel, by sensor type and method
+int lastPassCost = -1; // usec of the last preview pass following a demosaic, without the demosaic
+
 }
 
 namespace rtengine
@@ -76,9 +86,14 @@ ImProcCoordinator::ImProcCoordinator() :
     gamutCheck(false),
     sharpMask(false),
     sharpMaskChanged(false),
+    locallabMaskChanged(false),
+    externalChange(false),
+    stagesValid(false),
     scale(10),
     highDetailPreprocessComputed(false),
     highDetailRawComputed(false),
+    draftAllowed(true),
+    draftDemosaiced(false),
     allocated(false),
     bwAutoR(-9000.f),
     bwAutoG(-9000.f),
@@ -163,6 +178,7 @@ ImProcCoordinator::ImProcCoordinator() :
     frameCountListener(nullptr),
     imageTypeListener(nullptr),
     filmNegListener(nullptr),
+    pipelineListener(nullptr),
     actListener(nullptr),
     primListener(nullptr),
     adnListener(nullptr),
@@ -349,6 +365,9 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
         }
     }
 
+    MyTime passStart;
+    bool passTimed = false;
+
     if (((todo & ALL) == ALL) || (todo & M_MONITOR) || panningRelatedChange || (highDetailNeeded && options.prevdemo != PD_Sidecar)) {
         bwAutoR = bwAutoG = bwAutoB = -9000.f;
 
@@ -445,23 +464,67 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
                 imgsrc->setBorder(params->raw.xtranssensor.border);
             }
 
-            bool autoContrast = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicAutoContrast : params->raw.xtranssensor.dualDemosaicAutoContrast;
-            double contrastThreshold = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicContrast : params->raw.xtranssensor.dualDemosaicContrast;
-            imgsrc->demosaic(rp, autoContrast, contrastThreshold, params->pdsharpening.enabled);
+            const std::pair<int, Glib::ustring> demosaicKey(
+                imgsrc->getSensorType(),
+                imgsrc->getSensorType() == ST_FUJI_XTRANS ? rp.xtranssensor.method : rp.bayersensor.method
+            );
+            int rawW = 0, rawH = 0;
+            imgsrc->getFullSize(rawW, rawH);
+
+            draftDemosaiced = false;
+
+            if (draftAllowed && !params->retinex.enabled) {
+                // Bin the raw data for the first preview of an image to show it sooner, if the demosaic
+                // method of rp took longer than the pass of the pipeline the draft adds. Until both were
+                // measured, the first image of a session is not drafted. process() runs the demosaic
+                // method of rp in the next update, then the whole pipeline runs again on its result.
+                bool slow = false;
+
+                {
+                    std::lock_guard<std::mutex> lock(draftCostsMutex);
+                    const auto cost = demosaicCosts.find(demosaicKey);
+                    slow = cost != demosaicCosts.end() && lastPassCost >= 0 && cost->second * rawW * rawH > lastPassCost;
+                }
+
+                if (slow) {
+                    draftDemosaiced = imgsrc->draftDemosaic(rp);
+                }
+            }
+
+            draftAllowed = false;
+
+            if (!draftDemosaiced) {
+                MyTime t1, t2;
+                t1.set();
+
+                bool autoContrast = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicAutoContrast : params->raw.xtranssensor.dualDemosaicAutoContrast;
+                double contrastThreshold = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicContrast : params->raw.xtranssensor.dualDemosaicContrast;
+                imgsrc->demosaic(rp, autoContrast, contrastThreshold, params->pdsharpening.enabled, true);
+
+                t2.set();
+
+                if (rawW > 0 && rawH > 0) {
+                    std::lock_guard<std::mutex> lock(draftCostsMutex);
+                    demosaicCosts[demosaicKey] = static_cast<double>(t2.etime(t1)) / rawW / rawH;
+                }
 
-            if (imgsrc->getSensorType() == ST_BAYER && bayerAutoContrastListener && autoContrast) {
-                bayerAutoContrastListener->autoContrastChanged(contrastThreshold);
-            } else if (imgsrc->getSensorType() == ST_FUJI_XTRANS && xtransAutoContrastListener && autoContrast) {
+                if (imgsrc->getSensorType() == ST_BAYER && bayerAutoContrastListener && autoContrast) {
+                    bayerAutoContrastListener->autoContrastChanged(contrastThreshold);
+                } else if (imgsrc->getSensorType() == ST_FUJI_XTRANS && xtransAutoContrastListener && autoContrast) {
 
-                xtransAutoContrastListener->autoContrastChanged(contrastThreshold);
+                    xtransAutoContrastListener->autoContrastChanged(contrastThreshold);
+                }
             }
 
+            passStart.set();
+            passTimed = true;
+
             // if a demosaic happened we should also call getimage later, so we need to set the M_INIT flag
             todo |= (M_INIT | M_CSHARP);
 
         }
 
-        if ((todo & (M_RAW | M_CSHARP)) && params->pdsharpening.enabled) {
+        if ((todo & (M_RAW | M_CSHARP)) && params->pdsharpening.enabled && !draftDemosaiced) {
             double pdSharpencontrastThreshold = params->pdsharpening.contrast;
             double pdSharpenRadius = params->pdsharpening.deconvradius;
             imgsrc->captureSharpening(params->pdsharpening, sharpMask, pdSharpencontrastThreshold, pdSharpenRadius);
@@ -482,7 +545,7 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
                 //  || (!params->toneCurve.hrenabled && params->toneCurve.method == "Color" && imgsrc->isRGBSourceModified())) {
                 || (params->toneCurve.hrenabled && !iscolor && imgsrc->isRGBSourceModified())
                 || (!params->toneCurve.hrenabled && iscolor && imgsrc->isRGBSourceModified())) {
-            if (highDetailNeeded) {
+            if (highDetailNeeded && !draftDemosaiced) {
                 highDetailRawComputed = true;
             } else {
                 highDetailRawComputed = false;
@@ -2373,6 +2436,13 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
         }
     }
 
+    if (passTimed) {
+        MyTime passEnd;
+        passEnd.set();
+        std::lock_guard<std::mutex> lock(draftCostsMutex);
+        lastPassCost = passEnd.etime(passStart);
+    }
+
     if (orig_prev != oprevi) {
         delete oprevi;
         oprevi = nullptr;
@@ -2487,6 +2557,7 @@ void ImProcCoordinator::setScale(int prevscale)
 
     scale = prevscale;
     resultValid = false;
+    stagesValid = false;
     fullw = fw;
     fullh = fh;
 
@@ -3075,6 +3146,7 @@ void ImProcCoordinator::startProcessing(int changeCode)
 {
     paramsUpdateMutex.lock();
     changeSinceLast |= changeCode;
+    externalChange = true;
     paramsUpdateMutex.unlock();
 
     startProcessing();
@@ -3131,9 +3203,19 @@ void ImProcCoordinator::process()
             || params->spot.enabled != nextParams->spot.enabled
             || sharpMaskChanged;
 
+        const int requested = changeSinceLast;
+        int change = requested;
+
+        // Stages whose parameters did not change keep their cached result. The
+        // tweaked params and changes made outside of the params can't be compared.
+        if (stagesValid && !externalChange && !sharpMaskChanged && !locallabMaskChanged && !tweakOperator && !paramsBackup) {
+            change = PipelineStages::prune(change, PipelineStages::getFirstChanged(*params, *nextParams));
+        }
+
         sharpMaskChanged = false;
+        locallabMaskChanged = false;
+        externalChange = false;
         *params = *nextParams;
-        int change = changeSinceLast;
         changeSinceLast = 0;
 
         if (tweakOperator) {
@@ -3149,9 +3231,46 @@ void ImProcCoordinator::process()
         // M_VOID means no update, and is a bit higher that the rest
         if (change & (~M_VOID)) {
             updatePreviewImage(change, panningRelatedChange);
+
+            if (change & M_INIT) {
+                // the raw stages are not affected by setScale()
+                stagesValid = true;
+            }
+        }
+
+        if ((requested & (~M_VOID)) && (pipelineListener || settings->verbose)) {
+            const auto recomputed = PipelineStages::getNames(change);
+            const auto reused = PipelineStages::getNames(requested & ~change);
+
+            if (settings->verbose) {
+                printf("Preview stages recomputed:");
+
+                for (const auto& stage : recomputed) {
+                    printf(" %s", stage.c_str());
+                }
+
+                printf(", reused:");
+
+                for (const auto& stage : reused) {
+                    printf(" %s", stage.c_str());
+                }
+
+                printf("\n");
+            }
+
+            if (pipelineListener) {
+                pipelineListener->pipelineUpdated(recomputed, reused);
+            }
         }
 
         paramsUpdateMutex.lock();
+
+        if (draftDemosaiced) {
+            // replace the draft preview, the params did not change so prune() must not drop it
+            changeSinceLast |= DEMOSAIC;
+            externalChange = true;
+            draftDemosaiced = false;
+        }
     }
 
     paramsUpdateMutex.unlock();
@@ -22,6 +22,7 @@
 
 #include "array2D.h"
 #include "colortemp.h"
+#include "cplx_wavelet_pool.h"
 #include "curves.h"
 #include "dcrop.h"
 #include "imagesource.h"
@@ -91,10 +92,16 @@ protected:
     bool gamutCheck;
     bool sharpMask;
     bool sharpMaskChanged;
+    bool locallabMaskChanged;
+    bool externalChange;  // startProcessing() has been called for a change not reflected in the params
+    bool stagesValid;     // the cached results of all the PipelineStages are up to date
     int scale;
     bool highDetailPreprocessComputed;
     bool highDetailRawComputed;
+    bool draftAllowed;    // the first demosaic may be replaced by draftDemosaic() if it is slower than a pass of the pipeline
+    bool draftDemosaiced; // the preview comes from draftDemosaic(), process() requests the real demosaic
     bool allocated;
+    WaveletBufferPool::Keeper waveletBuffers; // reuse the wavelet buffers in the following updates
 
     void freeAll();
 
@@ -193,6 +200,7 @@ protected:
     FrameCountListener *frameCountListener;
     ImageTypeListener *imageTypeListener;
     FilmNegListener *filmNegListener;
+    PipelineListener* pipelineListener;
     AutoColorTonListener* actListener;
     AutoprimListener* primListener;
     AutoChromaListener* adnListener;
@@ -459,6 +467,25 @@ public:
 
     void setLocallabMaskVisibility(bool previewDeltaE, int locallColorMask, int locallColorMaskinv, int locallExpMask, int locallExpMaskinv, int locallSHMask, int locallSHMaskinv, int locallvibMask, int locallsoftMask, int locallblMask, int localltmMask, int locallretiMask, int locallsharMask, int localllcMask, int locallcbMask, int localllogMask, int locall_Mask, int locallcieMask) override
     {
+        locallabMaskChanged = locallabMaskChanged
+            || this->previewDeltaE != previewDeltaE
+            || this->locallColorMask != locallColorMask
+            || this->locallColorMaskinv != locallColorMaskinv
+            || this->locallExpMask != locallExpMask
+            || this->locallExpMaskinv != locallExpMaskinv
+            || this->locallSHMask != locallSHMask
+            || this->locallSHMaskinv != locallSHMaskinv
+            || this->locallvibMask != locallvibMask
+            || this->locallsoftMask != locallsoftMask
+            || this->locallblMask != locallblMask
+            || this->localltmMask != localltmMask
+            || this->locallretiMask != locallretiMask
+            || this->locallsharMask != locallsharMask
+            || this->localllcMask != localllcMask
+            || this->locallcbMask != locallcbMask
+            || this->localllogMask != localllogMask
+            || this->locall_Mask != locall_Mask
+            || this->locallcieMask != locallcieMask;
         this->previewDeltaE = previewDeltaE;
         this->locallColorMask = locallColorMask;
         this->locallColorMaskinv = locallColorMaskinv;
@@ -589,6 +616,11 @@ public:
         filmNegListener = fnl;
     }
 
+    void setPipelineListener (PipelineListener* pl) override
+    {
+        pipelineListener = pl;
+    }
+
     void saveInputICCReference (const Glib::ustring& fname, bool apply_wb) override;
 
     InitialImage*  getInitialImage () override
@@ -521,6 +521,7 @@ void ImProcFunctions::ciecam_02float(CieImage* ncie, float adap, int pW, int pwb
                                      LUTu & histLCAM, LUTu & histCCAM, LUTf & CAMBrightCurveJ, LUTf & CAMBrightCurveQ, float &mean, int Iterates, int scale, bool execsharp, float &d, float &dj, float &yb, int rtt,
                                      bool showSharpMask)
 {
+    TRACEFUN
     if (params->colorappearance.enabled) {
         //preparate for histograms CIECAM
         LUTu hist16JCAM;
@@ -1971,6 +1972,7 @@ void ImProcFunctions::rgbProc(Imagefloat* working, LabImage* lab, PipetteBuffer
                               double &rrm, double &ggm, double &bbm, float &autor, float &autog, float &autob, double expcomp, int hlcompr, int hlcomprthresh,
                               DCPProfile *dcpProf, const DCPProfileApplyState& asIn, LUTu& histToneCurve, size_t chunkSize, bool measure)
 {
+    TRACEFUN
 
     std::unique_ptr<StopWatch> stop;
 
@@ -4099,6 +4101,7 @@ void ImProcFunctions::luminanceCurve(LabImage* lold, LabImage* lnew, const LUTf&
 
 void ImProcFunctions::chromiLuminanceCurve(PipetteBuffer *pipetteBuffer, int pW, LabImage* lold, LabImage* lnew, const LUTf& acurve, const LUTf& bcurve, const LUTf& satcurve, const LUTf& lhskcurve, const LUTf& clcurve, LUTf & curve, bool utili, bool autili, bool butili, bool ccutili, bool cclutili, bool clcutili, LUTu &histCCurve, LUTu &histLCurve)
 {
+    TRACEFUN
     int W = lold->W;
     int H = lold->H;
 
@@ -5036,6 +5039,7 @@ void ImProcFunctions::badpixlab(LabImage* lab, double rad, int thr, float chrom)
 
 void ImProcFunctions::dirpyrequalizer(LabImage* lab, int scale)
 {
+    TRACEFUN
     if (params->dirpyrequalizer.enabled && lab->W >= 8 && lab->H >= 8) {
         float b_l = static_cast<float>(params->dirpyrequalizer.hueskin.getBottomLeft()) / 100.f;
         float t_l = static_cast<float>(params->dirpyrequalizer.hueskin.getTopLeft()) / 100.f;
@@ -307,6 +307,7 @@ void extract_channels(Imagefloat *img, array2D<float> &r, array2D<float> &g, arr
 
 void ImProcFunctions::dehaze(Imagefloat *img, const DehazeParams &dehazeParams)
 {
+    TRACEFUN
     if (!dehazeParams.enabled || dehazeParams.strength == 0.0) {
         return;
     }
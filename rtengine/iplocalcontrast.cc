@@ -28,12 +28,14 @@
 #include "improcfun.h"
 #include "procparams.h"
 #include "settings.h"
+#include "StopWatch.h"
 
 namespace rtengine
 {
 
 void ImProcFunctions::localContrast(LabImage *lab, float **destination, const rtengine::procparams::LocalContrastParams &localContrastParams, bool fftwlc, double scale)
 {
+    TRACEFUN
     if (!localContrastParams.enabled) {
         return;
     }
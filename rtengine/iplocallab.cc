@@ -13067,6 +13067,7 @@ void ImProcFunctions::Lab_Local(
 
     )
 {
+    TRACEFUN
     //general call of others functions : important return hueref, chromaref, lumaref
     if (!params->locallab.enabled) {
         return;
@@ -13774,8 +13775,7 @@ void ImProcFunctions::Lab_Local(
                         if (lp.chromet == 0) {
                             rtengine::guidedFilterLog(guide, 10.f, LL, r, epsil, multiThread);
                         } else if (lp.chromet == 1) {
-                            rtengine::guidedFilterLog(guide, 10.f, rr, r, epsil, multiThread);
-                            rtengine::guidedFilterLog(guide, 10.f, bb, r, epsil, multiThread);
+                            rtengine::guidedFilterLog(guide, 10.f, {&rr, &bb}, r, epsil, multiThread);
                         } else if (lp.chromet == 2) {
                             rtengine::guidedFilterLog(10.f, gg, r, epsil, multiThread);
                             rtengine::guidedFilterLog(10.f, rr, r, epsil, multiThread);
@@ -13929,8 +13929,7 @@ void ImProcFunctions::Lab_Local(
                         if (lp.chromet == 0) {
                             rtengine::guidedFilterLog(guide, 10.f, LL, r, epsil, multiThread);
                         } else if (lp.chromet == 1) {
-                            rtengine::guidedFilterLog(guide, 10.f, rr, r, epsil, multiThread);
-                            rtengine::guidedFilterLog(guide, 10.f, bb, r, epsil, multiThread);
+                            rtengine::guidedFilterLog(guide, 10.f, {&rr, &bb}, r, epsil, multiThread);
                         } else if (lp.chromet == 2) {
                             rtengine::guidedFilterLog(10.f, gg, r, epsil, multiThread);
                             rtengine::guidedFilterLog(10.f, rr, r, epsil, multiThread);
@@ -26,6 +26,7 @@
 #include "rt_math.h"
 #include "procparams.h"
 #include "sleef.h"
+#include "StopWatch.h"
 
 //#define PROFILE
 
@@ -51,6 +52,7 @@ static inline float Lanc (float x, float a)
 
 void ImProcFunctions::Lanczos (const Imagefloat* src, Imagefloat* dst, float scale)
 {
+    TRACEFUN
 
     const float delta = 1.0f / scale;
     const float a = 3.0f;
@@ -187,6 +189,7 @@ void ImProcFunctions::Lanczos (const Imagefloat* src, Imagefloat* dst, float sca
 
 void ImProcFunctions::Lanczos (const LabImage* src, LabImage* dst, float scale)
 {
+    TRACEFUN
     const float delta = 1.0f / scale;
     constexpr float a = 3.0f;
     const float sc = min(scale, 1.0f);
@@ -425,6 +428,7 @@ float ImProcFunctions::resizeScale (const ProcParams* params, int fw, int fh, in
 
 void ImProcFunctions::resize (Imagefloat* src, Imagefloat* dst, float dScale)
 {
+    TRACEFUN
 #ifdef PROFILE
     time_t t1 = clock();
 #endif
@@ -350,6 +350,7 @@ void ImProcFunctions::deconvsharpeningloc (float** luminance, float** tmp, int W
 
 void ImProcFunctions::sharpening (LabImage* lab, const procparams::SharpeningParams &sharpenParam, bool showMask)
 {
+    TRACEFUN
 
     if ((!sharpenParam.enabled) || sharpenParam.amount < 1 || lab->W < 8 || lab->H < 8) {
         return;
@@ -63,6 +63,7 @@ void fillCurveArrayVib (DiagonalCurve* diagCurve, LUTf &outCurve)
  */
 void ImProcFunctions::vibrance (LabImage* lab, const procparams::VibranceParams &vibranceParams, bool highlight, const Glib::ustring &workingProfile)
 {
+    TRACEFUN
     if (!vibranceParams.enabled) {
         return;
     }
@@ -23,8 +23,11 @@
 //
 ////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
+#include <vector>
 
 #include "array2D.h"
 #include "color.h"
@@ -177,6 +180,154 @@ struct cont_params {
 
 int wavNestedLevels = 1;
 
+namespace
+{
+
+// Sums over the detail coefficients of wavelet decompositions, so that tiles
+// of an image give the statistics Evaluate2 would compute on the whole image
+class WaveletStatistics
+{
+public:
+    // Adds the coefficients [left, right) x [top, bottom) of every level,
+    // in coordinates of the subsampled levels
+    void add(const wavelet_decomposition& decomposition, int left, int top, int right, int bottom)
+    {
+        levels = rtengine::min(decomposition.maxlevel(), 10);
+
+        for (int lvl = 0; lvl < levels; ++lvl) {
+            const int W = decomposition.level_W(lvl);
+            const int H = decomposition.level_H(lvl);
+            const float* const* coeffs = decomposition.level_coeffs(lvl);
+
+            for (int dir = 1; dir < 4; ++dir) {
+                Sums& sums = data[lvl][dir - 1];
+
+                for (int i = top; i < rtengine::min(bottom, H); ++i) {
+                    for (int j = left; j < rtengine::min(right, W); ++j) {
+                        const float val = coeffs[dir][i * W + j];
+
+                        if (val >= thres) {
+                            sums.sumP += val;
+                            sums.sqrP += SQR(static_cast<double>(val));
+                            sums.maxP = rtengine::max(sums.maxP, val);
+                            ++sums.countP;
+                        } else if (val < -thres) {
+                            sums.sumN += val;
+                            sums.sqrN += SQR(static_cast<double>(val));
+                            sums.minN = rtengine::min(sums.minN, val);
+                            ++sums.countN;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void merge(const WaveletStatistics& other)
+    {
+        levels = rtengine::max(levels, other.levels);
+
+        for (int lvl = 0; lvl < other.levels; ++lvl) {
+            for (int dir = 0; dir < 3; ++dir) {
+                Sums& sums = data[lvl][dir];
+                const Sums& add = other.data[lvl][dir];
+                sums.sumP += add.sumP;
+                sums.sqrP += add.sqrP;
+                sums.sumN += add.sumN;
+                sums.sqrN += add.sqrN;
+                sums.countP += add.countP;
+                sums.countN += add.countN;
+                sums.maxP = rtengine::max(sums.maxP, add.maxP);
+                sums.minN = rtengine::min(sums.minN, add.minN);
+            }
+        }
+    }
+
+    // Same results as Evaluate2, averaged over the three directions of each level
+    void get(float* mean, float* meanN, float* sigma, float* sigmaN, float* MaxP, float* MaxN) const
+    {
+        for (int lvl = 0; lvl < levels; ++lvl) {
+            float avP = 0.f, avN = 0.f, sigP = 0.f, sigN = 0.f, maxP = 0.f, minN = 0.f;
+
+            for (int dir = 0; dir < 3; ++dir) {
+                const Sums& sums = data[lvl][dir];
+
+                if (sums.countP > 0) {
+                    const double av = sums.sumP / sums.countP;
+                    avP += av;
+                    sigP += std::sqrt(rtengine::max(0.0, sums.sqrP / sums.countP - SQR(av)));
+                }
+
+                if (sums.countN > 0) {
+                    const double av = sums.sumN / sums.countN;
+                    avN += av;
+                    sigN += std::sqrt(rtengine::max(0.0, sums.sqrN / sums.countN - SQR(av)));
+                }
+
+                maxP += sums.maxP;
+                minN += sums.minN;
+            }
+
+            mean[lvl] = avP / 3;
+            meanN[lvl] = avN / 3;
+            sigma[lvl] = sigP / 3;
+            sigmaN[lvl] = sigN / 3;
+            MaxP[lvl] = maxP / 3;
+            MaxN[lvl] = minN / 3;
+        }
+    }
+
+private:
+    // threshold of ImProcFunctions::Aver
+    static constexpr float thres = 32.7f;
+
+    struct Sums {
+        double sumP = 0.0;
+        double sqrP = 0.0;
+        double sumN = 0.0;
+        double sqrN = 0.0;
+        long countP = 0;
+        long countN = 0;
+        float maxP = 0.f;
+        float minN = 0.f;
+    };
+
+    int levels = 0;
+    Sums data[10][3];
+};
+
+// 3x3 median of L in the blue sky, to avoid artifacts there. The first and last rows and columns are not changed
+void blueSkyMedian(float** L, const float* const* hue, const float* const* chroma, int W, int H, int numThreads)
+{
+    std::vector<float> tmL(W * H);
+
+    for (int i = 1; i < H - 1; i++) {
+        for (int j = 1; j < W - 1; j++) {
+            tmL[i * W + j] = L[i][j];
+        }
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(numThreads) if (numThreads>1)
+#endif
+
+    for (int i = 1; i < H - 1; i++) {
+        for (int j = 1; j < W - 1; j++) {
+            if ((hue[i][j] < -1.3f && hue[i][j] > - 2.5f)  && (chroma[i][j] > 15.f && chroma[i][j] < 55.f) && L[i][j] > 6000.f) { //blue sky + med3x3  ==> after for more effect use denoise
+                tmL[i * W + j] = median(L[i][j], L[i - 1][j], L[i + 1][j], L[i][j + 1], L[i][j - 1], L[i - 1][j - 1], L[i - 1][j + 1], L[i + 1][j - 1], L[i + 1][j + 1]);      //3x3
+            }
+        }
+    }
+
+    for (int i = 1; i < H - 1; i++) {
+        for (int j = 1; j < W - 1; j++) {
+            L[i][j] = tmL[i * W + j];
+        }
+    }
+}
+
+}
+
 std::unique_ptr<LUTf> ImProcFunctions::buildMeaLut(const float inVals[11], const float mea[10], float& lutFactor)
 {
     constexpr int lutSize = 100;
@@ -217,6 +368,7 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
 
 
 {
+    TRACEFUN
     TMatrix wiprof = ICCStore::getInstance()->workingSpaceInverseMatrix(params->icm.workingProfile);
     const double wip[3][3] = {
         {wiprof[0][0], wiprof[0][1], wiprof[0][2]},
@@ -717,6 +869,23 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
     */
     int tilesize = 128 * realtile;
     int overlap = (int) tilesize * 0.125f;
+
+    if (realtile > 0) {
+        // half the overlap covers the support of the filters of the first 7
+        // levels, so that their coefficients in the part of a tile not shared
+        // with its neighbours do not depend on the tile borders. The support
+        // of the coarser levels would make the tiles as large as the image:
+        // the statistics of levels 7 to 9 still depend on the tiling.
+        int support = DaubLen;
+
+        for (int level = 1; level < rtengine::min(levwav, 7); ++level) {
+            support += 2 * rtengine::max(1, (1 << (level - 1)) / skip);
+        }
+
+        overlap = rtengine::max(overlap, 2 * support);
+        tilesize = rtengine::max(tilesize, 4 * overlap);
+    }
+
     int numtiles_W, numtiles_H, tilewidth, tileheight, tileWskip, tileHskip;
 
     if (params->wavelet.Tilesmethod == "full") {
@@ -837,7 +1006,91 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
     if (settings->verbose) {
         printf("Ip Wavelet uses %d main thread(s) and up to %d nested thread(s) for each main thread\n", numthreads, wavNestedLevels);
     }
+#endif
+
+    // With tiles, the contrast of the levels uses the statistics of the whole
+    // image, otherwise it changes from one tile to the next. They come from a
+    // first pass which only decomposes the tiles, each one contributing the
+    // part of its coefficients it does not share with its neighbours. They
+    // are exact for levels 0 to 6 only, see the overlap above. This pass costs
+    // about as much as the decompositions of the main pass, which can't be
+    // kept for it without holding the whole image decomposed.
+    WaveletStatistics imageStats[3];
+
+    if (numtiles > 1) {
+        // levels of the decomposition of L in the tiles, at least 6 or 7
+        const int levstat = rtengine::min(rtengine::max(levwav, 7), maxlevelcrop, maxlev2);
+        // with chroma denoise, a and b of every tile use their statistics after denoise
+        const bool abDenoised = cp.noiseena && (cp.chromfi > 0.f || (cp.chromco > 0.f && cp.quamet == 0))
+                                && (cp.lev0n > 0.1f || cp.lev1n > 0.1f || cp.lev2n > 0.1f || cp.lev3n > 0.1f || cp.lev4n > 0.1f);
+        const int statChannels = abDenoised ? 1 : 3;
+        const int numtilesStat_W = (imwidth + tileWskip - 1) / tileWskip;
+        const int numtilesStat_H = (imheight + tileHskip - 1) / tileHskip;
+        std::vector<std::array<WaveletStatistics, 3>> tileStats(numtilesStat_W * numtilesStat_H);
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic) collapse(2) num_threads(numthreads)
+#endif
+
+        for (int tiletop = 0; tiletop < imheight; tiletop += tileHskip) {
+            for (int tileleft = 0; tileleft < imwidth ; tileleft += tileWskip) {
+                const int tileright = rtengine::min(imwidth, tileleft + tilewidth);
+                const int tilebottom = rtengine::min(imheight, tiletop + tileheight);
+                const int width  = tileright - tileleft;
+                const int height = tilebottom - tiletop;
+                // tile borders are even, the pixels 2 * k and 2 * k + 1 give the coefficient k
+                const int left = tileleft > 0 ? overlap / 4 : 0;
+                const int top = tiletop > 0 ? overlap / 4 : 0;
+                const int right = (tileright < imwidth ? width - overlap / 2 + 1 : width + 1) / 2;
+                const int bottom = (tilebottom < imheight ? height - overlap / 2 + 1 : height + 1) / 2;
+                std::array<WaveletStatistics, 3>& stats = tileStats[(tiletop / tileHskip) * numtilesStat_W + tileleft / tileWskip];
+                std::vector<float> channel(width * height);
+
+                for (int c = 0; c < statChannels; ++c) {
+                    const float* const* src = c == 0 ? lab->L : c == 1 ? lab->a : lab->b;
+
+                    for (int i = 0; i < height; ++i) {
+                        std::copy(src[tiletop + i] + tileleft, src[tiletop + i] + tileright, channel.data() + i * width);
+                    }
+
+                    if (c == 0 && params->wavelet.median) {
+                        // the same prefilter as the L of the tiles in the main pass
+                        array2D<float> tilehue(width, height);
+                        array2D<float> tilechro(width, height);
+                        std::vector<float*> rows(height);
+
+                        for (int i = 0; i < height; ++i) {
+                            for (int j = 0; j < width; ++j) {
+                                const float a = lab->a[tiletop + i][tileleft + j];
+                                const float b = lab->b[tiletop + i][tileleft + j];
+                                tilehue[i][j] = xatan2f(b, a);
+                                tilechro[i][j] = std::sqrt(a * a + b * b) / 327.68f;
+                            }
+
+                            rows[i] = channel.data() + i * width;
+                        }
+
+                        blueSkyMedian(rows.data(), tilehue, tilechro, width, height, 1);
+                    }
+
+                    const wavelet_decomposition decomposition(channel.data(), width, height, levstat, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen);
+
+                    if (!decomposition.memory_allocation_failed()) {
+                        stats[c].add(decomposition, left, top, right, bottom);
+                    }
+                }
+            }
+        }
+
+        // merged in a fixed order, the result does not depend on the threads
+        for (const auto& stats : tileStats) {
+            for (int c = 0; c < 3; ++c) {
+                imageStats[c].merge(stats[c]);
+            }
+        }
+    }
 
+#ifdef _OPENMP
     #pragma omp parallel num_threads(numthreads)
 #endif
     {
@@ -946,46 +1199,7 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
 
                 //to avoid artifacts in blue sky
                 if (params->wavelet.median) {
-                    float** tmL;
-                    int wid = labco->W;
-                    int hei = labco->H;
-                    int borderL = 1;
-                    tmL = new float*[hei];
-
-                    for (int i = 0; i < hei; i++) {
-                        tmL[i] = new float[wid];
-                    }
-
-                    for (int i = borderL; i < hei - borderL; i++) {
-                        for (int j = borderL; j < wid - borderL; j++) {
-                            tmL[i][j] = labco->L[i][j];
-                        }
-                    }
-
-#ifdef _OPENMP
-                    #pragma omp parallel for num_threads(wavNestedLevels) if (wavNestedLevels>1)
-#endif
-
-                    for (int i = 1; i < hei - 1; i++) {
-                        for (int j = 1; j < wid - 1; j++) {
-                            if ((varhue[i][j] < -1.3f && varhue[i][j] > - 2.5f)  && (varchro[i][j] > 15.f && varchro[i][j] < 55.f) && labco->L[i][j] > 6000.f) { //blue sky + med3x3  ==> after for more effect use denoise
-                                tmL[i][j] = median(labco->L[i][j], labco->L[i - 1][j], labco->L[i + 1][j], labco->L[i][j + 1], labco->L[i][j - 1], labco->L[i - 1][j - 1], labco->L[i - 1][j + 1], labco->L[i + 1][j - 1], labco->L[i + 1][j + 1]);      //3x3
-                            }
-                        }
-                    }
-
-                    for (int i = borderL; i < hei - borderL; i++) {
-                        for (int j = borderL; j < wid - borderL; j++) {
-                            labco->L[i][j] = tmL[i][j];
-                        }
-                    }
-
-                    for (int i = 0; i < hei; i++) {
-                        delete [] tmL[i];
-                    }
-
-                    delete [] tmL;
-                    // end blue sky
+                    blueSkyMedian(labco->L, varhue, varchro, labco->W, labco->H, wavNestedLevels);
                 }
 
                 if (numtiles == 1) {
@@ -1483,6 +1697,10 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                             Chutili = true;
                         }
 
+                        if (numtiles > 1) {
+                            imageStats[0].get(mean, meanN, sigma, sigmaN, MaxP, MaxN);
+                        }
+
                         WaveletcontAllL(labco, varhue, varchro, *Ldecomp, wavblcurve, cp, skip, mean, sigma, MaxP, MaxN, wavCLVCcurve, waOpacityCurveW, waOpacityCurveSH, ChCurve, Chutili);
 
                         if (cp.val > 0 || ref || contr  || cp.diagcurv) { //edge
@@ -1756,7 +1974,11 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                                     if(levwava == 6) {
                                         edge = 1;
                                     }
+                                    bool denoised = false;
+
                                     if (cp.noiseena && ((cp.chromfi > 0.f || cp.chromco > 0.f) && cp.quamet == 0 && isdenoisL)) {
+                                        denoised = true;
+
                                         if (settings->verbose) {
                                             printf("denoise standard a \n");
                                         }
@@ -1764,6 +1986,8 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                                        WaveletDenoiseAllAB(*Ldecomp, *adecomp, noisevarchrom, madL, variC, edge, noisevarab_r, true, false, false, 1);
 
                                     } else if (cp.noiseena && ((cp.chromfi > 0.f && cp.chromco >= 0.f) && cp.quamet == 1 && isdenoisL)){
+                                        denoised = true;
+
                                         if (settings->verbose) {
                                             printf("denoise bishrink a \n");
                                         }
@@ -1773,7 +1997,12 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                                        
                                     }
 
-                                    Evaluate2(*adecomp, meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab, wavNestedLevels);
+                                    // the whole image statistics are taken before denoise
+                                    if (numtiles > 1 && !denoised) {
+                                        imageStats[1].get(meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab);
+                                    } else {
+                                        Evaluate2(*adecomp, meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab, wavNestedLevels);
+                                    }
 
                                     WaveletcontAllAB(labco, varhue, varchro, *adecomp, wavblcurve, waOpacityCurveW, cp, true, skip, meanab, sigmaab);
 
@@ -1812,14 +2041,17 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                                 }
 
                                 if (!bdecomp->memory_allocation_failed()) {
+                                    bool denoised = false;
+
                                   //  if (cp.noiseena && ((cp.chromfi > 0.f || cp.chromco > 0.f) && cp.chromco < 2.f )) {
                                     if (cp.noiseena && ((cp.chromfi > 0.f || cp.chromco > 0.f) &&  cp.quamet == 0 && isdenoisL)) {
+                                        denoised = true;
                                         WaveletDenoiseAllAB(*Ldecomp, *bdecomp, noisevarchrom, madL, variCb, edge, noisevarab_r, true, false, false, 1);
                                         if (settings->verbose) {
                                             printf("Denoise standard b\n");
                                         }
                                     } else if (cp.noiseena && ((cp.chromfi > 0.f && cp.chromco >= 0.f) && cp.quamet == 1 && isdenoisL)){
-
+                                        denoised = true;
                                         WaveletDenoiseAll_BiShrinkAB(*Ldecomp, *bdecomp, noisevarchrom, madL, variCb, edge, noisevarab_r, true, false, false, 1);
                                         WaveletDenoiseAllAB(*Ldecomp, *bdecomp, noisevarchrom, madL, variCb, edge, noisevarab_r, true, false, false, 1);
                                         if (settings->verbose) {
@@ -1828,7 +2060,11 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
 
                                     }
 
-                                    Evaluate2(*bdecomp, meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab, wavNestedLevels);
+                                    if (numtiles > 1 && !denoised) {
+                                        imageStats[2].get(meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab);
+                                    } else {
+                                        Evaluate2(*bdecomp, meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab, wavNestedLevels);
+                                    }
                                     WaveletcontAllAB(labco, varhue, varchro, *bdecomp, wavblcurve, waOpacityCurveW, cp, false, skip, meanab, sigmaab);
                                     bdecomp->reconstruct(labco->data + 2 * datalen, cp.strength);
                                 }
@@ -1847,6 +2083,9 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                                 const std::unique_ptr<wavelet_decomposition> bdecomp(new wavelet_decomposition(labco->data + 2 * datalen, labco->W, labco->H, levwavab, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen));
 
                                 if (!adecomp->memory_allocation_failed() && !bdecomp->memory_allocation_failed()) {
+                                    // a and b get the same chroma denoise
+                                    const bool denoised = cp.noiseena && (cp.chromfi > 0.f || cp.chromco > 0.f) && isdenoisL;
+
                                     if (cp.noiseena && ((cp.chromfi > 0.f || cp.chromco > 0.f) && cp.quamet == 0 && isdenoisL)) {
                                         WaveletDenoiseAllAB(*Ldecomp, *adecomp, noisevarchrom, madL, variC, edge, noisevarab_r, true, false, false, 1);
                                         if (settings->verbose) {
@@ -1860,7 +2099,11 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                                         }
                                     }
 
-                                    Evaluate2(*adecomp, meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab, wavNestedLevels);
+                                    if (numtiles > 1 && !denoised) {
+                                        imageStats[1].get(meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab);
+                                    } else {
+                                        Evaluate2(*adecomp, meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab, wavNestedLevels);
+                                    }
                                     WaveletcontAllAB(labco, varhue, varchro, *adecomp, wavblcurve, waOpacityCurveW, cp, true, skip, meanab, sigmaab);
                                     if (cp.noiseena && ((cp.chromfi > 0.f || cp.chromco > 0.f) && cp.quamet == 0 && isdenoisL)) {
                                         WaveletDenoiseAllAB(*Ldecomp, *bdecomp, noisevarchrom, madL, variCb, edge, noisevarab_r, true, false, false, 1);
@@ -1869,7 +2112,11 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                                         WaveletDenoiseAllAB(*Ldecomp, *bdecomp, noisevarchrom, madL, variCb, edge, noisevarab_r, true, false, false, 1);
                                     }
 
-                                    Evaluate2(*bdecomp, meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab, wavNestedLevels);
+                                    if (numtiles > 1 && !denoised) {
+                                        imageStats[2].get(meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab);
+                                    } else {
+                                        Evaluate2(*bdecomp, meanab, meanNab, sigmaab, sigmaNab, MaxPab, MaxNab, wavNestedLevels);
+                                    }
 
                                     WaveletcontAllAB(labco, varhue, varchro, *bdecomp, wavblcurve, waOpacityCurveW, cp, false, skip, meanab, sigmaab);
                                     WaveletAandBAllAB(*adecomp, *bdecomp, cp, hhCurve, hhutili);
@@ -2047,13 +2294,12 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                             }
 
                             if (numtiles > 1) {
-                                float factor = Vmask[i1] * Hmask[j1];
                                 if(L <= 0.f) {
                                     L= 1.f;
                                 }
-                                dsttmp->L[i][j] += factor * L;
-                                dsttmp->a[i][j] += factor * a;
-                                dsttmp->b[i][j] += factor * b;
+                                labco->L[i1][j1] = L;
+                                labco->a[i1][j1] = a;
+                                labco->b[i1][j1] = b;
                             } else {
                                 if(L <= 0.f) {
                                     L= 1.f;
@@ -2065,6 +2311,24 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                             }
                         }
                     }
+
+                    if (numtiles > 1) {
+                        // the overlaps are shared with tiles processed by other threads
+#ifdef _OPENMP
+                        #pragma omp critical(waveletTileOutput)
+#endif
+                        for (int i = tiletop; i < tilebottom; i++) {
+                            const int i1 = i - tiletop;
+
+                            for (int j = tileleft; j < tileright; j++) {
+                                const int j1 = j - tileleft;
+                                const float factor = Vmask[i1] * Hmask[j1];
+                                dsttmp->L[i][j] += factor * labco->L[i1][j1];
+                                dsttmp->a[i][j] += factor * labco->a[i1][j1];
+                                dsttmp->b[i][j] += factor * labco->b[i1][j1];
+                            }
+                        }
+                    }
                 }
 
                 if (LoldBuffer != nullptr) {
@@ -160,7 +160,7 @@ private:
     explicit LCPStore(unsigned int _cache_size = 32);
 
     // Maps file name to profile as cache
-    mutable Cache<Glib::ustring, std::shared_ptr<LCPProfile>> cache;
+    mutable ShardedCache<Glib::ustring, std::shared_ptr<LCPProfile>> cache;
 };
 
 class LensCorrection {
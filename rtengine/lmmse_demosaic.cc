@@ -17,6 +17,7 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <cmath>
+#include <cstring>
 
 #include "rawimagesource.h"
 #include "rt_math.h"
@@ -25,6 +26,9 @@
 #include "sleef.h"
 #include "opthelper.h"
 #include "median.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
@@ -38,7 +42,8 @@ namespace rtengine
 // Dec. 2005.
 // Adapted to RawTherapee by Jacques Desmis 3/2013
 // Improved speed and reduced memory consumption by Ingo Weyrich 2/2015
-// TODO Tiles to reduce memory consumption
+// Tiled version: each thread runs all passes on tiles which fit into its L2 cache.
+// The tiles overlap by the reach of the passes, so the result does not depend on the tiling.
 void RawImageSource::lmmse_interpolate_omp(int winw, int winh, const array2D<float> &rawData, array2D<float> &red, array2D<float> &green, array2D<float> &blue, int iterations)
 {
     // Test for RGB cfa
@@ -54,13 +59,21 @@ void RawImageSource::lmmse_interpolate_omp(int winw, int winh, const array2D<flo
     }
 
     const int width = winw, height = winh;
+    // the passes work on a frame with a border of ba pixels around the image
     const int ba = 10;
     const int rr1 = height + 2 * ba;
     const int cc1 = width + 2 * ba;
-    const int w1 = cc1;
-    const int w2 = 2 * w1;
-    const int w3 = 3 * w1;
-    const int w4 = 4 * w1;
+    // reach of the passes: 2 (G-R(B)) + 4 (low pass) + 4 (LMMSE) + 2 (bilinear R/B) + 3 (median iterations) = 15
+    // must be even to keep the cfa pattern of the frame
+    constexpr int tileBorder = 16;
+    constexpr int tileSize = 256; // 5 planes of 256 x 256 floats, 1.25 MB per thread
+    constexpr int tileSizeN = tileSize - 2 * tileBorder;
+    const int numTh = height / tileSizeN + ((height % tileSizeN) ? 1 : 0);
+    const int numTw = width / tileSizeN + ((width % tileSizeN) ? 1 : 0);
+    constexpr int w1 = tileSize;
+    constexpr int w2 = 2 * w1;
+    constexpr int w3 = 3 * w1;
+    constexpr int w4 = 4 * w1;
     float h0, h1, h2, h3, h4, hs;
     h0 = 1.0f;
     h1 = exp( -1.0f / 8.0f);
@@ -96,565 +109,482 @@ void RawImageSource::lmmse_interpolate_omp(int winw, int winh, const array2D<flo
         applyGamma = true;
     }
 
-    float *rix[5];
-    float *qix[5];
-    float *buffer = (float *)calloc(static_cast<size_t>(rr1) * cc1 * 5 * sizeof(float), 1);
-
-    if (buffer == nullptr) { // allocation of big block of memory failed, try to get 5 smaller ones
-        printf("lmmse_interpolate_omp: allocation of big memory block failed, try to get 5 smaller ones now...\n");
-        bool allocationFailed = false;
-
-        for (int i = 0; i < 5; i++) {
-            qix[i] = (float *)calloc(static_cast<size_t>(rr1) * cc1 * sizeof(float), 1);
-
-            if (!qix[i]) { // allocation of at least one small block failed
-                allocationFailed = true;
-            }
-        }
-
-        if (allocationFailed) { // fall back to igv_interpolate
-            printf("lmmse_interpolate_omp: allocation of 5 small memory blocks failed, falling back to igv_interpolate...\n");
-
-            for (int i = 0; i < 5; i++) { // free the already allocated buffers
-                if (qix[i]) {
-                    free(qix[i]);
-                }
-            }
-
-            igv_interpolate(winw, winh);
-            return;
-        }
-    } else {
-        qix[0] = buffer;
+#ifdef _OPENMP
+    const int numThreads = omp_get_max_threads();
+#else
+    const int numThreads = 1;
+#endif
+    // 5 planes of tileSize x tileSize floats for each thread
+    float *buffers = (float *)malloc(static_cast<size_t>(numThreads) * tileSize * tileSize * 5 * sizeof(float));
 
-        for (int i = 1; i < 5; i++) {
-            qix[i] = qix[i - 1] + rr1 * cc1;
-        }
+    if (buffers == nullptr) {
+        printf("lmmse_interpolate_omp: allocation of the tile buffers failed, falling back to igv_interpolate\n");
+        igv_interpolate(winw, winh);
+        return;
     }
 
+    double progress = 0.0;
+
     if (plistener) {
         plistener->setProgressStr (Glib::ustring::compose(M("TP_RAW_DMETHOD_PROGRESSBAR"), M("TP_RAW_LMMSE")));
-        plistener->setProgress (0.0);
+        plistener->setProgress (progress);
     }
 
 
     LUTf *gamtab;
+    LUTf *igamtab;
 
     if (applyGamma) {
         gamtab = &(Color::gammatab_24_17a);
+        igamtab = &(Color::igammatab_24_17);
     } else {
         gamtab = new LUTf(65536, LUT_CLIP_BELOW);
         gamtab->makeIdentity(65535.f);
+        igamtab = new LUTf(65536, LUT_CLIP_BELOW);
+        igamtab->makeIdentity();
     }
 
+    array2D<float>* rgb[3];
+    rgb[0] = &red;
+    rgb[1] = &green;
+    rgb[2] = &blue;
 
 #ifdef _OPENMP
-    #pragma omp parallel private(rix)
+    #pragma omp parallel num_threads(numThreads)
 #endif
     {
+    int progresscounter = 0;
+    float *rix[5];
+    float *qix[5];
 #ifdef _OPENMP
-        #pragma omp for
+    float *buffer = buffers + static_cast<size_t>(omp_get_thread_num()) * tileSize * tileSize * 5;
+#else
+    float *buffer = buffers;
 #endif
+    qix[0] = buffer;
 
-        for (int rrr = ba; rrr < rr1 - ba; rrr++) {
-            for (int ccc = ba, row = rrr - ba; ccc < cc1 - ba; ccc++) {
-                int col = ccc - ba;
-                float *rix = qix[4] + rrr * cc1 + ccc;
-                rix[0] = (*gamtab)[rawData[row][col]];
-            }
-        }
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.1);
-            }
-        }
+    for (int i = 1; i < 5; i++) {
+        qix[i] = qix[i - 1] + tileSize * tileSize;
+    }
 
-        // G-R(B)
 #ifdef _OPENMP
-        #pragma omp for schedule(dynamic,16)
+    #pragma omp for schedule(dynamic) collapse(2) nowait
 #endif
 
-        for (int rr = 2; rr < rr1 - 2; rr++) {
-            // G-R(B) at R(B) location
-            for (int cc = 2 + (FC(rr, 2) & 1); cc < cc1 - 2; cc += 2) {
-                rix[4] = qix[4] + rr * cc1 + cc;
-                float v0 = 0.0625f * (rix[4][-w1 - 1] + rix[4][-w1 + 1] + rix[4][w1 - 1] + rix[4][w1 + 1]) + 0.25f * (rix[4][0]);
-                // horizontal
-                rix[0] = qix[0] + rr * cc1 + cc;
-                rix[0][0] = -0.25f * (rix[4][ -2] + rix[4][ 2]) + xdiv2f(rix[4][ -1] + rix[4][0] + rix[4][ 1]);
-                float Y = v0 + xdiv2f(rix[0][0]);
-
-                if (rix[4][0] > 1.75f * Y) {
-                    rix[0][0] = median(rix[0][0], rix[4][ -1], rix[4][ 1]);
-                } else {
-                    rix[0][0] = LIM(rix[0][0], 0.0f, 1.0f);
-                }
-
-                rix[0][0] -= rix[4][0];
-                // vertical
-                rix[1] = qix[1] + rr * cc1 + cc;
-                rix[1][0] = -0.25f * (rix[4][-w2] + rix[4][w2]) + xdiv2f(rix[4][-w1] + rix[4][0] + rix[4][w1]);
-                Y = v0 + xdiv2f(rix[1][0]);
-
-                if (rix[4][0] > 1.75f * Y) {
-                    rix[1][0] = median(rix[1][0], rix[4][-w1], rix[4][w1]);
-                } else {
-                    rix[1][0] = LIM(rix[1][0], 0.0f, 1.0f);
+    for (int tr = 0; tr < numTh; ++tr) {
+        for (int tc = 0; tc < numTw; ++tc) {
+            // image rows and columns of the tile without its border
+            const int rowStart = tr * tileSizeN;
+            const int rowEnd = std::min(rowStart + tileSizeN, height);
+            const int colStart = tc * tileSizeN;
+            const int colEnd = std::min(colStart + tileSizeN, width);
+            // frame rows and columns of the tile including its border, which is cut at the frame
+            const int rrStart = std::max(rowStart + ba - tileBorder, 0);
+            const int ccStart = std::max(colStart + ba - tileBorder, 0);
+            const int tileRows = std::min(rowEnd + ba + tileBorder, rr1) - rrStart;
+            const int tileCols = std::min(colEnd + ba + tileBorder, cc1) - ccStart;
+
+            // the frame outside the ranges computed by the passes is zero
+            memset(buffer, 0, static_cast<size_t>(tileSize) * tileSize * 4 * sizeof(float));
+
+            for (int rrr = 0, row = rrStart - ba; rrr < tileRows; rrr++, row++) {
+                for (int ccc = 0, col = ccStart - ba; ccc < tileCols; ccc++, col++) {
+                    float *rix = qix[4] + rrr * w1 + ccc;
+
+                    if ((row >= 0) & (row < height) & (col >= 0) & (col < width)) {
+                        rix[0] = (*gamtab)[rawData[row][col]];
+                    } else {
+                        rix[0] = 0.f;
+                    }
                 }
-
-                rix[1][0] -= rix[4][0];
-            }
-
-            // G-R(B) at G location
-            for (int ccc = 2 + (FC(rr, 3) & 1); ccc < cc1 - 2; ccc += 2) {
-                rix[0] = qix[0] + rr * cc1 + ccc;
-                rix[1] = qix[1] + rr * cc1 + ccc;
-                rix[4] = qix[4] + rr * cc1 + ccc;
-                rix[0][0] = 0.25f * (rix[4][ -2] + rix[4][ 2]) - xdiv2f(rix[4][ -1] + rix[4][0] + rix[4][ 1]);
-                rix[1][0] = 0.25f * (rix[4][-w2] + rix[4][w2]) - xdiv2f(rix[4][-w1] + rix[4][0] + rix[4][w1]);
-                rix[0][0] = LIM(rix[0][0], -1.0f, 0.0f) + rix[4][0];
-                rix[1][0] = LIM(rix[1][0], -1.0f, 0.0f) + rix[4][0];
             }
-        }
 
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.2);
-            }
-        }
+            // G-R(B)
+            for (int rr = 2; rr < tileRows - 2; rr++) {
+                // G-R(B) at R(B) location
+                for (int cc = 2 + (FC(rrStart + rr, ccStart + 2) & 1); cc < tileCols - 2; cc += 2) {
+                    rix[4] = qix[4] + rr * w1 + cc;
+                    float v0 = 0.0625f * (rix[4][-w1 - 1] + rix[4][-w1 + 1] + rix[4][w1 - 1] + rix[4][w1 + 1]) + 0.25f * (rix[4][0]);
+                    // horizontal
+                    rix[0] = qix[0] + rr * w1 + cc;
+                    rix[0][0] = -0.25f * (rix[4][ -2] + rix[4][ 2]) + xdiv2f(rix[4][ -1] + rix[4][0] + rix[4][ 1]);
+                    float Y = v0 + xdiv2f(rix[0][0]);
+
+                    if (rix[4][0] > 1.75f * Y) {
+                        rix[0][0] = median(rix[0][0], rix[4][ -1], rix[4][ 1]);
+                    } else {
+                        rix[0][0] = LIM(rix[0][0], 0.0f, 1.0f);
+                    }
 
+                    rix[0][0] -= rix[4][0];
+                    // vertical
+                    rix[1] = qix[1] + rr * w1 + cc;
+                    rix[1][0] = -0.25f * (rix[4][-w2] + rix[4][w2]) + xdiv2f(rix[4][-w1] + rix[4][0] + rix[4][w1]);
+                    Y = v0 + xdiv2f(rix[1][0]);
 
-        // apply low pass filter on differential colors
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+                    if (rix[4][0] > 1.75f * Y) {
+                        rix[1][0] = median(rix[1][0], rix[4][-w1], rix[4][w1]);
+                    } else {
+                        rix[1][0] = LIM(rix[1][0], 0.0f, 1.0f);
+                    }
 
-        for (int rr = 4; rr < rr1 - 4; rr++)
-            for (int cc = 4; cc < cc1 - 4; cc++) {
-                rix[0] = qix[0] + rr * cc1 + cc;
-                rix[2] = qix[2] + rr * cc1 + cc;
-                rix[2][0] = h0 * rix[0][0] + h1 * (rix[0][ -1] + rix[0][ 1]) + h2 * (rix[0][ -2] + rix[0][ 2]) + h3 * (rix[0][ -3] + rix[0][ 3]) + h4 * (rix[0][ -4] + rix[0][ 4]);
-                rix[1] = qix[1] + rr * cc1 + cc;
-                rix[3] = qix[3] + rr * cc1 + cc;
-                rix[3][0] = h0 * rix[1][0] + h1 * (rix[1][-w1] + rix[1][w1]) + h2 * (rix[1][-w2] + rix[1][w2]) + h3 * (rix[1][-w3] + rix[1][w3]) + h4 * (rix[1][-w4] + rix[1][w4]);
-            }
+                    rix[1][0] -= rix[4][0];
+                }
 
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.3);
+                // G-R(B) at G location
+                for (int ccc = 2 + (FC(rrStart + rr, ccStart + 3) & 1); ccc < tileCols - 2; ccc += 2) {
+                    rix[0] = qix[0] + rr * w1 + ccc;
+                    rix[1] = qix[1] + rr * w1 + ccc;
+                    rix[4] = qix[4] + rr * w1 + ccc;
+                    rix[0][0] = 0.25f * (rix[4][ -2] + rix[4][ 2]) - xdiv2f(rix[4][ -1] + rix[4][0] + rix[4][ 1]);
+                    rix[1][0] = 0.25f * (rix[4][-w2] + rix[4][w2]) - xdiv2f(rix[4][-w1] + rix[4][0] + rix[4][w1]);
+                    rix[0][0] = LIM(rix[0][0], -1.0f, 0.0f) + rix[4][0];
+                    rix[1][0] = LIM(rix[1][0], -1.0f, 0.0f) + rix[4][0];
+                }
             }
-        }
 
-        // interpolate G-R(B) at R(B)
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+            // apply low pass filter on differential colors
+            for (int rr = 4; rr < tileRows - 4; rr++)
+                for (int cc = 4; cc < tileCols - 4; cc++) {
+                    rix[0] = qix[0] + rr * w1 + cc;
+                    rix[2] = qix[2] + rr * w1 + cc;
+                    rix[2][0] = h0 * rix[0][0] + h1 * (rix[0][ -1] + rix[0][ 1]) + h2 * (rix[0][ -2] + rix[0][ 2]) + h3 * (rix[0][ -3] + rix[0][ 3]) + h4 * (rix[0][ -4] + rix[0][ 4]);
+                    rix[1] = qix[1] + rr * w1 + cc;
+                    rix[3] = qix[3] + rr * w1 + cc;
+                    rix[3][0] = h0 * rix[1][0] + h1 * (rix[1][-w1] + rix[1][w1]) + h2 * (rix[1][-w2] + rix[1][w2]) + h3 * (rix[1][-w3] + rix[1][w3]) + h4 * (rix[1][-w4] + rix[1][w4]);
+                }
 
-        for (int rr = 4; rr < rr1 - 4; rr++) {
-            int cc = 4 + (FC(rr, 4) & 1);
+            // interpolate G-R(B) at R(B)
+            for (int rr = 4; rr < tileRows - 4; rr++) {
+                int cc = 4 + (FC(rrStart + rr, ccStart + 4) & 1);
 #ifdef __SSE2__
-            vfloat p1v, p2v, p3v, p4v, p5v, p6v, p7v, p8v, p9v, muv, vxv, vnv, xhv, vhv, xvv, vvv;
-            vfloat epsv = F2V(1e-7);
-            vfloat ninev = F2V(9.f);
-
-            for (; cc < cc1 - 10; cc += 8) {
-                rix[0] = qix[0] + rr * cc1 + cc;
-                rix[1] = qix[1] + rr * cc1 + cc;
-                rix[2] = qix[2] + rr * cc1 + cc;
-                rix[3] = qix[3] + rr * cc1 + cc;
-                rix[4] = qix[4] + rr * cc1 + cc;
-                // horizontal
-                p1v = LC2VFU(rix[2][-4]);
-                p2v = LC2VFU(rix[2][-3]);
-                p3v = LC2VFU(rix[2][-2]);
-                p4v = LC2VFU(rix[2][-1]);
-                p5v = LC2VFU(rix[2][ 0]);
-                p6v = LC2VFU(rix[2][ 1]);
-                p7v = LC2VFU(rix[2][ 2]);
-                p8v = LC2VFU(rix[2][ 3]);
-                p9v = LC2VFU(rix[2][ 4]);
-                muv = (p1v + p2v + p3v + p4v + p5v + p6v + p7v + p8v + p9v) / ninev;
-                vxv = epsv + SQRV(p1v - muv) + SQRV(p2v - muv) + SQRV(p3v - muv) + SQRV(p4v - muv) + SQRV(p5v - muv) + SQRV(p6v - muv) + SQRV(p7v - muv) + SQRV(p8v - muv) + SQRV(p9v - muv);
-                p1v -= LC2VFU(rix[0][-4]);
-                p2v -= LC2VFU(rix[0][-3]);
-                p3v -= LC2VFU(rix[0][-2]);
-                p4v -= LC2VFU(rix[0][-1]);
-                p5v -= LC2VFU(rix[0][ 0]);
-                p6v -= LC2VFU(rix[0][ 1]);
-                p7v -= LC2VFU(rix[0][ 2]);
-                p8v -= LC2VFU(rix[0][ 3]);
-                p9v -= LC2VFU(rix[0][ 4]);
-                vnv = epsv + SQRV(p1v) + SQRV(p2v) + SQRV(p3v) + SQRV(p4v) + SQRV(p5v) + SQRV(p6v) + SQRV(p7v) + SQRV(p8v) + SQRV(p9v);
-                xhv = (LC2VFU(rix[0][0]) * vxv + LC2VFU(rix[2][0]) * vnv) / (vxv + vnv);
-                vhv = vxv * vnv / (vxv + vnv);
-
-                // vertical
-                p1v = LC2VFU(rix[3][-w4]);
-                p2v = LC2VFU(rix[3][-w3]);
-                p3v = LC2VFU(rix[3][-w2]);
-                p4v = LC2VFU(rix[3][-w1]);
-                p5v = LC2VFU(rix[3][  0]);
-                p6v = LC2VFU(rix[3][ w1]);
-                p7v = LC2VFU(rix[3][ w2]);
-                p8v = LC2VFU(rix[3][ w3]);
-                p9v = LC2VFU(rix[3][ w4]);
-                muv = (p1v + p2v + p3v + p4v + p5v + p6v + p7v + p8v + p9v) / ninev;
-                vxv = epsv + SQRV(p1v - muv) + SQRV(p2v - muv) + SQRV(p3v - muv) + SQRV(p4v - muv) + SQRV(p5v - muv) + SQRV(p6v - muv) + SQRV(p7v - muv) + SQRV(p8v - muv) + SQRV(p9v - muv);
-                p1v -= LC2VFU(rix[1][-w4]);
-                p2v -= LC2VFU(rix[1][-w3]);
-                p3v -= LC2VFU(rix[1][-w2]);
-                p4v -= LC2VFU(rix[1][-w1]);
-                p5v -= LC2VFU(rix[1][  0]);
-                p6v -= LC2VFU(rix[1][ w1]);
-                p7v -= LC2VFU(rix[1][ w2]);
-                p8v -= LC2VFU(rix[1][ w3]);
-                p9v -= LC2VFU(rix[1][ w4]);
-                vnv = epsv + SQRV(p1v) + SQRV(p2v) + SQRV(p3v) + SQRV(p4v) + SQRV(p5v) + SQRV(p6v) + SQRV(p7v) + SQRV(p8v) + SQRV(p9v);
-                xvv = (LC2VFU(rix[1][0]) * vxv + LC2VFU(rix[3][0]) * vnv) / (vxv + vnv);
-                vvv = vxv * vnv / (vxv + vnv);
-                // interpolated G-R(B)
-                muv = (xhv * vvv + xvv * vhv) / (vhv + vvv);
-                STC2VFU(rix[4][0], muv);
-            }
+                vfloat p1v, p2v, p3v, p4v, p5v, p6v, p7v, p8v, p9v, muv, vxv, vnv, xhv, vhv, xvv, vvv;
+                vfloat epsv = F2V(1e-7);
+                vfloat ninev = F2V(9.f);
+
+                for (; cc < tileCols - 10; cc += 8) {
+                    rix[0] = qix[0] + rr * w1 + cc;
+                    rix[1] = qix[1] + rr * w1 + cc;
+                    rix[2] = qix[2] + rr * w1 + cc;
+                    rix[3] = qix[3] + rr * w1 + cc;
+                    rix[4] = qix[4] + rr * w1 + cc;
+                    // horizontal
+                    p1v = LC2VFU(rix[2][-4]);
+                    p2v = LC2VFU(rix[2][-3]);
+                    p3v = LC2VFU(rix[2][-2]);
+                    p4v = LC2VFU(rix[2][-1]);
+                    p5v = LC2VFU(rix[2][ 0]);
+                    p6v = LC2VFU(rix[2][ 1]);
+                    p7v = LC2VFU(rix[2][ 2]);
+                    p8v = LC2VFU(rix[2][ 3]);
+                    p9v = LC2VFU(rix[2][ 4]);
+                    muv = (p1v + p2v + p3v + p4v + p5v + p6v + p7v + p8v + p9v) / ninev;
+                    vxv = epsv + SQRV(p1v - muv) + SQRV(p2v - muv) + SQRV(p3v - muv) + SQRV(p4v - muv) + SQRV(p5v - muv) + SQRV(p6v - muv) + SQRV(p7v - muv) + SQRV(p8v - muv) + SQRV(p9v - muv);
+                    p1v -= LC2VFU(rix[0][-4]);
+                    p2v -= LC2VFU(rix[0][-3]);
+                    p3v -= LC2VFU(rix[0][-2]);
+                    p4v -= LC2VFU(rix[0][-1]);
+                    p5v -= LC2VFU(rix[0][ 0]);
+                    p6v -= LC2VFU(rix[0][ 1]);
+                    p7v -= LC2VFU(rix[0][ 2]);
+                    p8v -= LC2VFU(rix[0][ 3]);
+                    p9v -= LC2VFU(rix[0][ 4]);
+                    vnv = epsv + SQRV(p1v) + SQRV(p2v) + SQRV(p3v) + SQRV(p4v) + SQRV(p5v) + SQRV(p6v) + SQRV(p7v) + SQRV(p8v) + SQRV(p9v);
+                    xhv = (LC2VFU(rix[0][0]) * vxv + LC2VFU(rix[2][0]) * vnv) / (vxv + vnv);
+                    vhv = vxv * vnv / (vxv + vnv);
+
+                    // vertical
+                    p1v = LC2VFU(rix[3][-w4]);
+                    p2v = LC2VFU(rix[3][-w3]);
+                    p3v = LC2VFU(rix[3][-w2]);
+                    p4v = LC2VFU(rix[3][-w1]);
+                    p5v = LC2VFU(rix[3][  0]);
+                    p6v = LC2VFU(rix[3][ w1]);
+                    p7v = LC2VFU(rix[3][ w2]);
+                    p8v = LC2VFU(rix[3][ w3]);
+                    p9v = LC2VFU(rix[3][ w4]);
+                    muv = (p1v + p2v + p3v + p4v + p5v + p6v + p7v + p8v + p9v) / ninev;
+                    vxv = epsv + SQRV(p1v - muv) + SQRV(p2v - muv) + SQRV(p3v - muv) + SQRV(p4v - muv) + SQRV(p5v - muv) + SQRV(p6v - muv) + SQRV(p7v - muv) + SQRV(p8v - muv) + SQRV(p9v - muv);
+                    p1v -= LC2VFU(rix[1][-w4]);
+                    p2v -= LC2VFU(rix[1][-w3]);
+                    p3v -= LC2VFU(rix[1][-w2]);
+                    p4v -= LC2VFU(rix[1][-w1]);
+                    p5v -= LC2VFU(rix[1][  0]);
+                    p6v -= LC2VFU(rix[1][ w1]);
+                    p7v -= LC2VFU(rix[1][ w2]);
+                    p8v -= LC2VFU(rix[1][ w3]);
+                    p9v -= LC2VFU(rix[1][ w4]);
+                    vnv = epsv + SQRV(p1v) + SQRV(p2v) + SQRV(p3v) + SQRV(p4v) + SQRV(p5v) + SQRV(p6v) + SQRV(p7v) + SQRV(p8v) + SQRV(p9v);
+                    xvv = (LC2VFU(rix[1][0]) * vxv + LC2VFU(rix[3][0]) * vnv) / (vxv + vnv);
+                    vvv = vxv * vnv / (vxv + vnv);
+                    // interpolated G-R(B)
+                    muv = (xhv * vvv + xvv * vhv) / (vhv + vvv);
+                    STC2VFU(rix[4][0], muv);
+                }
 
 #endif
 
-            for (; cc < cc1 - 4; cc += 2) {
-                rix[0] = qix[0] + rr * cc1 + cc;
-                rix[1] = qix[1] + rr * cc1 + cc;
-                rix[2] = qix[2] + rr * cc1 + cc;
-                rix[3] = qix[3] + rr * cc1 + cc;
-                rix[4] = qix[4] + rr * cc1 + cc;
-                // horizontal
-                float p1 = rix[2][-4];
-                float p2 = rix[2][-3];
-                float p3 = rix[2][-2];
-                float p4 = rix[2][-1];
-                float p5 = rix[2][ 0];
-                float p6 = rix[2][ 1];
-                float p7 = rix[2][ 2];
-                float p8 = rix[2][ 3];
-                float p9 = rix[2][ 4];
-                float mu = (p1 + p2 + p3 + p4 + p5 + p6 + p7 + p8 + p9) / 9.f;
-                float vx = 1e-7f + SQR(p1 - mu) + SQR(p2 - mu) + SQR(p3 - mu) + SQR(p4 - mu) + SQR(p5 - mu) + SQR(p6 - mu) + SQR(p7 - mu) + SQR(p8 - mu) + SQR(p9 - mu);
-                p1 -= rix[0][-4];
-                p2 -= rix[0][-3];
-                p3 -= rix[0][-2];
-                p4 -= rix[0][-1];
-                p5 -= rix[0][ 0];
-                p6 -= rix[0][ 1];
-                p7 -= rix[0][ 2];
-                p8 -= rix[0][ 3];
-                p9 -= rix[0][ 4];
-                float vn = 1e-7f + SQR(p1) + SQR(p2) + SQR(p3) + SQR(p4) + SQR(p5) + SQR(p6) + SQR(p7) + SQR(p8) + SQR(p9);
-                float xh = (rix[0][0] * vx + rix[2][0] * vn) / (vx + vn);
-                float vh = vx * vn / (vx + vn);
-
-                // vertical
-                p1 = rix[3][-w4];
-                p2 = rix[3][-w3];
-                p3 = rix[3][-w2];
-                p4 = rix[3][-w1];
-                p5 = rix[3][  0];
-                p6 = rix[3][ w1];
-                p7 = rix[3][ w2];
-                p8 = rix[3][ w3];
-                p9 = rix[3][ w4];
-                mu = (p1 + p2 + p3 + p4 + p5 + p6 + p7 + p8 + p9) / 9.f;
-                vx = 1e-7f + SQR(p1 - mu) + SQR(p2 - mu) + SQR(p3 - mu) + SQR(p4 - mu) + SQR(p5 - mu) + SQR(p6 - mu) + SQR(p7 - mu) + SQR(p8 - mu) + SQR(p9 - mu);
-                p1 -= rix[1][-w4];
-                p2 -= rix[1][-w3];
-                p3 -= rix[1][-w2];
-                p4 -= rix[1][-w1];
-                p5 -= rix[1][  0];
-                p6 -= rix[1][ w1];
-                p7 -= rix[1][ w2];
-                p8 -= rix[1][ w3];
-                p9 -= rix[1][ w4];
-                vn = 1e-7f + SQR(p1) + SQR(p2) + SQR(p3) + SQR(p4) + SQR(p5) + SQR(p6) + SQR(p7) + SQR(p8) + SQR(p9);
-                float xv = (rix[1][0] * vx + rix[3][0] * vn) / (vx + vn);
-                float vv = vx * vn / (vx + vn);
-                // interpolated G-R(B)
-                rix[4][0] = (xh * vv + xv * vh) / (vh + vv);
-            }
-        }
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.4);
+                for (; cc < tileCols - 4; cc += 2) {
+                    rix[0] = qix[0] + rr * w1 + cc;
+                    rix[1] = qix[1] + rr * w1 + cc;
+                    rix[2] = qix[2] + rr * w1 + cc;
+                    rix[3] = qix[3] + rr * w1 + cc;
+                    rix[4] = qix[4] + rr * w1 + cc;
+                    // horizontal
+                    float p1 = rix[2][-4];
+                    float p2 = rix[2][-3];
+                    float p3 = rix[2][-2];
+                    float p4 = rix[2][-1];
+                    float p5 = rix[2][ 0];
+                    float p6 = rix[2][ 1];
+                    float p7 = rix[2][ 2];
+                    float p8 = rix[2][ 3];
+                    float p9 = rix[2][ 4];
+                    float mu = (p1 + p2 + p3 + p4 + p5 + p6 + p7 + p8 + p9) / 9.f;
+                    float vx = 1e-7f + SQR(p1 - mu) + SQR(p2 - mu) + SQR(p3 - mu) + SQR(p4 - mu) + SQR(p5 - mu) + SQR(p6 - mu) + SQR(p7 - mu) + SQR(p8 - mu) + SQR(p9 - mu);
+                    p1 -= rix[0][-4];
+                    p2 -= rix[0][-3];
+                    p3 -= rix[0][-2];
+                    p4 -= rix[0][-1];
+                    p5 -= rix[0][ 0];
+                    p6 -= rix[0][ 1];
+                    p7 -= rix[0][ 2];
+                    p8 -= rix[0][ 3];
+                    p9 -= rix[0][ 4];
+                    float vn = 1e-7f + SQR(p1) + SQR(p2) + SQR(p3) + SQR(p4) + SQR(p5) + SQR(p6) + SQR(p7) + SQR(p8) + SQR(p9);
+                    float xh = (rix[0][0] * vx + rix[2][0] * vn) / (vx + vn);
+                    float vh = vx * vn / (vx + vn);
+
+                    // vertical
+                    p1 = rix[3][-w4];
+                    p2 = rix[3][-w3];
+                    p3 = rix[3][-w2];
+                    p4 = rix[3][-w1];
+                    p5 = rix[3][  0];
+                    p6 = rix[3][ w1];
+                    p7 = rix[3][ w2];
+                    p8 = rix[3][ w3];
+                    p9 = rix[3][ w4];
+                    mu = (p1 + p2 + p3 + p4 + p5 + p6 + p7 + p8 + p9) / 9.f;
+                    vx = 1e-7f + SQR(p1 - mu) + SQR(p2 - mu) + SQR(p3 - mu) + SQR(p4 - mu) + SQR(p5 - mu) + SQR(p6 - mu) + SQR(p7 - mu) + SQR(p8 - mu) + SQR(p9 - mu);
+                    p1 -= rix[1][-w4];
+                    p2 -= rix[1][-w3];
+                    p3 -= rix[1][-w2];
+                    p4 -= rix[1][-w1];
+                    p5 -= rix[1][  0];
+                    p6 -= rix[1][ w1];
+                    p7 -= rix[1][ w2];
+                    p8 -= rix[1][ w3];
+                    p9 -= rix[1][ w4];
+                    vn = 1e-7f + SQR(p1) + SQR(p2) + SQR(p3) + SQR(p4) + SQR(p5) + SQR(p6) + SQR(p7) + SQR(p8) + SQR(p9);
+                    float xv = (rix[1][0] * vx + rix[3][0] * vn) / (vx + vn);
+                    float vv = vx * vn / (vx + vn);
+                    // interpolated G-R(B)
+                    rix[4][0] = (xh * vv + xv * vh) / (vh + vv);
+                }
             }
-        }
 
-        // copy CFA values
-#ifdef _OPENMP
-        #pragma omp for
-#endif
+            // copy CFA values
+            for (int rr = 0, row = rrStart - ba; rr < tileRows; rr++, row++)
+                for (int cc = 0, col = ccStart - ba; cc < tileCols; cc++, col++) {
+                    int c = FC(rrStart + rr, ccStart + cc);
+                    rix[c] = qix[c] + rr * w1 + cc;
 
-        for (int rr = 0; rr < rr1; rr++)
-            for (int cc = 0, row = rr - ba; cc < cc1; cc++) {
-                int col = cc - ba;
-                int c = FC(rr, cc);
-                rix[c] = qix[c] + rr * cc1 + cc;
+                    if ((row >= 0) & (row < height) & (col >= 0) & (col < width)) {
+                        rix[c][0] = (*gamtab)[rawData[row][col]];
+                    } else {
+                        rix[c][0] = 0.f;
+                    }
 
-                if ((row >= 0) & (row < height) & (col >= 0) & (col < width)) {
-                    rix[c][0] = (*gamtab)[rawData[row][col]];
-                } else {
-                    rix[c][0] = 0.f;
+                    if (c != 1) {
+                        rix[1] = qix[1] + rr * w1 + cc;
+                        rix[4] = qix[4] + rr * w1 + cc;
+                        rix[1][0] = rix[c][0] + rix[4][0];
+                    }
                 }
 
-                if (c != 1) {
-                    rix[1] = qix[1] + rr * cc1 + cc;
-                    rix[4] = qix[4] + rr * cc1 + cc;
-                    rix[1][0] = rix[c][0] + rix[4][0];
+            // bilinear interpolation for R/B
+            // interpolate R/B at G location
+            for (int rr = 1; rr < tileRows - 1; rr++)
+                for (int cc = 1 + (FC(rrStart + rr, ccStart + 2) & 1), c = FC(rrStart + rr, ccStart + cc + 1); cc < tileCols - 1; cc += 2) {
+                    rix[c] = qix[c] + rr * w1 + cc;
+                    rix[1] = qix[1] + rr * w1 + cc;
+                    rix[c][0] = rix[1][0] + xdiv2f(rix[c][ -1] - rix[1][ -1] + rix[c][ 1] - rix[1][ 1]);
+                    c = 2 - c;
+                    rix[c] = qix[c] + rr * w1 + cc;
+                    rix[c][0] = rix[1][0] + xdiv2f(rix[c][-w1] - rix[1][-w1] + rix[c][w1] - rix[1][w1]);
+                    c = 2 - c;
                 }
-            }
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.5);
-            }
-        }
-
-        // bilinear interpolation for R/B
-        // interpolate R/B at G location
-#ifdef _OPENMP
-        #pragma omp for
-#endif
-
-        for (int rr = 1; rr < rr1 - 1; rr++)
-            for (int cc = 1 + (FC(rr, 2) & 1), c = FC(rr, cc + 1); cc < cc1 - 1; cc += 2) {
-                rix[c] = qix[c] + rr * cc1 + cc;
-                rix[1] = qix[1] + rr * cc1 + cc;
-                rix[c][0] = rix[1][0] + xdiv2f(rix[c][ -1] - rix[1][ -1] + rix[c][ 1] - rix[1][ 1]);
-                c = 2 - c;
-                rix[c] = qix[c] + rr * cc1 + cc;
-                rix[c][0] = rix[1][0] + xdiv2f(rix[c][-w1] - rix[1][-w1] + rix[c][w1] - rix[1][w1]);
-                c = 2 - c;
-            }
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.6);
-            }
-        }
-
-        // interpolate R/B at B/R location
-#ifdef _OPENMP
-        #pragma omp for
-#endif
-
-        for (int rr = 1; rr < rr1 - 1; rr++)
-            for (int cc = 1 + (FC(rr, 1) & 1), c = 2 - FC(rr, cc); cc < cc1 - 1; cc += 2) {
-                rix[c] = qix[c] + rr * cc1 + cc;
-                rix[1] = qix[1] + rr * cc1 + cc;
-                rix[c][0] = rix[1][0] + 0.25f * (rix[c][-w1] - rix[1][-w1] + rix[c][ -1] - rix[1][ -1] + rix[c][  1] - rix[1][  1] + rix[c][ w1] - rix[1][ w1]);
-            }
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            if (plistener) {
-                plistener->setProgress (0.7);
-            }
-        }
-
-    }// End of parallelization 1
 
-    // median filter/
-    for (int pass = 0; pass < iter; pass++) {
-        // Apply 3x3 median filter
-        // Compute median(R-G) and median(B-G)
-
-#ifdef _OPENMP
-        #pragma omp parallel for private(rix)
-#endif
+            // interpolate R/B at B/R location
+            for (int rr = 1; rr < tileRows - 1; rr++)
+                for (int cc = 1 + (FC(rrStart + rr, ccStart + 1) & 1), c = 2 - FC(rrStart + rr, ccStart + cc); cc < tileCols - 1; cc += 2) {
+                    rix[c] = qix[c] + rr * w1 + cc;
+                    rix[1] = qix[1] + rr * w1 + cc;
+                    rix[c][0] = rix[1][0] + 0.25f * (rix[c][-w1] - rix[1][-w1] + rix[c][ -1] - rix[1][ -1] + rix[c][  1] - rix[1][  1] + rix[c][ w1] - rix[1][ w1]);
+                }
 
-        for (int rr = 1; rr < rr1 - 1; rr++) {
-            for (int c = 0; c < 3; c += 2) {
-                int d = c + 3 - (c == 0 ? 0 : 1);
-                int cc = 1;
+            // median filter/
+            for (int pass = 0; pass < iter; pass++) {
+                // Apply 3x3 median filter
+                // Compute median(R-G) and median(B-G)
+                for (int rr = 1; rr < tileRows - 1; rr++) {
+                    for (int c = 0; c < 3; c += 2) {
+                        int d = c + 3 - (c == 0 ? 0 : 1);
+                        int cc = 1;
 #ifdef __SSE2__
 
-                for (; cc < cc1 - 4; cc += 4) {
-                    rix[d] = qix[d] + rr * cc1 + cc;
-                    rix[c] = qix[c] + rr * cc1 + cc;
-                    rix[1] = qix[1] + rr * cc1 + cc;
-                    // Assign 3x3 differential color values
-                    const std::array<vfloat, 9> p = {
-                        LVFU(rix[c][-w1 - 1]) - LVFU(rix[1][-w1 - 1]),
-                        LVFU(rix[c][-w1]) - LVFU(rix[1][-w1]),
-                        LVFU(rix[c][-w1 + 1]) - LVFU(rix[1][-w1 + 1]),
-                        LVFU(rix[c][   -1]) - LVFU(rix[1][   -1]),
-                        LVFU(rix[c][  0]) - LVFU(rix[1][  0]),
-                        LVFU(rix[c][    1]) - LVFU(rix[1][    1]),
-                        LVFU(rix[c][ w1 - 1]) - LVFU(rix[1][ w1 - 1]),
-                        LVFU(rix[c][ w1]) - LVFU(rix[1][ w1]),
-                        LVFU(rix[c][ w1 + 1]) - LVFU(rix[1][ w1 + 1])
-                    };
-                    _mm_storeu_ps(&rix[d][0], median(p));
-                }
+                        for (; cc < tileCols - 4; cc += 4) {
+                            rix[d] = qix[d] + rr * w1 + cc;
+                            rix[c] = qix[c] + rr * w1 + cc;
+                            rix[1] = qix[1] + rr * w1 + cc;
+                            // Assign 3x3 differential color values
+                            const std::array<vfloat, 9> p = {
+                                LVFU(rix[c][-w1 - 1]) - LVFU(rix[1][-w1 - 1]),
+                                LVFU(rix[c][-w1]) - LVFU(rix[1][-w1]),
+                                LVFU(rix[c][-w1 + 1]) - LVFU(rix[1][-w1 + 1]),
+                                LVFU(rix[c][   -1]) - LVFU(rix[1][   -1]),
+                                LVFU(rix[c][  0]) - LVFU(rix[1][  0]),
+                                LVFU(rix[c][    1]) - LVFU(rix[1][    1]),
+                                LVFU(rix[c][ w1 - 1]) - LVFU(rix[1][ w1 - 1]),
+                                LVFU(rix[c][ w1]) - LVFU(rix[1][ w1]),
+                                LVFU(rix[c][ w1 + 1]) - LVFU(rix[1][ w1 + 1])
+                            };
+                            _mm_storeu_ps(&rix[d][0], median(p));
+                        }
 
 #endif
 
-                for (; cc < cc1 - 1; cc++) {
-                    rix[d] = qix[d] + rr * cc1 + cc;
-                    rix[c] = qix[c] + rr * cc1 + cc;
-                    rix[1] = qix[1] + rr * cc1 + cc;
-                    // Assign 3x3 differential color values
-                    const std::array<float, 9> p = {
-                        rix[c][-w1 - 1] - rix[1][-w1 - 1],
-                        rix[c][-w1] - rix[1][-w1],
-                        rix[c][-w1 + 1] - rix[1][-w1 + 1],
-                        rix[c][   -1] - rix[1][   -1],
-                        rix[c][  0] - rix[1][  0],
-                        rix[c][    1] - rix[1][    1],
-                        rix[c][ w1 - 1] - rix[1][ w1 - 1],
-                        rix[c][ w1] - rix[1][ w1],
-                        rix[c][ w1 + 1] - rix[1][ w1 + 1]
-                    };
-                    rix[d][0] = median(p);
-                }
-            }
-        }
-
-        // red/blue at GREEN pixel locations & red/blue and green at BLUE/RED pixel locations
-#ifdef _OPENMP
-        #pragma omp parallel for private (rix)
-#endif
-
-        for (int rr = 0; rr < rr1; rr++) {
-            rix[0] = qix[0] + rr * cc1;
-            rix[1] = qix[1] + rr * cc1;
-            rix[2] = qix[2] + rr * cc1;
-            rix[3] = qix[3] + rr * cc1;
-            rix[4] = qix[4] + rr * cc1;
-            int c0 = FC(rr, 0);
-            int c1 = FC(rr, 1);
-
-            if (c0 == 1) {
-                c1 = 2 - c1;
-                int d = c1 + 3 - (c1 == 0 ? 0 : 1);
-                int cc;
-
-                for (cc = 0; cc < cc1 - 1; cc += 2) {
-                    rix[0][0] = rix[1][0] + rix[3][0];
-                    rix[2][0] = rix[1][0] + rix[4][0];
-                    rix[0]++;
-                    rix[1]++;
-                    rix[2]++;
-                    rix[3]++;
-                    rix[4]++;
-                    rix[c1][0] = rix[1][0] + rix[d][0];
-                    rix[1][0] = 0.5f * (rix[0][0] - rix[3][0] + rix[2][0] - rix[4][0]);
-                    rix[0]++;
-                    rix[1]++;
-                    rix[2]++;
-                    rix[3]++;
-                    rix[4]++;
+                        for (; cc < tileCols - 1; cc++) {
+                            rix[d] = qix[d] + rr * w1 + cc;
+                            rix[c] = qix[c] + rr * w1 + cc;
+                            rix[1] = qix[1] + rr * w1 + cc;
+                            // Assign 3x3 differential color values
+                            const std::array<float, 9> p = {
+                                rix[c][-w1 - 1] - rix[1][-w1 - 1],
+                                rix[c][-w1] - rix[1][-w1],
+                                rix[c][-w1 + 1] - rix[1][-w1 + 1],
+                                rix[c][   -1] - rix[1][   -1],
+                                rix[c][  0] - rix[1][  0],
+                                rix[c][    1] - rix[1][    1],
+                                rix[c][ w1 - 1] - rix[1][ w1 - 1],
+                                rix[c][ w1] - rix[1][ w1],
+                                rix[c][ w1 + 1] - rix[1][ w1 + 1]
+                            };
+                            rix[d][0] = median(p);
+                        }
+                    }
                 }
 
-                if (cc < cc1) { // remaining pixel, only if width is odd
-                    rix[0][0] = rix[1][0] + rix[3][0];
-                    rix[2][0] = rix[1][0] + rix[4][0];
-                }
-            } else {
-                c0 = 2 - c0;
-                int d = c0 + 3 - (c0 == 0 ? 0 : 1);
-                int cc;
-
-                for (cc = 0; cc < cc1 - 1; cc += 2) {
-                    rix[c0][0] = rix[1][0] + rix[d][0];
-                    rix[1][0] = 0.5f * (rix[0][0] - rix[3][0] + rix[2][0] - rix[4][0]);
-                    rix[0]++;
-                    rix[1]++;
-                    rix[2]++;
-                    rix[3]++;
-                    rix[4]++;
-                    rix[0][0] = rix[1][0] + rix[3][0];
-                    rix[2][0] = rix[1][0] + rix[4][0];
-                    rix[0]++;
-                    rix[1]++;
-                    rix[2]++;
-                    rix[3]++;
-                    rix[4]++;
+                // red/blue at GREEN pixel locations & red/blue and green at BLUE/RED pixel locations
+                for (int rr = 0; rr < tileRows; rr++) {
+                    rix[0] = qix[0] + rr * w1;
+                    rix[1] = qix[1] + rr * w1;
+                    rix[2] = qix[2] + rr * w1;
+                    rix[3] = qix[3] + rr * w1;
+                    rix[4] = qix[4] + rr * w1;
+                    int c0 = FC(rrStart + rr, ccStart);
+                    int c1 = FC(rrStart + rr, ccStart + 1);
+
+                    if (c0 == 1) {
+                        c1 = 2 - c1;
+                        int d = c1 + 3 - (c1 == 0 ? 0 : 1);
+                        int cc;
+
+                        for (cc = 0; cc < tileCols - 1; cc += 2) {
+                            rix[0][0] = rix[1][0] + rix[3][0];
+                            rix[2][0] = rix[1][0] + rix[4][0];
+                            rix[0]++;
+                            rix[1]++;
+                            rix[2]++;
+                            rix[3]++;
+                            rix[4]++;
+                            rix[c1][0] = rix[1][0] + rix[d][0];
+                            rix[1][0] = 0.5f * (rix[0][0] - rix[3][0] + rix[2][0] - rix[4][0]);
+                            rix[0]++;
+                            rix[1]++;
+                            rix[2]++;
+                            rix[3]++;
+                            rix[4]++;
+                        }
+
+                        if (cc < tileCols) { // remaining pixel, only if width is odd
+                            rix[0][0] = rix[1][0] + rix[3][0];
+                            rix[2][0] = rix[1][0] + rix[4][0];
+                        }
+                    } else {
+                        c0 = 2 - c0;
+                        int d = c0 + 3 - (c0 == 0 ? 0 : 1);
+                        int cc;
+
+                        for (cc = 0; cc < tileCols - 1; cc += 2) {
+                            rix[c0][0] = rix[1][0] + rix[d][0];
+                            rix[1][0] = 0.5f * (rix[0][0] - rix[3][0] + rix[2][0] - rix[4][0]);
+                            rix[0]++;
+                            rix[1]++;
+                            rix[2]++;
+                            rix[3]++;
+                            rix[4]++;
+                            rix[0][0] = rix[1][0] + rix[3][0];
+                            rix[2][0] = rix[1][0] + rix[4][0];
+                            rix[0]++;
+                            rix[1]++;
+                            rix[2]++;
+                            rix[3]++;
+                            rix[4]++;
+                        }
+
+                        if (cc < tileCols) { // remaining pixel, only if width is odd
+                            rix[c0][0] = rix[1][0] + rix[d][0];
+                            rix[1][0] = 0.5f * (rix[0][0] - rix[3][0] + rix[2][0] - rix[4][0]);
+                        }
+                    }
                 }
+            }
 
-                if (cc < cc1) { // remaining pixel, only if width is odd
-                    rix[c0][0] = rix[1][0] + rix[d][0];
-                    rix[1][0] = 0.5f * (rix[0][0] - rix[3][0] + rix[2][0] - rix[4][0]);
+            // copy result back to image matrix
+            for (int row = rowStart, rr = row + ba - rrStart; row < rowEnd; row++, rr++) {
+                for (int col = colStart, cc = col + ba - ccStart; col < colEnd; col++, cc++) {
+                    int c = FC(row, col);
+
+                    for (int ii = 0; ii < 3; ii++)
+                        if (ii != c) {
+                            float *rix = qix[ii] + rr * w1 + cc;
+                            (*(rgb[ii]))[row][col] = std::max(0.f, (*igamtab)[65535.f * rix[0]]);
+                        } else {
+                            (*(rgb[ii]))[row][col] = CLIP(rawData[row][col]);
+                        }
                 }
             }
-        }
-    }
 
-    if (plistener) {
-        plistener->setProgress (0.8);
-    }
-
-    if (applyGamma) {
-        gamtab = &(Color::igammatab_24_17);
-    } else {
-        gamtab->makeIdentity();
-    }
-
-    array2D<float>* rgb[3];
-    rgb[0] = &red;
-    rgb[1] = &green;
-    rgb[2] = &blue;
+            if (plistener) {
+                progresscounter++;
 
-    // copy result back to image matrix
+                if (progresscounter % 16 == 0) {
 #ifdef _OPENMP
-    #pragma omp parallel for
+                    #pragma omp critical (lmmseprogress)
 #endif
-
-    for (int row = 0; row < height; row++) {
-        for (int col = 0, rr = row + ba; col < width; col++) {
-            int cc = col + ba;
-            int c = FC(row, col);
-
-            for (int ii = 0; ii < 3; ii++)
-                if (ii != c) {
-                    float *rix = qix[ii] + rr * cc1 + cc;
-                    (*(rgb[ii]))[row][col] = std::max(0.f, (*gamtab)[65535.f * rix[0]]);
-                } else {
-                    (*(rgb[ii]))[row][col] = CLIP(rawData[row][col]);
+                    {
+                        progress += 16.0 * tileSizeN * tileSizeN / (height * width);
+                        progress = progress > 1.0 ? 1.0 : progress;
+                        plistener->setProgress(progress);
+                    }
                 }
+            }
         }
     }
 
+    } // End of parallelization
+
+    free(buffers);
+
     if (plistener) {
         plistener->setProgress (1.0);
     }
 
-    if (buffer) {
-        free(buffer);
-    } else
-        for (int i = 0; i < 5; i++) {
-            free(qix[i]);
-        }
-
     if (!applyGamma) {
         delete gamtab;
+        delete igamtab;
     }
 
     if (iterations > 4) {
@@ -19,8 +19,15 @@
 #include "myfile.h"
 #include <cstdarg>
 #include "rtengine.h"
+// The file is memory mapped, except on Windows builds without MYFILE_MMAP,
+// where it is read into memory. Either way the decoders find the whole file
+// in IMFILE::data.
+#if !defined(_WIN32) || defined(MYFILE_MMAP)
+#define MYFILE_USE_MMAP
+#endif
+
 // get mmap() sorted out
-#ifdef MYFILE_MMAP
+#ifdef MYFILE_USE_MMAP
 
 #ifdef _WIN32
 
@@ -66,9 +73,38 @@ int munmap(void *start, size_t length)
 #include <sys/mman.h>
 
 #endif // _WIN32
-#endif // MYFILE_MMAP
+#endif // MYFILE_USE_MMAP
+
+namespace
+{
+
+// Reads the whole file into memory, also used when it can't be mapped
+rtengine::IMFILE* readFile (const char* fname)
+{
+    FILE* f = g_fopen (fname, "rb");
+
+    if (!f) {
+        return nullptr;
+    }
+
+    rtengine::IMFILE* mf = new rtengine::IMFILE;
+    memset(mf, 0, sizeof(*mf));
+    mf->fd = -1;
+    fseek (f, 0, SEEK_END);
+    mf->size = ftell (f);
+    mf->data = new char [mf->size];
+    fseek (f, 0, SEEK_SET);
+    fread (mf->data, 1, mf->size, f);
+    fclose (f);
+    mf->pos = 0;
+    mf->eof = false;
+
+    return mf;
+}
+
+}
 
-#ifdef MYFILE_MMAP
+#ifdef MYFILE_USE_MMAP
 
 rtengine::IMFILE* rtengine::fopen (const char* fname)
 {
@@ -103,12 +139,12 @@ rtengine::IMFILE* rtengine::fopen (const char* fname)
         return nullptr;
     }
 
-    void* data = mmap(nullptr, stat_buffer.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // empty files and special files can't be mapped
+    void* data = stat_buffer.st_size > 0 ? mmap(nullptr, stat_buffer.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
 
     if ( data == MAP_FAILED ) {
-        printf("no mmap %s\n", fname);
         close(fd);
-        return nullptr;
+        return readFile(fname);
     }
 
     IMFILE* mf = new IMFILE;
@@ -123,58 +159,41 @@ rtengine::IMFILE* rtengine::fopen (const char* fname)
     return mf;
 }
 
-rtengine::IMFILE* rtengine::gfopen (const char* fname)
-{
-    return fopen(fname);
-}
 #else
 
 rtengine::IMFILE* rtengine::fopen (const char* fname)
 {
-
-    FILE* f = g_fopen (fname, "rb");
-
-    if (!f) {
-        return NULL;
-    }
-
-    IMFILE* mf = new IMFILE;
-    memset(mf, 0, sizeof(*mf));
-    fseek (f, 0, SEEK_END);
-    mf->size = ftell (f);
-    mf->data = new char [mf->size];
-    fseek (f, 0, SEEK_SET);
-    fread (mf->data, 1, mf->size, f);
-    fclose (f);
-    mf->pos = 0;
-    mf->eof = false;
-
-    return mf;
+    return readFile(fname);
 }
 
+#endif //MYFILE_USE_MMAP
+
 rtengine::IMFILE* rtengine::gfopen (const char* fname)
 {
+    return fopen(fname);
+}
 
-    FILE* f = g_fopen (fname, "rb");
+void rtengine::fwillneed (IMFILE* f, ssize_t offset, ssize_t size)
+{
+#if defined(MYFILE_USE_MMAP) && defined(MADV_WILLNEED)
 
-    if (!f) {
-        return NULL;
+    if (f->fd == -1 || offset < 0 || offset >= f->size || size <= 0) {
+        return;
     }
 
-    IMFILE* mf = new IMFILE;
-    memset(mf, 0, sizeof(*mf));
-    fseek (f, 0, SEEK_END);
-    mf->size = ftell (f);
-    mf->data = new char [mf->size];
-    fseek (f, 0, SEEK_SET);
-    fread (mf->data, 1, mf->size, f);
-    fclose (f);
-    mf->pos = 0;
-    mf->eof = false;
+    // madvise wants the start of a page
+    const ssize_t pageSize = sysconf(_SC_PAGESIZE);
+    const ssize_t start = pageSize > 0 ? offset / pageSize * pageSize : offset;
+    const ssize_t end = size < f->size - offset ? offset + size : f->size;
 
-    return mf;
+    madvise(f->data + start, end - start, MADV_WILLNEED);
+
+#else
+    (void)f;
+    (void)offset;
+    (void)size;
+#endif
 }
-#endif //MYFILE_MMAP
 
 rtengine::IMFILE* rtengine::fopen (unsigned* buf, int size)
 {
@@ -192,7 +211,7 @@ rtengine::IMFILE* rtengine::fopen (unsigned* buf, int size)
 
 void rtengine::fclose (IMFILE* f)
 {
-#ifdef MYFILE_MMAP
+#ifdef MYFILE_USE_MMAP
 
     if ( f->fd == -1 ) {
         delete [] f->data;
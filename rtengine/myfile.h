@@ -137,6 +137,19 @@ inline unsigned char* fdata(int offset, IMFILE* f)
     return (unsigned char*)f->data + offset;
 }
 
+// Zero-copy access to the file: the data at 'offset', with 'size' reduced to
+// what the file holds there, so decoders can read it without fread
+inline const unsigned char* fspan(IMFILE* f, ssize_t offset, ssize_t& size)
+{
+    offset = offset < 0 ? 0 : offset > f->size ? f->size : offset;
+    size = size < 0 ? 0 : size > f->size - offset ? f->size - offset : size;
+    return reinterpret_cast<const unsigned char*>(f->data) + offset;
+}
+
+// Hints that the data at 'offset' will be read soon, so that the system reads
+// ahead the pages of a mapped file
+void fwillneed(IMFILE* f, ssize_t offset, ssize_t size);
+
 int fscanf (IMFILE* f, const char* s ...);
 char* fgets (char* s, int n, IMFILE* f);
 
@@ -39,3 +39,16 @@
     #define ALIGNED64
     #define ALIGNED16
 #endif
+
+// SIMD_CLONES compiles a function (and its OpenMP regions) for AVX-512, AVX2 and the
+// build target, the loader picks the clone for the running cpu. Only for GCC on
+// x86-64 Linux (ifunc), and useless if the build already targets AVX2. Neither avx2
+// nor avx512f enables FMA and GCC >= 11 builds use -ffp-contract=off, so the clones do
+// not contract into FMA. Without -ffast-math the vectorizer does not reorder float
+// operations either, hence all clones should give the same results.
+#if defined(TARGET_CLONES) && defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__) && !defined(__AVX2__)
+    #define SIMD_CLONES_ENABLED
+    #define SIMD_CLONES __attribute__ ((target_clones ("avx512f", "avx2", "default")))
+#else
+    #define SIMD_CLONES
+#endif
@@ -0,0 +1,184 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "pipelinestages.h"
+
+#include "procparams.h"
+#include "refreshmap.h"
+
+namespace rtengine
+{
+
+using namespace procparams;
+
+namespace
+{
+
+// indices into the stages, in processing order
+enum : std::size_t {
+    STAGE_ALL,
+    STAGE_DEMOSAIC,
+    STAGE_ALLNORAW,
+    STAGE_HDR,
+    STAGE_TRANSFORM,
+    STAGE_AUTOEXP,
+    STAGE_RGBCURVE,
+    STAGE_LUMINANCECURVE,
+    STAGE_SHARPENING,
+    STAGE_NONE // not used by the preview
+};
+
+// the bits which may be dropped from an update, all others are always kept
+constexpr int stageBits = ALL | M_WB | M_RETINEX | M_CSHARP;
+
+struct Dependency {
+    std::size_t stage;
+    bool (*equal)(const ProcParams& a, const ProcParams& b);
+    void (*assign)(ProcParams& dst, const ProcParams& src); // nullptr if another entry assigns the whole member
+};
+
+#define STAGE_PARAMS(stage, member) \
+    {stage, [](const ProcParams& a, const ProcParams& b) { return a.member == b.member; }, [](ProcParams& dst, const ProcParams& src) { dst.member = src.member; }}
+
+// The stage of a member is the first stage of the refresh masks of all its
+// events. Members not listed here belong to STAGE_ALL.
+const std::vector<Dependency> dependencies = {
+    // highlight reconstruction works on the raw data, clampOOG on the whole pipeline
+    {STAGE_ALL, [](const ProcParams& a, const ProcParams& b) { return a.toneCurve.clampOOG == b.toneCurve.clampOOG; }, nullptr},
+    {STAGE_DEMOSAIC, [](const ProcParams& a, const ProcParams& b) {
+        return
+            a.toneCurve.hrenabled == b.toneCurve.hrenabled
+            && a.toneCurve.method == b.toneCurve.method
+            && a.toneCurve.hlbl == b.toneCurve.hlbl
+            && a.toneCurve.hlth == b.toneCurve.hlth;
+    }, nullptr},
+    STAGE_PARAMS(STAGE_ALLNORAW, dirpyrDenoise),
+    STAGE_PARAMS(STAGE_ALLNORAW, dirpyrequalizer),
+    STAGE_PARAMS(STAGE_ALLNORAW, fattal),
+    STAGE_PARAMS(STAGE_ALLNORAW, spot),
+    STAGE_PARAMS(STAGE_HDR, commonTrans),
+    STAGE_PARAMS(STAGE_HDR, rotate),
+    STAGE_PARAMS(STAGE_HDR, distortion),
+    STAGE_PARAMS(STAGE_HDR, perspective),
+    STAGE_PARAMS(STAGE_HDR, gradient),
+    STAGE_PARAMS(STAGE_HDR, pcvignette),
+    STAGE_PARAMS(STAGE_HDR, vignetting),
+    STAGE_PARAMS(STAGE_HDR, cacorrection),
+    STAGE_PARAMS(STAGE_HDR, dehaze),
+    STAGE_PARAMS(STAGE_HDR, locallab),
+    STAGE_PARAMS(STAGE_AUTOEXP, toneCurve),
+    STAGE_PARAMS(STAGE_AUTOEXP, toneEqualizer),
+    STAGE_PARAMS(STAGE_AUTOEXP, sh),
+    STAGE_PARAMS(STAGE_AUTOEXP, vibrance),
+    STAGE_PARAMS(STAGE_AUTOEXP, chmixer),
+    STAGE_PARAMS(STAGE_AUTOEXP, blackwhite),
+    STAGE_PARAMS(STAGE_AUTOEXP, colorToning),
+    STAGE_PARAMS(STAGE_AUTOEXP, rgbCurves),
+    STAGE_PARAMS(STAGE_AUTOEXP, hsvequalizer),
+    STAGE_PARAMS(STAGE_AUTOEXP, filmSimulation),
+    STAGE_PARAMS(STAGE_RGBCURVE, localContrast),
+    // decides whether CBDL runs before the Lab stages
+    {STAGE_RGBCURVE, [](const ProcParams& a, const ProcParams& b) { return a.colorappearance.enabled == b.colorappearance.enabled; }, nullptr},
+    STAGE_PARAMS(STAGE_LUMINANCECURVE, labCurve),
+    STAGE_PARAMS(STAGE_LUMINANCECURVE, colorappearance),
+    STAGE_PARAMS(STAGE_LUMINANCECURVE, softlight),
+    STAGE_PARAMS(STAGE_SHARPENING, sharpening),
+    STAGE_PARAMS(STAGE_SHARPENING, sharpenEdge),
+    STAGE_PARAMS(STAGE_SHARPENING, sharpenMicro),
+    STAGE_PARAMS(STAGE_SHARPENING, epd),
+    STAGE_PARAMS(STAGE_SHARPENING, impulseDenoise),
+    STAGE_PARAMS(STAGE_SHARPENING, defringe),
+    STAGE_PARAMS(STAGE_SHARPENING, wavelet),
+    STAGE_PARAMS(STAGE_NONE, resize),
+    STAGE_PARAMS(STAGE_NONE, prsharpening),
+    STAGE_PARAMS(STAGE_NONE, metadata)
+};
+
+#undef STAGE_PARAMS
+
+}
+
+const std::vector<PipelineStages::Stage>& PipelineStages::getStages()
+{
+    static const std::vector<Stage> stages = {
+        {"ALL", ALL},
+        {"DEMOSAIC", DEMOSAIC},
+        {"ALLNORAW", ALLNORAW},
+        {"HDR", HDR},
+        {"TRANSFORM", TRANSFORM},
+        {"AUTOEXP", AUTOEXP},
+        {"RGBCURVE", RGBCURVE},
+        {"LUMINANCECURVE", LUMINANCECURVE},
+        {"SHARPENING", SHARPENING}
+    };
+
+    return stages;
+}
+
+std::size_t PipelineStages::getFirstChanged(const ProcParams& previous, const ProcParams& next)
+{
+    std::size_t first = getStages().size();
+
+    for (const auto& dependency : dependencies) {
+        if (dependency.stage < first && !dependency.equal(previous, next)) {
+            first = dependency.stage;
+        }
+    }
+
+    if (first == STAGE_ALL) {
+        return first;
+    }
+
+    // everything else belongs to the first stage
+    ProcParams rest = previous;
+
+    for (const auto& dependency : dependencies) {
+        if (dependency.assign) {
+            dependency.assign(rest, next);
+        }
+    }
+
+    return rest == next ? first : STAGE_ALL;
+}
+
+int PipelineStages::prune(int action, std::size_t first)
+{
+    if (first == STAGE_ALL) {
+        return action;
+    }
+
+    const int kept = first < getStages().size() ? getStages()[first].action : 0;
+    return (action & ~stageBits) | (action & kept);
+}
+
+std::vector<std::string> PipelineStages::getNames(int action)
+{
+    const auto& stages = getStages();
+    std::vector<std::string> names;
+
+    for (std::size_t i = 0; i < stages.size(); ++i) {
+        // the bits of a stage not shared with the following ones
+        const int own = stages[i].action & ~(i + 1 < stages.size() ? stages[i + 1].action : 0);
+
+        if (action & own) {
+            names.emplace_back(stages[i].name);
+        }
+    }
+
+    return names;
+}
+
+}
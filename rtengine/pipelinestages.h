@@ -0,0 +1,64 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace rtengine
+{
+
+namespace procparams
+{
+
+class ProcParams;
+
+}
+
+/*
+ * Stages of the preview pipeline of ImProcCoordinator and Crop, in processing
+ * order. Each stage starts at one of the refresh masks of refreshmap.h, which
+ * every following stage is a subset of, and keeps its result cached until an
+ * update includes it again.
+ *
+ * A stage depends on the stages before it and on the ProcParams whose events
+ * use its refresh mask. Parameters not assigned to a later stage belong to the
+ * first one, so a change of an unknown parameter always updates everything.
+ */
+class PipelineStages final
+{
+public:
+    struct Stage {
+        const char* name;
+        int action; // refresh mask starting at this stage
+    };
+
+    static const std::vector<Stage>& getStages();
+
+    // Index of the first stage depending on a parameter which differs between
+    // the two, getStages().size() if none does
+    static std::size_t getFirstChanged(const procparams::ProcParams& previous, const procparams::ProcParams& next);
+
+    // 'action' without the stages before 'first', which can use their cached result
+    static int prune(int action, std::size_t first);
+
+    // Names of the stages run by 'action'
+    static std::vector<std::string> getNames(int action);
+};
+
+}
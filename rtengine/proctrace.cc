@@ -0,0 +1,310 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <ctime>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <glib/gstdio.h>
+
+#include "cJSON.h"
+#include "proctrace.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+namespace
+{
+
+thread_local int traceDepth = 0;
+thread_local unsigned int traceThreadId = 0;
+std::atomic<unsigned int> traceThreadCount(0);
+
+unsigned int getTraceThreadId()
+{
+    if (traceThreadId == 0) {
+        traceThreadId = ++traceThreadCount;
+    }
+
+    return traceThreadId;
+}
+
+double getProcessCpuMs()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0.0;
+    }
+
+    const auto toMs = [](const FILETIME& ft) {
+        return ((static_cast<unsigned long long>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) / 10000.0;
+    };
+    return toMs(kernel) + toMs(user);
+#else
+    timespec ts;
+
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts)) {
+        return 0.0;
+    }
+
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+std::int64_t getCurrentRss()
+{
+#if defined(__linux__)
+    long size = 0;
+    long resident = 0;
+    FILE* f = std::fopen("/proc/self/statm", "r");
+
+    if (!f) {
+        return 0;
+    }
+
+    const int n = std::fscanf(f, "%ld %ld", &size, &resident);
+    std::fclose(f);
+    return n == 2 ? static_cast<std::int64_t>(resident) * sysconf(_SC_PAGESIZE) : 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+        return 0;
+    }
+
+    return info.resident_size;
+#else
+    return 0; // not available without psapi
+#endif
+}
+
+std::int64_t getPeakRss()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    return usage.ru_maxrss; // bytes
+#else
+    return static_cast<std::int64_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+int getNumThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return std::max(1u, std::thread::hardware_concurrency());
+#endif
+}
+
+}
+
+std::atomic<bool> ProcTrace::enabled(false);
+
+struct ProcTrace::Impl {
+    mutable MyMutex mutex;
+    std::vector<Event> events;
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+};
+
+ProcTrace::ProcTrace() :
+    impl(new Impl)
+{
+}
+
+ProcTrace::~ProcTrace() = default;
+
+ProcTrace& ProcTrace::getInstance()
+{
+    static ProcTrace instance;
+    return instance;
+}
+
+void ProcTrace::setEnabled(bool enable)
+{
+    if (enable) {
+        clear();
+    }
+
+    enabled.store(enable);
+}
+
+void ProcTrace::clear()
+{
+    MyMutex::MyLock lock(impl->mutex);
+    impl->events.clear();
+    impl->origin = std::chrono::steady_clock::now();
+}
+
+std::int64_t ProcTrace::getResidentMemory()
+{
+    return getCurrentRss();
+}
+
+std::vector<ProcTrace::Event> ProcTrace::getEvents() const
+{
+    MyMutex::MyLock lock(impl->mutex);
+    return impl->events;
+}
+
+std::size_t ProcTrace::getEventCount() const
+{
+    MyMutex::MyLock lock(impl->mutex);
+    return impl->events.size();
+}
+
+std::string ProcTrace::getSummary(std::size_t firstEvent, int maxDepth) const
+{
+    const int threads = getNumThreads();
+    const unsigned int thread = getTraceThreadId();
+    const std::vector<Event> events = getEvents();
+    std::string summary;
+    char buffer[256];
+
+    for (std::size_t i = firstEvent; i < events.size(); ++i) {
+        const Event& event = events[i];
+
+        if (event.thread != thread || event.depth > maxDepth) {
+            continue;
+        }
+
+        const double wallMs = event.durationUs / 1000.0;
+        const double utilization = wallMs > 0.0 ? 100.0 * event.cpuMs / (wallMs * threads) : 0.0;
+        std::snprintf(buffer, sizeof(buffer), "%s%s %.0f ms (cpu %.0f ms, %.0f%% of %d threads, rss %+.0f MB, peak %.0f MB)",
+                      summary.empty() ? "" : "; ", event.name.c_str(), wallMs, event.cpuMs, utilization, threads,
+                      event.rssDelta / 1048576.0, event.peakRssBytes / 1048576.0);
+        summary += buffer;
+    }
+
+    return summary;
+}
+
+bool ProcTrace::saveChromeTrace(const Glib::ustring& fname) const
+{
+    const std::vector<Event> events = getEvents();
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON* traceEvents = cJSON_CreateArray();
+    cJSON_AddItemToObject(root, "traceEvents", traceEvents);
+    cJSON_AddItemToObject(root, "displayTimeUnit", cJSON_CreateString("ms"));
+
+    for (const auto& event : events) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddItemToObject(item, "name", cJSON_CreateString(event.name.c_str()));
+        cJSON_AddItemToObject(item, "cat", cJSON_CreateString(event.depth == 0 ? "stage" : "tool"));
+        cJSON_AddItemToObject(item, "ph", cJSON_CreateString("X"));
+        cJSON_AddItemToObject(item, "ts", cJSON_CreateNumber(event.startUs));
+        cJSON_AddItemToObject(item, "dur", cJSON_CreateNumber(event.durationUs));
+        cJSON_AddItemToObject(item, "pid", cJSON_CreateNumber(1));
+        cJSON_AddItemToObject(item, "tid", cJSON_CreateNumber(event.thread));
+
+        cJSON* args = cJSON_CreateObject();
+        cJSON_AddItemToObject(args, "cpu_ms", cJSON_CreateNumber(event.cpuMs));
+        cJSON_AddItemToObject(args, "rss_bytes", cJSON_CreateNumber(event.rssBytes));
+        cJSON_AddItemToObject(args, "rss_delta_bytes", cJSON_CreateNumber(event.rssDelta));
+        cJSON_AddItemToObject(args, "peak_rss_bytes", cJSON_CreateNumber(event.peakRssBytes));
+        cJSON_AddItemToObject(item, "args", args);
+
+        cJSON_AddItemToArray(traceEvents, item);
+    }
+
+    char* text = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    FILE* f = g_fopen(fname.c_str(), "wt");
+    bool ok = false;
+
+    if (f) {
+        ok = std::fputs(text, f) >= 0;
+        ok = std::fclose(f) == 0 && ok;
+    }
+
+    std::free(text);
+    return ok;
+}
+
+void ProcTrace::addEvent(Event&& event)
+{
+    MyMutex::MyLock lock(impl->mutex);
+    impl->events.push_back(std::move(event));
+}
+
+std::int64_t ProcTrace::nowUs() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - impl->origin).count();
+}
+
+void ProcTrace::Scope::begin()
+{
+    ++traceDepth;
+    startRss = getCurrentRss();
+    startCpuMs = getProcessCpuMs();
+    startUs = ProcTrace::getInstance().nowUs();
+}
+
+void ProcTrace::Scope::end()
+{
+    ProcTrace& trace = ProcTrace::getInstance();
+    const std::int64_t endUs = trace.nowUs();
+    const double endCpuMs = getProcessCpuMs();
+    const std::int64_t endRss = getCurrentRss();
+    --traceDepth;
+
+    trace.addEvent({
+        name,
+        getTraceThreadId(),
+        traceDepth,
+        startUs,
+        endUs - startUs,
+        endCpuMs - startCpuMs,
+        endRss,
+        endRss - startRss,
+        getPeakRss()
+    });
+}
+
+}
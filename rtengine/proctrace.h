@@ -0,0 +1,127 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glibmm/ustring.h>
+
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+/*
+ * Always compiled processing trace.
+ *
+ * While disabled, a Scope costs one relaxed atomic load. Once enabled, each
+ * Scope records wall time, process CPU time, resident memory and the process
+ * peak resident memory, nested per thread. The recorded events can be written
+ * as Chrome trace JSON (chrome://tracing, Perfetto) or summarized in one line.
+ */
+class ProcTrace final :
+    public NonCopyable
+{
+public:
+    struct Event {
+        std::string name;
+        unsigned int thread;     // small sequential id of the recording thread
+        int depth;               // nesting level on that thread, 0 = top level
+        std::int64_t startUs;    // wall time since the trace was (re)started
+        std::int64_t durationUs;
+        double cpuMs;            // process CPU time (all threads) spent during the scope
+        std::int64_t rssBytes;   // resident memory at the end of the scope
+        std::int64_t rssDelta;
+        std::int64_t peakRssBytes; // process high-water mark at the end of the scope
+    };
+
+    class Scope final :
+        public NonCopyable
+    {
+    public:
+        explicit Scope(const char* name) :
+            active(ProcTrace::isEnabled()),
+            name(name),
+            startUs(0),
+            startCpuMs(0.0),
+            startRss(0)
+        {
+            if (active) {
+                begin();
+            }
+        }
+
+        ~Scope()
+        {
+            if (active) {
+                end();
+            }
+        }
+
+    private:
+        void begin();
+        void end();
+
+        const bool active;
+        const char* name;
+        std::int64_t startUs;
+        double startCpuMs;
+        std::int64_t startRss;
+    };
+
+    ~ProcTrace();
+
+    static ProcTrace& getInstance();
+
+    static bool isEnabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // current resident memory of the process in bytes, 0 if unavailable
+    static std::int64_t getResidentMemory();
+
+    // Enabling restarts the time base and drops previously recorded events
+    void setEnabled(bool enable);
+    void clear();
+
+    std::vector<Event> getEvents() const;
+    std::size_t getEventCount() const;
+    // one line describing the events the calling thread recorded since firstEvent up to the given nesting level
+    std::string getSummary(std::size_t firstEvent = 0, int maxDepth = 0) const;
+    bool saveChromeTrace(const Glib::ustring& fname) const;
+
+private:
+    ProcTrace();
+
+    void addEvent(Event&& event);
+    std::int64_t nowUs() const;
+
+    static std::atomic<bool> enabled;
+
+    struct Impl;
+    const std::unique_ptr<Impl> impl;
+
+    friend class Scope;
+};
+
+}
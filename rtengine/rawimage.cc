@@ -436,6 +436,16 @@ skip_block:
     }
 }
 
+int RawImage::loadHeader(unsigned int imageNum)
+{
+    // loadRaw() opens the file with gfopen(): where it is mapped, only the pages of the
+    // headers and the thumbnail are read
+    RT_header_only = true;
+    const int res = loadRaw(false, imageNum, false);
+    RT_header_only = false;
+    return res;
+}
+
 int RawImage::loadRaw(bool loadData, unsigned int imageNum, bool closeFile, ProgressListener *plistener, double progressRange)
 {
     ifname = filename.c_str();
@@ -482,7 +492,7 @@ int RawImage::loadRaw(bool loadData, unsigned int imageNum, bool closeFile, Prog
         return 2;
     }
 
-    if (!strcmp(make, "Fujifilm") && raw_height * raw_width * 2u != raw_size) {
+    if (!strcmp(make, "Fujifilm") && raw_height * raw_width * 2u != raw_size && !RT_header_only) {
         if (raw_width * raw_height * 7u / 4u == raw_size) {
             load_raw = &RawImage::fuji_14bit_load_raw;
         } else {
@@ -534,7 +544,8 @@ int RawImage::loadRaw(bool loadData, unsigned int imageNum, bool closeFile, Prog
                   return 100;
               }
         */
-        // Load raw pixels data
+        // Load raw pixels data, the decoders may read it from several threads
+        fwillneed(ifp, data_offset, ifp->size - data_offset);
         fseek(ifp, data_offset, SEEK_SET);
         (this->*load_raw)();
 
@@ -722,6 +733,53 @@ int RawImage::loadRaw(bool loadData, unsigned int imageNum, bool closeFile, Prog
     return 0;
 }
 
+void RawImage::initSynthetic(int w, int h, unsigned cfaFilters, const int (*xtransMatrix)[6])
+{
+    raw_width = iwidth = width = w;
+    raw_height = iheight = height = h;
+    top_margin = left_margin = 0;
+    fuji_width = shrink = 0;
+    flip = 0;
+    filters = cfaFilters;
+    colors = 3;
+    is_raw = 1;
+    dng_version = 0;
+    black = 0;
+    memset(cblack, 0, sizeof(cblack));
+    maximum = 65535;
+    strcpy(make, "RawTherapee");
+    strcpy(model, "Synthetic");
+
+    for (int c = 0; c < 4; ++c) {
+        pre_mul[c] = cam_mul[c] = 1.f;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            rgb_cam[i][j] = i == j ? 1.f : 0.f;
+        }
+    }
+
+    if (xtransMatrix) {
+        for (int i = 0; i < 6; ++i) {
+            for (int j = 0; j < 6; ++j) {
+                xtrans[i][j] = xtrans_abs[i][j] = xtransMatrix[i][j];
+            }
+        }
+    }
+
+    delete [] allocation;
+    delete [] data;
+    allocation = new float[static_cast<unsigned long>(height) * static_cast<unsigned long>(width)];
+    data = new float*[height];
+
+    for (int i = 0; i < height; ++i) {
+        data[i] = allocation + static_cast<unsigned long>(i) * width;
+    }
+
+    set_prefilters();
+}
+
 float** RawImage::compress_image(unsigned int frameNum, bool freeImage)
 {
     if (!image) {
@@ -37,6 +37,9 @@ public:
     ~RawImage();
 
     int loadRaw(bool loadData, unsigned int imageNum = 0, bool closeFile = true, ProgressListener *plistener = nullptr, double progressRange = 1.0);
+    // Only parses the container to locate the embedded thumbnail and the shot information, the file stays open.
+    // Levels, color matrices and gain maps are not filled in, use loadRaw() for those.
+    int loadHeader(unsigned int imageNum = 0);
     void get_colorsCoeff(float* pre_mul_, float* scale_mul_, float* cblack_, bool forceAutoWB);
     void set_prefilters()
     {
@@ -50,6 +53,8 @@ public:
         return image;
     }
     float** compress_image(unsigned int frameNum, bool freeImage = true); // revert to compressed pixels format and release image data
+    // set up an in-memory sensor without backing file (used by rtbench), the caller fills data[][] afterwards
+    void initSynthetic(int w, int h, unsigned cfaFilters, const int (*xtransMatrix)[6] = nullptr);
     float** data;             // holds pixel values, data[i][j] corresponds to the ith row and jth column
     unsigned prefilters;               // original filters saved ( used for 4 color processing )
     unsigned int getFrameCount() const { return is_raw; }
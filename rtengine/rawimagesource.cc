@@ -19,11 +19,13 @@
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
 
 #include "camconst.h"
 #include "color.h"
 #include "curves.h"
 #include "dcp.h"
+#include "demosaiccache.h"
 #include "dfmanager.h"
 #include "ffmanager.h"
 #include "iccmatrices.h"
@@ -1392,8 +1394,65 @@ int RawImageSource::load(const Glib::ustring &fname, bool firstFrameOnly)
 
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
+void RawImageSource::loadSynthetic(RawImage *synthetic)
+{
+    // Minimal counterpart of load() for an in-memory sensor: identity camera matrix,
+    // unity white balance and no black level, rawData is filled directly from ri->data.
+    fileName = synthetic->get_filename();
+    ri = riFrames[0] = synthetic;
+    numFrames = 1;
+    currFrame = 0;
+
+    W = ri->get_width();
+    H = ri->get_height();
+    fuji = false;
+    d1x = false;
+    border = ri->getSensorType() == ST_FUJI_XTRANS ? 7 : 4;
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            imatrices.rgb_cam[i][j] = imatrices.cam_rgb[i][j] = i == j;
+            imatrices.xyz_cam[i][j] = xyz_sRGB[i][j];
+        }
+    }
+
+    inverse33(imatrices.xyz_cam, imatrices.cam_xyz);
+
+    for (int c = 0; c < 4; ++c) {
+        scale_mul[c] = ref_pre_mul[c] = 1.f;
+        c_black[c] = cblacksom[c] = 0.f;
+        c_white[c] = 65535.f;
+    }
+
+    initialGain = camInitialGain = 1.0;
+    camera_wb = ColorTemp(1.0, 1.0, 1.0, 1.0, ColorTemp::DEFAULT_OBSERVER);
+
+    idata = new FramesData(fileName);
+    idata->setDCRawFrameCount(numFrames);
+    idata->setDimensions(W, H);
+
+    rawData(W, H);
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int row = 0; row < H; ++row) {
+        for (int col = 0; col < W; ++col) {
+            rawData[row][col] = ri->data[row][col];
+        }
+    }
+
+    green(W, H);
+    red(W, H);
+    blue(W, H);
+    rawDirty = true;
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
 void RawImageSource::preprocess(const RAWParams &raw, const LensProfParams &lensProf, const CoarseTransformParams& coarse, bool prepareDenoise)
 {
+    TRACEFUN
 //    BENCHFUN
     MyTime t1, t2;
     t1.set();
@@ -1465,6 +1524,8 @@ void RawImageSource::preprocess(const RAWParams &raw, const LensProfParams &lens
         printf("Flat Field Correction:%s\n", rif->get_filename().c_str());
     }
 
+    bool scaled = false; // scaleColors done by copyOriginalPixels
+
     if (numFrames == 4) {
         int bufferNumber = 0;
 
@@ -1497,7 +1558,8 @@ void RawImageSource::preprocess(const RAWParams &raw, const LensProfParams &lens
             }
         }
     } else {
-        copyOriginalPixels(raw, ri, rid, rif, rawData);
+        // the gain map has to be applied to the unscaled pixels
+        scaled = copyOriginalPixels(raw, ri, rid, rif, rawData, !(raw.ff_FromMetaData && isGainMapSupported()));
     }
 
     //FLATFIELD end
@@ -1546,7 +1608,7 @@ void RawImageSource::preprocess(const RAWParams &raw, const LensProfParams &lens
         for (int i = 0; i < 4; ++i) {
             scaleColors(0, 0, W, H, raw, *rawDataFrames[i]);
         }
-    } else {
+    } else if (!scaled) {
         scaleColors(0, 0, W, H, raw, rawData); //+ + raw parameters for black level(raw.blackxx)
     }
 
@@ -1742,12 +1804,63 @@ void RawImageSource::preprocess(const RAWParams &raw, const LensProfParams &lens
 }
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &contrastThreshold, bool cache)
+bool RawImageSource::draftDemosaic(const RAWParams &raw)
 {
+    // nothing to gain if the requested method is as cheap as the binning
+    int block = 0;
+
+    if (ri->getSensorType() == ST_BAYER && ri->get_colors() == 3) {
+        using Method = RAWParams::BayerSensor::Method;
+
+        if (raw.bayersensor.method != RAWParams::BayerSensor::getMethodString(Method::FAST)
+                && raw.bayersensor.method != RAWParams::BayerSensor::getMethodString(Method::NONE)
+                && raw.bayersensor.method != RAWParams::BayerSensor::getMethodString(Method::MONO)) {
+            block = 2;
+        }
+    } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
+        using Method = RAWParams::XTransSensor::Method;
+
+        if (raw.xtranssensor.method != RAWParams::XTransSensor::getMethodString(Method::FAST)
+                && raw.xtranssensor.method != RAWParams::XTransSensor::getMethodString(Method::NONE)
+                && raw.xtranssensor.method != RAWParams::XTransSensor::getMethodString(Method::MONO)) {
+            block = 3;
+        }
+    }
+
+    if (!block || W < block || H < block) {
+        return false;
+    }
+
     MyTime t1, t2;
     t1.set();
 
-    if (ri->getSensorType() == ST_BAYER) {
+    draft_demosaic(block);
+
+    t2.set();
+    rgbSourceModified = false;
+
+    if (settings->verbose) {
+        printf("Draft demosaicing (%dx%d superpixels): %d usec\n", block, block, t2.etime(t1));
+    }
+
+    return true;
+}
+
+void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &contrastThreshold, bool cache, bool preview)
+{
+    TRACEFUN
+    MyTime t1, t2;
+    t1.set();
+
+    // empty key: the demosaic cache is not used
+    const std::string cacheKey = preview ? getDemosaicCacheKey(raw, autoContrast, contrastThreshold) : std::string();
+    const bool cached = DemosaicCache::load(cacheKey, red, green, blue, contrastThreshold);
+
+    if (cached) {
+        if (settings->verbose) {
+            printf("Demosaiced data read from the demosaic cache\n");
+        }
+    } else if (ri->getSensorType() == ST_BAYER) {
         if (raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::HPHD)) {
             hphd_demosaic();
         } else if (raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::VNG4)) {
@@ -1816,6 +1929,9 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &c
 
     t2.set();
 
+    if (!cached) {
+        DemosaicCache::store(cacheKey, red, green, blue, contrastThreshold);
+    }
 
     rgbSourceModified = false;
 
@@ -1878,6 +1994,47 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &c
     }
 }
 
+std::string RawImageSource::getDemosaicCacheKey(const RAWParams &raw, bool autoContrast, double contrastThreshold) const
+{
+    if (!DemosaicCache::isEnabled()) {
+        return {};
+    }
+
+    // fast methods and pixelshift, which reads all frames, are not cached
+    std::ostringstream description;
+
+    if (ri->getSensorType() == ST_BAYER) {
+        using Method = RAWParams::BayerSensor::Method;
+
+        for (const Method method : {Method::FAST, Method::MONO, Method::NONE, Method::PIXELSHIFT}) {
+            if (raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(method)) {
+                return {};
+            }
+        }
+
+        description << "bayer " << raw.bayersensor.method.raw()
+                    << ' ' << raw.bayersensor.dcb_iterations << ' ' << raw.bayersensor.dcb_enhance
+                    << ' ' << raw.bayersensor.lmmse_iterations << ' ' << raw.bayersensor.dualDemosaicContrast;
+    } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
+        using Method = RAWParams::XTransSensor::Method;
+
+        for (const Method method : {Method::FAST, Method::MONO, Method::NONE}) {
+            if (raw.xtranssensor.method == RAWParams::XTransSensor::getMethodString(method)) {
+                return {};
+            }
+        }
+
+        description << "xtrans " << raw.xtranssensor.method.raw() << ' ' << raw.xtranssensor.dualDemosaicContrast;
+    } else {
+        return {};
+    }
+
+    description.precision(17);
+    description << ' ' << autoContrast << ' ' << contrastThreshold << ' ' << border << ' ' << initialGain
+                << ' ' << ri->get_filters() << ' ' << ri->get_maker() << ' ' << ri->get_model();
+
+    return DemosaicCache::getKey(fileName, description.str(), rawData);
+}
 
 //void RawImageSource::retinexPrepareBuffers(ColorManagementParams cmp, RetinexParams retinexParams, multi_array2D<float, 3> &conversionBuffer, LUTu &lhist16RETI)
 void RawImageSource::retinexPrepareBuffers(const ColorManagementParams& cmp, const RetinexParams &retinexParams, multi_array2D<float, 4> &conversionBuffer, LUTu &lhist16RETI)
@@ -2565,6 +2722,14 @@ void RawImageSource::flush()
     if (blueloc) {
         blueloc(0, 0);
     }
+
+    // copies kept for capture sharpening
+    delete redCache;
+    redCache = nullptr;
+    delete greenCache;
+    greenCache = nullptr;
+    delete blueCache;
+    blueCache = nullptr;
 }
 
 void RawImageSource::HLRecovery_Global(const ToneCurveParams &hrp)
@@ -2585,8 +2750,9 @@ void RawImageSource::HLRecovery_Global(const ToneCurveParams &hrp)
 
 /* Copy original pixel data and
  * subtract dark frame (if present) from current image and apply flat field correction (if present)
+ * or, if scale is set and there is no flat field, do the work of scaleColors in the same pass
  */
-void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src, const RawImage *riDark, RawImage *riFlatFile, array2D<float> &rawData)
+bool RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src, const RawImage *riDark, RawImage *riFlatFile, array2D<float> &rawData, bool scale)
 {
     const auto tmpfilters = ri->get_filters();
     ri->set_filters(ri->prefilters); // we need 4 blacks for bayer processing
@@ -2599,7 +2765,67 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src, con
             rawData(W, H);
         }
 
-        if (riDark && W == riDark->get_width() && H == riDark->get_height()) { // This works also for xtrans-sensors, because black[0] to black[4] are equal for these
+        const bool hasDarkFrame = riDark && W == riDark->get_width() && H == riDark->get_height();
+
+        const bool hasFlatField = riFlatFile && W == riFlatFile->get_width() && H == riFlatFile->get_height();
+
+        if (scale && !hasFlatField && (ri->getSensorType() == ST_BAYER || ri->get_colors() != 1)) {
+            // dark frame subtraction and scaleColors in one pass over the raw data
+            calculateScaleColors(raw);
+            const bool xtrans = ri->getSensorType() == ST_FUJI_XTRANS;
+            const int period = xtrans ? 6 : 2; // the colours of a row repeat after period columns
+            chmax[0] = chmax[1] = chmax[2] = chmax[3] = 0;
+
+#ifdef _OPENMP
+            #pragma omp parallel
+#endif
+            {
+                float tmpchmax[3];
+                tmpchmax[0] = tmpchmax[1] = tmpchmax[2] = 0.0f;
+#ifdef _OPENMP
+                #pragma omp for nowait
+#endif
+
+                for (int row = 0; row < H; row++) {
+                    float rowBlack[6], rowBlackLevel[6], rowScale[6];
+                    int rowColor[6];
+
+                    for (int i = 0; i < period; i++) {
+                        const int c = FC(row, i);
+                        const int c4 = (c == 1 && !(row & 1)) ? 3 : c;
+                        rowBlack[i] = black[c4];
+                        rowColor[i] = xtrans ? ri->XTRANSFC(row, i) : c;
+                        rowBlackLevel[i] = cblacksom[xtrans ? rowColor[i] : c4];
+                        rowScale[i] = scale_mul[xtrans ? rowColor[i] : c4];
+                    }
+
+                    for (int col = 0, i = 0; col < W; col++, i = (i + 1 < period ? i + 1 : 0)) {
+                        float val = src->data[row][col];
+
+                        if (hasDarkFrame) {
+                            val = max(val + rowBlack[i] - riDark->data[row][col], 0.0f);
+                        }
+
+                        val = max(0.f, val - rowBlackLevel[i]) * rowScale[i];
+                        rawData[row][col] = val;
+                        tmpchmax[rowColor[i]] = max(tmpchmax[rowColor[i]], val);
+                    }
+                }
+
+#ifdef _OPENMP
+                #pragma omp critical
+#endif
+                {
+                    chmax[0] = max(tmpchmax[0], chmax[0]);
+                    chmax[1] = max(tmpchmax[1], chmax[1]);
+                    chmax[2] = max(tmpchmax[2], chmax[2]);
+                }
+            }
+
+            return true;
+        }
+
+        if (hasDarkFrame) { // This works also for xtrans-sensors, because black[0] to black[4] are equal for these
             StopWatch Stop1("darkframe subtraction");
 #ifdef _OPENMP
             #pragma omp parallel for
@@ -2635,7 +2861,7 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src, con
         }
 
 
-        if (riFlatFile && W == riFlatFile->get_width() && H == riFlatFile->get_height()) {
+        if (hasFlatField) {
             processFlatField(raw, riFlatFile, rawData, black);
         }  // flatfield
     } else if (ri->get_colors() == 1) {
@@ -2688,12 +2914,12 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src, con
             }
         }
     }
+
+    return false;
 }
 
-// Scale original pixels into the range 0 65535 using black offsets and multipliers
-void RawImageSource::scaleColors(int winx, int winy, int winw, int winh, const RAWParams &raw, array2D<float> &rawData)
+void RawImageSource::calculateScaleColors(const RAWParams &raw)
 {
-    chmax[0] = chmax[1] = chmax[2] = chmax[3] = 0; //channel maxima
     float black_lev[4] = {0.f};//black level
 
     //adjust black level  (eg Canon)
@@ -2731,6 +2957,13 @@ void RawImageSource::scaleColors(int winx, int winy, int winw, int winh, const R
     for (int i = 0; i < 4 ; i++) {
         clmax[i] = (c_white[i] - cblacksom[i]) * scale_mul[i];    // raw clip level
     }
+}
+
+// Scale original pixels into the range 0 65535 using black offsets and multipliers
+void RawImageSource::scaleColors(int winx, int winy, int winw, int winh, const RAWParams &raw, array2D<float> &rawData)
+{
+    chmax[0] = chmax[1] = chmax[2] = chmax[3] = 0; //channel maxima
+    calculateScaleColors(raw);
 
     // this seems strange, but it works
 
@@ -18,6 +18,7 @@
  */
 #include <cmath>
 
+#include "opthelper.h"
 #include "rawimagesource.h"
 #include "rt_math.h"
 #include "../rtgui/multilangmgr.h"
@@ -50,7 +51,7 @@ namespace rtengine
 // coefficients in an exact, shorter and more performant formula.
 // In cooperation with Hanno Schwalm (hanno@schwalm-bremen.de) and Luis Sanz Rodriguez this has been tuned for performance.
 
-void RawImageSource::rcd_demosaic(size_t chunkSize, bool measure)
+SIMD_CLONES void RawImageSource::rcd_demosaic(size_t chunkSize, bool measure)
 {
     // Test for RGB cfa
     for (int i = 0; i < 2; i++) {
@@ -23,6 +23,7 @@
 #include <ctime>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include <glibmm/ustring.h>
 
@@ -469,6 +470,16 @@ public:
     virtual void FrameCountChanged(int n, int frameNum) = 0;
 };
 
+class PipelineListener
+{
+public:
+    virtual ~PipelineListener() = default;
+    /** Called after each update of the preview.
+      * @param recomputed the stages which were run, see PipelineStages
+      * @param reused the stages requested by the changes whose cached result was still valid */
+    virtual void pipelineUpdated(const std::vector<std::string>& recomputed, const std::vector<std::string>& reused) = 0;
+};
+
 class FlatFieldAutoClipListener
 {
 public:
@@ -639,6 +650,7 @@ public:
     virtual void        setImageTypeListener    (ImageTypeListener* l) = 0;
     virtual void        setLocallabListener     (LocallabListener* l) = 0;
     virtual void        setFilmNegListener      (FilmNegListener* l) = 0;
+    virtual void        setPipelineListener     (PipelineListener* l) = 0;
 
     virtual void        setMonitorProfile       (const Glib::ustring& monitorProfile, RenderingIntent intent) = 0;
     virtual void        getMonitorProfile       (Glib::ustring& monitorProfile, RenderingIntent& intent) const = 0;
@@ -717,6 +729,15 @@ public:
                    * @param img is the result of the last ProcessingJob
                    * @return the next ProcessingJob to process */
     virtual ProcessingJob* imageReady(IImagefloat* img) = 0;
+    /** This function is called when the processing of an image starts. It returns the file of the image that will most likely be processed
+                   * next, so that it can be decoded in the background. It is only a hint, the job returned by imageReady may differ.
+                   * @param fname is set to the file name of the next image
+                   * @param isRaw is set to true if it is a raw file
+                   * @return true if there is a next image */
+    virtual bool getNextImage(Glib::ustring& fname, bool& isRaw)
+    {
+        return false;
+    }
 };
 /** This function performs all the image processing steps corresponding to the given ProcessingJob. It runs in the background, thus it returns immediately,
    * When it finishes, it calls the BatchProcessingListener with the resulting image and asks for the next job. It the listener gives a new job, it goes on
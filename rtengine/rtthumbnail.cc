@@ -483,8 +483,7 @@ Thumbnail* Thumbnail::loadQuickFromRaw (const Glib::ustring& fname, eSensorType
     }
 
     RawImage *ri = new RawImage (fname);
-    unsigned int imageNum = 0;
-    int r = ri->loadRaw (false, imageNum, false);
+    int r = ri->loadHeader ();
 
     if ( r ) {
         delete tpp;
@@ -51,6 +51,9 @@ public:
     Glib::ustring   flatFieldsPath;         ///< The default directory for flat fields
     Glib::ustring   cameraProfilesPath;     ///< The default directory for camera profiles
     Glib::ustring   lensProfilesPath;       ///< The default directory for lens profiles
+    Glib::ustring   demosaicCacheDir;       ///< The directory of the demosaic cache
+    int             demosaicCacheSize;      ///< Maximum size of the demosaic cache in MiB, 0 disables it
+    int             exportMemoryBudget;     ///< Estimated peak memory in MiB of the concurrent exports, 0 for no limit
 
     Glib::ustring   adobe;                  // filename of AdobeRGB1998 profile (default to the bundled one)
     Glib::ustring   prophoto;               // filename of Prophoto     profile (default to the bundled one)
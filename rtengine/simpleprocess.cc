@@ -17,6 +17,10 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <condition_variable>
+#include <future>
+#include <mutex>
+
 #include <glibmm/thread.h>
 #include <glibmm/ustring.h>
 
@@ -24,6 +28,7 @@
 #include "clutstore.h"
 #include "color.h"
 #include "colortemp.h"
+#include "cplx_wavelet_pool.h"
 #include "curves.h"
 #include "dcp.h"
 #include "guidedfilter.h"
@@ -34,10 +39,13 @@
 #include "labimage.h"
 #include "metadata.h"
 #include "mytime.h"
+#include "noncopyable.h"
 #include "processingjob.h"
 #include "procparams.h"
+#include "rawimage.h"
 #include "rawimagesource.h"
 #include "rtengine.h"
+#include "StopWatch.h"
 #include "utils.h"
 
 #include "../rtgui/multilangmgr.h"
@@ -59,6 +67,108 @@ void adjust_radius(const T &default_param, double scale_factor, T &param)
 }
 
 
+// Rough peak of the buffers allocated while processing an image, in bytes: the decoded raw data,
+// the demosaiced planes, the working Imagefloat and LabImage, the transformed copy and the output
+// image, plus the full size temporaries of the tools known to be expensive
+std::size_t estimatePeakMemory(const procparams::ProcParams& params, int width, int height)
+{
+    constexpr std::size_t raw = sizeof(unsigned short) + sizeof(float); // decoded and scaled raw data
+    constexpr std::size_t plane = sizeof(float) * 3; // one Imagefloat or LabImage
+    std::size_t planes = 5;
+
+    if (params.pdsharpening.enabled) {
+        ++planes; // copy of the demosaiced planes
+    }
+
+    if (params.retinex.enabled) {
+        planes += 2;
+    }
+
+    if (params.dirpyrDenoise.enabled) {
+        ++planes;
+    }
+
+    if (params.locallab.enabled && !params.locallab.spots.empty()) {
+        planes += 4;
+    }
+
+    if (params.wavelet.enabled) {
+        planes += 3;
+    }
+
+    return (raw + planes * plane) * width * height;
+}
+
+// Admission control for concurrent exports (batch queue, rawtherapee-cli -J): an image reserves
+// its estimated peak memory before decoding its raw data, and waits while the images in flight
+// would exceed settings->exportMemoryBudget. An image larger than the budget runs alone.
+// This only limits how many images are processed at once, the pipeline is not tiled: the peak
+// of a single image is not bounded.
+class MemoryReservation final :
+    public NonCopyable
+{
+public:
+    MemoryReservation() :
+        size(0)
+    {
+    }
+
+    ~MemoryReservation()
+    {
+        release();
+    }
+
+    void acquire(std::size_t bytes)
+    {
+        const std::size_t budget = static_cast<std::size_t>(std::max(settings->exportMemoryBudget, 0)) << 20;
+
+        if (budget == 0 || size > 0) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (holders > 0 && reserved + bytes > budget && settings->verbose) {
+            printf("Waiting for %zu MiB of the export memory budget\n", bytes >> 20);
+        }
+
+        released.wait(lock, [bytes, budget]() { return holders == 0 || reserved + bytes <= budget; });
+
+        reserved += bytes;
+        ++holders;
+        size = bytes;
+    }
+
+    void release()
+    {
+        if (size == 0) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reserved -= size;
+            --holders;
+            size = 0;
+        }
+
+        released.notify_all();
+    }
+
+private:
+    static std::mutex mutex;
+    static std::condition_variable released;
+    static std::size_t reserved;
+    static unsigned int holders;
+
+    std::size_t size;
+};
+
+std::mutex MemoryReservation::mutex;
+std::condition_variable MemoryReservation::released;
+std::size_t MemoryReservation::reserved = 0;
+unsigned int MemoryReservation::holders = 0;
+
 class ImageProcessor
 {
 public:
@@ -149,6 +259,7 @@ private:
 
     bool stage_init()
     {
+        TRACEFUN
         errorCode = 0;
 
         if (pl) {
@@ -159,6 +270,15 @@ private:
         initialImage = job->initialImage;
 
         if (!initialImage) {
+            if (job->isRaw) {
+                // reserve before the raw data is decoded, the size is in the header
+                RawImage header(job->fname);
+
+                if (header.loadHeader() == 0) {
+                    memory.acquire(estimatePeakMemory(job->pparams, header.get_width(), header.get_height()));
+                }
+            }
+
             initialImage = InitialImage::load(job->fname, job->isRaw, &errorCode);
 
             if (errorCode) {
@@ -186,6 +306,9 @@ private:
 
         imgsrc->getFullSize(fw, fh, tr);
 
+        // no-op if reserved before loading the raw data
+        memory.acquire(estimatePeakMemory(params, fw, fh));
+
         // check the crop params
         if (params.crop.x > fw || params.crop.y > fh) {
             // the crop is completely out of the image, so we disable the crop
@@ -1057,6 +1180,7 @@ private:
 
     void stage_denoise()
     {
+        TRACEFUN
         const procparams::ProcParams& params = job->pparams;
 
         DirPyrDenoiseParams denoiseParams = params.dirpyrDenoise;   // make a copy because we cheat here
@@ -1112,6 +1236,7 @@ private:
 
     void stage_transform()
     {
+        TRACEFUN
         const procparams::ProcParams& params = job->pparams;
         //ImProcFunctions ipf (&params, true);
         ImProcFunctions &ipf = * (ipf_p.get());
@@ -1164,6 +1289,7 @@ private:
 
     Imagefloat *stage_finish()
     {
+        TRACEFUN
         procparams::ProcParams& params = job->pparams;
         //ImProcFunctions ipf (&params, true);
         ImProcFunctions &ipf = * (ipf_p.get());
@@ -2143,6 +2269,7 @@ private:
 
     void stage_early_resize()
     {
+        TRACEFUN
         procparams::ProcParams& params = job->pparams;
         //ImProcFunctions ipf (&params, true);
         ImProcFunctions &ipf = * (ipf_p.get());
@@ -2279,6 +2406,7 @@ private:
     int& errorCode;
     ProgressListener* pl;
     bool flush;
+    MemoryReservation memory;
 
     // internal state
     std::unique_ptr<ImProcFunctions> ipf_p;
@@ -2353,15 +2481,96 @@ private:
 
 IImagefloat* processImage(ProcessingJob* pjob, int& errorCode, ProgressListener* pl, bool flush)
 {
+    TRACEFUN
+    const WaveletBufferPool::Exporting exporting;
     ImageProcessor proc(pjob, errorCode, pl, flush);
     return proc();
 }
 
+namespace
+{
+
+// Decodes the image of the next batch job in the background while the current one is processed
+class BatchPrefetch final :
+    public NonCopyable
+{
+public:
+    BatchPrefetch() :
+        isRaw(false)
+    {
+    }
+
+    ~BatchPrefetch()
+    {
+        discard();
+    }
+
+    void start(const Glib::ustring& nextFname, bool nextIsRaw)
+    {
+        if (image.valid()) {
+            if (nextFname == fname && nextIsRaw == isRaw) {
+                return;
+            }
+
+            discard();
+        }
+
+        fname = nextFname;
+        isRaw = nextIsRaw;
+        image = std::async(std::launch::async, [nextFname, nextIsRaw]() -> InitialImage* {
+            int errorCode = 0;
+            return InitialImage::load(nextFname, nextIsRaw, &errorCode);
+        });
+    }
+
+    // Hands the prefetched image over to the job if it is the one that was decoded.
+    // If decoding failed, the job loads the file again and reports the error.
+    void attach(ProcessingJob* job)
+    {
+        ProcessingJobImpl* const jobImpl = static_cast<ProcessingJobImpl*>(job);
+
+        if (image.valid() && !jobImpl->initialImage && jobImpl->fname == fname && jobImpl->isRaw == isRaw) {
+            // the job takes over the reference of the loaded image
+            jobImpl->initialImage = image.get();
+        } else {
+            discard();
+        }
+    }
+
+private:
+    void discard()
+    {
+        if (image.valid()) {
+            InitialImage* const img = image.get();
+
+            if (img) {
+                img->decreaseRef();
+            }
+        }
+    }
+
+    Glib::ustring fname;
+    bool isRaw;
+    std::future<InitialImage*> image;
+};
+
+}
+
 void batchProcessingThread(ProcessingJob* job, BatchProcessingListener* bpl)
 {
     ProcessingJob* currentJob = job;
+    BatchPrefetch prefetch;
 
     while (currentJob) {
+        prefetch.attach(currentJob);
+
+        Glib::ustring nextFname;
+        bool nextIsRaw;
+
+        if (bpl->getNextImage(nextFname, nextIsRaw)) {
+            prefetch.start(nextFname, nextIsRaw);
+        }
+
         int errorCode;
         IImagefloat* img = processImage(currentJob, errorCode, bpl, true);
 
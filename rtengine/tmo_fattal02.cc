@@ -1068,6 +1068,7 @@ void ImProcFunctions::ToneMapFattal02(Imagefloat *rgb, const FattalToneMappingPa
 //algo allows to use ART algorithme algo = 0 RT, algo = 1 ART
 //Lalone allows to use L without RGB values in RT mode
 {
+    TRACEFUN
     if (!fatParams.enabled) {
         return;
     }
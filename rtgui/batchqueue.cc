@@ -43,7 +43,7 @@
 using namespace std;
 using namespace rtengine;
 
-BatchQueue::BatchQueue (FileCatalog* aFileCatalog) : processing(nullptr), fileCatalog(aFileCatalog), sequence(0), listener(nullptr)
+BatchQueue::BatchQueue (FileCatalog* aFileCatalog) : processing(nullptr), saving(nullptr), savingParams(false), fileCatalog(aFileCatalog), sequence(0), listener(nullptr)
 {
 
     location = THLOC_BATCHQUEUE;
@@ -583,7 +583,8 @@ void BatchQueue::startProcessing ()
     if (!processing) {
         MYWRITERLOCK(l, entryRW);
 
-        if (!fd.empty()) {
+        // processing is cleared under the lock once the last image is written, check it again
+        if (!processing && !fd.empty() && !fd[0]->processing) {
             BatchQueueEntry* next;
 
             next = static_cast<BatchQueueEntry*>(fd[0]);
@@ -643,6 +644,10 @@ void BatchQueue::setProgressState(bool inProcessing)
 
 void BatchQueue::error(const Glib::ustring& descr)
 {
+    // the previous image may still be written in the background
+    Glib::ustring failedFileName;
+    finishSave (failedFileName);
+
     if (processing && processing->processing) {
         // restore failed thumb
         BatchQueueButtonSet* bqbs = new BatchQueueButtonSet (processing);
@@ -669,6 +674,15 @@ void BatchQueue::error(const Glib::ustring& descr)
 
 rtengine::ProcessingJob* BatchQueue::imageReady(rtengine::IImagefloat* img)
 {
+    // Wait for the previous image first, so that the automatic file names stay unique
+    // and a write error stops the queue at the entry it belongs to
+    Glib::ustring failedFileName;
+
+    if (!finishSave (failedFileName)) {
+        delete img;
+        throw Glib::FileError(Glib::FileError::FAILED, M("MAIN_MSG_CANNOTSAVE") + "\n" + failedFileName);
+    }
+
     // save image img
     Glib::ustring fname;
     SaveFormat saveFormat;
@@ -692,84 +706,174 @@ rtengine::ProcessingJob* BatchQueue::imageReady(rtengine::IImagefloat* img)
 
     //printf ("fname=%s, %s\n", fname.c_str(), removeExtension(fname).c_str());
 
+    // The entry stays in the queue, tagged as processing, until its image is written.
+    // Meanwhile the next entry gets processed.
+    saving = processing;
+    savingFileName = fname;
+    savingParams = saveFormat.saveParams;
+
     if (img && !fname.empty()) {
-        int err = 0;
-
-        if (saveFormat.format == "tif") {
-            err = img->saveAsTIFF (
-                fname,
-                saveFormat.tiffBits,
-                saveFormat.tiffFloat,
-                saveFormat.tiffUncompressed,
-                saveFormat.bigTiff
-            );
-        } else if (saveFormat.format == "png") {
-            err = img->saveAsPNG (fname, saveFormat.pngBits);
-        } else if (saveFormat.format == "jpg") {
-            err = img->saveAsJPEG (fname, saveFormat.jpegQuality, saveFormat.jpegSubSamp);
-        }
+        pendingSave = std::async(std::launch::async, [img, fname, saveFormat]() -> int {
+            int err = 0;
+
+            if (saveFormat.format == "tif") {
+                err = img->saveAsTIFF (
+                    fname,
+                    saveFormat.tiffBits,
+                    saveFormat.tiffFloat,
+                    saveFormat.tiffUncompressed,
+                    saveFormat.bigTiff
+                );
+            } else if (saveFormat.format == "png") {
+                err = img->saveAsPNG (fname, saveFormat.pngBits);
+            } else if (saveFormat.format == "jpg") {
+                err = img->saveAsJPEG (fname, saveFormat.jpegQuality, saveFormat.jpegSubSamp);
+            }
 
+            delete img;
+            return err;
+        });
+    } else {
         delete img;
-
-        if (err) {
-            throw Glib::FileError(Glib::FileError::FAILED, M("MAIN_MSG_CANNOTSAVE") + "\n" + fname);
-        }
-
-        if (saveFormat.saveParams) {
-            // We keep the extension to avoid overwriting the profile when we have
-            // the same output filename with different extension
-            //processing->params.save (removeExtension(fname) + paramFileExtension);
-            processing->params->save (fname + ".out" + paramFileExtension);
-        }
-
-        if (processing->thumbnail) {
-            processing->thumbnail->imageDeveloped ();
-            processing->thumbnail->imageRemovedFromQueue ();
-        }
     }
 
-    // save temporary params file name: delete as last thing
-    Glib::ustring processedParams = processing->savedParamsFile;
-
-    // delete from the queue
-    bool remove_button_set = false;
+    BatchQueueEntry* next = nullptr;
 
     {
         MYWRITERLOCK(l, entryRW);
 
-        delete processing;
-        processing = nullptr;
-
-        fd.erase (fd.begin());
+        // return next job, the one following the entry being saved
+        const auto savingPos = std::find (fd.begin(), fd.end(), saving);
 
-        // return next job
-        if (!fd.empty() && listener && listener->canStartNext ()) {
-            BatchQueueEntry* next = static_cast<BatchQueueEntry*>(fd[0]);
+        if (savingPos != fd.end() && savingPos + 1 != fd.end() && listener && listener->canStartNext ()) {
+            next = static_cast<BatchQueueEntry*>(*(savingPos + 1));
             // tag it as selected and set sequence
             next->processing = true;
             next->sequence = ++sequence;
-            processing = next;
 
             // remove from selection
-            if (processing->selected) {
-                std::vector<ThumbBrowserEntryBase*>::iterator pos = std::find (selected.begin(), selected.end(), processing);
+            if (next->selected) {
+                std::vector<ThumbBrowserEntryBase*>::iterator pos = std::find (selected.begin(), selected.end(), next);
 
                 if (pos != selected.end()) {
                     selected.erase (pos);
                 }
 
-                processing->selected = false;
+                next->selected = false;
             }
 
-            // remove button set
-            remove_button_set = true;
+            processing = next;
         }
+
+        // Otherwise the entry being saved stays the processing one until finishSave() is done with it,
+        // so that startProcessing() can not start it again meanwhile
     }
 
-    if (remove_button_set) {
+    if (next) {
         // ButtonSet have Cairo::Surface which might be rendered while we're trying to delete them
         GThreadLock lock;
-        processing->removeButtonSet ();
+        next->removeButtonSet ();
+    } else if (!finishSave (failedFileName)) {
+        // last image of the run: it has to be on disk before the queue stops
+        throw Glib::FileError(Glib::FileError::FAILED, M("MAIN_MSG_CANNOTSAVE") + "\n" + failedFileName);
+    }
+
+    redraw ();
+    notifyListener ();
+
+    return next ? next->job : nullptr;
+}
+
+bool BatchQueue::getNextImage(Glib::ustring& fname, bool& isRaw)
+{
+    MYREADERLOCK(l, entryRW);
+
+    // the entry following the one being processed
+    const auto pos = std::find (fd.begin(), fd.end(), processing);
+
+    if (pos == fd.end() || pos + 1 == fd.end()) {
+        return false;
+    }
+
+    const BatchQueueEntry* next = static_cast<BatchQueueEntry*>(*(pos + 1));
+
+    if (!next->thumbnail) {
+        return false;
+    }
+
+    fname = next->filename;
+    isRaw = next->thumbnail->getType() == FT_Raw;
+    return true;
+}
+
+// Completes the entry whose image was written in the background: returns false if it could not be
+// written, the entry is then put back in the queue like in error()
+bool BatchQueue::finishSave (Glib::ustring& failedFileName)
+{
+    if (!saving) {
+        return true;
+    }
+
+    BatchQueueEntry* const entry = saving;
+    saving = nullptr;
+
+    const bool written = pendingSave.valid();
+    const int err = written ? pendingSave.get() : 0;
+
+    if (err) {
+        failedFileName = savingFileName;
+
+        // restore failed thumb
+        BatchQueueButtonSet* bqbs = new BatchQueueButtonSet (entry);
+        bqbs->setButtonListener (this);
+        entry->addButtonSet (bqbs);
+        entry->processing = false;
+        entry->job = rtengine::ProcessingJob::create(entry->filename, entry->thumbnail->getType() == FT_Raw, *entry->params);
+
+        {
+            MYWRITERLOCK(l, entryRW);
+
+            if (processing == entry) {
+                processing = nullptr;
+            }
+        }
+
+        redraw ();
+        return false;
+    }
+
+    if (written) {
+        if (savingParams) {
+            // We keep the extension to avoid overwriting the profile when we have
+            // the same output filename with different extension
+            //processing->params.save (removeExtension(fname) + paramFileExtension);
+            entry->params->save (savingFileName + ".out" + paramFileExtension);
+        }
+
+        if (entry->thumbnail) {
+            entry->thumbnail->imageDeveloped ();
+            entry->thumbnail->imageRemovedFromQueue ();
+        }
+    }
+
+    // save temporary params file name: delete as last thing
+    Glib::ustring processedParams = entry->savedParamsFile;
+
+    // delete from the queue
+    {
+        MYWRITERLOCK(l, entryRW);
+
+        if (processing == entry) {
+            processing = nullptr;
+        }
+
+        const auto pos = std::find (fd.begin(), fd.end(), entry);
+
+        if (pos != fd.end()) {
+            fd.erase (pos);
+        }
+
+        delete entry;
     }
 
     if (saveBatchQueue ()) {
@@ -800,10 +904,7 @@ rtengine::ProcessingJob* BatchQueue::imageReady(rtengine::IImagefloat* img)
         }
     }
 
-    redraw ();
-    notifyListener ();
-
-    return processing ? processing->job : nullptr;
+    return true;
 }
 
 // Calculates automatic filename of processed batch entry, but just the base name
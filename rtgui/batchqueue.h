@@ -17,6 +17,7 @@
  */
 #pragma once
 
+#include <future>
 #include <set>
 
 #include <gtkmm.h>
@@ -73,6 +74,7 @@ public:
     void setProgressState(bool inProcessing) override;
     void error(const Glib::ustring& descr) override;
     rtengine::ProcessingJob* imageReady(rtengine::IImagefloat* img) override;
+    bool getNextImage(Glib::ustring& fname, bool& isRaw) override;
 
     void rightClicked () override;
     void doubleClicked (ThumbBrowserEntryBase* entry) override;
@@ -100,10 +102,15 @@ private:
     Glib::ustring getTempFilenameForParams( const Glib::ustring &filename );
     bool saveBatchQueue ();
     void notifyListener ();
+    bool finishSave (Glib::ustring& failedFileName);
 
     using ThumbBrowserBase::redrawNeeded;
 
     BatchQueueEntry* processing;  // holds the currently processed image
+    BatchQueueEntry* saving;      // holds the previous image while it is written in the background
+    Glib::ustring savingFileName;
+    bool savingParams;
+    std::future<int> pendingSave; // invalid if there is nothing to write for the saving entry
     FileCatalog* fileCatalog;
     int sequence; // holds the current sequence index
 
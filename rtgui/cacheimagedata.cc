@@ -17,12 +17,16 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "cacheimagedata.h"
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include <glib/gstdio.h>
 #include <glibmm/keyfile.h>
 #include "version.h"
 #include <locale.h>
 
+#include "cachemanager.h"
+
 #include "../rtengine/procparams.h"
 #include "../rtengine/settings.h"
 
@@ -33,6 +37,69 @@ namespace
 const Glib::ustring INI_GROUP_XMP_SIDECAR = "XmpSidecar";
 const Glib::ustring INI_XMP_SIDECAR_MD5 = "MD5";
 
+class BinaryWriter
+{
+public:
+    explicit BinaryWriter(std::string& out) : out(out) {}
+
+    template<typename T>
+    void put(T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void put(const Glib::ustring& value)
+    {
+        put<std::uint32_t>(value.bytes());
+        out.append(value.raw());
+    }
+
+private:
+    std::string& out;
+};
+
+class BinaryReader
+{
+public:
+    BinaryReader(const char* data, std::size_t size) : data(data), end(data + size), valid(true) {}
+
+    template<typename T>
+    void get(T& value)
+    {
+        if (check(sizeof(T))) {
+            std::memcpy(&value, data, sizeof(T));
+            data += sizeof(T);
+        }
+    }
+
+    void get(Glib::ustring& value)
+    {
+        std::uint32_t length = 0;
+        get(length);
+
+        if (check(length)) {
+            value.assign(data, data + length);
+            data += length;
+        }
+    }
+
+    bool isValid() const
+    {
+        return valid && data == end;
+    }
+
+private:
+    bool check(std::size_t size)
+    {
+        valid = valid && static_cast<std::size_t>(end - data) >= size;
+        return valid;
+    }
+
+    const char* data;
+    const char* const end;
+    bool valid;
+};
+
 }
 
 CacheImageData::CacheImageData() :
@@ -358,7 +425,109 @@ int CacheImageData::save (const Glib::ustring& fname)
     } else {
         fprintf (f, "%s", keyData.c_str ());
         fclose (f);
+        cacheMgr->updateIndex (*this);
         return 0;
     }
 }
 
+/*
+ * Same values as written by save(), in the order of the members.
+ * Rank and InTrash of the old implementation are dropped like by save().
+ */
+void CacheImageData::serialize (std::string& out) const
+{
+    BinaryWriter writer (out);
+
+    writer.put (md5);
+    writer.put (Glib::ustring (RTVERSION));
+    writer.put<char> (supported);
+    writer.put<int> (format);
+    writer.put<char> (recentlySaved);
+    writer.put (xmpSidecarMd5);
+    writer.put<char> (timeValid);
+    writer.put (year);
+    writer.put (month);
+    writer.put (day);
+    writer.put (hour);
+    writer.put (min);
+    writer.put (sec);
+    writer.put<char> (exifValid);
+    writer.put (frameCount);
+    writer.put (fnumber);
+    writer.put (shutter);
+    writer.put (focalLen);
+    writer.put (focalLen35mm);
+    writer.put (focusDist);
+    writer.put (iso);
+    writer.put (rating);
+    writer.put<char> (isHDR);
+    writer.put<char> (isPixelShift);
+    writer.put (sensortype);
+    writer.put<int> (sampleFormat);
+    writer.put (lens);
+    writer.put (camMake);
+    writer.put (camModel);
+    writer.put (filetype);
+    writer.put (expcomp);
+    writer.put (thumbImgType);
+    writer.put (width);
+    writer.put (height);
+}
+
+bool CacheImageData::deserialize (const char* data, std::size_t size)
+{
+    BinaryReader reader (data, size);
+    char flag = 0;
+    int value = 0;
+
+    reader.get (md5);
+    reader.get (version);
+    reader.get (flag);
+    supported = flag;
+    reader.get (value);
+    format = static_cast<ThFileType>(value);
+    reader.get (flag);
+    recentlySaved = flag;
+    reader.get (xmpSidecarMd5);
+    reader.get (flag);
+    timeValid = flag;
+    reader.get (year);
+    reader.get (month);
+    reader.get (day);
+    reader.get (hour);
+    reader.get (min);
+    reader.get (sec);
+    reader.get (flag);
+    exifValid = flag;
+    reader.get (frameCount);
+    reader.get (fnumber);
+    reader.get (shutter);
+    reader.get (focalLen);
+    reader.get (focalLen35mm);
+    reader.get (focusDist);
+    reader.get (iso);
+    reader.get (rating);
+    reader.get (flag);
+    isHDR = flag;
+    reader.get (flag);
+    isPixelShift = flag;
+    reader.get (sensortype);
+    reader.get (value);
+    sampleFormat = static_cast<rtengine::IIO_Sample_Format>(value);
+    reader.get (lens);
+    reader.get (camMake);
+    reader.get (camModel);
+    reader.get (filetype);
+    reader.get (expcomp);
+    reader.get (thumbImgType);
+    reader.get (width);
+    reader.get (height);
+
+    if (format != FT_Raw) {
+        rotate = 0;
+        thumbImgType = 0;
+    }
+
+    return reader.isValid ();
+}
+
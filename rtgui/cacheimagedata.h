@@ -18,6 +18,9 @@
  */
 #pragma once
 
+#include <cstddef>
+#include <string>
+
 #include <glibmm/ustring.h>
 
 #include "options.h"
@@ -91,6 +94,10 @@ public:
     int load (const Glib::ustring& fname);
     int save (const Glib::ustring& fname);
 
+    // compact binary form of the values of the data file, used by CacheIndex
+    void serialize (std::string& out) const;
+    bool deserialize (const char* data, std::size_t size);
+
     //-------------------------------------------------------------------------
     // FramesMetaData interface
     //-------------------------------------------------------------------------
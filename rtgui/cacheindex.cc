@@ -0,0 +1,381 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <iostream>
+
+#include <glib/gstdio.h>
+
+#include "cacheindex.h"
+
+#include "cacheimagedata.h"
+
+#include "../rtengine/settings.h"
+
+namespace
+{
+
+// Bump the version when the record layout of CacheImageData::serialize changes,
+// older files are then dropped and rebuilt from the data files.
+constexpr char indexMagic[] = {'R', 'T', 'C', 'I'};
+constexpr std::uint32_t indexVersion = 1;
+constexpr std::uint32_t byteOrderMark = 0x01020304;
+constexpr std::size_t headerSize = sizeof(indexMagic) + sizeof(indexVersion) + sizeof(byteOrderMark);
+
+// record: payload size (uint32), removed flag (1 byte), md5 (32 hex chars), payload
+constexpr std::size_t md5Size = 32;
+constexpr std::size_t recordHeaderSize = sizeof(std::uint32_t) + 1 + md5Size;
+
+std::string getHeader()
+{
+    std::string header(indexMagic, sizeof(indexMagic));
+    header.append(reinterpret_cast<const char*>(&indexVersion), sizeof(indexVersion));
+    header.append(reinterpret_cast<const char*>(&byteOrderMark), sizeof(byteOrderMark));
+    return header;
+}
+
+std::string getRecord(const std::string& md5, bool removed, const char* payload, std::size_t size)
+{
+    const std::uint32_t payloadSize = size;
+    std::string record(reinterpret_cast<const char*>(&payloadSize), sizeof(payloadSize));
+    record += removed ? '\1' : '\0';
+    record += md5;
+    record.append(payload, size);
+    return record;
+}
+
+}
+
+CacheIndex::CacheIndex () :
+    mapping(nullptr),
+    appendFile(nullptr),
+    staleBytes(0),
+    liveBytes(0)
+{
+}
+
+CacheIndex::~CacheIndex ()
+{
+    MyMutex::MyLock lock (mutex);
+    close ();
+}
+
+void CacheIndex::open (const Glib::ustring& fname)
+{
+    MyMutex::MyLock lock (mutex);
+
+    close ();
+    fileName = fname;
+    map ();
+}
+
+void CacheIndex::flush ()
+{
+    MyMutex::MyLock lock (mutex);
+
+    if (!mapping || staleBytes <= liveBytes) {
+        return;
+    }
+
+    // rewrite the file with the live records only
+    std::string contents = getHeader();
+    const char* const data = g_mapped_file_get_contents (mapping);
+
+    for (const auto& entry : mapped) {
+        if (written.find (entry.first) == written.end ()) {
+            contents += getRecord (entry.first, false, data + entry.second.offset, entry.second.size);
+        }
+    }
+
+    for (const auto& entry : written) {
+        if (!entry.second.empty ()) {
+            contents += getRecord (entry.first, false, entry.second.data (), entry.second.size ());
+        }
+    }
+
+    close ();
+
+    if (writeFile (contents)) {
+        map ();
+    }
+}
+
+bool CacheIndex::load (const std::string& md5, CacheImageData& imageData) const
+{
+    MyMutex::MyLock lock (mutex);
+
+    const char* data;
+    std::size_t size;
+
+    return getPayload (md5, data, size) && imageData.deserialize (data, size);
+}
+
+void CacheIndex::store (const std::string& md5, const CacheImageData& imageData)
+{
+    std::string payload;
+    imageData.serialize (payload);
+
+    store (md5, payload);
+}
+
+bool CacheIndex::load (const std::string& md5, std::string& payload) const
+{
+    MyMutex::MyLock lock (mutex);
+
+    const char* data;
+    std::size_t size;
+
+    if (!getPayload (md5, data, size)) {
+        return false;
+    }
+
+    payload.assign (data, size);
+    return true;
+}
+
+void CacheIndex::store (const std::string& md5, const std::string& payload)
+{
+    if (md5.size () != md5Size || payload.empty ()) {
+        return;
+    }
+
+    MyMutex::MyLock lock (mutex);
+
+    const char* data;
+    std::size_t size;
+
+    if (getPayload (md5, data, size) && size == payload.size () && !std::memcmp (data, payload.data (), size)) {
+        // unchanged, don't let the file grow
+        return;
+    }
+
+    append (md5, false, payload);
+}
+
+void CacheIndex::remove (const std::string& md5)
+{
+    MyMutex::MyLock lock (mutex);
+
+    const char* data;
+    std::size_t size;
+
+    if (getPayload (md5, data, size)) {
+        append (md5, true, {});
+    }
+}
+
+void CacheIndex::removePayloads (const std::unordered_set<std::string>& payloads)
+{
+    if (payloads.empty ()) {
+        return;
+    }
+
+    MyMutex::MyLock lock (mutex);
+
+    std::vector<std::string> keys;
+
+    for (const auto& record : written) {
+        // empty: removed
+        if (!record.second.empty () && payloads.count (record.second)) {
+            keys.push_back (record.first);
+        }
+    }
+
+    const char* const contents = mapping ? g_mapped_file_get_contents (mapping) : nullptr;
+
+    for (const auto& record : mapped) {
+        if (!written.count (record.first) && payloads.count (std::string (contents + record.second.offset, record.second.size))) {
+            keys.push_back (record.first);
+        }
+    }
+
+    for (const auto& key : keys) {
+        append (key, true, {});
+    }
+}
+
+void CacheIndex::clear ()
+{
+    MyMutex::MyLock lock (mutex);
+
+    close ();
+
+    if (writeFile (getHeader ())) {
+        map ();
+    }
+}
+
+void CacheIndex::close ()
+{
+    if (appendFile) {
+        std::fclose (appendFile);
+        appendFile = nullptr;
+    }
+
+    if (mapping) {
+        g_mapped_file_unref (mapping);
+        mapping = nullptr;
+    }
+
+    mapped.clear ();
+    written.clear ();
+    staleBytes = 0;
+    liveBytes = 0;
+}
+
+void CacheIndex::map ()
+{
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        GError* error = nullptr;
+        mapping = g_mapped_file_new (fileName.c_str (), FALSE, &error);
+
+        if (error) {
+            // no index yet
+            g_error_free (error);
+        }
+
+        const char* const data = mapping ? g_mapped_file_get_contents (mapping) : nullptr;
+        const std::size_t length = mapping ? g_mapped_file_get_length (mapping) : 0;
+        const bool validHeader = length >= headerSize && !getHeader ().compare (0, headerSize, data, headerSize);
+        std::size_t pos = headerSize;
+
+        while (validHeader && pos + recordHeaderSize <= length) {
+            std::uint32_t size;
+            std::memcpy (&size, data + pos, sizeof(size));
+
+            if (pos + recordHeaderSize + size > length) {
+                break;
+            }
+
+            const bool removed = data[pos + sizeof(size)];
+            const std::string md5 (data + pos + sizeof(size) + 1, md5Size);
+            const auto previous = mapped.find (md5);
+
+            if (previous != mapped.end ()) {
+                staleBytes += recordHeaderSize + previous->second.size;
+                liveBytes -= recordHeaderSize + previous->second.size;
+                mapped.erase (previous);
+            }
+
+            if (removed) {
+                staleBytes += recordHeaderSize + size;
+            } else {
+                mapped[md5] = {pos + recordHeaderSize, size};
+                liveBytes += recordHeaderSize + size;
+            }
+
+            pos += recordHeaderSize + size;
+        }
+
+        if (validHeader && pos == length) {
+            return;
+        }
+
+        // unknown or outdated format, or a tail damaged by a crash: keep what is usable
+        std::string contents = getHeader ();
+
+        if (validHeader) {
+            for (const auto& entry : mapped) {
+                contents += getRecord (entry.first, false, data + entry.second.offset, entry.second.size);
+            }
+        }
+
+        close ();
+
+        if (!writeFile (contents)) {
+            return;
+        }
+    }
+
+    // should not happen, the index stays disabled
+    close ();
+}
+
+bool CacheIndex::append (const std::string& md5, bool removed, const std::string& payload)
+{
+    if (!mapping) {
+        return false;
+    }
+
+    if (!appendFile) {
+        appendFile = g_fopen (fileName.c_str (), "ab");
+
+        if (!appendFile) {
+            return false;
+        }
+    }
+
+    const std::string record = getRecord (md5, removed, payload.data (), payload.size ());
+
+    if (std::fwrite (record.data (), 1, record.size (), appendFile) != record.size () || std::fflush (appendFile)) {
+        // a partial record is dropped the next time the file is mapped
+        return false;
+    }
+
+    const char* data;
+    std::size_t size;
+
+    if (getPayload (md5, data, size)) {
+        staleBytes += recordHeaderSize + size;
+        liveBytes -= recordHeaderSize + size;
+    }
+
+    if (removed) {
+        staleBytes += record.size ();
+    } else {
+        liveBytes += record.size ();
+    }
+
+    written[md5] = payload;
+    return true;
+}
+
+bool CacheIndex::getPayload (const std::string& md5, const char*& data, std::size_t& size) const
+{
+    const auto writtenRecord = written.find (md5);
+
+    if (writtenRecord != written.end ()) {
+        data = writtenRecord->second.data ();
+        size = writtenRecord->second.size ();
+        return size > 0;
+    }
+
+    const auto mappedRecord = mapped.find (md5);
+
+    if (mappedRecord != mapped.end ()) {
+        data = g_mapped_file_get_contents (mapping) + mappedRecord->second.offset;
+        size = mappedRecord->second.size;
+        return true;
+    }
+
+    return false;
+}
+
+bool CacheIndex::writeFile (const std::string& contents) const
+{
+    GError* error = nullptr;
+
+    if (!g_file_set_contents (fileName.c_str (), contents.data (), contents.size (), &error)) {
+        if (rtengine::settings->verbose) {
+            std::cerr << "Failed to write cache index '" << fileName << "': " << error->message << std::endl;
+        }
+
+        g_error_free (error);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,91 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <glib.h>
+#include <glibmm/ustring.h>
+
+#include "threadutils.h"
+
+#include "../rtengine/noncopyable.h"
+
+class CacheImageData;
+
+/*
+ * Single file holding the CacheImageData of all cached images in binary form,
+ * so that a folder can be populated without opening and parsing one data file
+ * per image. Other small per-image records can be kept the same way.
+ *
+ * The file is an append-only log of records keyed by the MD5 of the image. It
+ * is memory mapped when opened and only the record headers are walked to build
+ * the index; the newest record of a key wins, removals are tombstone records.
+ * Records written afterwards are kept in memory as well. flush() rewrites the
+ * file with the live records only once it contains too many stale ones.
+ *
+ * The per-image data files stay the reference: a missing or stale record is
+ * rebuilt from them.
+ */
+class CacheIndex :
+    public rtengine::NonCopyable
+{
+public:
+    CacheIndex ();
+    ~CacheIndex ();
+
+    void open (const Glib::ustring& fname);
+    void flush ();
+
+    bool load (const std::string& md5, CacheImageData& imageData) const;
+    void store (const std::string& md5, const CacheImageData& imageData);
+    bool load (const std::string& md5, std::string& payload) const;
+    void store (const std::string& md5, const std::string& payload);
+    void remove (const std::string& md5);
+    // removes the records whose payload is one of payloads, e.g. the identities of removed entries
+    void removePayloads (const std::unordered_set<std::string>& payloads);
+    void clear ();
+
+private:
+    struct Location {
+        std::size_t offset;
+        std::uint32_t size;
+    };
+
+    void close ();
+    void map ();
+    bool append (const std::string& md5, bool removed, const std::string& payload);
+    bool getPayload (const std::string& md5, const char*& data, std::size_t& size) const;
+    bool writeFile (const std::string& contents) const;
+
+    Glib::ustring fileName;
+    GMappedFile* mapping;
+    FILE* appendFile;
+
+    std::unordered_map<std::string, Location> mapped;     // records of the mapped file
+    std::unordered_map<std::string, std::string> written; // records appended since it was mapped, empty if removed
+    std::size_t staleBytes;
+    std::size_t liveBytes;
+
+    mutable MyMutex mutex;
+};
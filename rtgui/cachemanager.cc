@@ -19,6 +19,8 @@
 
 #include <memory>
 #include <iostream>
+#include <unordered_set>
+#include <vector>
 
 #include <dirent.h>
 #include <giomm.h>
@@ -30,6 +32,8 @@
 
 #include "cachemanager.h"
 
+#include "cacheimagedata.h"
+
 #include "guiutils.h"
 #include "options.h"
 #include "thumbnail.h"
@@ -41,6 +45,43 @@ namespace
 constexpr int cacheDirMode = 0777;
 constexpr const char* cacheDirs[] = { "profiles", "images", "embprofiles", "data" };
 
+// size of the blocks read from the start and the end of a file to identify it
+constexpr std::size_t identityBlockSize = 65536;
+
+std::string getContentMD5 (const Glib::ustring& fname, gint64 fileSize)
+{
+    const std::unique_ptr<FILE, decltype(&std::fclose)> file (g_fopen (fname.c_str (), "rb"), &std::fclose);
+
+    if (!file) {
+        return {};
+    }
+
+    Glib::Checksum checksum (Glib::Checksum::CHECKSUM_MD5);
+    checksum.update (Glib::ustring::compose ("%1%2", fname, fileSize));
+
+    // the first and the last block hold the metadata and a part of the image
+    // data, small files (e.g. sidecars) are read completely
+    std::vector<guchar> buffer (2 * identityBlockSize);
+    const bool readTail = fileSize > static_cast<gint64> (2 * identityBlockSize);
+    const std::size_t headSize = readTail ? identityBlockSize : fileSize;
+
+    if (std::fread (buffer.data (), 1, headSize, file.get ()) != headSize) {
+        return {};
+    }
+
+    checksum.update (buffer.data (), headSize);
+
+    if (readTail) {
+        if (std::fseek (file.get (), -static_cast<long> (identityBlockSize), SEEK_END) || std::fread (buffer.data (), 1, identityBlockSize, file.get ()) != identityBlockSize) {
+            return {};
+        }
+
+        checksum.update (buffer.data (), identityBlockSize);
+    }
+
+    return checksum.get_string ();
+}
+
 }
 
 CacheManager* CacheManager::getInstance ()
@@ -65,6 +106,9 @@ void CacheManager::init ()
     if (error != 0 && rtengine::settings->verbose) {
         std::cerr << "Failed to create all cache directories: " << g_strerror(errno) << std::endl;
     }
+
+    index.open (Glib::build_filename (baseDir, "data.idx"));
+    identities.open (Glib::build_filename (baseDir, "identity.idx"));
 }
 
 Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
@@ -106,7 +150,26 @@ Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
     {
         CacheImageData imageData;
 
-        const auto error = imageData.load (cacheName);
+        // the index spares opening and parsing the data file
+        const bool indexed = index.load (md5, imageData);
+
+        if (!indexed && options.fastFileIdentity) {
+            adoptLegacyEntry (fname, md5);
+        }
+
+        const auto error = indexed ? 0 : imageData.load (cacheName);
+
+        if (error == 0 && !indexed) {
+            // not indexed yet, e.g. written by an older version. The record drops the rank of the
+            // old implementation, the Thumbnail created below moves it to the processing profile.
+            index.store (md5, imageData);
+        }
+
+        if (error == 0 && imageData.md5 != md5) {
+            // the entry has been moved from another key
+            imageData.md5 = md5;
+            imageData.save (cacheName);
+        }
 
         if (error == 0 && imageData.supported) {
 
@@ -164,7 +227,9 @@ void CacheManager::deleteEntry (const Glib::ustring& fname)
     auto iterator = openEntries.find (fname);
 
     if (iterator == openEntries.end ()) {
-        deleteFiles (fname, getMD5 (fname), true, true);
+        const auto md5 = getMD5 (fname);
+        deleteFiles (fname, md5, true, true);
+        identities.removePayloads ({md5});
         return;
     }
 
@@ -183,29 +248,25 @@ void CacheManager::deleteEntry (const Glib::ustring& fname)
     // the thumbnail still exists,
     // if not, delete it
     if (openEntries.count (fname) == 0) {
-        deleteFiles (fname, thumbnail->getMD5 (), true, true);
+        const auto md5 = thumbnail->getMD5 ();
+        deleteFiles (fname, md5, true, true);
+        identities.removePayloads ({md5});
     }
 }
 
 void CacheManager::clearFromCache (const Glib::ustring& fname, bool purge) const
 {
-    deleteFiles (fname, getMD5 (fname), true, purge);
+    const auto md5 = getMD5 (fname);
+    deleteFiles (fname, md5, true, purge);
+    identities.removePayloads ({md5});
 }
 
 void CacheManager::renameEntry (const std::string& oldfilename, const std::string& oldmd5, const std::string& newfilename)
 {
     MyMutex::MyLock lock (mutex);
 
-    const auto newmd5 = getMD5 (newfilename);
-
-    auto error = g_rename (getCacheFileName ("profiles", oldfilename, paramFileExtension, oldmd5).c_str (), getCacheFileName ("profiles", newfilename, paramFileExtension, newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("images", oldfilename, ".rtti", oldmd5).c_str (), getCacheFileName ("images", newfilename, ".rtti", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("embprofiles", oldfilename, ".icc", oldmd5).c_str (), getCacheFileName ("embprofiles", newfilename, ".icc", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("data", oldfilename, ".txt", oldmd5).c_str (), getCacheFileName ("data", newfilename, ".txt", newmd5).c_str ());
-
-    if (error != 0 && rtengine::settings->verbose) {
-        std::cerr << "Failed to rename all files for cache entry '" << oldfilename << "': " << g_strerror(errno) << std::endl;
-    }
+    moveFiles (oldfilename, oldmd5, newfilename, getMD5 (newfilename));
+    identities.removePayloads ({oldmd5});
 
     // check if it is opened
     // if it is open, update md5
@@ -237,6 +298,8 @@ void CacheManager::closeCache () const
     MyMutex::MyLock lock (mutex);
 
     applyCacheSizeLimitation ();
+    index.flush ();
+    identities.flush ();
 }
 
 void CacheManager::clearAll () const
@@ -246,6 +309,10 @@ void CacheManager::clearAll () const
     for (const auto& cacheDir : cacheDirs) {
         deleteDir (cacheDir);
     }
+
+    deleteDir ("demosaic");
+    index.clear ();
+    identities.clear ();
 }
 
 void CacheManager::clearImages () const
@@ -255,6 +322,8 @@ void CacheManager::clearImages () const
     deleteDir ("data");
     deleteDir ("images");
     deleteDir ("embprofiles");
+    index.clear ();
+    identities.clear ();
 }
 
 void CacheManager::clearProfiles () const
@@ -285,6 +354,43 @@ void CacheManager::deleteDir (const Glib::ustring& dirName) const
     } catch (Glib::Error&) {}
 }
 
+void CacheManager::moveFiles (const Glib::ustring& oldfname, const std::string& oldmd5, const Glib::ustring& newfname, const std::string& newmd5) const
+{
+    auto error = g_rename (getCacheFileName ("profiles", oldfname, paramFileExtension, oldmd5).c_str (), getCacheFileName ("profiles", newfname, paramFileExtension, newmd5).c_str ());
+    error |= g_rename (getCacheFileName ("images", oldfname, ".rtti", oldmd5).c_str (), getCacheFileName ("images", newfname, ".rtti", newmd5).c_str ());
+    error |= g_rename (getCacheFileName ("embprofiles", oldfname, ".icc", oldmd5).c_str (), getCacheFileName ("embprofiles", newfname, ".icc", newmd5).c_str ());
+    error |= g_rename (getCacheFileName ("data", oldfname, ".txt", oldmd5).c_str (), getCacheFileName ("data", newfname, ".txt", newmd5).c_str ());
+
+    CacheImageData imageData;
+
+    if (index.load (oldmd5, imageData)) {
+        imageData.md5 = newmd5;
+        index.store (newmd5, imageData);
+        index.remove (oldmd5);
+    }
+
+    if (error != 0 && rtengine::settings->verbose) {
+        std::cerr << "Failed to rename all files for cache entry '" << oldfname << "': " << g_strerror(errno) << std::endl;
+    }
+}
+
+void CacheManager::adoptLegacyEntry (const Glib::ustring& fname, const std::string& md5) const
+{
+    // keep the entries cached before FastFileIdentity was enabled
+    const auto legacyMd5 = getLegacyMD5 (fname);
+
+    if (
+        legacyMd5.empty ()
+        || legacyMd5 == md5
+        || !Glib::file_test (getCacheFileName ("data", fname, ".txt", legacyMd5), Glib::FILE_TEST_EXISTS)
+        || Glib::file_test (getCacheFileName ("data", fname, ".txt", md5), Glib::FILE_TEST_EXISTS)
+    ) {
+        return;
+    }
+
+    moveFiles (fname, legacyMd5, fname, md5);
+}
+
 void CacheManager::deleteFiles (const Glib::ustring& fname, const std::string& md5, bool purgeData, bool purgeProfile) const
 {
     if (md5.empty ()) {
@@ -296,6 +402,7 @@ void CacheManager::deleteFiles (const Glib::ustring& fname, const std::string& m
 
     if (purgeData) {
         error |= g_remove (getCacheFileName ("data", fname, ".txt", md5).c_str ());
+        index.remove (md5);
     }
 
     if (purgeProfile) {
@@ -307,7 +414,40 @@ void CacheManager::deleteFiles (const Glib::ustring& fname, const std::string& m
     }
 }
 
-std::string CacheManager::getMD5 (const Glib::ustring& fname)
+std::string CacheManager::getMD5 (const Glib::ustring& fname) const
+{
+    if (!options.fastFileIdentity) {
+        return getLegacyMD5 (fname);
+    }
+
+    GStatBuf fileStat;
+
+    if (g_stat (fname.c_str (), &fileStat) != 0) {
+        return {};
+    }
+
+    // an unchanged file is identified without reading it again
+    const auto statKey = Glib::Checksum::compute_checksum (Glib::Checksum::CHECKSUM_MD5,
+        Glib::ustring::compose ("%1\n%2\n%3\n%4", fname, fileStat.st_ino, fileStat.st_size, fileStat.st_mtime));
+
+    std::string md5;
+
+    if (identities.load (statKey, md5)) {
+        return md5;
+    }
+
+    md5 = getContentMD5 (fname, fileStat.st_size);
+
+    if (md5.empty ()) {
+        // not readable, but it might still be cached
+        return getLegacyMD5 (fname);
+    }
+
+    identities.store (statKey, md5);
+    return md5;
+}
+
+std::string CacheManager::getLegacyMD5 (const Glib::ustring& fname)
 {
 
 #ifdef _WIN32
@@ -328,7 +468,7 @@ std::string CacheManager::getMD5 (const Glib::ustring& fname)
 
         try
         {
-            const auto info = file->query_info("standard::*");
+            const auto info = file->query_info(G_FILE_ATTRIBUTE_STANDARD_SIZE);
             if (info) {
                 // We only use name and size to identify a file.
                 const auto identifier = Glib::ustring::compose("%1%2", fname, info->get_size());
@@ -412,6 +552,8 @@ void CacheManager::applyCacheSizeLimitation () const
         }
     );
 
+    std::unordered_set<std::string> deleted;
+
     for (std::vector<FNameMTime>::const_iterator entry = files.begin(), end = files.begin() + toDelete; entry != end; ++entry) {
         const auto& name = entry->first;
         const auto name_size = name.size() - md5_size;
@@ -419,7 +561,16 @@ void CacheManager::applyCacheSizeLimitation () const
         const auto md5 = name.substr(name_size - 4, md5_size);
 
         deleteFiles(fname, md5, true, false);
+        deleted.insert(md5);
     }
+
+    // the file identities leading to the deleted entries
+    identities.removePayloads(deleted);
+}
+
+void CacheManager::updateIndex (const CacheImageData& imageData)
+{
+    index.store (imageData.md5, imageData);
 }
 
 void CacheManager::updateImageInfo(const Glib::ustring &fname, CacheImageData &imageData, const Glib::ustring &xmpSidecarMd5) const
@@ -23,6 +23,7 @@
 
 #include <glibmm/ustring.h>
 
+#include "cacheindex.h"
 #include "threadutils.h"
 
 #include "../rtengine/noncopyable.h"
@@ -38,9 +39,13 @@ private:
     Entries openEntries;
     Glib::ustring    baseDir;
     mutable MyMutex  mutex;
+    mutable CacheIndex index;
+    mutable CacheIndex identities; // file stat -> getMD5 result, spares reading the files again
 
     void deleteDir   (const Glib::ustring& dirName) const;
     void deleteFiles (const Glib::ustring& fname, const std::string& md5, bool purgeData, bool purgeProfile) const;
+    void moveFiles   (const Glib::ustring& oldfname, const std::string& oldmd5, const Glib::ustring& newfname, const std::string& newmd5) const;
+    void adoptLegacyEntry (const Glib::ustring& fname, const std::string& md5) const;
 
     void applyCacheSizeLimitation () const;
     void updateImageInfo(const Glib::ustring &fname, CacheImageData &imageData, const Glib::ustring &xmpSidecarMd5) const;
@@ -61,7 +66,9 @@ public:
     void clearImages () const;
     void clearProfiles () const;
     void clearFromCache (const Glib::ustring& fname, bool purge) const;
-    static std::string getMD5 (const Glib::ustring& fname);
+    void updateIndex (const CacheImageData& imageData);
+    std::string getMD5 (const Glib::ustring& fname) const;
+    static std::string getLegacyMD5 (const Glib::ustring& fname);
 
     Glib::ustring    getCacheFileName (const Glib::ustring& subDir,
                                        const Glib::ustring& fname,
@@ -0,0 +1,772 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * rtbench: offline micro benchmark of single rtengine stages.
+ *
+ * No input file is needed: a deterministic synthetic scene is rendered into
+ * Bayer/X-Trans raw frames or RGB/Lab images in memory, and each selected stage
+ * is timed in isolation for every requested thread count. Results are printed
+ * as a table and optionally written as JSON, so that two builds can be diffed.
+ * Only the decoder stage needs a real raw file, given with -i.
+ */
+
+#ifdef __GNUC__
+#if defined(__FAST_MATH__)
+#error Using the -ffast-math CFLAG is known to lead to problems. Disable it to compile RawTherapee.
+#endif
+#endif
+
+#include "config.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <locale.h>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <giomm.h>
+#include <glib/gstdio.h>
+#include <tiffio.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../rtengine/boxblur.h"
+#include "../rtengine/cache.h"
+#include "../rtengine/cJSON.h"
+#include "../rtengine/cplx_wavelet_dec.h"
+#include "../rtengine/curves.h"
+#include "../rtengine/gauss.h"
+#include "../rtengine/guidedfilter.h"
+#include "../rtengine/imagefloat.h"
+#include "../rtengine/improcfun.h"
+#include "../rtengine/labimage.h"
+#include "../rtengine/opthelper.h"
+#include "../rtengine/procparams.h"
+#include "../rtengine/rawimage.h"
+#include "../rtengine/rawimagesource.h"
+#include "options.h"
+#include "version.h"
+
+Glib::ustring argv0;
+Glib::ustring argv1;
+
+namespace
+{
+
+using namespace rtengine;
+using namespace rtengine::procparams;
+
+enum class BenchInput {
+    BAYER,
+    XTRANS,
+    RGB,
+    LAB,
+    FILE,
+    NONE
+};
+
+struct BenchConfig {
+    int width = 6000;
+    int height = 4000;
+    int repeat = 3;
+    std::vector<int> threads;
+    std::vector<std::string> stages;
+    std::string jsonFile;
+    std::string inputFile;
+};
+
+Glib::ustring rawFile; // input of the decode stage
+
+// Deterministic test scene: smooth gradients, a zone plate and hard edged patches,
+// plus a small amount of reproducible noise. Values are in the [0;65535] range.
+class SyntheticScene
+{
+public:
+    SyntheticScene(int width, int height) : width(width), height(height) {}
+
+    float operator()(int row, int col, int c) const
+    {
+        const float x = static_cast<float>(col) / width;
+        const float y = static_cast<float>(row) / height;
+        const float r2 = (x - 0.5f) * (x - 0.5f) + (y - 0.5f) * (y - 0.5f);
+        float v = 0.15f + 0.5f * (c == 0 ? x : c == 1 ? 0.5f * (x + y) : y);
+        v += 0.15f * std::cos(400.f * r2 + c);
+
+        if (((col >> 7) + (row >> 7)) % 5 == 0) {
+            v *= 0.35f + 0.2f * c;
+        }
+
+        // xorshift style hash, stable across platforms and thread counts
+        unsigned int h = static_cast<unsigned int>(row) * 0x9E3779B1u ^ static_cast<unsigned int>(col) * 0x85EBCA77u ^ static_cast<unsigned int>(c) * 0xC2B2AE3Du;
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 12;
+        v += (static_cast<float>(h & 0xffff) / 65535.f - 0.5f) * 0.02f;
+
+        return 65535.f * std::max(0.f, std::min(v, 1.f));
+    }
+
+    const int width;
+    const int height;
+};
+
+using BenchRun = std::function<void()>;
+
+struct BenchStage {
+    const char* name;
+    BenchInput input;
+    std::function<BenchRun(const SyntheticScene&)> prepare; // untimed setup, returns the timed part
+};
+
+constexpr unsigned int bayerFilters = 0x94949494; // RGGB
+
+constexpr int xtransPattern[6][6] = {
+    {1, 1, 0, 1, 1, 2},
+    {1, 1, 2, 1, 1, 0},
+    {2, 0, 1, 0, 2, 1},
+    {1, 1, 2, 1, 1, 0},
+    {1, 1, 0, 1, 1, 2},
+    {0, 2, 1, 2, 0, 1}
+};
+
+std::shared_ptr<RawImageSource> makeRawSource(const SyntheticScene& scene, bool xtrans, RawImage** raw = nullptr)
+{
+    RawImage* ri = new RawImage("rtbench-synthetic");
+    ri->initSynthetic(scene.width, scene.height, xtrans ? 9 : bayerFilters, xtrans ? xtransPattern : nullptr);
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int row = 0; row < scene.height; ++row) {
+        for (int col = 0; col < scene.width; ++col) {
+            ri->data[row][col] = scene(row, col, xtrans ? ri->XTRANSFC(row, col) : ri->FC(row, col));
+        }
+    }
+
+    auto src = std::make_shared<RawImageSource>();
+    src->loadSynthetic(ri);
+
+    if (raw) {
+        *raw = ri; // owned by src
+    }
+
+    return src;
+}
+
+std::shared_ptr<Imagefloat> makeRGB(const SyntheticScene& scene)
+{
+    auto img = std::make_shared<Imagefloat>(scene.width, scene.height);
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int row = 0; row < scene.height; ++row) {
+        for (int col = 0; col < scene.width; ++col) {
+            img->r(row, col) = scene(row, col, 0);
+            img->g(row, col) = scene(row, col, 1);
+            img->b(row, col) = scene(row, col, 2);
+        }
+    }
+
+    return img;
+}
+
+std::shared_ptr<LabImage> makeLab(const SyntheticScene& scene)
+{
+    auto lab = std::make_shared<LabImage>(scene.width, scene.height);
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int row = 0; row < scene.height; ++row) {
+        for (int col = 0; col < scene.width; ++col) {
+            lab->L[row][col] = 0.5f * scene(row, col, 1);
+            lab->a[row][col] = 0.25f * (scene(row, col, 0) - scene(row, col, 1));
+            lab->b[row][col] = 0.25f * (scene(row, col, 1) - scene(row, col, 2));
+        }
+    }
+
+    return lab;
+}
+
+BenchStage bayerDemosaic(const char* name, RAWParams::BayerSensor::Method method)
+{
+    return {name, BenchInput::BAYER, [method](const SyntheticScene& scene) -> BenchRun {
+        const auto src = makeRawSource(scene, false);
+        const auto params = std::make_shared<ProcParams>();
+        params->raw.bayersensor.method = RAWParams::BayerSensor::getMethodString(method);
+        return [src, params]() {
+            double contrastThreshold = params->raw.bayersensor.dualDemosaicContrast;
+            src->demosaic(params->raw, false, contrastThreshold);
+        };
+    }};
+}
+
+BenchStage xtransDemosaic(const char* name, RAWParams::XTransSensor::Method method)
+{
+    return {name, BenchInput::XTRANS, [method](const SyntheticScene& scene) -> BenchRun {
+        const auto src = makeRawSource(scene, true);
+        const auto params = std::make_shared<ProcParams>();
+        params->raw.xtranssensor.method = RAWParams::XTransSensor::getMethodString(method);
+        return [src, params]() {
+            double contrastThreshold = params->raw.xtranssensor.dualDemosaicContrast;
+            src->demosaic(params->raw, false, contrastThreshold);
+        };
+    }};
+}
+
+// Copy and scaling of the raw data done by RawImageSource::preprocess, either
+// in two passes (copyOriginalPixels, then scaleColors) or fused into one.
+BenchStage rawCopyStage(const char* name, bool xtrans, bool fused)
+{
+    return {name, xtrans ? BenchInput::XTRANS : BenchInput::BAYER, [xtrans, fused](const SyntheticScene& scene) -> BenchRun {
+        RawImage* ri = nullptr;
+        const auto src = makeRawSource(scene, xtrans, &ri);
+        const auto params = std::make_shared<ProcParams>();
+        const auto rawData = std::make_shared<array2D<float>>(scene.width, scene.height);
+        const int w = scene.width;
+        const int h = scene.height;
+        return [src, ri, params, rawData, fused, w, h]() {
+            if (!src->copyOriginalPixels(params->raw, ri, nullptr, nullptr, *rawData, fused)) {
+                src->scaleColors(0, 0, w, h, params->raw, *rawData);
+            }
+        };
+    }};
+}
+
+// Decomposition and reconstruction of the L channel in 5 levels, the first
+// one with a Daubechies filter of 'taps' coefficients
+BenchStage waveletTransformStage(const char* name, int taps)
+{
+    return {name, BenchInput::LAB, [taps](const SyntheticScene& scene) -> BenchRun {
+        const auto lab = makeLab(scene);
+        return [lab, taps]() {
+#ifdef _OPENMP
+            const int threads = omp_get_max_threads();
+#else
+            const int threads = 1;
+#endif
+            wavelet_decomposition decomposition(lab->data, lab->W, lab->H, 5, 1, 1, threads, taps);
+
+            if (!decomposition.memory_allocation_failed()) {
+                decomposition.reconstruct(lab->data);
+            }
+        };
+    }};
+}
+
+// Gaussian blur of the L channel, the division variant is the one used by the
+// retinex like tools. Sigma of 25 and above takes the double precision path.
+BenchStage gaussianBlurStage(const char* name, double sigma, eGaussType gausstype)
+{
+    return {name, BenchInput::LAB, [sigma, gausstype](const SyntheticScene& scene) -> BenchRun {
+        const auto lab = makeLab(scene);
+        const auto dst = std::make_shared<array2D<float>>(scene.width, scene.height);
+        const int w = scene.width;
+        const int h = scene.height;
+        return [lab, dst, sigma, gausstype, w, h]() {
+#ifdef _OPENMP
+            #pragma omp parallel
+#endif
+            gaussianBlur(lab->L, *dst, w, h, sigma, false, gausstype, gausstype == GAUSS_DIV ? lab->a : nullptr);
+        };
+    }};
+}
+
+// Guided filter of the a channel with L as guide, subsampling 1 filters at full
+// resolution, 0 lets the filter choose as the tools do
+BenchStage guidedFilterStage(const char* name, int radius, int subsampling)
+{
+    return {name, BenchInput::LAB, [radius, subsampling](const SyntheticScene& scene) -> BenchRun {
+        const auto lab = makeLab(scene);
+        const auto guide = std::make_shared<array2D<float>>(scene.width, scene.height, lab->L, ARRAY2D_BYREFERENCE);
+        const auto src = std::make_shared<array2D<float>>(scene.width, scene.height, lab->a, ARRAY2D_BYREFERENCE);
+        const auto dst = std::make_shared<array2D<float>>(scene.width, scene.height);
+        return [lab, guide, src, dst, radius, subsampling]() {
+            guidedFilter(*guide, *src, *dst, radius, 0.001f * 32768.f * 32768.f, true, subsampling);
+        };
+    }};
+}
+
+BenchStage boxBlurStage(const char* name, int radius)
+{
+    return {name, BenchInput::LAB, [radius](const SyntheticScene& scene) -> BenchRun {
+        const auto lab = makeLab(scene);
+        const auto dst = std::make_shared<array2D<float>>(scene.width, scene.height);
+        const int w = scene.width;
+        const int h = scene.height;
+        return [lab, dst, radius, w, h]() {
+            boxblur(lab->L, static_cast<float**>(*dst), radius, w, h, true);
+        };
+    }};
+}
+
+BenchStage saveStage(const char* name, const std::string& ext)
+{
+    return {name, BenchInput::RGB, [ext](const SyntheticScene& scene) -> BenchRun {
+        const auto img = makeRGB(scene);
+        const Glib::ustring fname = Glib::build_filename(Glib::get_tmp_dir(), "rtbench-output." + ext);
+        return [img, fname, ext]() {
+            if (ext == "jpg") {
+                img->saveAsJPEG(fname, 92, 3);
+            } else {
+                img->saveAsTIFF(fname, 16, false, true);
+            }
+
+            g_remove(fname.c_str());
+        };
+    }};
+}
+
+// Concurrent lookups in a small working set, as done by the HaldCLUT and LCP stores.
+// One lookup per 16 pixels, so that the run time follows -s like the image stages.
+template<typename CacheType>
+BenchStage cacheStage(const char* name)
+{
+    return {name, BenchInput::NONE, [](const SyntheticScene& scene) -> BenchRun {
+        constexpr int numKeys = 64;
+        const auto cache = std::make_shared<CacheType>(numKeys);
+        const auto keys = std::make_shared<std::vector<Glib::ustring>>();
+
+        for (int i = 0; i < numKeys; ++i) {
+            keys->push_back(Glib::ustring::compose("/usr/share/rawtherapee/clut/Film Simulation/Color %1.png", i));
+            cache->set(keys->back(), std::make_shared<int>(i));
+        }
+
+        const int lookups = std::max(1, (scene.width / 4) * (scene.height / 4));
+        return [cache, keys, lookups]() {
+#ifdef _OPENMP
+            #pragma omp parallel for schedule(static)
+#endif
+
+            for (int i = 0; i < lookups; ++i) {
+                std::shared_ptr<int> value;
+                cache->get((*keys)[(i ^ (i >> 6)) & (numKeys - 1)], value);
+            }
+        };
+    }};
+}
+
+std::vector<BenchStage> getStages()
+{
+    using BayerMethod = RAWParams::BayerSensor::Method;
+    using XTransMethod = RAWParams::XTransSensor::Method;
+
+    std::vector<BenchStage> stages = {
+        bayerDemosaic("demosaic-amaze", BayerMethod::AMAZE),
+        bayerDemosaic("demosaic-rcd", BayerMethod::RCD),
+        bayerDemosaic("demosaic-dcb", BayerMethod::DCB),
+        bayerDemosaic("demosaic-lmmse", BayerMethod::LMMSE),
+        bayerDemosaic("demosaic-igv", BayerMethod::IGV),
+        bayerDemosaic("demosaic-ahd", BayerMethod::AHD),
+        bayerDemosaic("demosaic-vng4", BayerMethod::VNG4),
+        bayerDemosaic("demosaic-fast", BayerMethod::FAST),
+        bayerDemosaic("demosaic-amazevng4", BayerMethod::AMAZEVNG4),
+        xtransDemosaic("demosaic-xtrans-3pass", XTransMethod::THREE_PASS),
+        xtransDemosaic("demosaic-xtrans-1pass", XTransMethod::ONE_PASS),
+        xtransDemosaic("demosaic-xtrans-fast", XTransMethod::FAST),
+        rawCopyStage("rawcopy-2pass", false, false),
+        rawCopyStage("rawcopy-fused", false, true),
+        rawCopyStage("rawcopy-xtrans-2pass", true, false),
+        rawCopyStage("rawcopy-xtrans-fused", true, true),
+        {"denoise", BenchInput::RGB, [](const SyntheticScene& scene) -> BenchRun {
+            const auto src = makeRGB(scene);
+            const auto dst = std::make_shared<Imagefloat>(scene.width, scene.height);
+            const auto params = std::make_shared<ProcParams>();
+            params->dirpyrDenoise.enabled = true;
+            params->dirpyrDenoise.luma = 30.0;
+            params->dirpyrDenoise.chroma = 15.0;
+            return [src, dst, params]() {
+                ImProcFunctions ipf(params.get(), true);
+                NoiseCurve noiseLCurve;
+                NoiseCurve noiseCCurve;
+                float ch_M[9], max_r[9], max_b[9];
+                float nresi, highresi;
+                ipf.RGB_denoise(2, src.get(), dst.get(), nullptr, ch_M, max_r, max_b, true, params->dirpyrDenoise, 0.0, noiseLCurve, noiseCCurve, nresi, highresi);
+            };
+        }},
+        {"wavelet", BenchInput::LAB, [](const SyntheticScene& scene) -> BenchRun {
+            const auto lab = makeLab(scene);
+            const auto params = std::make_shared<ProcParams>();
+            params->wavelet.enabled = true;
+            params->wavelet.expcontrast = true;
+
+            for (int i = 0; i < 9; ++i) {
+                params->wavelet.c[i] = 20;
+            }
+
+            return [lab, params]() {
+                ImProcFunctions ipf(params.get(), true);
+                WavCurve wavCLVCurve;
+                WavCurve wavdenoise;
+                WavCurve wavdenoiseh;
+                Wavblcurve wavblcurve;
+                WavOpacityCurveRG waOpacityCurveRG;
+                WavOpacityCurveSH waOpacityCurveSH;
+                WavOpacityCurveBY waOpacityCurveBY;
+                WavOpacityCurveW waOpacityCurveW;
+                WavOpacityCurveWL waOpacityCurveWL;
+                LUTf wavclCurve(65536, 0);
+                params->wavelet.getCurves(wavCLVCurve, wavdenoise, wavdenoiseh, wavblcurve, waOpacityCurveRG, waOpacityCurveSH, waOpacityCurveBY, waOpacityCurveW, waOpacityCurveWL);
+                CurveFactory::diagonalCurve2Lut(params->wavelet.wavclCurve, wavclCurve, 1);
+                ipf.ip_wavelet(lab.get(), lab.get(), 2, params->wavelet, wavCLVCurve, wavdenoise, wavdenoiseh, wavblcurve, waOpacityCurveRG, waOpacityCurveSH, waOpacityCurveBY, waOpacityCurveW, waOpacityCurveWL, wavclCurve, 1);
+            };
+        }},
+        waveletTransformStage("wavelet-transform-d4", 6),
+        waveletTransformStage("wavelet-transform-d6", 8),
+        waveletTransformStage("wavelet-transform-d10", 12),
+        waveletTransformStage("wavelet-transform-d14", 16),
+        gaussianBlurStage("gauss-sigma-1.5", 1.5, GAUSS_STANDARD),
+        gaussianBlurStage("gauss-sigma-5", 5.0, GAUSS_STANDARD),
+        gaussianBlurStage("gauss-sigma-20", 20.0, GAUSS_STANDARD),
+        gaussianBlurStage("gauss-sigma-40", 40.0, GAUSS_STANDARD),
+        gaussianBlurStage("gauss-div-sigma-5", 5.0, GAUSS_DIV),
+        boxBlurStage("boxblur-r2", 2),
+        boxBlurStage("boxblur-r30", 30),
+        guidedFilterStage("guided-r4-full", 4, 1),
+        guidedFilterStage("guided-r30-full", 30, 1),
+        guidedFilterStage("guided-r30", 30, 0),
+        {"resize-lanczos", BenchInput::RGB, [](const SyntheticScene& scene) -> BenchRun {
+            const float scale = 0.5f;
+            const auto src = makeRGB(scene);
+            const auto dst = std::make_shared<Imagefloat>(static_cast<int>(scene.width * scale + 0.5f), static_cast<int>(scene.height * scale + 0.5f));
+            const auto params = std::make_shared<ProcParams>();
+            return [src, dst, params, scale]() {
+                ImProcFunctions ipf(params.get(), true);
+                ipf.Lanczos(src.get(), dst.get(), scale);
+            };
+        }},
+        {"transform-rotate", BenchInput::RGB, [](const SyntheticScene& scene) -> BenchRun {
+            const auto rawSrc = makeRawSource(SyntheticScene(16, 16), false); // only provides the metadata
+            const auto src = makeRGB(scene);
+            const auto dst = std::make_shared<Imagefloat>(scene.width, scene.height);
+            const auto params = std::make_shared<ProcParams>();
+            params->rotate.degree = 3.0;
+            const int w = scene.width;
+            const int h = scene.height;
+            return [rawSrc, src, dst, params, w, h]() {
+                ImProcFunctions ipf(params.get(), true);
+                ipf.transform(src.get(), dst.get(), 0, 0, 0, 0, w, h, w, h, rawSrc->getMetaData(), 0, true);
+            };
+        }},
+        {"decode", BenchInput::FILE, [](const SyntheticScene&) -> BenchRun {
+            // from the page cache after the warm-up run, so that only decoding is measured
+            const Glib::ustring fname = rawFile;
+            return [fname]() {
+                RawImage ri(fname);
+                ri.loadRaw(true);
+            };
+        }},
+        saveStage("save-jpeg", "jpg"),
+        saveStage("save-tiff", "tif"),
+        cacheStage<Cache<Glib::ustring, std::shared_ptr<int>>>("cache-lru"),
+        cacheStage<ShardedCache<Glib::ustring, std::shared_ptr<int>>>("cache-sharded")
+    };
+
+    return stages;
+}
+
+const char* getInputName(BenchInput input)
+{
+    switch (input) {
+        case BenchInput::BAYER:
+            return "bayer";
+
+        case BenchInput::XTRANS:
+            return "xtrans";
+
+        case BenchInput::RGB:
+            return "rgb";
+
+        case BenchInput::LAB:
+            return "lab";
+
+        case BenchInput::FILE:
+            return "file";
+
+        case BenchInput::NONE:
+            return "none";
+    }
+
+    return "";
+}
+
+std::vector<std::string> split(const std::string& s, char delim)
+{
+    std::vector<std::string> tokens;
+    std::istringstream stream(s);
+    std::string token;
+
+    while (std::getline(stream, token, delim)) {
+        if (!token.empty()) {
+            tokens.push_back(token);
+        }
+    }
+
+    return tokens;
+}
+
+void setThreads(int threads)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+}
+
+int getMaxThreads()
+{
+#ifdef _OPENMP
+    return omp_get_num_procs();
+#else
+    return 1;
+#endif
+}
+
+// The variant of the SIMD_CLONES functions the loader selects on this cpu
+const char* getSimdClone()
+{
+#ifdef SIMD_CLONES_ENABLED
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") ? "avx512f" : __builtin_cpu_supports("avx2") ? "avx2" : "default";
+#else
+    return "disabled";
+#endif
+}
+
+void printUsage(const char* name)
+{
+    std::cout << "Usage: " << name << " [-s <width>x<height>] [-i <raw file>] [-t <n>[,<n>...]] [-r <repeat>] [-j <file.json>] [-l] [stage ...]" << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -s <w>x<h>   Size of the synthetic image (default 6000x4000)." << std::endl;
+    std::cout << "  -i <file>    Raw file decoded by the 'decode' stage, which is skipped without it." << std::endl;
+    std::cout << "               Its size replaces the one of -s." << std::endl;
+    std::cout << "  -t <list>    Comma separated thread counts (default 1,2,4,... up to the number of cores)." << std::endl;
+    std::cout << "  -r <n>       Timed repetitions per thread count, after one warm-up run (default 3)." << std::endl;
+    std::cout << "  -j <file>    Also write the results as JSON to <file>." << std::endl;
+    std::cout << "  -l           List the available stages and exit." << std::endl;
+    std::cout << "  stage ...    Stages to run (prefix match, e.g. 'demosaic'), all if omitted." << std::endl;
+}
+
+int parseArgs(int argc, char** argv, BenchConfig& config, const std::vector<BenchStage>& stages)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+
+        if (arg == "-s" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &config.width, &config.height) != 2 || config.width < 64 || config.height < 64) {
+                std::cerr << "Error: invalid image size \"" << argv[i] << "\"." << std::endl;
+                return -1;
+            }
+        } else if (arg == "-t" && i + 1 < argc) {
+            for (const auto& t : split(argv[++i], ',')) {
+                config.threads.push_back(std::max(1, std::atoi(t.c_str())));
+            }
+        } else if (arg == "-i" && i + 1 < argc) {
+            config.inputFile = argv[++i];
+        } else if (arg == "-r" && i + 1 < argc) {
+            config.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "-j" && i + 1 < argc) {
+            config.jsonFile = argv[++i];
+        } else if (arg == "-l") {
+            for (const auto& stage : stages) {
+                std::cout << stage.name << std::endl;
+            }
+
+            return 1;
+        } else if (arg.empty() || arg[0] == '-') {
+            printUsage(argv[0]);
+            return -1;
+        } else {
+            config.stages.push_back(arg);
+        }
+    }
+
+    if (config.threads.empty()) {
+        const int maxThreads = getMaxThreads();
+
+        for (int t = 1; t < maxThreads; t *= 2) {
+            config.threads.push_back(t);
+        }
+
+        config.threads.push_back(maxThreads);
+    }
+
+    return 0;
+}
+
+bool isSelected(const BenchConfig& config, const char* name)
+{
+    if (config.stages.empty()) {
+        return true;
+    }
+
+    for (const auto& prefix : config.stages) {
+        if (std::string(name).compare(0, prefix.size(), prefix) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "");
+    setlocale(LC_NUMERIC, "C"); // to set decimal point to "."
+
+    Gio::init();
+
+    argv0 = DATA_SEARCH_PATH;
+    options.rtSettings.lensfunDbDirectory = LENSFUN_DB_PATH;
+    options.rtSettings.lensfunDbBundleDirectory = LENSFUN_DB_PATH;
+
+    const std::vector<BenchStage> stages = getStages();
+    BenchConfig config;
+    const int parsed = parseArgs(argc, argv, config, stages);
+
+    if (parsed != 0) {
+        return parsed > 0 ? 0 : -1;
+    }
+
+    try {
+        Options::load(true);
+    } catch (Options::Error &e) {
+        std::cerr << std::endl
+                  << "FATAL ERROR:" << std::endl
+                  << e.get_msg() << std::endl;
+        return -2;
+    }
+
+    TIFFSetWarningHandler(nullptr);
+
+    if (!config.inputFile.empty()) {
+        RawImage ri(config.inputFile);
+
+        if (ri.loadRaw(false) || ri.get_width() < 64 || ri.get_height() < 64) {
+            std::cerr << "Error: \"" << config.inputFile << "\" is not a supported raw file." << std::endl;
+            return -1;
+        }
+
+        rawFile = config.inputFile;
+        config.width = ri.get_width();
+        config.height = ri.get_height();
+    }
+
+    const SyntheticScene scene(config.width, config.height);
+    const double pixels = static_cast<double>(config.width) * config.height;
+
+    std::cout << "RawTherapee, version " << RTVERSION << ", stage benchmark." << std::endl;
+    std::cout << "Image size " << config.width << "x" << config.height << ", " << config.repeat << " repetition(s)" << std::endl;
+    std::cout << "SIMD clones: " << getSimdClone() << std::endl;
+    std::printf("%-24s %8s %12s %12s %10s %8s\n", "stage", "threads", "median ms", "min ms", "ns/pixel", "speedup");
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "version", cJSON_CreateString(RTVERSION));
+    cJSON_AddItemToObject(root, "width", cJSON_CreateNumber(config.width));
+    cJSON_AddItemToObject(root, "height", cJSON_CreateNumber(config.height));
+    cJSON_AddItemToObject(root, "repeat", cJSON_CreateNumber(config.repeat));
+    cJSON_AddItemToObject(root, "simdClone", cJSON_CreateString(getSimdClone()));
+    cJSON* jsonStages = cJSON_CreateArray();
+    cJSON_AddItemToObject(root, "stages", jsonStages);
+
+    for (const auto& stage : stages) {
+        if (!isSelected(config, stage.name) || (stage.input == BenchInput::FILE && rawFile.empty())) {
+            continue;
+        }
+
+        setThreads(getMaxThreads());
+        const BenchRun run = stage.prepare(scene);
+
+        cJSON* jsonStage = cJSON_CreateObject();
+        cJSON_AddItemToObject(jsonStage, "name", cJSON_CreateString(stage.name));
+        cJSON_AddItemToObject(jsonStage, "input", cJSON_CreateString(getInputName(stage.input)));
+        cJSON* jsonScaling = cJSON_CreateArray();
+        cJSON_AddItemToObject(jsonStage, "scaling", jsonScaling);
+        cJSON_AddItemToArray(jsonStages, jsonStage);
+
+        double singleThreadMedian = 0.0;
+
+        for (const int threads : config.threads) {
+            setThreads(threads);
+            run(); // warm-up, also touches all buffers once
+
+            std::vector<double> samples;
+
+            for (int i = 0; i < config.repeat; ++i) {
+                const auto start = std::chrono::steady_clock::now();
+                run();
+                const auto stop = std::chrono::steady_clock::now();
+                samples.push_back(std::chrono::duration<double, std::nano>(stop - start).count());
+            }
+
+            std::sort(samples.begin(), samples.end());
+            const double median = samples[samples.size() / 2];
+            const double minimum = samples.front();
+
+            if (singleThreadMedian == 0.0) {
+                singleThreadMedian = median;
+            }
+
+            const double speedup = singleThreadMedian / median;
+            std::printf("%-24s %8d %12.2f %12.2f %10.3f %8.2f\n", stage.name, threads, median * 1e-6, minimum * 1e-6, median / pixels, speedup);
+
+            cJSON* jsonRun = cJSON_CreateObject();
+            cJSON_AddItemToObject(jsonRun, "threads", cJSON_CreateNumber(threads));
+            cJSON_AddItemToObject(jsonRun, "median_ns", cJSON_CreateNumber(median));
+            cJSON_AddItemToObject(jsonRun, "min_ns", cJSON_CreateNumber(minimum));
+            cJSON_AddItemToObject(jsonRun, "ns_per_pixel", cJSON_CreateNumber(median / pixels));
+            cJSON_AddItemToObject(jsonRun, "speedup", cJSON_CreateNumber(speedup));
+            cJSON_AddItemToArray(jsonScaling, jsonRun);
+        }
+    }
+
+    int ret = 0;
+
+    if (!config.jsonFile.empty()) {
+        char* text = cJSON_Print(root);
+        FILE* f = g_fopen(config.jsonFile.c_str(), "wt");
+
+        if (f) {
+            std::fputs(text, f);
+            std::fputc('\n', f);
+            std::fclose(f);
+        } else {
+            std::cerr << "Error: could not write \"" << config.jsonFile << "\"." << std::endl;
+            ret = -2;
+        }
+
+        std::free(text);
+    }
+
+    cJSON_Delete(root);
+
+    return ret;
+}
@@ -31,7 +31,17 @@
 #include <cstring>
 #include <cstdlib>
 #include <locale.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "../rtengine/procparams.h"
+#include "../rtengine/proctrace.h"
 #include "../rtengine/profilestore.h"
 #include "../rtengine/rtengine.h"
 #include "options.h"
@@ -254,6 +264,10 @@ int processLineParams ( int argc, char **argv )
     int bits = -1;
     bool isFloat = false;
     std::string outputType;
+    bool traceStages = false;
+    unsigned int parallelJobs = 1;
+    std::int64_t memoryLimit = 0;
+    Glib::ustring traceFile;
     unsigned errors = 0;
 
     for ( int iArg = 1; iArg < argc; iArg++) {
@@ -415,6 +429,44 @@ int processLineParams ( int argc, char **argv )
                     fast_export = true;
                     break;
 
+                case 'J':
+                    if (currParam.length() > 2 && currParam.at (2) == 'm') {
+                        // peak memory cap in MiB for the concurrent jobs
+                        const int limit = atoi (currParam.substr (3).c_str());
+
+                        if (limit < 1) {
+                            std::cerr << "Error: the -Jm switch requires a memory size in MiB!" << std::endl;
+                            deleteProcParams (processingParams);
+                            return -3;
+                        }
+
+                        memoryLimit = static_cast<std::int64_t>(limit) << 20;
+                        // also reserve the estimated peak of each image up front, the resident size lags behind
+                        options.rtSettings.exportMemoryBudget = limit;
+                    } else {
+                        const int jobs = atoi (currParam.substr (2).c_str());
+
+                        if (jobs < 1) {
+                            std::cerr << "Error: the -J switch requires the number of concurrent jobs!" << std::endl;
+                            deleteProcParams (processingParams);
+                            return -3;
+                        }
+
+                        parallelJobs = jobs;
+                    }
+
+                    break;
+
+                case 'T':
+                    traceStages = true;
+
+                    if (currParam.size() > 2 && currParam.at (2) == 'j' && iArg + 1 < argc) {
+                        iArg++;
+                        traceFile = Glib::ustring (fname_to_utf8 (argv[iArg]));
+                    }
+
+                    break;
+
                 case 'c': // MUST be last option
                     while (iArg + 1 < argc) {
                         iArg++;
@@ -521,7 +573,7 @@ int processLineParams ( int argc, char **argv )
                     std::cout << "  " << Glib::path_get_basename (argv[0]) << " <other options> -c <dir>|<files>   Convert files in batch with your own settings." << std::endl;
                     std::cout << std::endl;
                     std::cout << "Options:" << std::endl;
-                    std::cout << "  " << Glib::path_get_basename (argv[0]) << "[-o <output>|-O <output>] [-q] [-a] [-s|-S] [-p <one.pp3> [-p <two.pp3> ...] ] [-d] [ -j[1-100] -js<1-3> | -t[z] -b<8|16|16f|32> | -n -b<8|16> ] [-Y] [-f] -c <input>" << std::endl;
+                    std::cout << "  " << Glib::path_get_basename (argv[0]) << "[-o <output>|-O <output>] [-q] [-a] [-s|-S] [-p <one.pp3> [-p <two.pp3> ...] ] [-d] [ -j[1-100] -js<1-3> | -t[z] -b<8|16|16f|32> | -n -b<8|16> ] [-Y] [-f] [-J<n> [-Jm<MiB>]] [-T|-Tj <file.json>] -c <input>" << std::endl;
                     std::cout << std::endl;
                     std::cout << "  -c <files>       Specify one or more input files or folders." << std::endl;
                     std::cout << "                   When specifying folders, Rawtherapee will look for image file types which comply" << std::endl;
@@ -563,6 +615,17 @@ int processLineParams ( int argc, char **argv )
                     std::cout << "                   Compression is hard-coded to PNG_FILTER_PAETH, Z_RLE." << std::endl;
                     std::cout << "  -Y               Overwrite output if present." << std::endl;
                     std::cout << "  -f               Use the custom fast-export processing pipeline." << std::endl;
+                    std::cout << "  -J<n>            Process up to n images concurrently. The threads are shared between" << std::endl;
+                    std::cout << "                   the images in flight, so that the serial steps of one image (decoding," << std::endl;
+                    std::cout << "                   encoding) overlap the processing of the others." << std::endl;
+                    std::cout << "  -Jm<MiB>         With -J, don't start another image while the resident memory of" << std::endl;
+                    std::cout << "                   RawTherapee exceeds this size (Linux and macOS only), and hold an" << std::endl;
+                    std::cout << "                   image back before processing while the estimated peak memory of the" << std::endl;
+                    std::cout << "                   images in flight would exceed it." << std::endl;
+                    std::cout << "  -T               Print the time, CPU utilization and memory use of each processing" << std::endl;
+                    std::cout << "                   stage after every image." << std::endl;
+                    std::cout << "  -Tj <file.json>  Like -T and also write a Chrome trace (chrome://tracing, Perfetto)" << std::endl;
+                    std::cout << "                   of all stages and tools of all processed images to <file.json>." << std::endl;
                     std::cout << std::endl;
                     std::cout << "Your " << pparamsExt << " files can be incomplete, RawTherapee will build the final values as follows:" << std::endl;
                     std::cout << "  1- A new processing profile is created using neutral values," << std::endl;
@@ -655,14 +718,26 @@ int processLineParams ( int argc, char **argv )
         }
     }
 
-    for ( size_t iFile = 0; iFile < inputFiles.size(); iFile++) {
+    if (traceStages) {
+        rtengine::ProcTrace::getInstance().setEnabled(true);
+    }
+
+    if ( outputType.empty() ) {
+        outputType = "jpg";
+    }
 
+    std::mutex profileMutex; // the dynamic profile rules are loaded lazily by the ProfileStore
+
+    // Processes one input file, returns false on error. Messages go to out and err, so that
+    // concurrent jobs can print them in one piece.
+    const auto processFile =
+        [&](const Glib::ustring& inputFile, std::ostream& out, std::ostream& err) -> bool
+    {
         // Has to be reinstanciated at each profile to have a ProcParams object with default values
         rtengine::procparams::ProcParams currentParams;
 
-        Glib::ustring inputFile = inputFiles[iFile];
-        std::cout << "Output is " << bits << "-bit " << (isFloat ? "floating-point" : "integer") << "." << std::endl;
-        std::cout << "Processing: " << inputFile << std::endl;
+        out << "Output is " << bits << "-bit " << (isFloat ? "floating-point" : "integer") << "." << std::endl;
+        out << "Processing: " << inputFile << std::endl;
 
         rtengine::InitialImage* ii = nullptr;
         rtengine::ProcessingJob* job = nullptr;
@@ -671,10 +746,6 @@ int processLineParams ( int argc, char **argv )
 
         Glib::ustring outputFile;
 
-        if ( outputType.empty() ) {
-            outputType = "jpg";
-        }
-
         if ( outputPath.empty() ) {
             Glib::ustring s = inputFile;
             Glib::ustring::size_type ext = s.find_last_of ('.');
@@ -694,13 +765,13 @@ int processLineParams ( int argc, char **argv )
         }
 
         if ( inputFile == outputFile) {
-            std::cerr << "Cannot overwrite: " << inputFile << std::endl;
-            continue;
+            err << "Cannot overwrite: " << inputFile << std::endl;
+            return true;
         }
 
         if ( !overwriteFiles && Glib::file_test ( outputFile, Glib::FILE_TEST_EXISTS ) ) {
-            std::cerr << outputFile  << " already exists: use -Y option to overwrite. This image has been skipped." << std::endl;
-            continue;
+            err << outputFile  << " already exists: use -Y option to overwrite. This image has been skipped." << std::endl;
+            return true;
         }
 
         // Load the image
@@ -711,33 +782,38 @@ int processLineParams ( int argc, char **argv )
             isRaw = false;
         }
 
-        ii = rtengine::InitialImage::load ( inputFile, isRaw, &errorCode, nullptr );
+        const std::size_t firstTraceEvent = rtengine::ProcTrace::getInstance().getEventCount();
+
+        {
+            rtengine::ProcTrace::Scope traceLoad("load");
+            ii = rtengine::InitialImage::load ( inputFile, isRaw, &errorCode, nullptr );
+        }
 
         if (!ii) {
-            errors++;
-            std::cerr << "Error loading file: " << inputFile << std::endl;
-            continue;
+            err << "Error loading file: " << inputFile << std::endl;
+            return false;
         }
 
         if (useDefault) {
-            if (isRaw) {
-                if (options.defProfRaw == DEFPROFILE_DYNAMIC) {
-                    rawParams->deleteInstance();
-                    delete rawParams;
-                    rawParams = ProfileStore::getInstance()->loadDynamicProfile (ii->getMetaData(), inputFile);
-                }
+            rtengine::procparams::PartialProfile* defaultParams = isRaw ? rawParams : imgParams;
+            const bool dynamicProfile = (isRaw ? options.defProfRaw : options.defProfImg) == DEFPROFILE_DYNAMIC;
+
+            if (dynamicProfile) {
+                std::lock_guard<std::mutex> lock(profileMutex);
+                defaultParams = ProfileStore::getInstance()->loadDynamicProfile (ii->getMetaData(), inputFile);
+            }
 
-                std::cout << "  Merging default raw processing profile." << std::endl;
-                rawParams->applyTo (&currentParams);
+            if (isRaw) {
+                out << "  Merging default raw processing profile." << std::endl;
             } else {
-                if (options.defProfImg == DEFPROFILE_DYNAMIC) {
-                    imgParams->deleteInstance();
-                    delete imgParams;
-                    imgParams = ProfileStore::getInstance()->loadDynamicProfile (ii->getMetaData(), inputFile);
-                }
+                out << "  Merging default non-raw processing profile." << std::endl;
+            }
+
+            defaultParams->applyTo (&currentParams);
 
-                std::cout << "  Merging default non-raw processing profile." << std::endl;
-                imgParams->applyTo (&currentParams);
+            if (dynamicProfile) {
+                defaultParams->deleteInstance();
+                delete defaultParams;
             }
         }
 
@@ -752,15 +828,15 @@ int processLineParams ( int argc, char **argv )
 
                 // the "load" method don't reset the procparams values anymore, so values found in the procparam file override the one of currentParams
                 if ( !Glib::file_test ( sideProcessingParams, Glib::FILE_TEST_EXISTS ) || currentParams.load ( sideProcessingParams )) {
-                    std::cerr << "Warning: sidecar file requested but not found for: " << sideProcessingParams << std::endl;
+                    err << "Warning: sidecar file requested but not found for: " << sideProcessingParams << std::endl;
                 } else {
                     sideCarFound = true;
-                    std::cout << "  Merging sidecar procparams." << std::endl;
+                    out << "  Merging sidecar procparams." << std::endl;
                 }
             }
 
             if ( processingParams.size() > i  ) {
-                std::cout << "  Merging procparams #" << i << std::endl;
+                out << "  Merging procparams #" << i << std::endl;
                 processingParams[i]->applyTo (&currentParams);
             }
 
@@ -769,44 +845,44 @@ int processLineParams ( int argc, char **argv )
 
         if ( sideProcParams && !sideCarFound && skipIfNoSidecar ) {
             delete ii;
-            errors++;
-            std::cerr << "Error: no sidecar procparams found for: " << inputFile << std::endl;
-            continue;
+            err << "Error: no sidecar procparams found for: " << inputFile << std::endl;
+            return false;
         }
 
         job = rtengine::ProcessingJob::create (ii, currentParams, fast_export);
 
         if ( !job ) {
-            errors++;
-            std::cerr << "Error creating processing for: " << inputFile << std::endl;
+            err << "Error creating processing for: " << inputFile << std::endl;
             ii->decreaseRef();
-            continue;
+            return false;
         }
 
         // Process image
         rtengine::IImagefloat* resultImage = rtengine::processImage (job, errorCode, nullptr);
 
         if ( !resultImage ) {
-            errors++;
-            std::cerr << "Error processing: " << inputFile << std::endl;
+            err << "Error processing: " << inputFile << std::endl;
             rtengine::ProcessingJob::destroy ( job );
-            continue;
+            return false;
         }
 
         // save image to disk
-        if ( outputType == "jpg" ) {
-            errorCode = resultImage->saveAsJPEG ( outputFile, compression, subsampling );
-        } else if ( outputType == "tif" ) {
-            errorCode = resultImage->saveAsTIFF ( outputFile, bits, isFloat, compression == 0  );
-        } else if ( outputType == "png" ) {
-            errorCode = resultImage->saveAsPNG ( outputFile, bits );
-        } else {
-            errorCode = resultImage->saveToFile (outputFile);
+        {
+            rtengine::ProcTrace::Scope traceSave("save");
+
+            if ( outputType == "jpg" ) {
+                errorCode = resultImage->saveAsJPEG ( outputFile, compression, subsampling );
+            } else if ( outputType == "tif" ) {
+                errorCode = resultImage->saveAsTIFF ( outputFile, bits, isFloat, compression == 0  );
+            } else if ( outputType == "png" ) {
+                errorCode = resultImage->saveAsPNG ( outputFile, bits );
+            } else {
+                errorCode = resultImage->saveToFile (outputFile);
+            }
         }
 
         if (errorCode) {
-            errors++;
-            std::cerr << "Error saving to: " << outputFile << std::endl;
+            err << "Error saving to: " << outputFile << std::endl;
         } else {
             if ( copyParamsFile ) {
                 Glib::ustring outputProcessingParams = outputFile + paramFileExtension;
@@ -814,8 +890,104 @@ int processLineParams ( int argc, char **argv )
             }
         }
 
+        if (traceStages) {
+            // top level (load, processImage, save) and the pipeline stages below processImage
+            out << "  Trace: " << rtengine::ProcTrace::getInstance().getSummary(firstTraceEvent, 1) << std::endl;
+        }
+
         ii->decreaseRef();
         delete resultImage;
+
+        return !errorCode;
+    };
+
+    const std::size_t jobCount = std::min<std::size_t>(parallelJobs, inputFiles.size());
+
+    if (jobCount <= 1) {
+        for (const auto& inputFile : inputFiles) {
+            if (!processFile(inputFile, std::cout, std::cerr)) {
+                errors++;
+            }
+        }
+    } else {
+        // Every worker takes the next file and runs it through load, processing and save, so the
+        // serial parts (decoding, metadata, encoding) of one image overlap the parallel tools of
+        // the others. The OpenMP threads are split between the images in flight.
+#ifdef _OPENMP
+        const int threadBudget = omp_get_max_threads();
+#else
+        const int threadBudget = 1;
+#endif
+        std::mutex schedulerMutex;
+        std::condition_variable jobFinished;
+        std::size_t nextFile = 0;
+        std::size_t inFlight = 0;
+
+        const auto worker =
+            [&]()
+        {
+            while (true) {
+                std::size_t iFile;
+                int threads;
+
+                {
+                    std::unique_lock<std::mutex> lock(schedulerMutex);
+
+                    // don't start another image while the ones in flight already exceed the memory cap
+                    while (memoryLimit > 0 && inFlight > 0 && nextFile < inputFiles.size() && rtengine::ProcTrace::getResidentMemory() > memoryLimit) {
+                        jobFinished.wait_for(lock, std::chrono::milliseconds(100));
+                    }
+
+                    if (nextFile == inputFiles.size()) {
+                        return;
+                    }
+
+                    iFile = nextFile++;
+                    ++inFlight;
+                    // the last images of the batch get the threads of the workers running out of files
+                    const std::size_t activeJobs = std::min(jobCount, inFlight + inputFiles.size() - nextFile);
+                    threads = std::max<int>(1, threadBudget / static_cast<int>(activeJobs));
+                }
+
+#ifdef _OPENMP
+                omp_set_num_threads(threads);
+#endif
+                std::ostringstream out;
+                std::ostringstream err;
+                const bool success = processFile(inputFiles[iFile], out, err);
+
+                {
+                    std::lock_guard<std::mutex> lock(schedulerMutex);
+                    --inFlight;
+
+                    if (!success) {
+                        errors++;
+                    }
+
+                    std::cout << out.str() << std::flush;
+                    std::cerr << err.str() << std::flush;
+                }
+
+                jobFinished.notify_all();
+            }
+        };
+
+        std::cout << "Processing " << inputFiles.size() << " files with " << jobCount << " concurrent jobs." << std::endl;
+
+        std::vector<std::thread> workers;
+
+        for (std::size_t i = 0; i < jobCount; ++i) {
+            workers.emplace_back(worker);
+        }
+
+        for (auto& thread : workers) {
+            thread.join();
+        }
+    }
+
+    if (!traceFile.empty() && !rtengine::ProcTrace::getInstance().saveChromeTrace(traceFile)) {
+        errors++;
+        std::cerr << "Error saving trace to: " << traceFile << std::endl;
     }
 
     if (imgParams) {
@@ -406,6 +406,7 @@ void Options::setDefaults()
     maxThumbnailHeight = 250;
     maxThumbnailWidth = 800;
     maxCacheEntries = 20000;
+    fastFileIdentity = true;
     thumbInterp = 1;
     autoSuffix = true;
     forceFormatOpts = true;
@@ -576,6 +577,9 @@ void Options::setDefaults()
     rtSettings.flatFieldsPath = "";
 	rtSettings.cameraProfilesPath = "";
 	rtSettings.lensProfilesPath = "";
+    rtSettings.demosaicCacheDir = "";
+    rtSettings.demosaicCacheSize = 0;
+    rtSettings.exportMemoryBudget = 0;
 	
 #ifdef _WIN32
     const gchar* sysRoot = g_getenv("SystemRoot");  // Returns e.g. "c:\Windows"
@@ -1246,6 +1250,10 @@ void Options::readFromFile(Glib::ustring fname)
                     maxCacheEntries = keyFile.get_integer("File Browser", "MaxCacheEntries");
                 }
 
+                if (keyFile.has_key("File Browser", "FastFileIdentity")) {
+                    fastFileIdentity = keyFile.get_boolean("File Browser", "FastFileIdentity");
+                }
+
                 if (keyFile.has_key("File Browser", "ParseExtensions")) {
                     auto l = keyFile.get_string_list("File Browser", "ParseExtensions");
                     if (!l.empty()) {
@@ -1414,6 +1422,14 @@ void Options::readFromFile(Glib::ustring fname)
                 if (keyFile.has_key("Performance", "ThumbnailInspectorMode")) {
                     rtSettings.thumbnail_inspector_mode = static_cast<rtengine::Settings::ThumbnailInspectorMode>(keyFile.get_integer("Performance", "ThumbnailInspectorMode"));
                 }
+
+                if (keyFile.has_key("Performance", "DemosaicCacheSize")) {
+                    rtSettings.demosaicCacheSize = std::max(0, keyFile.get_integer("Performance", "DemosaicCacheSize"));
+                }
+
+                if (keyFile.has_key("Performance", "ExportMemoryBudget")) {
+                    rtSettings.exportMemoryBudget = std::max(0, keyFile.get_integer("Performance", "ExportMemoryBudget"));
+                }
             }
 
             if (keyFile.has_group("GUI")) {
@@ -2409,6 +2425,7 @@ void Options::saveToFile(Glib::ustring fname)
         keyFile.set_integer("File Browser", "MaxPreviewHeight", maxThumbnailHeight);
         keyFile.set_integer("File Browser", "MaxPreviewWidth", maxThumbnailWidth);
         keyFile.set_integer("File Browser", "MaxCacheEntries", maxCacheEntries);
+        keyFile.set_boolean("File Browser", "FastFileIdentity", fastFileIdentity);
         Glib::ArrayHandle<Glib::ustring> pext = parseExtensions;
         keyFile.set_string_list("File Browser", "ParseExtensions", pext);
         Glib::ArrayHandle<int> pextena = parseExtensionsEnabled;
@@ -2462,6 +2479,8 @@ void Options::saveToFile(Glib::ustring fname)
         keyFile.set_integer("Performance", "ChunkSizeXT", chunkSizeXT);
         keyFile.set_integer("Performance", "ChunkSizeCA", chunkSizeCA);
         keyFile.set_integer("Performance", "ThumbnailInspectorMode", int(rtSettings.thumbnail_inspector_mode));
+        keyFile.set_integer("Performance", "DemosaicCacheSize", rtSettings.demosaicCacheSize);
+        keyFile.set_integer("Performance", "ExportMemoryBudget", rtSettings.exportMemoryBudget);
 
 
         keyFile.set_string("Output", "Format", saveFormat.format);
@@ -2874,6 +2893,8 @@ void Options::load(bool lightweight)
         printf("Cache directory (cacheBaseDir) = %s\n", cacheBaseDir.c_str());
     }
 
+    options.rtSettings.demosaicCacheDir = Glib::build_filename(cacheBaseDir, "demosaic");
+
     // Update profile's path and recreate it if necessary
     options.updatePaths();
 
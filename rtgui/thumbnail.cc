@@ -24,6 +24,8 @@
 #include "thumbnail.h"
 #include <sstream>
 #include <iomanip>
+#include <iostream>
+#include <memory>
 #include <cstdio>
 #include <cstdlib>
 #include "../rtengine/colortemp.h"
@@ -40,7 +42,6 @@
 #include "guiutils.h"
 #include "batchqueue.h"
 #include "extprog.h"
-#include "md5helper.h"
 #include "pathutils.h"
 #include "paramsedited.h"
 #include "ppversion.h"
@@ -1081,7 +1082,7 @@ void Thumbnail::setFileName (const Glib::ustring &fn)
 {
 
     fname = fn;
-    cfs.md5 = ::getMD5 (fname);
+    cfs.md5 = cachemgr->getMD5 (fname);
 }
 
 int Thumbnail::getRank  () const